@@ -25,9 +25,13 @@
 #include "Context.hh"
 #include "MBSTFEventHandler.hh"
 #include "MBSTFNetworkFunction.hh"
+#include "ObjectStore.hh"
 #include "Open5GSFSM.hh"
 #include "Open5GSEvent.hh"
 #include "Open5GSSockAddr.hh"
+#include "Open5GSTimer.hh"
+#include "StateJournal.hh"
+#include "TimerFunc.hh"
 #include "openapi/api/IndividualMBSDistributionSessionApi-info.h"
 #include "mbstf-version.h"
 
@@ -80,6 +84,32 @@ extern "C" void app_terminate(void)
 
 MBSTF_NAMESPACE_START
 
+// Periodically removes expired objects from all ObjectStores, driven by the Open5GS timer manager
+class ObjectExpiryTimerFunc : public TimerFunc {
+public:
+    ObjectExpiryTimerFunc() :TimerFunc(), m_timer() {};
+    ObjectExpiryTimerFunc(ObjectExpiryTimerFunc &&) = delete;
+    ObjectExpiryTimerFunc(const ObjectExpiryTimerFunc&) = delete;
+    ObjectExpiryTimerFunc &operator=(ObjectExpiryTimerFunc &&) = delete;
+    ObjectExpiryTimerFunc &operator=(const ObjectExpiryTimerFunc &) = delete;
+    virtual ~ObjectExpiryTimerFunc() {};
+
+    void start(const std::shared_ptr<Open5GSTimer> &timer) {
+        m_timer = timer;
+        if (m_timer) m_timer->start(ObjectStore::Metadata::cacheExpiryInterval() * 1000);
+    };
+
+    virtual void trigger() {
+        ObjectStore::checkExpiredObjectsInAllStores();
+        if (m_timer) m_timer->start(ObjectStore::Metadata::cacheExpiryInterval() * 1000);
+    };
+
+private:
+    std::shared_ptr<Open5GSTimer> m_timer;
+};
+
+static ObjectExpiryTimerFunc g_object_expiry_timer_func;
+
 App::App(const char *const argv[])
     :m_app()     // initialise logging first
     ,m_context() // initialise logging first
@@ -113,9 +143,16 @@ void App::initialise()
     nf_name += m_app->serverName();
     m_appMetadata.serverName(nf_name);
 
+    // Bring back the sessions from before a restart before we open the SBI interface and register with the NRF
+    if (m_context->stateJournal) {
+        m_context->stateJournal->restore(*m_context);
+    }
+
     if (!m_app->sbiOpen()) {
         throw std::runtime_error("Open SBI servers failed!");
     }
+
+    g_object_expiry_timer_func.start(m_app->addTimer(g_object_expiry_timer_func));
 }
 
 void App::startEventHandler()
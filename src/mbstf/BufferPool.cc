@@ -0,0 +1,150 @@
+/******************************************************************************
+ * 5G-MAG Reference Tools: MBS Traffic Function: Buffer Pool class
+ ******************************************************************************
+ * Copyright: (C)2025 British Broadcasting Corporation
+ * Author(s): David Waring <david.waring2@bbc.co.uk>
+ * License: 5G-MAG Public License v1
+ *
+ * For full license terms please see the LICENSE file distributed with this
+ * program. If this file is missing then the license can be retrieved from
+ * https://drive.google.com/file/d/1cinCiA778IErENZ3JN52VFW-1ffHpx7Z/view
+ */
+
+#include <sys/mman.h>
+
+#include <bit>
+#include <cstddef>
+#include <mutex>
+#include <new>
+#include <vector>
+
+#include "common.hh"
+
+#include "BufferPool.hh"
+
+MBSTF_NAMESPACE_START
+
+BufferPool::BufferPool()
+    :m_sizeClasses()
+    ,m_hugePages(false)
+    ,m_cacheLimit(64 << 20)
+    ,m_cachedBytes(0)
+    ,m_poolHits(0)
+    ,m_poolMisses(0)
+{
+}
+
+BufferPool::~BufferPool()
+{
+    trim();
+}
+
+BufferPool &BufferPool::instance()
+{
+    static BufferPool pool;
+    return pool;
+}
+
+BufferPool::Block BufferPool::allocate(std::size_t min_size)
+{
+    Block block{nullptr, blockSizeFor(min_size)};
+    int idx = sizeClassIndex(block.size);
+
+    if (idx >= 0) {
+        SizeClass &size_class(m_sizeClasses[idx]);
+        std::lock_guard<std::mutex> lock(size_class.mutex);
+        if (!size_class.freeBlocks.empty()) {
+            block.data = size_class.freeBlocks.back();
+            size_class.freeBlocks.pop_back();
+            m_cachedBytes -= block.size;
+            m_poolHits++;
+            return block;
+        }
+    }
+
+    m_poolMisses++;
+    block.data = mapBlock(block.size);
+    return block;
+}
+
+void BufferPool::release(const Block &block)
+{
+    if (!block.data) return;
+
+    int idx = sizeClassIndex(block.size);
+    if (idx >= 0 && m_cachedBytes + block.size <= m_cacheLimit) {
+        SizeClass &size_class(m_sizeClasses[idx]);
+        std::lock_guard<std::mutex> lock(size_class.mutex);
+        size_class.freeBlocks.push_back(block.data);
+        m_cachedBytes += block.size;
+        return;
+    }
+
+    unmapBlock(block);
+}
+
+void BufferPool::trim()
+{
+    for (unsigned int shift = c_minClassShift; shift <= c_maxClassShift; shift++) {
+        SizeClass &size_class(m_sizeClasses[shift - c_minClassShift]);
+        std::vector<unsigned char*> free_blocks;
+        {
+            std::lock_guard<std::mutex> lock(size_class.mutex);
+            free_blocks.swap(size_class.freeBlocks);
+        }
+        for (auto data : free_blocks) {
+            m_cachedBytes -= std::size_t(1) << shift;
+            unmapBlock({data, std::size_t(1) << shift});
+        }
+    }
+}
+
+std::size_t BufferPool::blockSizeFor(std::size_t min_size)
+{
+    if (min_size <= (std::size_t(1) << c_minClassShift)) return std::size_t(1) << c_minClassShift;
+    if (min_size > (std::size_t(1) << c_maxClassShift)) {
+        // Too big to pool, just round up to whole pages
+        std::size_t page_mask = (std::size_t(1) << c_minClassShift) - 1;
+        return (min_size + page_mask) & ~page_mask;
+    }
+    return std::bit_ceil(min_size);
+}
+
+int BufferPool::sizeClassIndex(std::size_t block_size)
+{
+    if (!std::has_single_bit(block_size)) return -1;
+    int shift = std::countr_zero(block_size);
+    if (shift < static_cast<int>(c_minClassShift) || shift > static_cast<int>(c_maxClassShift)) return -1;
+    return shift - c_minClassShift;
+}
+
+unsigned char *BufferPool::mapBlock(std::size_t block_size)
+{
+    void *data = MAP_FAILED;
+    bool huge = m_hugePages && block_size >= (std::size_t(1) << c_hugePageShift);
+
+#ifdef MAP_HUGETLB
+    if (huge) {
+        data = mmap(nullptr, block_size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB, -1, 0);
+    }
+#endif
+    if (data == MAP_FAILED) {
+        data = mmap(nullptr, block_size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+        if (data == MAP_FAILED) throw std::bad_alloc();
+#ifdef MADV_HUGEPAGE
+        if (huge) madvise(data, block_size, MADV_HUGEPAGE);
+#endif
+    }
+
+    return reinterpret_cast<unsigned char*>(data);
+}
+
+void BufferPool::unmapBlock(const Block &block)
+{
+    munmap(block.data, block.size);
+}
+
+MBSTF_NAMESPACE_STOP
+
+/* vim:ts=8:sts=4:sw=4:expandtab:
+ */
@@ -0,0 +1,94 @@
+#ifndef _MBS_TF_BUFFER_POOL_HH_
+#define _MBS_TF_BUFFER_POOL_HH_
+/******************************************************************************
+ * 5G-MAG Reference Tools: MBS Traffic Function: Buffer Pool class
+ ******************************************************************************
+ * Copyright: (C)2025 British Broadcasting Corporation
+ * Author(s): David Waring <david.waring2@bbc.co.uk>
+ * License: 5G-MAG Public License v1
+ *
+ * For full license terms please see the LICENSE file distributed with this
+ * program. If this file is missing then the license can be retrieved from
+ * https://drive.google.com/file/d/1cinCiA778IErENZ3JN52VFW-1ffHpx7Z/view
+ */
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+#include "common.hh"
+
+MBSTF_NAMESPACE_START
+
+/* Size-classed pool of page aligned payload blocks
+ *
+ * Blocks are allocated in power of two size classes from 4KiB up to 1GiB using mmap() and, when released, are kept
+ * on a free list for their class so that the next object of a similar size reuses them. Once the pool is warm a
+ * streaming session ingesting, sending and dropping similar sized segments does no payload allocations at all, and
+ * as blocks never come from the heap they cannot fragment it.
+ *
+ * Blocks of 2MiB or more can optionally be backed by huge pages (explicit hugetlbfs pages if available, otherwise
+ * transparent huge pages are requested).
+ */
+class BufferPool {
+public:
+    struct Block {
+        unsigned char *data;
+        std::size_t size;
+    };
+
+    BufferPool(const BufferPool &) = delete;
+    BufferPool(BufferPool &&) = delete;
+    virtual ~BufferPool();
+
+    BufferPool &operator=(const BufferPool &) = delete;
+    BufferPool &operator=(BufferPool &&) = delete;
+
+    static BufferPool &instance();
+
+    Block allocate(std::size_t min_size); // throws std::bad_alloc
+    void release(const Block &block);
+    void trim();
+
+    bool hugePages() const { return m_hugePages; };
+    BufferPool &hugePages(bool huge_pages) { m_hugePages = huge_pages; return *this; };
+    std::size_t cacheLimit() const { return m_cacheLimit; };
+    BufferPool &cacheLimit(std::size_t cache_limit) { m_cacheLimit = cache_limit; return *this; };
+
+    std::size_t cachedBytes() const { return m_cachedBytes; };
+    unsigned long long poolHits() const { return m_poolHits; };
+    unsigned long long poolMisses() const { return m_poolMisses; };
+
+    static std::size_t blockSizeFor(std::size_t min_size);
+
+private:
+    BufferPool();
+
+    static constexpr unsigned int c_minClassShift = 12; // 4KiB
+    static constexpr unsigned int c_maxClassShift = 30; // 1GiB
+    static constexpr unsigned int c_hugePageShift = 21; // 2MiB
+
+    struct SizeClass {
+        std::mutex mutex;
+        std::vector<unsigned char*> freeBlocks;
+    };
+
+    static int sizeClassIndex(std::size_t block_size);
+    unsigned char *mapBlock(std::size_t block_size);
+    static void unmapBlock(const Block &block);
+
+    std::array<SizeClass, c_maxClassShift - c_minClassShift + 1> m_sizeClasses;
+    std::atomic<bool> m_hugePages;
+    std::atomic<std::size_t> m_cacheLimit;
+    std::atomic<std::size_t> m_cachedBytes;
+    std::atomic<unsigned long long> m_poolHits;
+    std::atomic<unsigned long long> m_poolMisses;
+};
+
+MBSTF_NAMESPACE_STOP
+
+/* vim:ts=8:sts=4:sw=4:expandtab:
+ */
+#endif /* _MBS_TF_BUFFER_POOL_HH_ */
@@ -17,22 +17,34 @@
  * under the License.
  */
 
+#include <unistd.h>
+
+#include <chrono>
 #include <map>
 #include <memory>
 #include <string>
 #include <cstring>
 #include <stdexcept>
+#include <system_error>
 #include "ogs-sbi.h"
 #include "ogs-app.h"
 
 #include "common.hh"
 #include "App.hh"
+#include "BufferPool.hh"
+#include "CurlFetchEngine.hh"
 #include "DistributionSession.hh"
+#include "EventExecutor.hh"
 #include "Open5GSNetworkFunction.hh"
 #include "Open5GSSBIServer.hh"
 #include "Open5GSSockAddr.hh"
 #include "Open5GSYamlDocument.hh"
+#include "ObjectStore.hh"
 #include "Open5GSYamlIter.hh"
+#include "PullObjectIngester.hh"
+#include "Reactor.hh"
+#include "StateJournal.hh"
+#include "SubscriptionService.hh"
 #include "openapi/model/DistSessionState.h"
 
 #include "Context.hh"
@@ -41,16 +53,23 @@ using reftools::mbstf::DistSessionState;
 
 MBSTF_NAMESPACE_START
 
+static std::size_t parse_byte_size(const std::string &value);
+
 Context::Context()
     :distributionSessions()
     ,servers()
     ,cacheControl({60, 60})
     ,totalMaxBitRateSoftLimit(100)
+    ,stateJournal()
 {
 }
 
 Context::~Context()
 {
+    // Tear down the sessions before the journal so that it sees no further events, the journal is kept for a warm restart
+    distributionSessions.clear();
+    stateJournal.reset();
+
     for (auto &svrs : servers) {
         for (auto &svr: svrs) {
             svr.reset();
@@ -102,6 +121,20 @@ bool Context::parseConfig()
 
                     } while (distSess_array.type() == YAML_SEQUENCE_NODE);
 
+                } else if (mbstf_key == "objectStore") {
+                    Open5GSYamlIter os_iter(mbstf_iter);
+                    if (os_iter.type() == YAML_MAPPING_NODE) {
+                        parseObjectStore(os_iter);
+                    } else {
+                        throw std::out_of_range("Bad configuration node at mbstf.objectStore");
+                    }
+                } else if (mbstf_key == "warmRestart") {
+                    Open5GSYamlIter wr_iter(mbstf_iter);
+                    if (wr_iter.type() == YAML_MAPPING_NODE) {
+                        parseWarmRestart(wr_iter);
+                    } else {
+                        throw std::out_of_range("Bad configuration node at mbstf.warmRestart");
+                    }
                 } else if (mbstf_key == "totalMaxBitRateSoftLimit") {
                     if (mbstf_iter.type() == YAML_MAPPING_NODE) {
                         std::string limit_val(mbstf_iter.value());
@@ -113,6 +146,107 @@ bool Context::parseConfig()
                     } else {
                         throw std::out_of_range("Bad configuration node at mbstf.totalMaxBitRateSoftLimit");
                     }
+                } else if (mbstf_key == "eventThreads") {
+                    if (mbstf_iter.type() == YAML_SCALAR_NODE) {
+                        std::string threads_val(mbstf_iter.value());
+                        size_t idx = 0;
+                        unsigned long num_threads = std::stoul(threads_val, &idx);
+                        if (idx != threads_val.size()) {
+                            throw std::out_of_range("Bad configuration value at mbstf.eventThreads");
+                        }
+                        EventExecutor::threads(num_threads);
+                    } else {
+                        throw std::out_of_range("Bad configuration node at mbstf.eventThreads");
+                    }
+                } else if (mbstf_key == "reactorThreads") {
+                    if (mbstf_iter.type() == YAML_SCALAR_NODE) {
+                        std::string threads_val(mbstf_iter.value());
+                        size_t idx = 0;
+                        unsigned long num_threads = std::stoul(threads_val, &idx);
+                        if (idx != threads_val.size()) {
+                            throw std::out_of_range("Bad configuration value at mbstf.reactorThreads");
+                        }
+                        Reactor::threads(num_threads);
+                    } else {
+                        throw std::out_of_range("Bad configuration node at mbstf.reactorThreads");
+                    }
+                } else if (mbstf_key == "fetchMaxTransfers") {
+                    if (mbstf_iter.type() == YAML_SCALAR_NODE) {
+                        std::string transfers_val(mbstf_iter.value());
+                        size_t idx = 0;
+                        unsigned long max_transfers = std::stoul(transfers_val, &idx);
+                        if (idx != transfers_val.size()) {
+                            throw std::out_of_range("Bad configuration value at mbstf.fetchMaxTransfers");
+                        }
+                        CurlFetchEngine::maxTransfers(max_transfers);
+                    } else {
+                        throw std::out_of_range("Bad configuration node at mbstf.fetchMaxTransfers");
+                    }
+                } else if (mbstf_key == "fetchMaxTransfersPerOrigin") {
+                    if (mbstf_iter.type() == YAML_SCALAR_NODE) {
+                        std::string transfers_val(mbstf_iter.value());
+                        size_t idx = 0;
+                        unsigned long max_transfers = std::stoul(transfers_val, &idx);
+                        if (idx != transfers_val.size()) {
+                            throw std::out_of_range("Bad configuration value at mbstf.fetchMaxTransfersPerOrigin");
+                        }
+                        CurlFetchEngine::maxTransfersPerOrigin(max_transfers);
+                    } else {
+                        throw std::out_of_range("Bad configuration node at mbstf.fetchMaxTransfersPerOrigin");
+                    }
+                } else if (mbstf_key == "fetchPrewarmLeadTime") {
+                    if (mbstf_iter.type() == YAML_SCALAR_NODE) {
+                        std::string lead_time_val(mbstf_iter.value());
+                        size_t idx = 0;
+                        unsigned long lead_time_ms = std::stoul(lead_time_val, &idx);
+                        if (idx != lead_time_val.size()) {
+                            throw std::out_of_range("Bad configuration value at mbstf.fetchPrewarmLeadTime");
+                        }
+                        CurlFetchEngine::prewarmLeadTime(std::chrono::milliseconds(lead_time_ms));
+                    } else {
+                        throw std::out_of_range("Bad configuration node at mbstf.fetchPrewarmLeadTime");
+                    }
+                } else if (mbstf_key == "fetchRangesAbove" || mbstf_key == "fetchRangeSize") {
+                    if (mbstf_iter.type() == YAML_SCALAR_NODE) {
+                        PullObjectIngester::RangedFetchConfig ranged(PullObjectIngester::rangedFetchConfig());
+                        std::size_t size = parse_byte_size(mbstf_iter.value());
+                        if (mbstf_key == "fetchRangesAbove") {
+                            ranged.threshold = size;
+                        } else if (size == 0) {
+                            throw std::out_of_range("Bad configuration value at mbstf.fetchRangeSize");
+                        } else {
+                            ranged.rangeSize = size;
+                        }
+                        PullObjectIngester::rangedFetchConfig(ranged);
+                    } else {
+                        throw std::out_of_range("Bad configuration node at mbstf." + mbstf_key);
+                    }
+                } else if (mbstf_key == "fetchMaxRanges") {
+                    if (mbstf_iter.type() == YAML_SCALAR_NODE) {
+                        std::string ranges_val(mbstf_iter.value());
+                        size_t idx = 0;
+                        unsigned long max_ranges = std::stoul(ranges_val, &idx);
+                        if (idx != ranges_val.size() || max_ranges == 0) {
+                            throw std::out_of_range("Bad configuration value at mbstf.fetchMaxRanges");
+                        }
+                        PullObjectIngester::RangedFetchConfig ranged(PullObjectIngester::rangedFetchConfig());
+                        ranged.maxRanges = max_ranges;
+                        PullObjectIngester::rangedFetchConfig(ranged);
+                    } else {
+                        throw std::out_of_range("Bad configuration node at mbstf.fetchMaxRanges");
+                    }
+                } else if (mbstf_key == "eventCoalescingInterval") {
+                    if (mbstf_iter.type() == YAML_SCALAR_NODE) {
+                        std::string interval_val(mbstf_iter.value());
+                        size_t idx = 0;
+                        unsigned long interval_ms = std::stoul(interval_val, &idx);
+                        if (idx != interval_val.size()) {
+                            throw std::out_of_range("Bad configuration value at mbstf.eventCoalescingInterval");
+                        }
+                        SubscriptionService::coalescingInterval(std::chrono::milliseconds(interval_ms));
+                    } else {
+                        throw std::out_of_range("Bad configuration node at mbstf.eventCoalescingInterval");
+                    }
                 } else {
                     ogs_warn("Unknown key `mbstf.%s` in configuration", mbstf_key.c_str());
                 }
@@ -132,6 +266,7 @@ void Context::addDistributionSession(const std::shared_ptr<DistributionSession>
     std::string id(session->distributionSessionId());
     std::shared_ptr<DistributionSession> sess_ptr(session);
     distributionSessions.insert(std::make_pair(std::move(id), std::move(sess_ptr)));
+    if (stateJournal) stateJournal->sessionAdded(session);
     updateNFLoad();
 }
 
@@ -140,6 +275,7 @@ void Context::deleteDistributionSession(const std::string &distributionSessionid
 {
     auto it = distributionSessions.find(distributionSessionid);
     if (it != distributionSessions.end()) {
+        if (stateJournal) stateJournal->sessionRemoved(distributionSessionid);
         distributionSessions.erase(it);
         updateNFLoad();
     } else {
@@ -166,6 +302,79 @@ void Context::parseCacheControl(Open5GSYamlIter &iter) {
     }
 }
 
+void Context::parseObjectStore(Open5GSYamlIter &iter) {
+    ObjectStore::MemoryBudget budget(ObjectStore::memoryBudget());
+    ObjectStore::SpoolConfig spool(ObjectStore::spoolConfig());
+    while (iter.next()) {
+        std::string os_key(iter.key());
+        std::string os_val(iter.value()?iter.value():"");
+        try {
+            if (os_key == "sessionMemoryLimit") {
+                budget.sessionLimit = parse_byte_size(os_val);
+            } else if (os_key == "totalMemoryLimit") {
+                budget.totalLimit = parse_byte_size(os_val);
+            } else if (os_key == "highWaterMark") {
+                budget.highWaterMarkPercent = std::stoul(os_val);
+                if (budget.highWaterMarkPercent == 0 || budget.highWaterMarkPercent > 100) {
+                    throw std::out_of_range("percentage out of range");
+                }
+            } else if (os_key == "retryAfter") {
+                budget.retryAfter = std::stoul(os_val);
+            } else if (os_key == "memoryPressureThreshold") {
+                budget.pressureThreshold = std::stod(os_val);
+            } else if (os_key == "spoolDirectory") {
+                spool.directory = os_val;
+            } else if (os_key == "spoolThreshold") {
+                spool.threshold = parse_byte_size(os_val);
+            } else if (os_key == "bufferPoolCacheLimit") {
+                BufferPool::instance().cacheLimit(parse_byte_size(os_val));
+            } else if (os_key == "bufferPoolHugePages") {
+                BufferPool::instance().hugePages(iter.valueBool());
+            } else {
+                ogs_warn("Unknown key `mbstf.objectStore.%s` in configuration", os_key.c_str());
+            }
+        } catch (std::out_of_range &ex) {
+            ogs_error("Object store value for %s of \"%s\" is out of range.", os_key.c_str(), os_val.c_str());
+        } catch (std::invalid_argument &ex) {
+            ogs_error("Object store value for %s of \"%s\" is not understood.", os_key.c_str(), os_val.c_str());
+        }
+    }
+    ObjectStore::memoryBudget(budget);
+
+    if (!spool.directory.empty() && access(spool.directory.c_str(), W_OK) != 0) {
+        ogs_error("Object spool directory \"%s\" is not writable, large objects will be kept in memory", spool.directory.c_str());
+        spool.directory.clear();
+    }
+    ObjectStore::spoolConfig(spool);
+}
+
+void Context::parseWarmRestart(Open5GSYamlIter &iter) {
+    std::string directory;
+    bool persist_objects = true;
+    while (iter.next()) {
+        std::string wr_key(iter.key());
+        if (wr_key == "directory") {
+            directory = iter.value()?iter.value():"";
+        } else if (wr_key == "persistObjects") {
+            persist_objects = iter.valueBool();
+        } else {
+            ogs_warn("Unknown key `mbstf.warmRestart.%s` in configuration", wr_key.c_str());
+        }
+    }
+
+    if (directory.empty()) {
+        stateJournal.reset();
+        return;
+    }
+
+    try {
+        stateJournal.reset(new StateJournal(directory, persist_objects));
+    } catch (std::system_error &ex) {
+        ogs_error("Warm restart disabled: %s", ex.what());
+        stateJournal.reset();
+    }
+}
+
 void Context::parseConfiguration(std::string &pc_key, Open5GSYamlIter &iter)   {
      ogs_list_t list, list6;
      ogs_socknode_t *node = NULL, *node6 = NULL;
@@ -376,6 +585,33 @@ void Context::updateNFLoad()
     }
 }
 
+static std::size_t parse_byte_size(const std::string &value)
+{
+    // Accepts a plain byte count or one with a K, M or G (binary multiple) suffix, e.g. "512M"
+    std::size_t idx = 0;
+    std::size_t size = std::stoull(value, &idx);
+    if (idx < value.size()) {
+        switch (value[idx++]) {
+        case 'k':
+        case 'K':
+            size <<= 10;
+            break;
+        case 'm':
+        case 'M':
+            size <<= 20;
+            break;
+        case 'g':
+        case 'G':
+            size <<= 30;
+            break;
+        default:
+            throw std::invalid_argument("unknown size suffix");
+        }
+    }
+    if (idx != value.size()) throw std::invalid_argument("trailing characters after size");
+    return size;
+}
+
 MBSTF_NAMESPACE_STOP
 
 /* vim:ts=8:sts=4:sw=4:expandtab:
@@ -34,6 +34,7 @@ class DistributionSession;
 class Open5GSSBIServer;
 class Open5GSSockAddr;
 class Open5GSYamlIter;
+class StateJournal;
 
 class Context {
 public:
@@ -70,9 +71,12 @@ public:
         unsigned int defaultObjectMaxAge; // Use if not given by push/pull resource Cache-Control.
     } cacheControl;
     int totalMaxBitRateSoftLimit; // total maximum bit rate this MBSTF ought to asked to handle
+    std::shared_ptr<StateJournal> stateJournal; // only set if warm restart is configured
 
 private:
     void parseCacheControl(Open5GSYamlIter &iter);
+    void parseObjectStore(Open5GSYamlIter &iter);
+    void parseWarmRestart(Open5GSYamlIter &iter);
     void parseConfiguration(std::string &pc_key, Open5GSYamlIter &iter);
     int checkForAddr(ogs_socknode_t *node);
     void updateNFLoad();
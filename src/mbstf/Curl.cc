@@ -11,12 +11,27 @@
  * https://drive.google.com/file/d/1cinCiA778IErENZ3JN52VFW-1ffHpx7Z/view
  */
 
+#include <algorithm>
+#include <charconv>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <string_view>
+#include <system_error>
 
 #include "ogs-app.h"
 
 #include "common.hh"
 #include "mbstf-version.h"
+#include "HttpFreshness.hh"
+#include "HttpHeaders.hh"
+#include "IngestProgress.hh"
+#include "MappedObjectBuffer.hh"
+#include "ObjectBuffer.hh"
+#include "PooledObjectBuffer.hh"
+#include "RangedObjectBuffer.hh"
 
 #include "Curl.hh"
 
@@ -33,6 +48,45 @@ public:
 // Ensure cURL clean up called on program exit
 static CurlGlobalCleanup g_curl_global_cleanup;
 
+/* DNS cache, connection pool and TLS sessions shared by all Curl instances, so that sessions pulling from the same
+ * origin reuse each other's connections rather than each doing their own lookups and handshakes.
+ */
+class CurlShare {
+public:
+    CurlShare()
+        :m_share(curl_share_init())
+        ,m_locks()
+    {
+        curl_share_setopt(m_share, CURLSHOPT_LOCKFUNC, lock_callback);
+        curl_share_setopt(m_share, CURLSHOPT_UNLOCKFUNC, unlock_callback);
+        curl_share_setopt(m_share, CURLSHOPT_USERDATA, this);
+        curl_share_setopt(m_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+        curl_share_setopt(m_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+        curl_share_setopt(m_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+    };
+
+    static CURLSH *handle() {
+        // Never destroyed: easy handles using it may be cleaned up during static destruction
+        static CurlShare *share = new CurlShare;
+        return share->m_share;
+    };
+
+private:
+    static void lock_callback(CURL *handle, curl_lock_data data, curl_lock_access access, void *userptr) {
+        static_cast<CurlShare*>(userptr)->m_locks[data].lock();
+    };
+    static void unlock_callback(CURL *handle, curl_lock_data data, void *userptr) {
+        static_cast<CurlShare*>(userptr)->m_locks[data].unlock();
+    };
+
+    CURLSH *m_share;
+    std::mutex m_locks[CURL_LOCK_DATA_LAST];
+};
+
+static bool accepts_byte_ranges(std::string_view accept_ranges);
+static bool content_range_matches(std::string_view content_range, std::size_t first, std::size_t last,
+                                  std::size_t complete_length);
+
 enum HeaderProcessingState {
     HEADER_START,
     HEADER_HEADERS,
@@ -43,6 +97,22 @@ enum HeaderProcessingState {
 Curl::Curl()
     :m_hdrState(HEADER_START)
     ,m_receivedData()
+    ,m_spoolDirectory()
+    ,m_spoolThreshold(0)
+    ,m_spoolBuffer()
+    ,m_nextProgress()
+    ,m_progress()
+    ,m_nextSplitThreshold(0)
+    ,m_nextSplitRangeSize(0)
+    ,m_splitThreshold(0)
+    ,m_splitRangeSize(0)
+    ,m_nextByteRange()
+    ,m_rangeRequested(false)
+    ,m_rangedBuffer()
+    ,m_rangeStart(0)
+    ,m_rangeLength(0)
+    ,m_rangeReceived(0)
+    ,m_responseSplit(false)
     ,m_etag()
     ,m_contentType()
     ,m_effectiveUrl()
@@ -50,7 +120,13 @@ Curl::Curl()
     ,m_protocol()
     ,m_statusCode(0)
     ,m_permanentRedirectUrl()
-    ,m_cacheControlMaxAge(0)
+    ,m_headers()
+    ,m_requestTime()
+    ,m_responseTime()
+    ,m_lastModified()
+    ,m_ifNoneMatch()
+    ,m_ifModifiedSince()
+    ,m_requestHeaders(nullptr)
 {
     // Ensure curl_global_init is called only once
     static std::once_flag init_flag;
@@ -60,84 +136,201 @@ Curl::Curl()
 
     // Initialize the CURL handle
     m_curl = curl_easy_init();
+    if (m_curl) {
+        curl_easy_setopt(m_curl, CURLOPT_SHARE, CurlShare::handle());
+        // Keep idle connections to origins alive between fetches, e.g. from one live segment to the next
+        curl_easy_setopt(m_curl, CURLOPT_TCP_KEEPALIVE, 1L);
+        curl_easy_setopt(m_curl, CURLOPT_TCP_KEEPIDLE, c_keepAliveIdle.count());
+        curl_easy_setopt(m_curl, CURLOPT_TCP_KEEPINTVL, c_keepAliveInterval.count());
+        curl_easy_setopt(m_curl, CURLOPT_MAXAGE_CONN, c_maxIdleConnectionAge.count());
+        curl_easy_setopt(m_curl, CURLOPT_DNS_CACHE_TIMEOUT, c_dnsCacheTimeout.count());
+    }
 }
 
 Curl::~Curl() {
     if (m_curl) {
         curl_easy_cleanup(m_curl);
     }
+    curl_slist_free_all(m_requestHeaders);
 }
 
 long Curl::get(const std::string& url, std::chrono::milliseconds timeout) {
+    if (!prepareGet(url, timeout)) return -2; // Indicate error if m_curl is not initialized
+    return completeGet(curl_easy_perform(m_curl));
+}
+
+bool Curl::prepareGet(const std::string& url, std::chrono::milliseconds timeout) {
     m_etag.clear(); // Clear the ETag before making a new request
-    m_receivedData.clear(); // Clear the received data before making a new request
+    m_receivedData.reset(); // Clear the received data before making a new request
+    m_spoolBuffer.reset();
+    m_progress = std::move(m_nextProgress);
+    m_nextProgress.reset();
+    m_lastModified.reset();
+
+    // Splitting and byte ranges only apply to one request
+    m_splitThreshold = m_nextSplitThreshold;
+    m_splitRangeSize = m_nextSplitRangeSize;
+    m_nextSplitThreshold = 0;
+    std::optional<ByteRange> byte_range(std::move(m_nextByteRange));
+    m_nextByteRange.reset();
+    m_rangeRequested = byte_range.has_value();
+    m_rangedBuffer.reset();
+    m_rangeStart = 0;
+    m_rangeLength = 0;
+    m_rangeReceived = 0;
+    m_responseSplit = false;
+    if (byte_range) {
+        m_rangedBuffer = std::move(byte_range->buffer);
+        m_rangeStart = byte_range->first;
+        m_rangeLength = byte_range->last - byte_range->first + 1;
+    }
 
-    if (m_curl) {
-        curl_easy_setopt(m_curl, CURLOPT_URL, url.c_str());
-        curl_easy_setopt(m_curl, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2);
-	curl_easy_setopt(m_curl, CURLOPT_CONNECTTIMEOUT_MS, 500l);
-        curl_easy_setopt(m_curl, CURLOPT_TIMEOUT_MS, timeout.count());
-        curl_easy_setopt(m_curl, CURLOPT_FOLLOWLOCATION, 1L);
-	curl_easy_setopt(m_curl, CURLOPT_HEADERDATA, this);
-        curl_easy_setopt(m_curl, CURLOPT_HEADERFUNCTION, headerCallback);
-        curl_easy_setopt(m_curl, CURLOPT_WRITEDATA, &m_receivedData);
-        curl_easy_setopt(m_curl, CURLOPT_WRITEFUNCTION, writeCallback);
-        if (m_userAgent.empty()) {
-            curl_easy_setopt(m_curl, CURLOPT_USERAGENT, MBSTF_TYPE "/" MBSTF_VERSION);
-        } else {
-            curl_easy_setopt(m_curl, CURLOPT_USERAGENT, m_userAgent.c_str());
-        }
+    // Conditions only apply to one request
+    std::optional<std::string> if_none_match(std::move(m_ifNoneMatch));
+    std::optional<std::chrono::system_clock::time_point> if_modified_since(std::move(m_ifModifiedSince));
+    m_ifNoneMatch.reset();
+    m_ifModifiedSince.reset();
 
-        // reset values collected during redirects
-        m_hdrState = HEADER_START;
-        m_statusCode = 0;
-        m_protocol.clear();
-        m_permanentRedirectUrl.clear();
-
-        CURLcode res = curl_easy_perform(m_curl);
-        if (res == CURLE_OK) {
-	    struct curl_header *type;
-            CURLHcode h;
-            h = curl_easy_header(m_curl, "ETag", 0, CURLH_HEADER, -1, &type);
-            if (h == CURLHE_OK && type) {
-                m_etag = std::string(type->value);
-		ogs_info("ETag: %s", m_etag.c_str());
-            } else {
-		ogs_info("ETag header not found.");
-            }
+    if (!m_curl) return false;
 
-            // Get the Content-Type header
-	    char *ct = NULL;
-	    res = curl_easy_getinfo(m_curl, CURLINFO_CONTENT_TYPE, &ct);
-	    if (!res && ct) {
-	        m_contentType = std::string(ct);
-	    }
-
-            char *redir_url = NULL;
-            res = curl_easy_getinfo(m_curl, CURLINFO_EFFECTIVE_URL, &redir_url);
-            if (!res && redir_url) {
-                m_effectiveUrl = redir_url;
-            }
+    curl_slist_free_all(m_requestHeaders);
+    m_requestHeaders = nullptr;
+    if (if_none_match) {
+        m_requestHeaders = curl_slist_append(m_requestHeaders, ("If-None-Match: " + if_none_match.value()).c_str());
+    }
+    if (byte_range && byte_range->ifRange) {
+        m_requestHeaders = curl_slist_append(m_requestHeaders, ("If-Range: " + byte_range->ifRange.value()).c_str());
+    }
+    curl_easy_setopt(m_curl, CURLOPT_HTTPHEADER, m_requestHeaders);
+    if (byte_range) {
+        curl_easy_setopt(m_curl, CURLOPT_RANGE,
+                         (std::to_string(byte_range->first) + "-" + std::to_string(byte_range->last)).c_str());
+    } else {
+        curl_easy_setopt(m_curl, CURLOPT_RANGE, nullptr);
+    }
+    if (if_modified_since && !if_none_match) {
+        // If-None-Match takes precedence at the server anyway (RFC 9110 section 13.2.2)
+        curl_easy_setopt(m_curl, CURLOPT_TIMECONDITION, static_cast<long>(CURL_TIMECOND_IFMODSINCE));
+        curl_easy_setopt(m_curl, CURLOPT_TIMEVALUE_LARGE, static_cast<curl_off_t>(
+                                    std::chrono::system_clock::to_time_t(if_modified_since.value())));
+    } else {
+        curl_easy_setopt(m_curl, CURLOPT_TIMECONDITION, static_cast<long>(CURL_TIMECOND_NONE));
+    }
+
+    curl_easy_setopt(m_curl, CURLOPT_URL, url.c_str());
+    curl_easy_setopt(m_curl, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2);
+    curl_easy_setopt(m_curl, CURLOPT_CONNECTTIMEOUT_MS, 500l);
+    curl_easy_setopt(m_curl, CURLOPT_TIMEOUT_MS, timeout.count());
+    curl_easy_setopt(m_curl, CURLOPT_FOLLOWLOCATION, 1L);
+    curl_easy_setopt(m_curl, CURLOPT_HEADERDATA, this);
+    curl_easy_setopt(m_curl, CURLOPT_HEADERFUNCTION, headerCallback);
+    curl_easy_setopt(m_curl, CURLOPT_WRITEDATA, this);
+    curl_easy_setopt(m_curl, CURLOPT_WRITEFUNCTION, writeCallback);
+    if (m_userAgent.empty()) {
+        curl_easy_setopt(m_curl, CURLOPT_USERAGENT, MBSTF_TYPE "/" MBSTF_VERSION);
+    } else {
+        curl_easy_setopt(m_curl, CURLOPT_USERAGENT, m_userAgent.c_str());
+    }
+
+    // reset values collected during redirects
+    m_hdrState = HEADER_START;
+    m_statusCode = 0;
+    m_protocol.clear();
+    m_permanentRedirectUrl.clear();
+    m_headers.clear();
+    m_requestTime = std::chrono::system_clock::now();
+    m_responseTime = m_requestTime;
+
+    return true;
+}
 
-            return m_receivedData.size(); // Return the number of bytes received
-        } else if (res == CURLE_OPERATION_TIMEDOUT) {
-            return -1; // Indicate timeout
+long Curl::completeGet(CURLcode res) {
+    // Stopping the transfer after the first range of a split response shows up as a write error
+    if (res == CURLE_WRITE_ERROR && m_responseSplit) res = CURLE_OK;
+    // The buffer for a byte range belongs to whoever asked for the range
+    if (m_rangeRequested) m_rangedBuffer.reset();
+
+    if (res == CURLE_OK) {
+        auto etag = m_headers.get("ETag");
+        if (etag) {
+            m_etag = etag.value();
+            ogs_info("ETag: %s", m_etag.c_str());
         } else {
-            //std::cerr << "curl_easy_perform() failed: " << curl_easy_strerror(res) << std::endl;
-            return -2; // Indicate other error
+            ogs_info("ETag header not found.");
         }
+
+        // Get the Content-Type header
+        char *ct = NULL;
+        res = curl_easy_getinfo(m_curl, CURLINFO_CONTENT_TYPE, &ct);
+        if (!res && ct) {
+            m_contentType = std::string(ct);
+        }
+
+        char *redir_url = NULL;
+        res = curl_easy_getinfo(m_curl, CURLINFO_EFFECTIVE_URL, &redir_url);
+        if (!res && redir_url) {
+            m_effectiveUrl = redir_url;
+        }
+
+        m_lastModified = m_headers.getDate("Last-Modified");
+
+        // Return the number of bytes received
+        if (m_rangeRequested || m_responseSplit) return m_rangeReceived;
+        if (m_spoolBuffer) return m_spoolBuffer->bytesWritten();
+        if (m_receivedData) return m_receivedData->size();
+        return 0;
+    } else if (res == CURLE_OPERATION_TIMEDOUT) {
+        return -1; // Indicate timeout
     }
-    return -2; // Indicate error if m_curl is not initialized
+    //std::cerr << "curl_easy_perform() failed: " << curl_easy_strerror(res) << std::endl;
+    return -2; // Indicate other error
 }
 
-std::vector<unsigned char>& Curl::getData()
+std::shared_ptr<const ObjectBuffer> Curl::takeBuffer()
 {
-    return m_receivedData;
+    if (m_spoolBuffer) {
+        std::shared_ptr<MappedObjectBuffer> buffer(std::move(m_spoolBuffer));
+        buffer->seal();
+        return buffer;
+    }
+    if (m_receivedData) return std::move(m_receivedData);
+    return std::make_shared<ObjectBuffer>();
 }
 
-const std::vector<unsigned char>& Curl::getData() const
+Curl &Curl::conditional(const std::optional<std::string> &entity_tag,
+                        const std::optional<std::chrono::system_clock::time_point> &last_modified)
 {
-    return m_receivedData;
+    m_ifNoneMatch = entity_tag;
+    m_ifModifiedSince = last_modified;
+    return *this;
+}
+
+Curl &Curl::reportProgress(const std::shared_ptr<IngestProgress> &progress)
+{
+    m_nextProgress = progress;
+    return *this;
+}
+
+Curl &Curl::splitLargeResponse(std::size_t threshold, std::size_t range_size)
+{
+    m_nextSplitThreshold = threshold;
+    m_nextSplitRangeSize = range_size;
+    return *this;
+}
+
+Curl &Curl::byteRange(const std::shared_ptr<RangedObjectBuffer> &buffer, std::size_t first, std::size_t last,
+                      const std::optional<std::string> &if_range)
+{
+    if (last < first) throw std::invalid_argument("Byte range ends before it starts");
+    m_nextByteRange = ByteRange{buffer, first, last, if_range};
+    return *this;
+}
+
+Curl &Curl::spool(const std::string &spool_directory, std::size_t threshold)
+{
+    m_spoolDirectory = spool_directory;
+    m_spoolThreshold = threshold;
+    return *this;
 }
 
 const std::string& Curl::getEtag() const
@@ -160,9 +353,9 @@ const std::string &Curl::getPermanentRedirectUrl() const
     return m_permanentRedirectUrl;
 }
 
-const unsigned long Curl::getCacheControlMaxAge() const
+HttpFreshness Curl::getFreshness() const
 {
-    return m_cacheControlMaxAge;
+    return HttpFreshness(m_headers, m_requestTime, m_responseTime);
 }
 
 
@@ -206,45 +399,22 @@ void Curl::processHeaderLine(std::string_view &header_line)
         //ogs_debug("Header: %s", std::string(header_line).c_str());
         if (header_line.empty()) {
             m_hdrState = HEADER_BODY;
-        } else if ((m_statusCode == 301 || m_statusCode == 308) &&
-                   (header_line.starts_with("Location:") || header_line.starts_with("location:"))) {
-            header_line.remove_prefix(9);
-            while (header_line.front() == ' ') header_line.remove_prefix(1);
-            m_permanentRedirectUrl = header_line;
-            ogs_debug("Got new redirect URL: %s", m_permanentRedirectUrl.c_str());
-        } else if (header_line.starts_with("Cache-Control:") || header_line.starts_with("cache-control:")|| header_line.starts_with("Cache-control:")) {
-            // Remove "Cache-Control:" prefix (14 characters)
-            header_line.remove_prefix(14);
-            // Skip any leading whitespace after the colon
-            while (!header_line.empty() && header_line.front() == ' ')
-                header_line.remove_prefix(1);
-
-            // Look for the "max-age=" directive within the header line.
-            auto pos = header_line.find("max-age=");
-	    if (pos == std::string_view::npos) {
-	        pos = header_line.find("Max-age=");
-	    }
-            if (pos != std::string_view::npos) {
-                pos += 8; // Move past "max-age="
-                // Find where the numeric value ends (comma, space, or end-of-line)
-                auto endPos = header_line.find_first_of(", \r\n", pos);
-                if (endPos == std::string_view::npos)
-                    endPos = header_line.size();
-
-                // Convert the extracted substring to an integer.
-                std::string maxAgeStr(header_line.substr(pos, endPos - pos));
-                try {
-                    m_cacheControlMaxAge = std::stoul(maxAgeStr);
-                } catch (const std::exception&) {
-                    m_cacheControlMaxAge = 0; // Fallback in case of conversion failure
+            m_responseTime = std::chrono::system_clock::now();
+            if (m_statusCode == 301 || m_statusCode == 308) {
+                auto location = m_headers.get("Location");
+                if (location) {
+                    m_permanentRedirectUrl = location.value();
+                    ogs_debug("Got new redirect URL: %s", m_permanentRedirectUrl.c_str());
                 }
-                ogs_debug("Extracted Cache-Control max-age: %lu", m_cacheControlMaxAge);
             }
+        } else {
+            m_headers.addLine(header_line);
         }
         break;
     case HEADER_BODY: // We're in the response body, so this is either a trailing header or a new status line after redirect
         //ogs_debug("Trailer/New status: %s", std::string(header_line).c_str());
         if (header_line.starts_with("HTTP/") && extractProtocolAndStatusCode(header_line)) {
+            m_headers.clear();
             m_hdrState = HEADER_HEADERS;
         } else {
             m_hdrState = HEADER_TRAILING;
@@ -252,6 +422,7 @@ void Curl::processHeaderLine(std::string_view &header_line)
         break;
     case HEADER_TRAILING: // We're in trailing headers, but if we see a status line we're starting a new redirected fetch
         if (header_line.starts_with("HTTP/") && extractProtocolAndStatusCode(header_line)) {
+            m_headers.clear();
             m_hdrState = HEADER_HEADERS;
         }
         break;
@@ -274,12 +445,149 @@ size_t Curl::headerCallback(char* buffer, size_t size, size_t nitems, void* user
 size_t Curl::writeCallback(void* contents, size_t memberSize, size_t numberOfMembers, void* userData)
 {
     size_t totalSize = memberSize * numberOfMembers;
-    std::vector<unsigned char>* receivedData = static_cast<std::vector<unsigned char>*>(userData);
-    unsigned char* data = static_cast<unsigned char*>(contents);
-    receivedData->insert(receivedData->end(), data, data + totalSize);
+    Curl* self = reinterpret_cast<Curl*>(userData);
+    if (!self->receiveData(static_cast<unsigned char*>(contents), totalSize)) return 0; // abort the transfer
     return totalSize;
 }
 
+bool Curl::receiveData(const unsigned char *data, size_t size)
+{
+    try {
+        if (m_rangedBuffer) return receiveRange(data, size);
+        if (m_splitThreshold && !m_receivedData && !m_spoolBuffer && !m_progress && splitResponse()) {
+            return receiveRange(data, size);
+        }
+        if (!m_receivedData && !m_spoolBuffer) {
+            // First part of the body, size the buffer for the whole body if we know how big it will be
+            curl_off_t content_length = -1;
+            if (curl_easy_getinfo(m_curl, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &content_length) != CURLE_OK) {
+                content_length = -1;
+            }
+            if (m_progress && content_length >= 0) m_progress->transferLength(content_length);
+            if (content_length > 0 && !m_spoolDirectory.empty() &&
+                static_cast<size_t>(content_length) >= m_spoolThreshold) {
+                m_spoolBuffer.reset(new MappedObjectBuffer(m_spoolDirectory));
+            } else {
+                size_t initial_capacity = size;
+                if (content_length > 0 && static_cast<size_t>(content_length) > size) initial_capacity = content_length;
+                m_receivedData.reset(new PooledObjectBuffer(initial_capacity));
+            }
+        }
+        size_t received = m_receivedData ? m_receivedData->size() : 0;
+        if (!m_spoolBuffer && !m_spoolDirectory.empty() && received + size >= m_spoolThreshold) {
+            // Body has grown large enough to be spooled, move what we have so far to a spool file
+            m_spoolBuffer.reset(new MappedObjectBuffer(m_spoolDirectory));
+            if (m_receivedData) m_spoolBuffer->append(m_receivedData->data(), m_receivedData->size());
+            m_receivedData.reset();
+        }
+        if (m_spoolBuffer) {
+            m_spoolBuffer->append(data, size);
+        } else {
+            m_receivedData->append(data, size);
+        }
+        if (m_progress) m_progress->received(size);
+    } catch (const std::system_error &ex) {
+        ogs_error("Unable to spool received data: %s", ex.what());
+        return false;
+    } catch (const std::bad_alloc &ex) {
+        ogs_error("Unable to allocate buffer for received data: %s", ex.what());
+        return false;
+    } catch (const std::out_of_range &ex) {
+        ogs_error("Received data does not fit the object: %s", ex.what());
+        return false;
+    }
+    return true;
+}
+
+bool Curl::splitResponse()
+{
+    // Called for the first part of the body, only a complete response of known size can be fetched in ranges
+    if (m_statusCode != 200) return false;
+    auto accept_ranges = m_headers.get("Accept-Ranges");
+    if (!accept_ranges || !accepts_byte_ranges(accept_ranges.value())) return false;
+    curl_off_t content_length = -1;
+    if (curl_easy_getinfo(m_curl, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &content_length) != CURLE_OK ||
+        content_length < 0) {
+        return false;
+    }
+    std::size_t object_size = content_length;
+    if (object_size < m_splitThreshold || object_size <= m_splitRangeSize) return false;
+
+    ogs_debug("Receiving the first %zu of %zu bytes, the rest will be fetched as byte ranges", m_splitRangeSize,
+              object_size);
+    m_rangedBuffer = std::make_shared<RangedObjectBuffer>(object_size, m_spoolDirectory, m_spoolThreshold);
+    m_rangeStart = 0;
+    m_rangeLength = m_splitRangeSize;
+    return true;
+}
+
+bool Curl::receiveRange(const unsigned char *data, size_t size)
+{
+    if (m_rangeRequested && m_rangeReceived == 0) {
+        // A 200 response is the whole object, which means the If-Range validator no longer matches
+        if (m_statusCode != 206) return false;
+        auto content_range = m_headers.get("Content-Range");
+        if (!content_range || !content_range_matches(content_range.value(), m_rangeStart,
+                                                     m_rangeStart + m_rangeLength - 1, m_rangedBuffer->size())) {
+            ogs_error("Content-Range of the response does not match the byte range requested");
+            return false;
+        }
+    }
+
+    std::size_t wanted = m_rangeLength - m_rangeReceived;
+    if (m_rangeRequested && size > wanted) {
+        ogs_error("Received more data than the byte range requested");
+        return false;
+    }
+    std::size_t length = std::min(size, wanted);
+    m_rangedBuffer->write(m_rangeStart + m_rangeReceived, data, length);
+    m_rangeReceived += length;
+    if (!m_rangeRequested && m_rangeReceived == m_rangeLength) {
+        // Have the first range of a split response, stop the transfer here
+        m_responseSplit = true;
+        return false;
+    }
+    return true;
+}
+
+static bool accepts_byte_ranges(std::string_view accept_ranges)
+{
+    // Comma separated list of range units (RFC 9110 section 14.3)
+    while (!accept_ranges.empty()) {
+        auto end = accept_ranges.find(',');
+        std::string_view unit(accept_ranges.substr(0, end));
+        auto start = unit.find_first_not_of(" \t");
+        if (start != std::string_view::npos) {
+            unit = unit.substr(start, unit.find_last_not_of(" \t") - start + 1);
+            if (HttpHeaders::name_type(unit.data(), unit.size()) == "bytes") return true;
+        }
+        if (end == std::string_view::npos) break;
+        accept_ranges.remove_prefix(end + 1);
+    }
+    return false;
+}
+
+static bool content_range_matches(std::string_view content_range, std::size_t first, std::size_t last,
+                                  std::size_t complete_length)
+{
+    // bytes first-last/complete-length (RFC 9110 section 14.4)
+    if (!content_range.starts_with("bytes ")) return false;
+    const char *pos = content_range.data() + 6;
+    const char *end = content_range.data() + content_range.size();
+    std::size_t values[3];
+    const char separators[3] = {'-', '/', '\0'};
+    for (int i = 0; i < 3; i++) {
+        auto [next, ec] = std::from_chars(pos, end, values[i]);
+        if (ec != std::errc()) return false;
+        pos = next;
+        if (separators[i]) {
+            if (pos == end || *pos != separators[i]) return false;
+            pos++;
+        }
+    }
+    return pos == end && values[0] == first && values[1] == last && values[2] == complete_length;
+}
+
 MBSTF_NAMESPACE_STOP
 
 /* vim:ts=8:sts=4:sw=4:expandtab:
@@ -21,37 +21,104 @@
 #include <mutex>
 #include <chrono>
 #include <functional>
+#include <memory>
+#include <optional>
 #include <vector>
 #include "common.hh"
+#include "HttpFreshness.hh"
+#include "HttpHeaders.hh"
 
 MBSTF_NAMESPACE_START
 
+class IngestProgress;
+class MappedObjectBuffer;
+class ObjectBuffer;
+class PooledObjectBuffer;
+class RangedObjectBuffer;
+
 class Curl {
 public:
     Curl();
     ~Curl();
 
     long get(const std::string& url, std::chrono::milliseconds timeout);
-    std::vector<unsigned char> &getData();
-    const std::vector<unsigned char> &getData() const;
+
+    // get() in two halves, for when the transfer is performed elsewhere (e.g. by CurlFetchEngine on a multi handle)
+    bool prepareGet(const std::string& url, std::chrono::milliseconds timeout);
+    long completeGet(CURLcode result);
+    CURL *handle() const { return m_curl; };
+
+    std::shared_ptr<const ObjectBuffer> takeBuffer();
     const std::string &getEtag() const;
     const std::string &getContentType() const;
     const std::string &getEffectiveUrl() const;
     const std::string &getPermanentRedirectUrl() const;
-    const unsigned long getCacheControlMaxAge() const;
+    int getStatusCode() const { return m_statusCode; };
+    const HttpHeaders &getHeaders() const { return m_headers; }; // of the final response
+    HttpFreshness getFreshness() const;
+    const std::optional<std::chrono::system_clock::time_point> &getLastModified() const { return m_lastModified; };
+
+    // Make the next get() conditional on the object having changed, a 304 Not Modified response has no body
+    Curl &conditional(const std::optional<std::string> &entity_tag,
+                      const std::optional<std::chrono::system_clock::time_point> &last_modified);
 
 
+    // Keep progress up to date with the body of the next get() as it arrives
+    Curl &reportProgress(const std::shared_ptr<IngestProgress> &progress);
+
+    // If the response to the next get() is at least threshold bytes and the server accepts byte ranges, stop after the
+    // first range_size bytes. responseSplit() is then true and takeRangedBuffer(), sized for the whole object, has them.
+    Curl &splitLargeResponse(std::size_t threshold, std::size_t range_size);
+    // Make the next get() a request for bytes first to last, written straight into buffer. With if_range, an entity
+    // tag or HTTP date, the server sends the whole object instead if it has changed, which is treated as an error.
+    Curl &byteRange(const std::shared_ptr<RangedObjectBuffer> &buffer, std::size_t first, std::size_t last,
+                    const std::optional<std::string> &if_range = std::nullopt);
+    bool responseSplit() const { return m_responseSplit; };
+    std::shared_ptr<RangedObjectBuffer> takeRangedBuffer() { return std::move(m_rangedBuffer); };
+
     Curl &setUserAgent(const std::string &user_agent);
+    Curl &spool(const std::string &spool_directory, std::size_t threshold);
 
 private:
+    static constexpr std::chrono::seconds c_keepAliveIdle{30};         // idle time before TCP keep-alive probes
+    static constexpr std::chrono::seconds c_keepAliveInterval{10};     // between TCP keep-alive probes
+    static constexpr std::chrono::seconds c_maxIdleConnectionAge{300}; // pooled connections idle longer are not reused
+    static constexpr std::chrono::seconds c_dnsCacheTimeout{120};
+
     bool extractProtocolAndStatusCode(std::string_view &status_line);
     void processHeaderLine(std::string_view &header_line);
     static size_t headerCallback(char* buffer, size_t size, size_t numberOfItems, void* userData);
     static size_t writeCallback(void* contents, size_t memberSize, size_t numberOfMembers, void* userData);
+    bool receiveData(const unsigned char *data, size_t size);
+    bool splitResponse();
+    bool receiveRange(const unsigned char *data, size_t size);
+
+    struct ByteRange {
+        std::shared_ptr<RangedObjectBuffer> buffer;
+        std::size_t first;
+        std::size_t last;
+        std::optional<std::string> ifRange;
+    };
 
     CURL* m_curl;
     int m_hdrState;
-    std::vector<unsigned char> m_receivedData;
+    std::shared_ptr<PooledObjectBuffer> m_receivedData;
+    std::string m_spoolDirectory;
+    std::size_t m_spoolThreshold;
+    std::shared_ptr<MappedObjectBuffer> m_spoolBuffer; // used instead of m_receivedData for large bodies
+    std::shared_ptr<IngestProgress> m_nextProgress; // set by reportProgress() for the next get()
+    std::shared_ptr<IngestProgress> m_progress;
+    std::size_t m_nextSplitThreshold;  // set by splitLargeResponse() for the next get(), 0 if not splitting
+    std::size_t m_nextSplitRangeSize;
+    std::size_t m_splitThreshold;
+    std::size_t m_splitRangeSize;
+    std::optional<ByteRange> m_nextByteRange; // set by byteRange() for the next get()
+    bool m_rangeRequested;
+    std::shared_ptr<RangedObjectBuffer> m_rangedBuffer; // used instead of the others for a split or byte range get()
+    std::size_t m_rangeStart;
+    std::size_t m_rangeLength;
+    std::size_t m_rangeReceived;
+    bool m_responseSplit;
     std::string m_etag;
     std::string m_contentType;
     std::string m_effectiveUrl;
@@ -59,7 +126,13 @@ private:
     std::string m_protocol;
     int m_statusCode;
     std::string m_permanentRedirectUrl;
-    unsigned long m_cacheControlMaxAge;
+    HttpHeaders m_headers;
+    std::chrono::system_clock::time_point m_requestTime;
+    std::chrono::system_clock::time_point m_responseTime; // when the headers of the final response were received
+    std::optional<std::chrono::system_clock::time_point> m_lastModified;
+    std::optional<std::string> m_ifNoneMatch;
+    std::optional<std::chrono::system_clock::time_point> m_ifModifiedSince;
+    struct curl_slist *m_requestHeaders; // must stay valid until the transfer completes
 };
 
 MBSTF_NAMESPACE_STOP
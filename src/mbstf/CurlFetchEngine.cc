@@ -0,0 +1,464 @@
+/******************************************************************************
+ * 5G-MAG Reference Tools: MBS Traffic Function: cURL Fetch Engine class
+ ******************************************************************************
+ * Copyright: (C)2025 British Broadcasting Corporation
+ * Author(s): David Waring <david.waring2@bbc.co.uk>
+ * License: 5G-MAG Public License v1
+ *
+ * For full license terms please see the LICENSE file distributed with this
+ * program. If this file is missing then the license can be retrieved from
+ * https://drive.google.com/file/d/1cinCiA778IErENZ3JN52VFW-1ffHpx7Z/view
+ */
+
+#include <curl/curl.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/posix/stream_descriptor.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/system_timer.hpp>
+
+#include "ogs-app.h"
+
+#include "common.hh"
+#include "Curl.hh"
+#include "Reactor.hh"
+
+#include "CurlFetchEngine.hh"
+
+MBSTF_NAMESPACE_START
+
+static std::atomic<unsigned int> g_maxTransfers(256);
+static std::atomic<unsigned int> g_maxTransfersPerOrigin(8);
+static std::atomic<std::chrono::milliseconds::rep> g_prewarmLeadTimeMs(1000);
+
+struct CurlFetchEngine::Fetch {
+    Fetch(FetchId fetch_id, const std::shared_ptr<Curl> &curl_obj, const std::string &fetch_url,
+          const std::optional<time_type> &fetch_deadline, Callback &&cb)
+        :id(fetch_id)
+        ,curl(curl_obj)
+        ,url(fetch_url)
+        ,origin(origin_of(fetch_url))
+        ,deadline(fetch_deadline)
+        ,callback(std::move(cb))
+        ,active(false)
+    {};
+
+    QueueKey queueKey() const { return QueueKey(deadline.value_or(time_type::max()), id); };
+
+    FetchId id;
+    std::shared_ptr<Curl> curl;
+    std::string url;
+    std::string origin;
+    std::optional<time_type> deadline;
+    Callback callback;
+    bool active; // added to the multi handle, otherwise queued
+};
+
+struct CurlFetchEngine::Socket {
+    Socket(boost::asio::io_context &io_context, curl_socket_t sock, std::uint64_t serial_no)
+        :descriptor(io_context, sock)
+        ,what(CURL_POLL_NONE)
+        ,reading(false)
+        ,writing(false)
+        ,serial(serial_no)
+    {};
+    ~Socket() {
+        // cURL owns the socket and will close it, just stop watching it
+        descriptor.release();
+    };
+
+    boost::asio::posix::stream_descriptor descriptor;
+    int what;             // CURL_POLL_* that cURL is interested in
+    bool reading;         // async_wait for read outstanding
+    bool writing;         // async_wait for write outstanding
+    std::uint64_t serial; // tells this socket apart from an earlier one with the same descriptor
+};
+
+CurlFetchEngine::CurlFetchEngine()
+    :m_io(Reactor::instance().ioContext())
+    ,m_multi(curl_multi_init())
+    ,m_multiTimer(m_io)
+    ,m_deadlineTimer(m_io)
+    ,m_fetches()
+    ,m_queue()
+    ,m_originTransfers()
+    ,m_originKnownUrls()
+    ,m_sockets()
+    ,m_transfers(0)
+    ,m_nextSocketSerial(0)
+    ,m_nextFetchId(1)
+{
+    curl_multi_setopt(m_multi, CURLMOPT_SOCKETFUNCTION, socket_callback);
+    curl_multi_setopt(m_multi, CURLMOPT_SOCKETDATA, this);
+    curl_multi_setopt(m_multi, CURLMOPT_TIMERFUNCTION, timer_callback);
+    curl_multi_setopt(m_multi, CURLMOPT_TIMERDATA, this);
+    // Share HTTP/2 connections between transfers to the same origin rather than opening more connections
+    curl_multi_setopt(m_multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+    if (g_maxTransfersPerOrigin) {
+        curl_multi_setopt(m_multi, CURLMOPT_MAX_HOST_CONNECTIONS, static_cast<long>(g_maxTransfersPerOrigin));
+    }
+}
+
+CurlFetchEngine::~CurlFetchEngine()
+{
+    m_multiTimer.cancel();
+    m_deadlineTimer.cancel();
+    for (auto &[fetch_id, fetch] : m_fetches) {
+        if (fetch->active) curl_multi_remove_handle(m_multi, fetch->curl->handle());
+    }
+    m_fetches.clear();
+    m_queue.clear();
+    m_sockets.clear();
+    curl_multi_cleanup(m_multi);
+}
+
+CurlFetchEngine &CurlFetchEngine::instance()
+{
+    // Never destroyed: like the Reactor it runs on, in-flight transfers may outlive static destruction order
+    static CurlFetchEngine *engine = new CurlFetchEngine;
+    return *engine;
+}
+
+unsigned int CurlFetchEngine::maxTransfers()
+{
+    return g_maxTransfers;
+}
+
+void CurlFetchEngine::maxTransfers(unsigned int max_transfers)
+{
+    g_maxTransfers = max_transfers;
+}
+
+unsigned int CurlFetchEngine::maxTransfersPerOrigin()
+{
+    return g_maxTransfersPerOrigin;
+}
+
+void CurlFetchEngine::maxTransfersPerOrigin(unsigned int max_transfers)
+{
+    g_maxTransfersPerOrigin = max_transfers;
+}
+
+std::chrono::milliseconds CurlFetchEngine::prewarmLeadTime()
+{
+    return std::chrono::milliseconds(g_prewarmLeadTimeMs);
+}
+
+void CurlFetchEngine::prewarmLeadTime(const std::chrono::milliseconds &lead_time)
+{
+    g_prewarmLeadTimeMs = lead_time.count();
+}
+
+CurlFetchEngine::FetchId CurlFetchEngine::fetch(const std::shared_ptr<Curl> &curl, const std::string &url,
+                                                const std::optional<time_type> &deadline, Callback &&callback)
+{
+    FetchId fetch_id = m_nextFetchId++;
+    std::unique_ptr<Fetch> new_fetch(new Fetch(fetch_id, curl, url, deadline, std::move(callback)));
+    boost::asio::post(m_io, [this, new_fetch = std::move(new_fetch)]() mutable {
+        enqueue(std::move(new_fetch));
+        dispatch();
+    });
+    return fetch_id;
+}
+
+bool CurlFetchEngine::cancel(FetchId fetch_id)
+{
+    if (m_io.get_executor().running_in_this_thread()) {
+        bool cancelled = doCancel(fetch_id);
+        dispatch();
+        return cancelled;
+    }
+
+    // Anything already queued on m_io for this fetch, including its callback, will have run before this does
+    bool cancelled = false;
+    std::atomic_bool done(false);
+    boost::asio::post(m_io, [this, fetch_id, &cancelled, &done]() {
+        cancelled = doCancel(fetch_id);
+        dispatch();
+        done = true;
+        done.notify_all();
+    });
+    done.wait(false);
+    return cancelled;
+}
+
+void CurlFetchEngine::prewarm(const std::string &url)
+{
+    boost::asio::post(m_io, [this, url]() { startPrewarm(url); });
+}
+
+std::string CurlFetchEngine::origin_of(const std::string &url)
+{
+    std::string origin(url);
+    CURLU *parsed = curl_url();
+    if (parsed && curl_url_set(parsed, CURLUPART_URL, url.c_str(), 0) == CURLUE_OK) {
+        char *scheme = nullptr;
+        char *host = nullptr;
+        char *port = nullptr;
+        if (curl_url_get(parsed, CURLUPART_SCHEME, &scheme, 0) == CURLUE_OK &&
+            curl_url_get(parsed, CURLUPART_HOST, &host, 0) == CURLUE_OK &&
+            curl_url_get(parsed, CURLUPART_PORT, &port, CURLU_DEFAULT_PORT) == CURLUE_OK) {
+            origin = std::string(scheme) + "://" + host + ":" + port;
+        }
+        curl_free(scheme);
+        curl_free(host);
+        curl_free(port);
+    }
+    curl_url_cleanup(parsed);
+    return origin;
+}
+
+int CurlFetchEngine::socket_callback(CURL *easy, curl_socket_t sock, int what, void *userp, void *socketp)
+{
+    CurlFetchEngine *engine = static_cast<CurlFetchEngine*>(userp);
+    if (what == CURL_POLL_REMOVE) {
+        // Releases the descriptor, any waits on it complete with operation_aborted
+        engine->m_sockets.erase(sock);
+    } else {
+        engine->watchSocket(sock, what);
+    }
+    return 0;
+}
+
+int CurlFetchEngine::timer_callback(CURLM *multi, long timeout_ms, void *userp)
+{
+    CurlFetchEngine *engine = static_cast<CurlFetchEngine*>(userp);
+    if (timeout_ms < 0) {
+        engine->m_multiTimer.cancel();
+    } else {
+        engine->m_multiTimer.expires_after(std::chrono::milliseconds(timeout_ms));
+        engine->m_multiTimer.async_wait([engine](const boost::system::error_code &ec) {
+            if (!ec) engine->socketAction(CURL_SOCKET_TIMEOUT, 0);
+        });
+    }
+    return 0;
+}
+
+void CurlFetchEngine::enqueue(std::unique_ptr<Fetch> &&fetch)
+{
+    Fetch *queued = fetch.get();
+    m_queue[queued->queueKey()] = queued;
+    m_fetches[queued->id] = std::move(fetch);
+}
+
+void CurlFetchEngine::startPrewarm(const std::string &url)
+{
+    // A transfer in progress means the connection is already warm, this also stops more than one pre-warm per origin
+    std::string origin(origin_of(url));
+    if (m_originTransfers.find(origin) != m_originTransfers.end()) return;
+    auto known_url = m_originKnownUrls.find(origin);
+    if (known_url == m_originKnownUrls.end()) return;
+
+    // Not subject to the transfer limits, this is one short request per origin and it's needed before the fetch time
+    std::shared_ptr<Curl> curl(std::make_shared<Curl>());
+    FetchId fetch_id = m_nextFetchId++;
+    std::unique_ptr<Fetch> prewarm_fetch(new Fetch(fetch_id, curl, known_url->second,
+                                                   std::chrono::system_clock::now() + c_prewarmTimeout,
+                                                   [](FetchId, long result) {}));
+    curl_easy_setopt(curl->handle(), CURLOPT_NOBODY, 1L);
+    if (!start(*prewarm_fetch)) return;
+    ogs_debug("Pre-warming connection to %s", origin.c_str());
+    m_fetches[fetch_id] = std::move(prewarm_fetch);
+}
+
+bool CurlFetchEngine::doCancel(FetchId fetch_id)
+{
+    auto it = m_fetches.find(fetch_id);
+    if (it == m_fetches.end()) return false;
+    if (it->second->active) {
+        stop(*it->second);
+    } else {
+        m_queue.erase(it->second->queueKey());
+    }
+    m_fetches.erase(it);
+    return true;
+}
+
+void CurlFetchEngine::dispatch()
+{
+    std::vector<std::pair<std::unique_ptr<Fetch>, long> > finished;
+    unsigned int max_transfers = g_maxTransfers;
+    unsigned int max_per_origin = g_maxTransfersPerOrigin;
+    auto now = std::chrono::system_clock::now();
+
+    // The queue is in deadline order, so any that have already missed their deadline are at the front
+    for (auto it = m_queue.begin(); it != m_queue.end(); ) {
+        Fetch &fetch(*it->second);
+        if (fetch.deadline && fetch.deadline.value() <= now) {
+            it = m_queue.erase(it);
+            auto fetch_it = m_fetches.find(fetch.id);
+            finished.emplace_back(std::move(fetch_it->second), -1);
+            m_fetches.erase(fetch_it);
+            continue;
+        }
+        if (max_transfers && m_transfers >= max_transfers) break;
+        if (max_per_origin) {
+            auto origin_it = m_originTransfers.find(fetch.origin);
+            if (origin_it != m_originTransfers.end() && origin_it->second >= max_per_origin) {
+                ++it;
+                continue;
+            }
+        }
+        it = m_queue.erase(it);
+        if (!start(fetch)) {
+            auto fetch_it = m_fetches.find(fetch.id);
+            finished.emplace_back(std::move(fetch_it->second), -2);
+            m_fetches.erase(fetch_it);
+        }
+    }
+
+    // Come back when the next queued fetch would miss its deadline
+    if (!m_queue.empty() && m_queue.begin()->first.first != time_type::max()) {
+        m_deadlineTimer.expires_at(m_queue.begin()->first.first);
+        m_deadlineTimer.async_wait([this](const boost::system::error_code &ec) {
+            if (!ec) dispatch();
+        });
+    } else {
+        m_deadlineTimer.cancel();
+    }
+
+    for (auto &[fetch, result] : finished) {
+        complete(std::move(fetch), result);
+    }
+}
+
+bool CurlFetchEngine::start(Fetch &fetch)
+{
+    std::chrono::milliseconds timeout(c_defaultTimeout);
+    if (fetch.deadline) {
+        timeout = std::chrono::ceil<std::chrono::milliseconds>(fetch.deadline.value() - std::chrono::system_clock::now());
+        if (timeout.count() <= 0) timeout = std::chrono::milliseconds(1);
+    }
+    if (!fetch.curl->prepareGet(fetch.url, timeout)) return false;
+
+    CURL *easy = fetch.curl->handle();
+    curl_easy_setopt(easy, CURLOPT_PRIVATE, &fetch);
+    // Wait for an existing connection to become available for multiplexing rather than opening another. Only for https,
+    // where ALPN settles whether a connection can multiplex during the handshake: over cleartext that is not known
+    // until the first response is complete, so every other fetch to the origin would be held up behind it.
+    curl_easy_setopt(easy, CURLOPT_PIPEWAIT, fetch.origin.compare(0, 8, "https://") == 0 ? 1L : 0L);
+    if (curl_multi_add_handle(m_multi, easy) != CURLM_OK) {
+        ogs_error("Unable to start fetch of %s", fetch.url.c_str());
+        return false;
+    }
+    fetch.active = true;
+    m_transfers++;
+    m_originTransfers[fetch.origin]++;
+    return true;
+}
+
+void CurlFetchEngine::stop(Fetch &fetch)
+{
+    if (!fetch.active) return;
+    curl_multi_remove_handle(m_multi, fetch.curl->handle());
+    fetch.active = false;
+    m_transfers--;
+    auto origin_it = m_originTransfers.find(fetch.origin);
+    if (origin_it != m_originTransfers.end() && --origin_it->second == 0) m_originTransfers.erase(origin_it);
+}
+
+void CurlFetchEngine::collectCompleted()
+{
+    std::vector<std::pair<std::unique_ptr<Fetch>, long> > finished;
+    CURLMsg *msg;
+    int msgs_left;
+    while ((msg = curl_multi_info_read(m_multi, &msgs_left))) {
+        if (msg->msg != CURLMSG_DONE) continue;
+        char *private_data = nullptr;
+        curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, &private_data);
+        Fetch *fetch = reinterpret_cast<Fetch*>(private_data);
+        if (!fetch) continue;
+        // Collect the response details before removing the handle, as that invalidates msg
+        long result = fetch->curl->completeGet(msg->data.result);
+        long status_code = fetch->curl->getStatusCode();
+        if (result >= 0 && ((status_code >= 200 && status_code < 300) || status_code == 304)) {
+            m_originKnownUrls.insert_or_assign(fetch->origin, fetch->url);
+        }
+        stop(*fetch);
+        auto fetch_it = m_fetches.find(fetch->id);
+        finished.emplace_back(std::move(fetch_it->second), result);
+        m_fetches.erase(fetch_it);
+    }
+
+    for (auto &[fetch, result] : finished) {
+        complete(std::move(fetch), result);
+    }
+
+    // Transfers have finished so there may be room for more
+    if (!finished.empty()) dispatch();
+}
+
+void CurlFetchEngine::complete(std::unique_ptr<Fetch> &&fetch, long result)
+{
+    try {
+        fetch->callback(fetch->id, result);
+    } catch (std::exception &ex) {
+        ogs_error("Unhandled exception in fetch callback for %s: %s", fetch->url.c_str(), ex.what());
+    }
+}
+
+void CurlFetchEngine::watchSocket(curl_socket_t sock, int what)
+{
+    auto it = m_sockets.find(sock);
+    if (it == m_sockets.end()) {
+        it = m_sockets.emplace(sock, std::make_unique<Socket>(m_io, sock, m_nextSocketSerial++)).first;
+    }
+    it->second->what = what;
+    waitOnSocket(sock, *it->second);
+}
+
+void CurlFetchEngine::waitOnSocket(curl_socket_t sock, Socket &socket)
+{
+    // A wait that is no longer wanted when it completes is ignored, rather than cancelled here
+    if ((socket.what & CURL_POLL_IN) && !socket.reading) {
+        socket.reading = true;
+        std::uint64_t serial = socket.serial;
+        socket.descriptor.async_wait(boost::asio::posix::stream_descriptor::wait_read,
+                                     [this, sock, serial](const boost::system::error_code &ec) {
+            auto it = m_sockets.find(sock);
+            if (it == m_sockets.end() || it->second->serial != serial) return;
+            it->second->reading = false;
+            if (ec) return;
+            if (it->second->what & CURL_POLL_IN) socketAction(sock, CURL_CSELECT_IN);
+            it = m_sockets.find(sock);
+            if (it != m_sockets.end() && it->second->serial == serial) waitOnSocket(sock, *it->second);
+        });
+    }
+    if ((socket.what & CURL_POLL_OUT) && !socket.writing) {
+        socket.writing = true;
+        std::uint64_t serial = socket.serial;
+        socket.descriptor.async_wait(boost::asio::posix::stream_descriptor::wait_write,
+                                     [this, sock, serial](const boost::system::error_code &ec) {
+            auto it = m_sockets.find(sock);
+            if (it == m_sockets.end() || it->second->serial != serial) return;
+            it->second->writing = false;
+            if (ec) return;
+            if (it->second->what & CURL_POLL_OUT) socketAction(sock, CURL_CSELECT_OUT);
+            it = m_sockets.find(sock);
+            if (it != m_sockets.end() && it->second->serial == serial) waitOnSocket(sock, *it->second);
+        });
+    }
+}
+
+void CurlFetchEngine::socketAction(curl_socket_t sock, int ev_bitmask)
+{
+    int running_handles = 0;
+    curl_multi_socket_action(m_multi, sock, ev_bitmask, &running_handles);
+    collectCompleted();
+}
+
+MBSTF_NAMESPACE_STOP
+
+/* vim:ts=8:sts=4:sw=4:expandtab:
+ */
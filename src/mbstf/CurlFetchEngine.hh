@@ -0,0 +1,128 @@
+#ifndef _MBS_TF_CURL_FETCH_ENGINE_HH_
+#define _MBS_TF_CURL_FETCH_ENGINE_HH_
+/******************************************************************************
+ * 5G-MAG Reference Tools: MBS Traffic Function: cURL Fetch Engine class
+ ******************************************************************************
+ * Copyright: (C)2025 British Broadcasting Corporation
+ * Author(s): David Waring <david.waring2@bbc.co.uk>
+ * License: 5G-MAG Public License v1
+ *
+ * For full license terms please see the LICENSE file distributed with this
+ * program. If this file is missing then the license can be retrieved from
+ * https://drive.google.com/file/d/1cinCiA778IErENZ3JN52VFW-1ffHpx7Z/view
+ */
+
+#include <curl/curl.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/system_timer.hpp>
+
+#include "common.hh"
+
+MBSTF_NAMESPACE_START
+
+class Curl;
+
+/* Process wide asynchronous HTTP fetcher
+ *
+ * Transfers for all sessions are driven from one curl multi handle using curl_multi_socket_action() on a Reactor
+ * io_context, so any number of fetches can be in progress without a thread each. HTTP/2 connections are multiplexed.
+ *
+ * Fetches wait in a queue ordered by deadline (those without a deadline go last, in the order they were asked for)
+ * until there is room for them: at most maxTransfers() are in progress at once, and at most maxTransfersPerOrigin()
+ * to any one scheme://host:port. A fetch whose deadline passes, either while queued or while in progress, completes
+ * as timed out.
+ *
+ * The callback is called on the engine's io_context thread with the result as Curl::get() would return it, after
+ * which the Curl object can be used again. Callbacks should be quick, e.g. queue the result and wake a ReactorTask.
+ *
+ * prewarm() gets a connection to the origin of a URL ready ahead of a scheduled fetch, so the DNS lookup, TCP and
+ * TLS handshakes are done (or an idle pooled connection is confirmed to still be alive) before the fetch time rather
+ * than after it. The URL to be fetched may not exist yet, e.g. a live segment, and asking for it early could get an
+ * error response cached on the way, so instead a HEAD request is sent for the last URL successfully fetched from that
+ * origin, such as the session's manifest. Origins nothing has been fetched from yet are not pre-warmed.
+ */
+class CurlFetchEngine {
+public:
+    using time_type = std::chrono::system_clock::time_point;
+    using FetchId = std::uint64_t;
+    using Callback = std::function<void(FetchId fetch_id, long result)>;
+
+    CurlFetchEngine(const CurlFetchEngine &) = delete;
+    CurlFetchEngine(CurlFetchEngine &&) = delete;
+    virtual ~CurlFetchEngine();
+
+    CurlFetchEngine &operator=(const CurlFetchEngine &) = delete;
+    CurlFetchEngine &operator=(CurlFetchEngine &&) = delete;
+
+    static CurlFetchEngine &instance();
+
+    static unsigned int maxTransfers();
+    static void maxTransfers(unsigned int max_transfers);
+    static unsigned int maxTransfersPerOrigin();
+    static void maxTransfersPerOrigin(unsigned int max_transfers);
+    static std::chrono::milliseconds prewarmLeadTime(); // how long before a scheduled fetch to call prewarm()
+    static void prewarmLeadTime(const std::chrono::milliseconds &lead_time);
+
+    FetchId fetch(const std::shared_ptr<Curl> &curl, const std::string &url, const std::optional<time_type> &deadline,
+                  Callback &&callback);
+    bool cancel(FetchId fetch_id); // once this returns the callback won't be called, false if already completed
+    void prewarm(const std::string &url); // does nothing if there is already a transfer to the origin of url
+
+private:
+    static constexpr std::chrono::milliseconds c_defaultTimeout{10000};
+    static constexpr std::chrono::milliseconds c_prewarmTimeout{5000};
+
+    struct Fetch;
+    struct Socket;
+    using QueueKey = std::pair<time_type, FetchId>;
+
+    CurlFetchEngine();
+
+    static std::string origin_of(const std::string &url);
+    static int socket_callback(CURL *easy, curl_socket_t sock, int what, void *userp, void *socketp);
+    static int timer_callback(CURLM *multi, long timeout_ms, void *userp);
+
+    void enqueue(std::unique_ptr<Fetch> &&fetch);
+    void startPrewarm(const std::string &url);
+    bool doCancel(FetchId fetch_id);
+    void dispatch();
+    bool start(Fetch &fetch);
+    void stop(Fetch &fetch);
+    void collectCompleted();
+    void complete(std::unique_ptr<Fetch> &&fetch, long result);
+    void watchSocket(curl_socket_t sock, int what);
+    void waitOnSocket(curl_socket_t sock, Socket &socket);
+    void socketAction(curl_socket_t sock, int ev_bitmask);
+
+    // Only touched from the m_io thread, apart from m_nextFetchId
+    boost::asio::io_context &m_io;
+    CURLM *m_multi;
+    boost::asio::steady_timer m_multiTimer;    // curl's timeout
+    boost::asio::system_timer m_deadlineTimer; // earliest deadline in the queue
+    std::map<FetchId, std::unique_ptr<Fetch> > m_fetches;
+    std::map<QueueKey, Fetch*> m_queue;
+    std::map<std::string, unsigned int> m_originTransfers;
+    std::map<std::string, std::string> m_originKnownUrls; // last URL successfully fetched from each origin
+    std::map<curl_socket_t, std::unique_ptr<Socket> > m_sockets;
+    unsigned int m_transfers;
+    std::uint64_t m_nextSocketSerial;
+    std::atomic<FetchId> m_nextFetchId;
+};
+
+MBSTF_NAMESPACE_STOP
+
+/* vim:ts=8:sts=4:sw=4:expandtab:
+ */
+#endif /* _MBS_TF_CURL_FETCH_ENGINE_HH_ */
@@ -46,7 +46,7 @@ static LIBMPDPP_NAMESPACE_CLASS(MPD) ingest_manifest(const ObjectStore::Object &
 DASHManifestHandler::DASHManifestHandler(const ObjectStore::Object &object, ObjectController *controller, bool pull_distribution)
     :ManifestHandler(controller, pull_distribution)
     ,m_mpd(ingest_manifest(object))
-    ,m_manifest(&object)
+    ,m_manifest(object)
     ,m_refreshMpd(false)
 {
     m_mpd.selectAllRepresentations();
@@ -141,9 +141,9 @@ void DASHManifestHandler::addMPDRefreshToExtraPullObjects()
 {
 
       if (m_pullDistribution && m_mpd.hasMinimumUpdatePeriod()) {
-        auto min_update_time = m_manifest->second.receivedTime() + m_mpd.minimumUpdatePeriod().value();
-        auto time_to_update = m_manifest->second.hasExpiryTime() ? std::max(min_update_time, m_manifest->second.ExpiryTime()): min_update_time;
-         m_extraPullObjects.push_back(SegmentAvailability(time_to_update, 0s, m_manifest->second.getFetchedUrl(), m_mpd.availabilityEndTime()));
+        auto min_update_time = m_manifest.metadata().receivedTime() + m_mpd.minimumUpdatePeriod().value();
+        auto time_to_update = m_manifest.metadata().hasExpiryTime() ? std::max(min_update_time, m_manifest.metadata().ExpiryTime()): min_update_time;
+         m_extraPullObjects.push_back(SegmentAvailability(time_to_update, 0s, m_manifest.metadata().getFetchedUrl(), m_mpd.availabilityEndTime()));
 
      }
 }
@@ -189,6 +189,7 @@ bool DASHManifestHandler::update(const ObjectStore::Object &new_manifest)
 
     m_refreshMpd = false;
     m_mpd = ingest_manifest(new_manifest);
+    m_manifest = new_manifest;
     m_mpd.selectAllRepresentations();
     //SelectedInitialistionSegments(): For everything init segments in the list schedule an ingester.
     m_extraPullObjects = m_mpd.selectedInitializationSegments();
@@ -197,6 +198,19 @@ bool DASHManifestHandler::update(const ObjectStore::Object &new_manifest)
     return true; // assume manifest updated, use false for no manifest change
 }
 
+bool DASHManifestHandler::refreshed(const ObjectStore::Object &manifest)
+{
+    // Same MPD, so no need to parse it again, but the next refresh is now due relative to this revalidation
+    const std::string &manifest_url(m_manifest.metadata().getFetchedUrl());
+    m_extraPullObjects.remove_if([&manifest_url](const SegmentAvailability &sa) {
+        return sa.segmentURL() == manifest_url;
+    });
+    m_manifest = manifest;
+    addMPDRefreshToExtraPullObjects();
+
+    return true;
+}
+
 void DASHManifestHandler::adjustAvailabilityStartTime() {
     if(!m_extraPullObjects.empty()) {
         time_type current_time = std::chrono::system_clock::now();
@@ -213,10 +227,10 @@ static bool g_registered = ManifestHandlerFactory::registerManifestHandler("appl
 
 static LIBMPDPP_NAMESPACE_CLASS(MPD) ingest_manifest(const ObjectStore::Object &new_manifest)
 {
-    if ( new_manifest.second.mediaType() != "application/dash+xml" ){
+    if ( new_manifest.metadata().mediaType() != "application/dash+xml" ){
          throw std::invalid_argument("Does not look like a DASH Manifest as the media type is invalid. Expected media type: application/dash+xml");
     }
-    return LIBMPDPP_NAMESPACE_CLASS(MPD) (new_manifest.first, new_manifest.second.getFetchedUrl());
+    return LIBMPDPP_NAMESPACE_CLASS(MPD) (new_manifest.data().toVector(), new_manifest.metadata().getFetchedUrl());
 
 
 }
@@ -36,6 +36,7 @@ public:
     virtual std::pair<ManifestHandler::time_type, ManifestHandler::ingest_list> nextIngestItems();
     virtual ManifestHandler::durn_type getDefaultDeadline();
     virtual bool update(const ObjectStore::Object &new_manifest);
+    virtual bool refreshed(const ObjectStore::Object &manifest);
     virtual std::string nextObjectId();
     static unsigned int factoryPriority() { return 100; };
 
@@ -46,7 +47,7 @@ private:
   void removeExtraPullObjectsEntry(const LIBMPDPP_NAMESPACE_CLASS(SegmentAvailability) &segment);
 
   LIBMPDPP_NAMESPACE_CLASS(MPD)  m_mpd;
-  const ObjectStore::Object *m_manifest;
+  ObjectStore::Object m_manifest;
   bool m_refreshMpd;
   ManifestHandler::time_type m_mpdReceivedTime;
   std::list<LIBMPDPP_NAMESPACE_CLASS(SegmentAvailability)> m_extraPullObjects;
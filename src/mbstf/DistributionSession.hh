@@ -66,6 +66,7 @@ public:
     const std::shared_ptr<reftools::mbstf::CreateReqData> &distributionSessionReqData() const {return m_createReqData;};
     const SysTimeMS &generated() const {return m_generated;};
     const std::string &hash() const {return m_hash;};
+    const std::shared_ptr<Controller> &controller() const {return m_controller;};
     void setController(std::shared_ptr<Controller> controller) {m_controller = controller;};
 
     static bool processEvent(Open5GSEvent &event);
@@ -10,7 +10,17 @@
  * https://drive.google.com/file/d/1cinCiA778IErENZ3JN52VFW-1ffHpx7Z/view
  */
 
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <deque>
 #include <iostream>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 #include "common.hh"
 
@@ -18,36 +28,113 @@
 
 MBSTF_NAMESPACE_START
 
-Event::Event(const char *event_name)
-    :m_eventName(event_name)
+namespace {
+
+struct TypeRegistry {
+    TypeRegistry() :mutex(), names(), ids(), byId() {};
+
+    std::mutex mutex;
+    std::deque<std::string> names; // deque so that references to names stay valid as more are added
+    std::unordered_map<std::string, Event::TypeId> ids;
+    std::array<std::atomic<const std::string*>, Event::c_maxTypeIds> byId;
+};
+
+/* Recycled allocations for Event::make(), in 64 byte size classes up to 512 bytes. Larger events come from the heap. */
+struct AllocationPool {
+    static constexpr std::size_t c_granularity = 64;
+    static constexpr std::size_t c_numSizeClasses = 8;
+    static constexpr std::size_t c_maxFreeBlocks = 1024; // per size class
+
+    struct SizeClass {
+        SizeClass() :mutex(), freeBlocks() { freeBlocks.reserve(c_maxFreeBlocks); };
+
+        std::mutex mutex;
+        std::vector<void*> freeBlocks;
+    };
+
+    AllocationPool() :sizeClasses() {};
+
+    std::array<SizeClass, c_numSizeClasses> sizeClasses;
+};
+
+/* Per-thread cache in front of the AllocationPool so that most Event::make() calls don't touch a shared lock */
+struct ThreadCache {
+    static constexpr std::size_t c_maxBlocks = 32; // per size class
+
+    struct Blocks {
+        std::size_t count;
+        void *blocks[c_maxBlocks];
+    };
+
+    ThreadCache() :sizeClasses() {};
+    ~ThreadCache();
+
+    std::array<Blocks, AllocationPool::c_numSizeClasses> sizeClasses;
+};
+
+}
+
+static TypeRegistry &type_registry();
+static AllocationPool &allocation_pool();
+static void return_to_pool(std::size_t size_class_idx, void **blocks, std::size_t count);
+
+static thread_local ThreadCache t_threadCache;
+static thread_local bool t_threadCacheGone = false; // events freed during thread exit bypass the cache
+
+ThreadCache::~ThreadCache()
+{
+    t_threadCacheGone = true;
+    for (std::size_t i = 0; i < sizeClasses.size(); i++) {
+        return_to_pool(i, sizeClasses[i].blocks, sizeClasses[i].count);
+        sizeClasses[i].count = 0;
+    }
+}
+
+Event::Event(TypeId type_id)
+    :m_typeId(type_id)
+    ,m_classEvent(true)
     ,m_preventDefault(false)
     ,m_stopProcessing(false)
 {
 }
 
-Event::Event(const std::string &event_name)
-    :m_eventName(event_name)
+Event::Event(const char *event_name)
+    :m_typeId(registerType(event_name))
+    ,m_classEvent(false)
     ,m_preventDefault(false)
     ,m_stopProcessing(false)
 {
 }
 
-Event::Event(std::string &&event_name)
-    :m_eventName(std::move(event_name))
+Event::Event(const std::string &event_name)
+    :m_typeId(registerType(event_name))
+    ,m_classEvent(false)
     ,m_preventDefault(false)
     ,m_stopProcessing(false)
 {
 }
 
+// Copies are plain Events unless made by a subclass with Event(TypeId, const Event&), as this may be a sliced copy
+
 Event::Event(const Event &other)
-    :m_eventName(other.m_eventName)
+    :m_typeId(other.m_typeId)
+    ,m_classEvent(false)
     ,m_preventDefault(other.m_preventDefault)
     ,m_stopProcessing(other.m_stopProcessing)
 {
 }
 
 Event::Event(Event &&other)
-    :m_eventName(std::move(other.m_eventName))
+    :m_typeId(other.m_typeId)
+    ,m_classEvent(false)
+    ,m_preventDefault(other.m_preventDefault)
+    ,m_stopProcessing(other.m_stopProcessing)
+{
+}
+
+Event::Event(TypeId type_id, const Event &other)
+    :m_typeId(type_id)
+    ,m_classEvent(true)
     ,m_preventDefault(other.m_preventDefault)
     ,m_stopProcessing(other.m_stopProcessing)
 {
@@ -57,9 +144,11 @@ Event::~Event()
 {
 }
 
+// Assignment keeps m_classEvent, which belongs to the class of this object rather than the one copied from
+
 Event &Event::operator=(const Event &other)
 {
-    m_eventName = other.m_eventName;
+    m_typeId = other.m_typeId;
     m_preventDefault = other.m_preventDefault;
     m_stopProcessing = other.m_stopProcessing;
     return *this;
@@ -67,7 +156,7 @@ Event &Event::operator=(const Event &other)
 
 Event &Event::operator=(Event &&other)
 {
-    m_eventName = std::move(other.m_eventName);
+    m_typeId = other.m_typeId;
     m_preventDefault = other.m_preventDefault;
     m_stopProcessing = other.m_stopProcessing;
     return *this;
@@ -86,7 +175,100 @@ void Event::preventDefault()
 
 Event Event::clone()
 {
-    return Event(*this);
+    return Event(*this); // sliced to a plain Event
+}
+
+Event::TypeId Event::registerType(const std::string &event_name)
+{
+    TypeRegistry &registry(type_registry());
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    auto it = registry.ids.find(event_name);
+    if (it != registry.ids.end()) return it->second;
+
+    if (registry.names.size() >= c_maxTypeIds) {
+        throw std::overflow_error("Too many event types registered");
+    }
+    TypeId type_id = static_cast<TypeId>(registry.names.size());
+    registry.names.push_back(event_name);
+    registry.ids.emplace(event_name, type_id);
+    registry.byId[type_id].store(&registry.names.back(), std::memory_order_release);
+    return type_id;
+}
+
+const std::string &Event::typeName(TypeId type_id)
+{
+    static const std::string unknown;
+    if (type_id >= c_maxTypeIds) return unknown;
+    const std::string *name = type_registry().byId[type_id].load(std::memory_order_acquire);
+    return name?*name:unknown;
+}
+
+void *Event::poolAllocate(std::size_t size)
+{
+    std::size_t idx = (size + AllocationPool::c_granularity - 1) / AllocationPool::c_granularity;
+    if (idx == 0 || idx > AllocationPool::c_numSizeClasses || t_threadCacheGone) return ::operator new(idx * AllocationPool::c_granularity);
+
+    ThreadCache::Blocks &cached(t_threadCache.sizeClasses[idx - 1]);
+    if (cached.count == 0) {
+        // Refill half the thread cache from the shared pool
+        AllocationPool::SizeClass &size_class(allocation_pool().sizeClasses[idx - 1]);
+        std::lock_guard<std::mutex> lock(size_class.mutex);
+        while (cached.count < ThreadCache::c_maxBlocks / 2 && !size_class.freeBlocks.empty()) {
+            cached.blocks[cached.count++] = size_class.freeBlocks.back();
+            size_class.freeBlocks.pop_back();
+        }
+    }
+    if (cached.count > 0) return cached.blocks[--cached.count];
+
+    return ::operator new(idx * AllocationPool::c_granularity);
+}
+
+void Event::poolDeallocate(void *ptr, std::size_t size) noexcept
+{
+    std::size_t idx = (size + AllocationPool::c_granularity - 1) / AllocationPool::c_granularity;
+    if (idx == 0 || idx > AllocationPool::c_numSizeClasses) {
+        ::operator delete(ptr);
+        return;
+    }
+    if (t_threadCacheGone) {
+        return_to_pool(idx - 1, &ptr, 1);
+        return;
+    }
+
+    ThreadCache::Blocks &cached(t_threadCache.sizeClasses[idx - 1]);
+    if (cached.count == ThreadCache::c_maxBlocks) {
+        // Events are usually freed on a different thread to the one that made them, so pass half back to the pool
+        cached.count -= ThreadCache::c_maxBlocks / 2;
+        return_to_pool(idx - 1, &cached.blocks[cached.count], ThreadCache::c_maxBlocks / 2);
+    }
+    cached.blocks[cached.count++] = ptr;
+}
+
+static void return_to_pool(std::size_t size_class_idx, void **blocks, std::size_t count)
+{
+    AllocationPool::SizeClass &size_class(allocation_pool().sizeClasses[size_class_idx]);
+    std::lock_guard<std::mutex> lock(size_class.mutex);
+    for (std::size_t i = 0; i < count; i++) {
+        if (size_class.freeBlocks.size() < AllocationPool::c_maxFreeBlocks) {
+            size_class.freeBlocks.push_back(blocks[i]);
+        } else {
+            ::operator delete(blocks[i]);
+        }
+    }
+}
+
+// The registry and pool are never destroyed, as events may outlive static destruction of other objects
+
+static TypeRegistry &type_registry()
+{
+    static TypeRegistry *registry = new TypeRegistry;
+    return *registry;
+}
+
+static AllocationPool &allocation_pool()
+{
+    static AllocationPool *pool = new AllocationPool;
+    return *pool;
 }
 
 MBSTF_NAMESPACE_STOP
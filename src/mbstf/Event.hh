@@ -12,19 +12,62 @@
  * https://drive.google.com/file/d/1cinCiA778IErENZ3JN52VFW-1ffHpx7Z/view
  */
 
+#include <cstddef>
+#include <memory>
 #include <string>
+#include <typeinfo>
+#include <utility>
 
 #include "common.hh"
 
 MBSTF_NAMESPACE_START
 
+/* Base class for events sent by a SubscriptionService
+ *
+ * Each event name is given a small integer type id the first time it is seen, and an Event only carries its type id.
+ * Event classes declare their name as c_eventName, e.g.
+ *
+ *     static constexpr const char c_eventName[] = "ObjectAdded";
+ *
+ * which lets Event::typeIdOf<E>() look the id up once per class, after which testing for an event type is an integer
+ * compare (event.is<E>()) and the downcast a static_cast (event.as<E>()).
+ *
+ * Ids are shared between names and classes so that subscribing by name still matches class events, but is<E>() only
+ * passes for events made by an Event subclass through the protected Event(TypeId) constructor. An Event made from a
+ * name, or copied by the Event copy or move constructor (so any sliced copy, such as clone()), can carry the same id
+ * as a class without is<E>() letting it be cast to that class. A subclass that needs to be copied should do so with
+ * the protected Event(TypeId, const Event&) constructor. Debug builds also check the cast in as<E>().
+ *
+ * Asynchronous events should be created with Event::make<E>(...), which allocates the event and its shared_ptr control
+ * block in one go from a pool of recycled blocks.
+ */
 class Event
 {
 public:
+    using TypeId = unsigned int;
+    static constexpr TypeId c_maxTypeIds = 256;
+
+    template <class T>
+    class PoolAllocator {
+    public:
+        using value_type = T;
+
+        PoolAllocator() noexcept {};
+        template <class U>
+        PoolAllocator(const PoolAllocator<U> &) noexcept {};
+
+        T *allocate(std::size_t n) { return static_cast<T*>(Event::poolAllocate(n * sizeof(T))); };
+        void deallocate(T *ptr, std::size_t n) noexcept { Event::poolDeallocate(ptr, n * sizeof(T)); };
+
+        template <class U>
+        bool operator==(const PoolAllocator<U> &) const noexcept { return true; };
+        template <class U>
+        bool operator!=(const PoolAllocator<U> &) const noexcept { return false; };
+    };
+
     Event() = delete;
     Event(const char *event_name);
     Event(const std::string &event_name);
-    Event(std::string &&event_name);
     Event(const Event &);
     Event(Event &&);
 
@@ -33,18 +76,55 @@ public:
     Event &operator=(const Event &);
     Event &operator=(Event &&);
 
-    const std::string &eventName() const { return m_eventName; };
+    TypeId typeId() const { return m_typeId; };
+    const std::string &eventName() const { return typeName(m_typeId); };
     void stopProcessing(); // Do not send to any other Subscribers and do not perform default action
     void preventDefault(); // Send to other subscribers but do not perform any default action (synchronous events only)
 
     bool stopProcessingFlag() const { return m_stopProcessing; };
     bool preventDefaultFlag() const { return m_preventDefault; };
 
+    template <class E>
+    bool is() const { return m_classEvent && m_typeId == typeIdOf<E>(); };
+    template <class E>
+    E &as() {
+#ifndef NDEBUG
+        if (!dynamic_cast<E*>(this)) throw std::bad_cast();
+#endif
+        return static_cast<E&>(*this);
+    };
+    template <class E>
+    const E &as() const {
+#ifndef NDEBUG
+        if (!dynamic_cast<const E*>(this)) throw std::bad_cast();
+#endif
+        return static_cast<const E&>(*this);
+    };
+
     virtual Event clone();
 
-    virtual std::string reprString() const { return std::string("Event(\"") + m_eventName + "\")"; };
+    virtual std::string reprString() const { return std::string("Event(\"") + eventName() + "\")"; };
+
+    static TypeId registerType(const std::string &event_name); // returns existing id if already registered
+    static const std::string &typeName(TypeId type_id);
+    template <class E>
+    static TypeId typeIdOf() { static const TypeId type_id = registerType(E::c_eventName); return type_id; };
+
+    template <class E, class... Args>
+    static std::shared_ptr<E> make(Args&&... args) {
+        return std::allocate_shared<E>(PoolAllocator<E>(), std::forward<Args>(args)...);
+    };
+
+    static void *poolAllocate(std::size_t size);
+    static void poolDeallocate(void *ptr, std::size_t size) noexcept;
+
+protected:
+    Event(TypeId type_id); // for subclasses, with an id from typeIdOf<>()
+    Event(TypeId type_id, const Event &other); // for subclass copy constructors
+
 private:
-    std::string m_eventName;
+    TypeId m_typeId;
+    bool m_classEvent; // made by a subclass for its own type id, see is<E>()
     bool m_preventDefault;
     bool m_stopProcessing;
 };
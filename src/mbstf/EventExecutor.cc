@@ -0,0 +1,155 @@
+/******************************************************************************
+ * 5G-MAG Reference Tools: MBS Traffic Function: Event Executor class
+ ******************************************************************************
+ * Copyright: (C)2025 British Broadcasting Corporation
+ * Author(s): David Waring <david.waring2@bbc.co.uk>
+ * License: 5G-MAG Public License v1
+ *
+ * For full license terms please see the LICENSE file distributed with this
+ * program. If this file is missing then the license can be retrieved from
+ * https://drive.google.com/file/d/1cinCiA778IErENZ3JN52VFW-1ffHpx7Z/view
+ */
+
+#include <pthread.h>
+
+#include <atomic>
+#include <exception>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "ogs-app.h"
+
+#include "common.hh"
+
+#include "EventExecutor.hh"
+
+MBSTF_NAMESPACE_START
+
+static std::atomic<unsigned int> g_numThreads(0);
+
+// Which executor and worker the current thread belongs to, if any
+static thread_local const EventExecutor *t_executor = nullptr;
+static thread_local std::size_t t_workerIndex = 0;
+
+EventExecutor::EventExecutor(unsigned int num_threads)
+    :m_workers()
+    ,m_wakeSequence(0)
+    ,m_nextWorker(0)
+    ,m_stop(false)
+{
+    if (num_threads == 0) num_threads = std::thread::hardware_concurrency();
+    if (num_threads == 0) num_threads = 1;
+
+    for (unsigned int i = 0; i < num_threads; i++) {
+        m_workers.emplace_back(new Worker);
+    }
+    for (std::size_t i = 0; i < m_workers.size(); i++) {
+        m_workers[i]->thread = std::thread(&EventExecutor::workerLoop, this, i);
+        std::string name("mbstf-evt-" + std::to_string(i));
+        pthread_setname_np(m_workers[i]->thread.native_handle(), name.substr(0, 15).c_str());
+    }
+}
+
+EventExecutor::~EventExecutor()
+{
+    m_stop = true;
+    m_wakeSequence++;
+    m_wakeSequence.notify_all();
+    for (auto &worker : m_workers) {
+        if (worker->thread.joinable()) worker->thread.join();
+    }
+}
+
+EventExecutor &EventExecutor::instance()
+{
+    static EventExecutor executor(g_numThreads);
+    return executor;
+}
+
+unsigned int EventExecutor::threads()
+{
+    return g_numThreads;
+}
+
+void EventExecutor::threads(unsigned int num_threads)
+{
+    g_numThreads = num_threads;
+}
+
+void EventExecutor::post(Task &&task)
+{
+    std::size_t index;
+    if (t_executor == this) {
+        index = t_workerIndex;
+    } else {
+        index = m_nextWorker++ % m_workers.size();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_workers[index]->mutex);
+        m_workers[index]->tasks.push_back(std::move(task));
+    }
+    m_wakeSequence++;
+    m_wakeSequence.notify_one();
+}
+
+bool EventExecutor::popTask(std::size_t worker_index, Task &task)
+{
+    // Own queue first, oldest task first
+    {
+        Worker &worker(*m_workers[worker_index]);
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        if (!worker.tasks.empty()) {
+            task = std::move(worker.tasks.front());
+            worker.tasks.pop_front();
+            return true;
+        }
+    }
+
+    // Then steal the newest task from another worker
+    for (std::size_t i = 1; i < m_workers.size(); i++) {
+        Worker &victim(*m_workers[(worker_index + i) % m_workers.size()]);
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.back());
+            victim.tasks.pop_back();
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void EventExecutor::workerLoop(std::size_t worker_index)
+{
+    t_executor = this;
+    t_workerIndex = worker_index;
+
+    while (true) {
+        // Read the sequence before looking for work, so a post() after we look changes it and wait() won't sleep
+        std::uint32_t wake_seq = m_wakeSequence.load();
+        Task task;
+        if (popTask(worker_index, task)) {
+            try {
+                task();
+            } catch (std::exception &ex) {
+                // Tasks are expected to deal with their own errors, don't let one take down the worker
+                ogs_error("Unhandled exception in event executor task: %s", ex.what());
+            }
+            continue;
+        }
+
+        if (m_stop) break;
+        m_wakeSequence.wait(wake_seq);
+    }
+
+    t_executor = nullptr;
+}
+
+MBSTF_NAMESPACE_STOP
+
+/* vim:ts=8:sts=4:sw=4:expandtab:
+ */
@@ -0,0 +1,83 @@
+#ifndef _MBS_TF_EVENT_EXECUTOR_HH_
+#define _MBS_TF_EVENT_EXECUTOR_HH_
+/******************************************************************************
+ * 5G-MAG Reference Tools: MBS Traffic Function: Event Executor class
+ ******************************************************************************
+ * Copyright: (C)2025 British Broadcasting Corporation
+ * Author(s): David Waring <david.waring2@bbc.co.uk>
+ * License: 5G-MAG Public License v1
+ *
+ * For full license terms please see the LICENSE file distributed with this
+ * program. If this file is missing then the license can be retrieved from
+ * https://drive.google.com/file/d/1cinCiA778IErENZ3JN52VFW-1ffHpx7Z/view
+ */
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "common.hh"
+
+MBSTF_NAMESPACE_START
+
+/* Process wide pool of worker threads for asynchronous event delivery
+ *
+ * Each worker has its own task queue. Tasks posted from a worker go on that worker's queue, others are spread round
+ * robin, and a worker with nothing to do steals from the back of the other queues. This keeps the number of threads
+ * bounded by the pool size, rather than growing with the number of SubscriptionServices, while a busy service does
+ * not hold up the others.
+ *
+ * Idle workers sleep on an atomic wake-up counter (a futex on Linux), so a post() costs no more than a counter
+ * increment and, if anything is asleep, a single wake-up.
+ *
+ * There is no ordering between tasks, callers needing ordering (see SubscriptionService) must serialise their own.
+ */
+class EventExecutor {
+public:
+    using Task = std::function<void()>;
+
+    EventExecutor(const EventExecutor &) = delete;
+    EventExecutor(EventExecutor &&) = delete;
+    virtual ~EventExecutor();
+
+    EventExecutor &operator=(const EventExecutor &) = delete;
+    EventExecutor &operator=(EventExecutor &&) = delete;
+
+    static EventExecutor &instance();
+    static unsigned int threads();
+    static void threads(unsigned int num_threads); // must be set before first use, 0 means one per CPU core
+
+    void post(Task &&task);
+    std::size_t size() const { return m_workers.size(); };
+
+private:
+    struct Worker {
+        Worker() :mutex(), tasks(), thread() {};
+
+        std::mutex mutex;
+        std::deque<Task> tasks;
+        std::thread thread;
+    };
+
+    EventExecutor(unsigned int num_threads);
+
+    bool popTask(std::size_t worker_index, Task &task);
+    void workerLoop(std::size_t worker_index);
+
+    std::vector<std::unique_ptr<Worker> > m_workers;
+    std::atomic<std::uint32_t> m_wakeSequence; // bumped on every post() and on shutdown
+    std::atomic<std::size_t> m_nextWorker;
+    std::atomic_bool m_stop;
+};
+
+MBSTF_NAMESPACE_STOP
+
+/* vim:ts=8:sts=4:sw=4:expandtab:
+ */
+#endif /* _MBS_TF_EVENT_EXECUTOR_HH_ */
@@ -0,0 +1,164 @@
+/******************************************************************************
+ * 5G-MAG Reference Tools: MBS Traffic Function: HTTP Freshness class
+ ******************************************************************************
+ * Copyright: (C)2025 British Broadcasting Corporation
+ * Author(s): David Waring <david.waring2@bbc.co.uk>
+ * License: 5G-MAG Public License v1
+ *
+ * For full license terms please see the LICENSE file distributed with this
+ * program. If this file is missing then the license can be retrieved from
+ * https://drive.google.com/file/d/1cinCiA778IErENZ3JN52VFW-1ffHpx7Z/view
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+#include "common.hh"
+#include "HttpHeaders.hh"
+
+#include "HttpFreshness.hh"
+
+MBSTF_NAMESPACE_START
+
+// Delta-seconds too large to represent are taken to be this (RFC 9111 section 1.2.2)
+static const std::uint64_t g_maxDeltaSeconds = 2147483648;
+
+static std::string_view trim_ows(std::string_view str);
+
+HttpFreshness::HttpFreshness(const HttpHeaders &headers, const time_type &request_time, const time_type &response_time)
+    :m_responseTime(response_time)
+    ,m_maxAge()
+    ,m_sharedMaxAge()
+    ,m_noCache(false)
+    ,m_noStore(false)
+    ,m_lastModified(headers.getDate("Last-Modified"))
+    ,m_freshnessLifetime()
+    ,m_heuristic(false)
+    ,m_initialAge(0)
+{
+    headers.forEach("Cache-Control", [this](std::string_view cache_control) { parseCacheControl(cache_control); });
+
+    // A recipient of a response without a valid Date uses the time it was received (RFC 9110 section 6.6.1)
+    time_type date(headers.getDate("Date").value_or(response_time));
+
+    // Freshness lifetime (RFC 9111 section 4.2.1)
+    if (m_sharedMaxAge) {
+        m_freshnessLifetime = m_sharedMaxAge;
+    } else if (m_maxAge) {
+        m_freshnessLifetime = m_maxAge;
+    } else if (auto expires = headers.get("Expires")) {
+        auto expires_time = HttpHeaders::parseHttpDate(expires.value());
+        if (expires_time) {
+            m_freshnessLifetime = std::max(duration_type(0),
+                                           std::chrono::duration_cast<duration_type>(expires_time.value() - date));
+        } else {
+            // Invalid dates, especially "0", are in the past (RFC 9111 section 5.3)
+            m_freshnessLifetime = duration_type(0);
+        }
+    } else if (m_lastModified && m_lastModified.value() < date) {
+        // Heuristic freshness (RFC 9111 section 4.2.2)
+        m_freshnessLifetime = std::chrono::duration_cast<duration_type>(date - m_lastModified.value()) / 10;
+        m_heuristic = true;
+    }
+
+    // A response that must be revalidated before each reuse is stale as soon as it arrives (RFC 9111 section 5.2.2.4)
+    if (m_noCache) {
+        m_freshnessLifetime = duration_type(0);
+        m_heuristic = false;
+    }
+
+    // Age when received (RFC 9111 section 4.2.3)
+    duration_type age_value(0);
+    if (auto age = headers.get("Age")) age_value = parse_delta_seconds(age.value()).value_or(duration_type(0));
+    duration_type apparent_age(std::max(duration_type(0),
+                                        std::chrono::duration_cast<duration_type>(response_time - date)));
+    duration_type response_delay(std::max(duration_type(0),
+                                          std::chrono::duration_cast<duration_type>(response_time - request_time)));
+    m_initialAge = std::max(apparent_age, age_value + response_delay);
+}
+
+std::optional<HttpFreshness::time_type> HttpFreshness::expires() const
+{
+    if (!m_freshnessLifetime) return std::nullopt;
+    return m_responseTime + m_freshnessLifetime.value() - m_initialAge;
+}
+
+HttpFreshness::time_type HttpFreshness::expires(const duration_type &default_lifetime) const
+{
+    return m_responseTime + m_freshnessLifetime.value_or(default_lifetime) - m_initialAge;
+}
+
+std::optional<HttpFreshness::duration_type> HttpFreshness::parse_delta_seconds(std::string_view delta_seconds)
+{
+    if (delta_seconds.empty()) return std::nullopt;
+    std::uint64_t seconds = 0;
+    for (auto c : delta_seconds) {
+        if (c < '0' || c > '9') return std::nullopt;
+        seconds = std::min(seconds * 10 + (c - '0'), g_maxDeltaSeconds);
+    }
+    return duration_type(seconds);
+}
+
+void HttpFreshness::parseCacheControl(std::string_view cache_control)
+{
+    // Comma separated list of directives, each a token optionally followed by "=" and a token or quoted-string
+    while (!cache_control.empty()) {
+        auto end = cache_control.find_first_of("=,");
+        std::string_view directive(trim_ows(cache_control.substr(0, end)));
+        std::optional<std::string_view> argument;
+        if (end != std::string_view::npos && cache_control[end] == '=') {
+            cache_control = trim_ows(cache_control.substr(end + 1));
+            if (!cache_control.empty() && cache_control.front() == '"') {
+                // Quoted string, which may contain commas
+                std::size_t pos = 1;
+                while (pos < cache_control.size() && cache_control[pos] != '"') {
+                    if (cache_control[pos] == '\\') pos++;
+                    pos++;
+                }
+                pos = std::min(pos, cache_control.size());
+                argument = cache_control.substr(1, pos - 1);
+                cache_control.remove_prefix(std::min(pos + 1, cache_control.size()));
+                end = cache_control.find(',');
+            } else {
+                end = cache_control.find(',');
+                argument = trim_ows(cache_control.substr(0, end));
+            }
+        }
+        if (!directive.empty()) cacheDirective(directive, argument);
+        if (end == std::string_view::npos) break;
+        cache_control.remove_prefix(end + 1);
+    }
+}
+
+void HttpFreshness::cacheDirective(std::string_view directive, const std::optional<std::string_view> &argument)
+{
+    HttpHeaders::name_type name(directive.data(), directive.size());
+
+    // Where a directive is repeated the first one is used (RFC 9111 section 4.2.1)
+    if (name == "s-maxage") {
+        if (!m_sharedMaxAge && argument) m_sharedMaxAge = parse_delta_seconds(argument.value());
+    } else if (name == "max-age") {
+        if (!m_maxAge && argument) m_maxAge = parse_delta_seconds(argument.value());
+    } else if (name == "no-cache") {
+        // The qualified form only applies to the fields it lists, the rest of the response can still be reused
+        if (!argument) m_noCache = true;
+    } else if (name == "no-store") {
+        m_noStore = true;
+    }
+}
+
+static std::string_view trim_ows(std::string_view str)
+{
+    auto start = str.find_first_not_of(" \t");
+    if (start == std::string_view::npos) return std::string_view();
+    auto end = str.find_last_not_of(" \t");
+    return str.substr(start, end - start + 1);
+}
+
+MBSTF_NAMESPACE_STOP
+
+/* vim:ts=8:sts=4:sw=4:expandtab:
+ */
@@ -0,0 +1,81 @@
+#ifndef _MBS_TF_HTTP_FRESHNESS_HH_
+#define _MBS_TF_HTTP_FRESHNESS_HH_
+/******************************************************************************
+ * 5G-MAG Reference Tools: MBS Traffic Function: HTTP Freshness class
+ ******************************************************************************
+ * Copyright: (C)2025 British Broadcasting Corporation
+ * Author(s): David Waring <david.waring2@bbc.co.uk>
+ * License: 5G-MAG Public License v1
+ *
+ * For full license terms please see the LICENSE file distributed with this
+ * program. If this file is missing then the license can be retrieved from
+ * https://drive.google.com/file/d/1cinCiA778IErENZ3JN52VFW-1ffHpx7Z/view
+ */
+
+#include <chrono>
+#include <optional>
+#include <string_view>
+
+#include "common.hh"
+
+MBSTF_NAMESPACE_START
+
+class HttpHeaders;
+
+/* How long an HTTP response stays fresh (RFC 9111 section 4.2)
+ *
+ * Worked out from the Cache-Control, Expires, Date, Age and Last-Modified fields of the response along with when the
+ * request was sent and the response received. The MBSTF holds objects for many receivers so it is a shared cache, and
+ * s-maxage takes precedence over max-age, then Expires. Without any of those a response with a Last-Modified date gets
+ * the usual heuristic lifetime of 10% of the time since it was last modified.
+ *
+ * The age of the response when received (corrected_initial_age) is taken off the lifetime, so an object that spent
+ * time in other caches on the way expires when they would have expired it. A no-cache response has no lifetime.
+ *
+ * expires() is when the response needs revalidating, which may be before it has arrived. It is not how long to keep
+ * the response for: stores should hold objects for long enough to send them, see ObjectStore::Metadata::freshUntil().
+ */
+class HttpFreshness {
+public:
+    using time_type = std::chrono::system_clock::time_point;
+    using duration_type = std::chrono::seconds;
+
+    HttpFreshness(const HttpHeaders &headers, const time_type &request_time, const time_type &response_time);
+    HttpFreshness(const HttpFreshness &other) = default;
+    HttpFreshness(HttpFreshness &&other) = default;
+    virtual ~HttpFreshness() {};
+
+    HttpFreshness &operator=(const HttpFreshness &other) = default;
+    HttpFreshness &operator=(HttpFreshness &&other) = default;
+
+    const std::optional<duration_type> &freshnessLifetime() const { return m_freshnessLifetime; }; // unset if unknown
+    bool heuristic() const { return m_heuristic; }; // freshnessLifetime() is a guess from Last-Modified
+    const duration_type &initialAge() const { return m_initialAge; };
+    bool noCache() const { return m_noCache; };     // must be revalidated before each reuse, freshnessLifetime() is 0
+    bool noStore() const { return m_noStore; };     // must not be kept in non-volatile storage
+    const std::optional<time_type> &lastModified() const { return m_lastModified; };
+
+    std::optional<time_type> expires() const; // when the response stops being fresh, unset if the lifetime is unknown
+    time_type expires(const duration_type &default_lifetime) const; // as above but using default_lifetime if unknown
+
+private:
+    static std::optional<duration_type> parse_delta_seconds(std::string_view delta_seconds);
+    void parseCacheControl(std::string_view cache_control);
+    void cacheDirective(std::string_view directive, const std::optional<std::string_view> &argument);
+
+    time_type m_responseTime;
+    std::optional<duration_type> m_maxAge;
+    std::optional<duration_type> m_sharedMaxAge;
+    bool m_noCache;
+    bool m_noStore;
+    std::optional<time_type> m_lastModified;
+    std::optional<duration_type> m_freshnessLifetime;
+    bool m_heuristic;
+    duration_type m_initialAge;
+};
+
+MBSTF_NAMESPACE_STOP
+
+/* vim:ts=8:sts=4:sw=4:expandtab:
+ */
+#endif /* _MBS_TF_HTTP_FRESHNESS_HH_ */
@@ -0,0 +1,113 @@
+/******************************************************************************
+ * 5G-MAG Reference Tools: MBS Traffic Function: HTTP Headers class
+ ******************************************************************************
+ * Copyright: (C)2025 British Broadcasting Corporation
+ * Author(s): David Waring <david.waring2@bbc.co.uk>
+ * License: 5G-MAG Public License v1
+ *
+ * For full license terms please see the LICENSE file distributed with this
+ * program. If this file is missing then the license can be retrieved from
+ * https://drive.google.com/file/d/1cinCiA778IErENZ3JN52VFW-1ffHpx7Z/view
+ */
+
+#include <chrono>
+#include <locale>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <string_view>
+
+#include "common.hh"
+
+#include "HttpHeaders.hh"
+
+MBSTF_NAMESPACE_START
+
+static std::string_view trim_ows(std::string_view str);
+
+HttpHeaders::HttpHeaders()
+    :m_text()
+    ,m_entries()
+{
+}
+
+HttpHeaders &HttpHeaders::clear()
+{
+    // Keeps the capacity of both for the next message
+    m_text.clear();
+    m_entries.clear();
+    return *this;
+}
+
+HttpHeaders &HttpHeaders::add(std::string_view name, std::string_view value)
+{
+    Entry entry{m_text.size(), name.size(), m_text.size() + name.size(), value.size()};
+    m_text.append(name);
+    m_text.append(value);
+    m_entries.push_back(entry);
+    return *this;
+}
+
+bool HttpHeaders::addLine(std::string_view field_line)
+{
+    auto colon = field_line.find(':');
+    // No whitespace is allowed between the field name and colon (RFC 9112 section 5.1), obsolete line folding
+    // continuation lines start with whitespace and are not supported
+    if (colon == 0 || colon == std::string_view::npos) return false;
+    if (field_line.front() == ' ' || field_line.front() == '\t') return false;
+    std::string_view name(field_line.substr(0, colon));
+    if (name.back() == ' ' || name.back() == '\t') return false;
+    add(name, trim_ows(field_line.substr(colon + 1)));
+    return true;
+}
+
+std::optional<std::string_view> HttpHeaders::get(name_type name) const
+{
+    for (const auto &entry : m_entries) {
+        if (this->name(entry) == name) return value(entry);
+    }
+    return std::nullopt;
+}
+
+std::optional<HttpHeaders::time_type> HttpHeaders::getDate(name_type name) const
+{
+    auto date = get(name);
+    if (!date) return std::nullopt;
+    return parseHttpDate(date.value());
+}
+
+std::optional<HttpHeaders::time_type> HttpHeaders::parseHttpDate(std::string_view http_date)
+{
+    // RFC 9110 section 5.6.7: recipients accept all three formats, though only the first should be sent
+    std::string date_time_str(http_date);
+    time_type date_time;
+    std::istringstream iss(date_time_str);
+    iss.imbue(std::locale("C"));
+    iss >> std::chrono::parse("%a, %d %b %Y %H:%M:%S GMT", date_time); // RFC822/RFC1123 (IMF-fixdate)
+    if (iss.fail()) {
+        iss.clear();
+        iss.str(date_time_str);
+        iss >> std::chrono::parse("%A, %d-%b-%y %H:%M:%S GMT", date_time); // RFC1036
+        if (iss.fail()) {
+            iss.clear();
+            iss.str(date_time_str);
+            iss >> std::chrono::parse("%a %b %d %H:%M:%S %Y", date_time); // ANSI C asctime format
+        }
+    }
+    if (iss.fail()) return std::nullopt;
+
+    return date_time;
+}
+
+static std::string_view trim_ows(std::string_view str)
+{
+    auto start = str.find_first_not_of(" \t");
+    if (start == std::string_view::npos) return std::string_view();
+    auto end = str.find_last_not_of(" \t");
+    return str.substr(start, end - start + 1);
+}
+
+MBSTF_NAMESPACE_STOP
+
+/* vim:ts=8:sts=4:sw=4:expandtab:
+ */
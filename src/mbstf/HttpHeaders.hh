@@ -0,0 +1,86 @@
+#ifndef _MBS_TF_HTTP_HEADERS_HH_
+#define _MBS_TF_HTTP_HEADERS_HH_
+/******************************************************************************
+ * 5G-MAG Reference Tools: MBS Traffic Function: HTTP Headers class
+ ******************************************************************************
+ * Copyright: (C)2025 British Broadcasting Corporation
+ * Author(s): David Waring <david.waring2@bbc.co.uk>
+ * License: 5G-MAG Public License v1
+ *
+ * For full license terms please see the LICENSE file distributed with this
+ * program. If this file is missing then the license can be retrieved from
+ * https://drive.google.com/file/d/1cinCiA778IErENZ3JN52VFW-1ffHpx7Z/view
+ */
+
+#include <chrono>
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "common.hh"
+#include "CaseInsensitiveTraits.hh"
+
+MBSTF_NAMESPACE_START
+
+/* Index of the header fields of an HTTP message
+ *
+ * Field names are matched case-insensitively. The names and values are copied into one buffer held by the index and
+ * the entries refer to them by offset, so once an index has grown to fit a typical message, clear() followed by add()
+ * for the next message does not allocate. Field lines with the same name are kept as separate entries in the order
+ * they were added. The string_views returned are only valid until the next add() or clear().
+ */
+class HttpHeaders {
+public:
+    using name_type = std::basic_string_view<char, CaseInsensitiveTraits<char> >;
+    using time_type = std::chrono::system_clock::time_point;
+
+    HttpHeaders();
+    HttpHeaders(const HttpHeaders &other) = default;
+    HttpHeaders(HttpHeaders &&other) = default;
+    virtual ~HttpHeaders() {};
+
+    HttpHeaders &operator=(const HttpHeaders &other) = default;
+    HttpHeaders &operator=(HttpHeaders &&other) = default;
+
+    HttpHeaders &clear();
+    HttpHeaders &add(std::string_view name, std::string_view value);
+    bool addLine(std::string_view field_line); // "name: value" with no line ending, false if not a field line
+
+    bool empty() const { return m_entries.empty(); };
+    std::size_t size() const { return m_entries.size(); };
+
+    std::optional<std::string_view> get(name_type name) const; // value of the first field line with the name
+    std::optional<time_type> getDate(name_type name) const;     // first value parsed as an HTTP-date
+    template<class Fn>
+    void forEach(name_type name, Fn &&fn) const {               // calls fn(std::string_view value) for each field line
+        for (const auto &entry : m_entries) {
+            if (this->name(entry) == name) fn(value(entry));
+        }
+    };
+
+    static std::optional<time_type> parseHttpDate(std::string_view http_date);
+
+private:
+    struct Entry {
+        std::size_t nameStart;
+        std::size_t nameLength;
+        std::size_t valueStart;
+        std::size_t valueLength;
+    };
+
+    name_type name(const Entry &entry) const { return name_type(m_text.data() + entry.nameStart, entry.nameLength); };
+    std::string_view value(const Entry &entry) const {
+        return std::string_view(m_text.data() + entry.valueStart, entry.valueLength);
+    };
+
+    std::string m_text;
+    std::vector<Entry> m_entries;
+};
+
+MBSTF_NAMESPACE_STOP
+
+/* vim:ts=8:sts=4:sw=4:expandtab:
+ */
+#endif /* _MBS_TF_HTTP_HEADERS_HH_ */
@@ -0,0 +1,68 @@
+#ifndef _MBS_TF_INGEST_PROGRESS_HH_
+#define _MBS_TF_INGEST_PROGRESS_HH_
+/******************************************************************************
+ * 5G-MAG Reference Tools: MBS Traffic Function: Ingest Progress class
+ ******************************************************************************
+ * Copyright: (C)2025 British Broadcasting Corporation
+ * Author(s): David Waring <david.waring2@bbc.co.uk>
+ * License: 5G-MAG Public License v1
+ *
+ * For full license terms please see the LICENSE file distributed with this
+ * program. If this file is missing then the license can be retrieved from
+ * https://drive.google.com/file/d/1cinCiA778IErENZ3JN52VFW-1ffHpx7Z/view
+ */
+
+#include <atomic>
+#include <cstddef>
+#include <limits>
+#include <optional>
+
+#include "common.hh"
+
+MBSTF_NAMESPACE_START
+
+/* Progress of an object that is still being received
+ *
+ * An ingester lists one of these in the ObjectStore with ObjectStore::addGrowingObject() when an object starts to
+ * arrive and keeps it up to date as the body comes in. The body itself stays in the ingester's own receive buffer
+ * until the complete object is added with ObjectStore::addObject(), anything else holding one only looks at the
+ * progress. Updates are lock free so that they can be made for every block received.
+ */
+class IngestProgress {
+public:
+    using size_type = std::size_t;
+
+    IngestProgress() :m_bytesReceived(0), m_transferLength(c_unknownLength), m_complete(false) {};
+    IngestProgress(const IngestProgress &) = delete;
+    IngestProgress(IngestProgress &&) = delete;
+
+    virtual ~IngestProgress() {};
+
+    IngestProgress &operator=(const IngestProgress &) = delete;
+    IngestProgress &operator=(IngestProgress &&) = delete;
+
+    IngestProgress &received(size_type size) { m_bytesReceived += size; return *this; };
+    IngestProgress &transferLength(size_type transfer_length) { m_transferLength = transfer_length; return *this; };
+    IngestProgress &complete() { m_transferLength = m_bytesReceived.load(); m_complete = true; return *this; };
+
+    size_type bytesReceived() const { return m_bytesReceived; };
+    std::optional<size_type> transferLength() const {
+        size_type transfer_length = m_transferLength;
+        if (transfer_length == c_unknownLength) return std::nullopt;
+        return transfer_length;
+    };
+    bool isComplete() const { return m_complete; };
+
+private:
+    static constexpr size_type c_unknownLength = std::numeric_limits<size_type>::max();
+
+    std::atomic<size_type> m_bytesReceived;
+    std::atomic<size_type> m_transferLength;
+    std::atomic_bool m_complete;
+};
+
+MBSTF_NAMESPACE_STOP
+
+/* vim:ts=8:sts=4:sw=4:expandtab:
+ */
+#endif /* _MBS_TF_INGEST_PROGRESS_HH_ */
@@ -0,0 +1,144 @@
+#ifndef _MBS_TF_MPSC_QUEUE_HH_
+#define _MBS_TF_MPSC_QUEUE_HH_
+/******************************************************************************
+ * 5G-MAG Reference Tools: MBS Traffic Function: Multi-producer, single-consumer queue
+ ******************************************************************************
+ * Copyright: (C)2025 British Broadcasting Corporation
+ * Author(s): David Waring <david.waring2@bbc.co.uk>
+ * License: 5G-MAG Public License v1
+ *
+ * For full license terms please see the LICENSE file distributed with this
+ * program. If this file is missing then the license can be retrieved from
+ * https://drive.google.com/file/d/1cinCiA778IErENZ3JN52VFW-1ffHpx7Z/view
+ */
+
+#include <atomic>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+#include "common.hh"
+
+MBSTF_NAMESPACE_START
+
+/* Multi-producer, single-consumer FIFO queue
+ *
+ * Entries go into a fixed size lock-free ring (bounded MPMC ring after D. Vyukov, with the consumer side simplified as
+ * there is only ever one consumer). Pushing never fails though: if the ring is full the entry goes on a mutex guarded
+ * overflow list instead, and all pushes use the overflow list until the consumer has emptied it, so that entries from
+ * any one producer stay in order. Only the ring is bounded, the overflow list is not, so the queue as a whole is
+ * unbounded. The ring should be sized so that the overflow list is only used in bursts.
+ *
+ * Any number of threads may push(), but only one thread at a time may pop(). pop() returns false while the next entry
+ * in the ring has been claimed by a push() that has not finished yet, even if there are entries behind it, as the
+ * consumer cannot tell which producer that entry belongs to. The producer is still inside push() at that point, so
+ * callers that reschedule the consumer after each push() will not miss the entry.
+ */
+template <class T>
+class MPSCQueue {
+public:
+    MPSCQueue(std::size_t capacity = 1024)
+        :m_cells()
+        ,m_mask(0)
+        ,m_enqueuePos(0)
+        ,m_dequeuePos(0)
+        ,m_overflowing(false)
+        ,m_overflowMutex()
+        ,m_overflow()
+    {
+        std::size_t size = 2;
+        while (size < capacity) size <<= 1;
+        m_cells.reset(new Cell[size]);
+        for (std::size_t i = 0; i < size; i++) {
+            m_cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+        m_mask = size - 1;
+    };
+    MPSCQueue(const MPSCQueue &) = delete;
+    MPSCQueue(MPSCQueue &&) = delete;
+    virtual ~MPSCQueue() {};
+
+    MPSCQueue &operator=(const MPSCQueue &) = delete;
+    MPSCQueue &operator=(MPSCQueue &&) = delete;
+
+    std::size_t capacity() const { return m_mask + 1; };
+
+    void push(T &&value) {
+        if (!m_overflowing.load(std::memory_order_acquire) && tryPush(value)) return;
+        std::lock_guard<std::mutex> guard(m_overflowMutex);
+        m_overflow.push_back(std::move(value));
+        m_overflowing.store(true, std::memory_order_release);
+    };
+
+    bool pop(T &value) {
+        if (tryPop(value)) return true;
+        if (!m_overflowing.load(std::memory_order_acquire)) return false;
+        std::lock_guard<std::mutex> guard(m_overflowMutex);
+        // ring entries pushed before the overflow started must go first, including ones still being pushed
+        if (tryPop(value)) return true;
+        if (m_enqueuePos.load(std::memory_order_acquire) != m_dequeuePos.load(std::memory_order_relaxed)) return false;
+        if (m_overflow.empty()) {
+            m_overflowing.store(false, std::memory_order_release);
+            return false;
+        }
+        value = std::move(m_overflow.front());
+        m_overflow.pop_front();
+        if (m_overflow.empty()) m_overflowing.store(false, std::memory_order_release);
+        return true;
+    };
+
+private:
+    struct Cell {
+        Cell() :sequence(0), value() {};
+
+        std::atomic<std::size_t> sequence;
+        T value;
+    };
+
+    bool tryPush(T &value) {
+        std::size_t pos = m_enqueuePos.load(std::memory_order_relaxed);
+        Cell *cell;
+        while (true) {
+            cell = &m_cells[pos & m_mask];
+            std::size_t seq = cell->sequence.load(std::memory_order_acquire);
+            std::ptrdiff_t diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos);
+            if (diff == 0) {
+                if (m_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+            } else if (diff < 0) {
+                return false; // full
+            } else {
+                pos = m_enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+        cell->value = std::move(value);
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    };
+
+    bool tryPop(T &value) {
+        std::size_t pos = m_dequeuePos.load(std::memory_order_relaxed);
+        Cell &cell(m_cells[pos & m_mask]);
+        if (cell.sequence.load(std::memory_order_acquire) != pos + 1) return false; // empty, or push still in progress
+        value = std::move(cell.value);
+        cell.value = T();
+        cell.sequence.store(pos + m_mask + 1, std::memory_order_release);
+        m_dequeuePos.store(pos + 1, std::memory_order_relaxed);
+        return true;
+    };
+
+    std::unique_ptr<Cell[]> m_cells;
+    std::size_t m_mask;
+    alignas(64) std::atomic<std::size_t> m_enqueuePos;
+    alignas(64) std::atomic<std::size_t> m_dequeuePos; // only changed by the consumer
+    alignas(64) std::atomic_bool m_overflowing;
+    std::mutex m_overflowMutex;
+    std::deque<T> m_overflow;
+};
+
+MBSTF_NAMESPACE_STOP
+
+/* vim:ts=8:sts=4:sw=4:expandtab:
+ */
+#endif /* _MBS_TF_MPSC_QUEUE_HH_ */
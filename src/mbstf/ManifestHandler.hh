@@ -57,6 +57,8 @@ public:
     virtual std::pair<time_type, ingest_list> nextIngestItems() = 0;
     virtual durn_type getDefaultDeadline() = 0;
     virtual bool update(const ObjectStore::Object &new_manifest) = 0;
+    // The manifest was revalidated with the origin and is unchanged, returns true if there is more to schedule
+    virtual bool refreshed(const ObjectStore::Object &manifest) { return false; };
 
 protected:
    ObjectController *m_controller;
@@ -51,7 +51,7 @@ bool ManifestHandlerFactory::registerManifestHandler(const std::string &content_
 
 ManifestHandler *ManifestHandlerFactory::makeManifestHandler(const ObjectStore::Object &object, ObjectController *controller, bool pull_distribution)
 {
-    std::string media_type = object.second.mediaType();
+    std::string media_type = object.metadata().mediaType();
     // Try manifest handlers for the media type of the object, fallback to any media type (empty string)
     while (true) {
         auto it = constructorsByContentType().find(media_type);
@@ -0,0 +1,161 @@
+/******************************************************************************
+ * 5G-MAG Reference Tools: MBS Traffic Function: Memory mapped Object Buffer class
+ ******************************************************************************
+ * Copyright: (C)2025 British Broadcasting Corporation
+ * Author(s): David Waring <david.waring2@bbc.co.uk>
+ * License: 5G-MAG Public License v1
+ *
+ * For full license terms please see the LICENSE file distributed with this
+ * program. If this file is missing then the license can be retrieved from
+ * https://drive.google.com/file/d/1cinCiA778IErENZ3JN52VFW-1ffHpx7Z/view
+ */
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "common.hh"
+
+#include "MappedObjectBuffer.hh"
+
+MBSTF_NAMESPACE_START
+
+MappedObjectBuffer::MappedObjectBuffer(const std::string &spool_directory)
+    :ObjectBuffer()
+    ,m_fd(-1)
+    ,m_bytesWritten(0)
+    ,m_mapping(MAP_FAILED)
+    ,m_sealed(false)
+{
+    std::string path_template(spool_directory + "/mbstf-object-XXXXXX");
+    std::vector<char> path(path_template.begin(), path_template.end());
+    path.push_back('\0');
+
+    m_fd = mkostemp(path.data(), O_CLOEXEC);
+    if (m_fd < 0) {
+        throw std::system_error(errno, std::generic_category(), "Unable to create spool file in " + spool_directory);
+    }
+    // Unlink straight away so the space is reclaimed when the last handle goes, even if we crash
+    unlink(path.data());
+}
+
+MappedObjectBuffer::MappedObjectBuffer(int fd, size_type size)
+    :ObjectBuffer()
+    ,m_fd(fd)
+    ,m_bytesWritten(size)
+    ,m_mapping(MAP_FAILED)
+    ,m_sealed(false)
+{
+}
+
+std::shared_ptr<MappedObjectBuffer> MappedObjectBuffer::mapFile(const std::string &path)
+{
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        throw std::system_error(errno, std::generic_category(), "Unable to open " + path);
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        int err = errno;
+        close(fd);
+        throw std::system_error(err, std::generic_category(), "Unable to stat " + path);
+    }
+
+    std::shared_ptr<MappedObjectBuffer> buffer(new MappedObjectBuffer(fd, st.st_size));
+    buffer->seal();
+    return buffer;
+}
+
+MappedObjectBuffer::~MappedObjectBuffer()
+{
+    if (m_mapping != MAP_FAILED) munmap(m_mapping, m_bytesWritten);
+    if (m_fd >= 0) close(m_fd);
+}
+
+MappedObjectBuffer &MappedObjectBuffer::append(const value_type *data, size_type size)
+{
+    if (m_sealed) throw std::logic_error("Attempt to append to a sealed MappedObjectBuffer");
+
+    while (size > 0) {
+        ssize_t written = ::write(m_fd, data, size);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            throw std::system_error(errno, std::generic_category(), "Unable to write to spool file");
+        }
+        data += written;
+        size -= written;
+        m_bytesWritten += written;
+    }
+
+    return *this;
+}
+
+MappedObjectBuffer &MappedObjectBuffer::resize(size_type size)
+{
+    if (m_sealed) throw std::logic_error("Attempt to resize a sealed MappedObjectBuffer");
+
+    // Any new space is a hole in the file until written, so this doesn't use any disk space yet
+    if (ftruncate(m_fd, size) < 0 || lseek(m_fd, size, SEEK_SET) < 0) {
+        throw std::system_error(errno, std::generic_category(), "Unable to resize spool file");
+    }
+    m_bytesWritten = size;
+
+    return *this;
+}
+
+MappedObjectBuffer &MappedObjectBuffer::write(size_type offset, const value_type *data, size_type size)
+{
+    if (m_sealed) throw std::logic_error("Attempt to write to a sealed MappedObjectBuffer");
+    if (offset > m_bytesWritten || size > m_bytesWritten - offset) {
+        throw std::out_of_range("Write beyond the end of a MappedObjectBuffer");
+    }
+
+    while (size > 0) {
+        ssize_t written = pwrite(m_fd, data, size, offset);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            throw std::system_error(errno, std::generic_category(), "Unable to write to spool file");
+        }
+        data += written;
+        size -= written;
+        offset += written;
+    }
+
+    return *this;
+}
+
+MappedObjectBuffer &MappedObjectBuffer::seal()
+{
+    if (m_sealed) return *this;
+
+    if (m_bytesWritten > 0) {
+        m_mapping = mmap(nullptr, m_bytesWritten, PROT_READ, MAP_SHARED, m_fd, 0);
+        if (m_mapping == MAP_FAILED) {
+            throw std::system_error(errno, std::generic_category(), "Unable to map spool file");
+        }
+        // The FLUTE transmitter reads the object front to back
+        madvise(m_mapping, m_bytesWritten, MADV_SEQUENTIAL);
+        view(reinterpret_cast<const value_type*>(m_mapping), m_bytesWritten);
+    }
+
+    // The mapping keeps the file alive, we don't need the descriptor anymore
+    close(m_fd);
+    m_fd = -1;
+    m_sealed = true;
+
+    return *this;
+}
+
+MBSTF_NAMESPACE_STOP
+
+/* vim:ts=8:sts=4:sw=4:expandtab:
+ */
@@ -0,0 +1,76 @@
+#ifndef _MBS_TF_MAPPED_OBJECT_BUFFER_HH_
+#define _MBS_TF_MAPPED_OBJECT_BUFFER_HH_
+/******************************************************************************
+ * 5G-MAG Reference Tools: MBS Traffic Function: Memory mapped Object Buffer class
+ ******************************************************************************
+ * Copyright: (C)2025 British Broadcasting Corporation
+ * Author(s): David Waring <david.waring2@bbc.co.uk>
+ * License: 5G-MAG Public License v1
+ *
+ * For full license terms please see the LICENSE file distributed with this
+ * program. If this file is missing then the license can be retrieved from
+ * https://drive.google.com/file/d/1cinCiA778IErENZ3JN52VFW-1ffHpx7Z/view
+ */
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "common.hh"
+#include "ObjectBuffer.hh"
+
+MBSTF_NAMESPACE_START
+
+/* Object payload spilled to a file in the spool directory
+ *
+ * The payload is written to an anonymous (already unlinked) spool file with append() and then seal() maps the file
+ * read-only. Once sealed the buffer is immutable and data() points into the mapping, so the object only occupies
+ * page cache which the kernel can reclaim, rather than process heap.
+ *
+ * Instead of appending, the file can be resize()d to the full payload size and filled in any order with write(), e.g.
+ * from byte ranges fetched in parallel. Writes to different parts of the file may be made from different threads.
+ * write() throws std::out_of_range for bytes beyond the size of the file.
+ *
+ * mapFile() gives a sealed buffer for an existing file, which can then be renamed or removed but must not be changed.
+ *
+ * Errors creating, writing or mapping the spool file throw std::system_error.
+ */
+class MappedObjectBuffer : public ObjectBuffer {
+public:
+    MappedObjectBuffer() = delete;
+    MappedObjectBuffer(const std::string &spool_directory);
+    MappedObjectBuffer(const MappedObjectBuffer &) = delete;
+    MappedObjectBuffer(MappedObjectBuffer &&) = delete;
+
+    virtual ~MappedObjectBuffer();
+
+    MappedObjectBuffer &operator=(const MappedObjectBuffer &) = delete;
+    MappedObjectBuffer &operator=(MappedObjectBuffer &&) = delete;
+
+    static std::shared_ptr<MappedObjectBuffer> mapFile(const std::string &path);
+
+    MappedObjectBuffer &append(const value_type *data, size_type size);
+    MappedObjectBuffer &append(const std::vector<value_type> &data) { return append(data.data(), data.size()); };
+    MappedObjectBuffer &resize(size_type size); // appends continue from the new end of the file
+    MappedObjectBuffer &write(size_type offset, const value_type *data, size_type size);
+    MappedObjectBuffer &seal();
+
+    bool isSealed() const { return m_sealed; };
+    size_type bytesWritten() const { return m_bytesWritten; };
+
+    virtual size_type residentSize() const { return 0; };
+
+private:
+    MappedObjectBuffer(int fd, size_type size); // takes ownership of fd
+
+    int m_fd;
+    size_type m_bytesWritten;
+    void *m_mapping;
+    bool m_sealed;
+};
+
+MBSTF_NAMESPACE_STOP
+
+/* vim:ts=8:sts=4:sw=4:expandtab:
+ */
+#endif /* _MBS_TF_MAPPED_OBJECT_BUFFER_HH_ */
@@ -0,0 +1,61 @@
+/******************************************************************************
+ * 5G-MAG Reference Tools: MBS Traffic Function: Object Buffer class
+ ******************************************************************************
+ * Copyright: (C)2025 British Broadcasting Corporation
+ * Author(s): David Waring <david.waring2@bbc.co.uk>
+ * License: 5G-MAG Public License v1
+ *
+ * For full license terms please see the LICENSE file distributed with this
+ * program. If this file is missing then the license can be retrieved from
+ * https://drive.google.com/file/d/1cinCiA778IErENZ3JN52VFW-1ffHpx7Z/view
+ */
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "common.hh"
+
+#include "ObjectBuffer.hh"
+
+MBSTF_NAMESPACE_START
+
+ObjectBuffer::ObjectBuffer()
+    :m_data()
+    ,m_view(nullptr)
+    ,m_viewSize(0)
+{
+}
+
+ObjectBuffer::ObjectBuffer(std::vector<value_type> &&data)
+    :m_data(std::move(data))
+    ,m_view(m_data.data())
+    ,m_viewSize(m_data.size())
+{
+}
+
+ObjectBuffer::ObjectBuffer(const value_type *data, size_type size)
+    :m_data(data, data + size)
+    ,m_view(m_data.data())
+    ,m_viewSize(m_data.size())
+{
+}
+
+ObjectBuffer::~ObjectBuffer()
+{
+}
+
+bool ObjectBuffer::operator==(const ObjectBuffer &other) const
+{
+    return size() == other.size() && std::equal(begin(), end(), other.begin());
+}
+
+bool ObjectBuffer::operator==(const std::vector<value_type> &other) const
+{
+    return size() == other.size() && std::equal(begin(), end(), other.begin());
+}
+
+MBSTF_NAMESPACE_STOP
+
+/* vim:ts=8:sts=4:sw=4:expandtab:
+ */
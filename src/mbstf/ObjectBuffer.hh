@@ -0,0 +1,75 @@
+#ifndef _MBS_TF_OBJECT_BUFFER_HH_
+#define _MBS_TF_OBJECT_BUFFER_HH_
+/******************************************************************************
+ * 5G-MAG Reference Tools: MBS Traffic Function: Object Buffer class
+ ******************************************************************************
+ * Copyright: (C)2025 British Broadcasting Corporation
+ * Author(s): David Waring <david.waring2@bbc.co.uk>
+ * License: 5G-MAG Public License v1
+ *
+ * For full license terms please see the LICENSE file distributed with this
+ * program. If this file is missing then the license can be retrieved from
+ * https://drive.google.com/file/d/1cinCiA778IErENZ3JN52VFW-1ffHpx7Z/view
+ */
+
+#include <cstddef>
+#include <vector>
+
+#include "common.hh"
+
+MBSTF_NAMESPACE_START
+
+/* Immutable object payload
+ *
+ * The ObjectStore hands these out as std::shared_ptr<const ObjectBuffer> so that the bytes stay valid for as long as
+ * any packager, manifest handler or transmitter holds on to them, regardless of what happens to the store entry.
+ *
+ * This base class keeps the payload in memory, subclasses can provide the bytes from elsewhere (e.g. a file mapping)
+ * by setting the view onto their storage.
+ */
+class ObjectBuffer {
+public:
+    using value_type = unsigned char;
+    using size_type = std::size_t;
+    using const_iterator = const value_type*;
+
+    ObjectBuffer();
+    ObjectBuffer(std::vector<value_type> &&data);
+    ObjectBuffer(const value_type *data, size_type size);
+    ObjectBuffer(const ObjectBuffer &) = delete;
+    ObjectBuffer(ObjectBuffer &&) = delete;
+
+    virtual ~ObjectBuffer();
+
+    ObjectBuffer &operator=(const ObjectBuffer &) = delete;
+    ObjectBuffer &operator=(ObjectBuffer &&) = delete;
+
+    const value_type *data() const { return m_view; };
+    size_type size() const { return m_viewSize; };
+    bool empty() const { return size() == 0; };
+
+    // Number of bytes of process memory this buffer pins, used for ObjectStore memory accounting
+    virtual size_type residentSize() const { return size(); };
+
+    const_iterator begin() const { return data(); };
+    const_iterator end() const { return data() + size(); };
+
+    std::vector<value_type> toVector() const { return std::vector<value_type>(begin(), end()); };
+
+    bool operator==(const ObjectBuffer &other) const;
+    bool operator==(const std::vector<value_type> &other) const;
+
+protected:
+    ObjectBuffer &view(const value_type *data, size_type size) { m_view = data; m_viewSize = size; return *this; };
+
+private:
+    std::vector<value_type> m_data;
+    const value_type *m_view;
+    size_type m_viewSize;
+};
+
+MBSTF_NAMESPACE_STOP
+
+/* vim:ts=8:sts=4:sw=4:expandtab:
+ */
+#endif /* _MBS_TF_OBJECT_BUFFER_HH_ */
@@ -46,8 +46,8 @@ const std::shared_ptr<PushObjectIngester> &ObjectController::setPushIngester(Pus
 }
 
 void ObjectController::processEvent(Event &event, SubscriptionService &event_service) {
-    if (event.eventName() == "ObjectSendCompleted") {
-	ObjectPackager::ObjectSendCompleted &objSendEvent = dynamic_cast<ObjectPackager::ObjectSendCompleted&>(event);
+    if (event.is<ObjectPackager::ObjectSendCompleted>()) {
+	ObjectPackager::ObjectSendCompleted &objSendEvent = event.as<ObjectPackager::ObjectSendCompleted>();
         std::string object_id = objSendEvent.objectId();
         ogs_info("Object [%s] sent", object_id.c_str());
 
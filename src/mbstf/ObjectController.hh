@@ -12,6 +12,7 @@
  * https://drive.google.com/file/d/1cinCiA778IErENZ3JN52VFW-1ffHpx7Z/view
  */
 
+#include <atomic>
 #include <memory>
 #include <list>
 
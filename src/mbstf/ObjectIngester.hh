@@ -13,9 +13,11 @@
  */
 
 
-#include "common.hh"
-#include <thread>
 #include <atomic>
+#include <chrono>
+
+#include "common.hh"
+#include "ReactorTask.hh"
 
 MBSTF_NAMESPACE_START
 
@@ -26,13 +28,12 @@ class ObjectIngester {
 public:
     ObjectIngester() = delete;
     ObjectIngester(ObjectStore &objectStore, ObjectController &controller)
-        : m_objectStore(objectStore), m_controller(controller), m_workerThread(), m_workerCancel(false) {}
+        : m_objectStore(objectStore), m_controller(controller), m_ingestTask([this]() { doObjectIngest(); })
+        , m_workerCancel(false) {}
 
     void abort() {
 	m_workerCancel = true;
-        if (m_workerThread.get_id() != std::this_thread::get_id() && m_workerThread.joinable()) {
-	    m_workerThread.join();
-        }
+        m_ingestTask.cancel();
     }
 
     virtual ~ObjectIngester() {
@@ -46,15 +47,18 @@ protected:
     const ObjectStore &objectStore() const { return m_objectStore; }
     ObjectController &controller() { return m_controller; }
     const ObjectController &controller() const { return m_controller; }
-    void startWorker(){m_workerThread = std::thread(workerLoop, this);};
+
+    // doObjectIngest() runs on the shared Reactor each time the worker is woken, it should not loop or wait itself
+    void startWorker() { wakeWorker(); };
+    void wakeWorker() { if (!m_workerCancel) m_ingestTask.wake(); };
+    void wakeWorkerAfter(const std::chrono::steady_clock::duration &delay) { if (!m_workerCancel) m_ingestTask.wakeAfter(delay); };
 
     virtual void doObjectIngest() = 0;
 
 private:
-    static void workerLoop(ObjectIngester*);
     ObjectStore &m_objectStore;
     ObjectController &m_controller;
-    std::thread m_workerThread;
+    ReactorTask m_ingestTask;
     std::atomic_bool m_workerCancel;
 };
 
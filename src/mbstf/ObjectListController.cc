@@ -80,10 +80,12 @@ std::shared_ptr<ObjectListPackager> ObjectListController::getObjectListPackager(
 }
 
 void ObjectListController::processEvent(Event &event, SubscriptionService &event_service) {
-    if (event.eventName() == "ObjectAdded") {
-        ObjectStore::ObjectAddedEvent &objAddedEvent = dynamic_cast<ObjectStore::ObjectAddedEvent&>(event);
+    if (event.is<ObjectStore::ObjectAddedEvent>()) {
+        ObjectStore::ObjectAddedEvent &objAddedEvent = event.as<ObjectStore::ObjectAddedEvent>();
         std::string objectId = objAddedEvent.objectId();
         ogs_info("Object added with ID: %s", objectId.c_str());
+        // Already queued with the packager when it started to grow
+        if (objAddedEvent.wasGrowing()) return;
 
         ObjectListPackager::PackageItem item(objectId);
         std::shared_ptr<ObjectListPackager> packager(getObjectListPackager());
@@ -92,8 +94,46 @@ void ObjectListController::processEvent(Event &event, SubscriptionService &event
         } else {
             ogs_error("ObjectListPackager is not initialized.");
         }
-    } else if (event.eventName() == "ObjectPushStart") {
-        PushObjectIngester::ObjectPushEvent &obj_push_event = dynamic_cast<PushObjectIngester::ObjectPushEvent&>(event);
+    } else if (event.is<ObjectStore::ObjectGrowingEvent>()) {
+        ObjectStore::ObjectGrowingEvent &obj_growing_event = event.as<ObjectStore::ObjectGrowingEvent>();
+        ogs_debug("Object growing with ID: %s", obj_growing_event.objectId().c_str());
+
+        // Queue it now, the packager holds it back until it is complete
+        ObjectListPackager::PackageItem item(obj_growing_event.objectId());
+        std::shared_ptr<ObjectListPackager> packager(getObjectListPackager());
+        if (packager) {
+            packager->add(item);
+        } else {
+            ogs_error("ObjectListPackager is not initialized.");
+        }
+    } else if (event.is<ObjectStore::ObjectsAddedEvent>()) {
+        ObjectStore::ObjectsAddedEvent &objs_added_event = event.as<ObjectStore::ObjectsAddedEvent>();
+        ogs_info("%zu objects added", objs_added_event.objectIds().size());
+
+        std::list<ObjectListPackager::PackageItem> items;
+        for (const auto &object_id : objs_added_event.objectIds()) {
+            items.emplace_back(object_id);
+        }
+        std::shared_ptr<ObjectListPackager> packager(getObjectListPackager());
+        if (packager) {
+            packager->add(std::move(items));
+        } else {
+            ogs_error("ObjectListPackager is not initialized.");
+        }
+    } else if (event.is<ObjectStore::ObjectRefreshedEvent>()) {
+        ObjectStore::ObjectRefreshedEvent &obj_refreshed_event = event.as<ObjectStore::ObjectRefreshedEvent>();
+        ogs_debug("Object refreshed with ID: %s", obj_refreshed_event.objectId().c_str());
+
+        // Unchanged at the origin but fetched again, so send it again
+        ObjectListPackager::PackageItem item(obj_refreshed_event.objectId());
+        std::shared_ptr<ObjectListPackager> packager(getObjectListPackager());
+        if (packager) {
+            packager->add(item);
+        } else {
+            ogs_error("ObjectListPackager is not initialized.");
+        }
+    } else if (event.is<PushObjectIngester::ObjectPushEvent::Start>()) {
+        PushObjectIngester::ObjectPushEvent &obj_push_event = event.as<PushObjectIngester::ObjectPushEvent>();
         const PushObjectIngester::Request &request(obj_push_event.request());
         const std::optional<std::string> &content_type(request.contentType());
         const std::string &url(request.urlPath());
@@ -163,7 +203,7 @@ void ObjectListController::initPushObjectIngester()
     PushObjectIngester *pushIngester = new PushObjectIngester(objectStore(), *this);
 
     distributionSession().setObjectIngestBaseUrl(pushIngester->getIngestServerPrefix());
-    subscribeTo({"ObjectPushStart"}, *pushIngester);
+    subscribeTo<PushObjectIngester::ObjectPushEvent::Start>(*pushIngester);
     setPushIngester(pushIngester);
 }
 
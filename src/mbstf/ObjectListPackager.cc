@@ -20,10 +20,13 @@
 
 #include <netinet/in.h>
 
+#include <boost/asio/post.hpp>
+
 #include "ogs-app.h" // ogs_error(), ogs_info()
 #include "Transmitter.h" // LibFlute
 
 #include "common.hh"
+#include "ObjectBuffer.hh"
 #include "ObjectController.hh"
 #include "ObjectListController.hh"
 #include "ObjectPackager.hh"
@@ -64,6 +67,7 @@ ObjectListPackager::ObjectListPackager(ObjectStore &object_store, ObjectControll
     ,m_tunnelEndpoint()
     ,m_packageItemsMutex (new std::recursive_mutex)
 {
+    for (const auto &item : m_packageItems) objectStore().holdForSending(item.objectId());
     sortListByPolicy();
     if (tunnel_address) {
         m_tunnelEndpoint = boost::asio::ip::udp::endpoint(boost::asio::ip::address::from_string(tunnel_address.value()), tunnel_port);
@@ -79,6 +83,7 @@ ObjectListPackager::ObjectListPackager(ObjectStore &object_store, ObjectControll
     ,m_tunnelEndpoint()
     ,m_packageItemsMutex (new std::recursive_mutex)
 {
+    for (const auto &item : m_packageItems) objectStore().holdForSending(item.objectId());
     sortListByPolicy();
     if (tunnel_address) {
         m_tunnelEndpoint = boost::asio::ip::udp::endpoint(boost::asio::ip::address::from_string(tunnel_address.value()), tunnel_port);
@@ -102,20 +107,40 @@ ObjectListPackager::ObjectListPackager(ObjectStore &object_store, ObjectControll
 
 ObjectListPackager::~ObjectListPackager() {
     abort();
-    if (m_transmitter) delete m_transmitter;
+    ogs_debug("ObjectListPackager %p: packaging worker woken %llu times", static_cast<void*>(this),
+              static_cast<unsigned long long>(workerWakeups()));
+    destroyTransmitter();
+    for (const auto &[object_id, listener_id] : m_growingListeners) {
+        objectStore().cancelNotifyWhenAdded(object_id, listener_id);
+    }
+    for (const auto &item : m_packageItems) objectStore().releaseSendHold(item.objectId());
+    if (m_queued) objectStore().releaseSendHold(m_queuedObjectId);
 }
 
 bool ObjectListPackager::add(const PackageItem &item) {
     std::lock_guard<std::recursive_mutex> lock(*m_packageItemsMutex);
+    objectStore().holdForSending(item.objectId());
     m_packageItems.push_back(item);
     sortListByPolicy();
+    wakeWorker();
     return true;
 }
 
 bool ObjectListPackager::add(PackageItem &&item) {
     std::lock_guard<std::recursive_mutex> lock(*m_packageItemsMutex);
+    objectStore().holdForSending(item.objectId());
     m_packageItems.push_back(std::move(item));
     sortListByPolicy();
+    wakeWorker();
+    return true;
+}
+
+bool ObjectListPackager::add(std::list<PackageItem> &&items) {
+    std::lock_guard<std::recursive_mutex> lock(*m_packageItemsMutex);
+    for (const auto &item : items) objectStore().holdForSending(item.objectId());
+    m_packageItems.splice(m_packageItems.end(), items);
+    sortListByPolicy();
+    wakeWorker();
     return true;
 }
 
@@ -132,16 +157,20 @@ void ObjectListPackager::doObjectPackage() {
                     0,
                     mtu(),
                     rateLimit(),
-                    m_io,
+                    m_fluteIo,
                     m_tunnelEndpoint,
                     LibFlute::FileDeliveryTable::FDT_NS_DRAFT_2005);
                 m_transmitter->register_completion_callback(
                     [this](uint32_t toi) {
-                        if (m_queuedToi == toi) {
+                        std::lock_guard<std::recursive_mutex> lock(*m_packageItemsMutex);
+                        if (m_queued && m_queuedToi == toi) {
 
                             m_queued = false;
+                            m_queuedObjectBuffer.reset();
+                            objectStore().releaseSendHold(m_queuedObjectId);
 			    objectSendCompletion(m_queuedObjectId);
                             ogs_info("Transmitted: Object with TOI: %d", toi);
+                            wakeWorker();
                         } else {
                             ogs_error("Unscheduled completion of Object with TOI: %d", toi);
                         }
@@ -150,56 +179,107 @@ void ObjectListPackager::doObjectPackage() {
 
 
                 );
+                startTransmitterThread();
 
                 // emitFluteSessionStartedEvent();
             }
+            std::optional<ObjectStore::Object> object;
             {
                 std::lock_guard<std::recursive_mutex> lock(*m_packageItemsMutex);
-
-                if (!m_packageItems.empty() && !m_queued) {
-
-                    auto &item = m_packageItems.front();
-	            m_packageItemsMutex->unlock();
-                    std::string location;
-		    m_queuedObjectId = item.objectId();
-                    std::vector<unsigned char> &objData = objectStore().getObjectData(item.objectId());
-                    const ObjectStore::Metadata &metadata = objectStore().getMetadata(item.objectId());
-                    std::string obj_ingest_base_url = metadata.objIngestBaseUrl().value_or(std::string());
-                    std::string obj_distribution_base_url = metadata.objDistributionBaseUrl().value_or(std::string());
-
-                    // If we need to substitute objIngestBaseUrl for objDistributionBaseUrl then do so
-                    if (!obj_ingest_base_url.empty() && !obj_distribution_base_url.empty() &&
-                        metadata.getFetchedUrl().starts_with(obj_ingest_base_url)) {
-                        location = obj_distribution_base_url + metadata.getFetchedUrl().substr(obj_ingest_base_url.size());
+                if (m_queued) return;
+
+                // Send the first object that is complete, any still being received keep their place in the queue
+                auto it = m_packageItems.begin();
+                while (!object && it != m_packageItems.end()) {
+                    if (waitingForGrowingObject(it->objectId())) {
+                        ++it;
+                        continue;
+                    }
+                    object = objectStore().findObject(it->objectId());
+                    if (object) {
+                        m_queuedObjectId = it->objectId();
+                        m_queued = true;
                     } else {
-                        // Just use the fetched URL
-                        location = metadata.getFetchedUrl();
+                        ogs_warn("Object [%s] was removed from the store before it could be sent",
+                                 it->objectId().c_str());
+                        objectStore().releaseSendHold(it->objectId());
                     }
+                    it = m_packageItems.erase(it);
+                }
+            }
+            if (!object) return;
+
+            std::string location;
+            m_queuedObjectBuffer = object->buffer();
+            const ObjectStore::Metadata &metadata = object->metadata();
+            std::string obj_ingest_base_url = metadata.objIngestBaseUrl().value_or(std::string());
+            std::string obj_distribution_base_url = metadata.objDistributionBaseUrl().value_or(std::string());
+
+            // If we need to substitute objIngestBaseUrl for objDistributionBaseUrl then do so
+            if (!obj_ingest_base_url.empty() && !obj_distribution_base_url.empty() &&
+                metadata.getFetchedUrl().starts_with(obj_ingest_base_url)) {
+                location = obj_distribution_base_url + metadata.getFetchedUrl().substr(obj_ingest_base_url.size());
+            } else {
+                // Just use the fetched URL
+                location = metadata.getFetchedUrl();
+            }
 
-                    m_queued = true;
+            // Hand the object to the Transmitter on its own thread, its completion callback is called there too
+            boost::asio::post(m_fluteIo, [this, location = std::move(location), media_type = metadata.mediaType(),
+                                          cache_expires = metadata.cacheExpires()]() {
+                try {
                     uint64_t expires_in;
-                    const auto &cache_expires = metadata.cacheExpires();
-                    if (cache_expires) {
+                    if (cache_expires && cache_expires.value() > std::chrono::system_clock::now()) {
                         expires_in = std::chrono::duration_cast<std::chrono::seconds>(cache_expires.value().time_since_epoch()).count() + 2208988800;
+                    } else if (cache_expires) {
+                        // Held past its expiry while queued, the FDT must not say the object expired before it was sent
+                        expires_in = m_transmitter->seconds_since_epoch() + ObjectStore::Metadata::cacheMinimumHold();
                     } else {
                         expires_in = m_transmitter->seconds_since_epoch() + 60;
                     }
-                    m_queuedToi = m_transmitter->send(location, metadata.mediaType(),
-                            expires_in,
-                            reinterpret_cast<char*>(objData.data()),
-                            objData.size()
+                    uint32_t toi = m_transmitter->send(location, media_type, expires_in,
+                            const_cast<char*>(reinterpret_cast<const char*>(m_queuedObjectBuffer->data())),
+                            m_queuedObjectBuffer->size()
                     );
-                    m_packageItemsMutex->lock();
-                    m_packageItems.pop_front();
+                    std::lock_guard<std::recursive_mutex> lock(*m_packageItemsMutex);
+                    m_queuedToi = toi;
+                } catch (std::exception &ex) {
+                    ogs_error("Unable to send object [%s], will retry in %llds: %s", m_queuedObjectId.c_str(),
+                              static_cast<long long>(std::chrono::duration_cast<std::chrono::seconds>(c_retryInterval).count()),
+                              ex.what());
+                    std::lock_guard<std::recursive_mutex> lock(*m_packageItemsMutex);
+                    m_queued = false;
+                    m_queuedObjectBuffer.reset();
+                    objectStore().releaseSendHold(m_queuedObjectId);
+                    wakeWorkerAfter(c_retryInterval);
                 }
-	    }
-
-            m_io.run_one();
+            });
         }
     } catch (std::exception &ex) {
-        ogs_error("Exiting on unhandled exception: %s", ex.what());
+        ogs_error("Unhandled exception while packaging, will retry in %llds: %s",
+                  static_cast<long long>(std::chrono::duration_cast<std::chrono::seconds>(c_retryInterval).count()),
+                  ex.what());
         // emitFluteSessionFailedEvent();
+        // Don't retry straight away, whatever went wrong is unlikely to have cleared up
+        wakeWorkerAfter(c_retryInterval);
+    }
+}
+
+bool ObjectListPackager::waitingForGrowingObject(const std::string &object_id)
+{
+    // Must be called with m_packageItemsMutex held. The store adds the complete object before it stops listing the
+    // growing one, so if this returns false the complete object is in the store or has gone for good.
+    auto it = m_growingListeners.find(object_id);
+    if (it == m_growingListeners.end()) {
+        ObjectStore::GrowingListenerId listener_id = objectStore().notifyWhenAdded(object_id, [this]() { wakeWorker(); });
+        if (listener_id == ObjectStore::c_noGrowingListener) return false;
+        ogs_debug("Object [%s] queued for sending as soon as it has all arrived", object_id.c_str());
+        m_growingListeners.emplace(object_id, listener_id);
+        return true;
     }
+    if (objectStore().findGrowingObject(object_id)) return true;
+    m_growingListeners.erase(it); // listener has been called
+    return false;
 }
 
 void ObjectListPackager::sortListByPolicy() {
@@ -213,7 +293,7 @@ void ObjectListPackager::sortListByPolicy() {
 
 void ObjectListPackager::objectSendCompletion(std::string &object_id)
 {
-    std::shared_ptr<Event> event(new ObjectListPackager::ObjectSendCompleted(object_id));
+    std::shared_ptr<Event> event(Event::make<ObjectListPackager::ObjectSendCompleted>(object_id));
     sendEventAsynchronous(event);
 }
 
@@ -13,7 +13,9 @@
  */
 
 #include <chrono>
+#include <cstdint>
 #include <list>
+#include <map>
 #include <memory>
 #include <optional>
 #include <string>
@@ -27,6 +29,7 @@
 
 MBSTF_NAMESPACE_START
 
+class ObjectBuffer;
 class ObjectController;
 class ObjectStore;
 
@@ -73,16 +76,23 @@ public:
 
     bool add(const PackageItem &item);
     bool add(PackageItem &&item);
+    bool add(std::list<PackageItem> &&items);
 
 protected:
     virtual void doObjectPackage();
 
 private:
+    // How long to wait before trying again after doObjectPackage() fails
+    static constexpr std::chrono::seconds c_retryInterval{5};
+
     void sortListByPolicy();
+    bool waitingForGrowingObject(const std::string &object_id);
     void objectSendCompletion(std::string &object_id);
     std::list<PackageItem> m_packageItems;
+    std::map<std::string, std::uint64_t> m_growingListeners; // ObjectStore::notifyWhenAdded() ids for queued objects
     std::optional<boost::asio::ip::udp::endpoint> m_tunnelEndpoint;
     std::unique_ptr<std::recursive_mutex> m_packageItemsMutex;
+    std::shared_ptr<const ObjectBuffer> m_queuedObjectBuffer; // keeps the payload alive while FLUTE is sending it
 };
 
 MBSTF_NAMESPACE_STOP
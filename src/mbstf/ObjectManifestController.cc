@@ -11,6 +11,7 @@
  */
 
 #include <exception>
+#include <chrono>
 #include <iostream>
 #include <list>
 #include <memory>
@@ -22,6 +23,7 @@
 #include "ogs-app.h"
 
 #include "common.hh"
+#include "CurlFetchEngine.hh"
 #include "DistributionSession.hh"
 #include "Event.hh"
 #include "ObjectController.hh"
@@ -43,8 +45,12 @@ static bool validate_push_acquisition_method(DistributionSession &distributionSe
 ObjectManifestController::ObjectManifestController(DistributionSession &dist_session)
         :ObjectController(dist_session)
         ,m_manifestHandler(nullptr)
-	,m_scheduledPullCancel(false)
-
+        ,m_manifestHandlerMutex()
+        ,m_scheduledPullTask([this]() { scheduledPull(); })
+        ,m_nextIngestItems()
+        ,m_fetchTimer(TimerWheel::c_noTimer)
+        ,m_manifestUpdated(false)
+        ,m_prewarmed(false)
 {
     validate_pull_acquisition_method(dist_session);
     validate_push_acquisition_method(dist_session);
@@ -95,7 +101,7 @@ void ObjectManifestController::initPushObjectIngester()
     PushObjectIngester *pushIngester = new PushObjectIngester(objectStore(), *this);
 
     distributionSession().setObjectIngestBaseUrl(pushIngester->getIngestServerPrefix());
-    subscribeTo({"ObjectPushStart"}, *pushIngester);
+    subscribeTo<PushObjectIngester::ObjectPushEvent::Start>(*pushIngester);
     setPushIngester(pushIngester);
 }
 
@@ -124,76 +130,97 @@ std::string ObjectManifestController::generateUUID()
     return std::string(uuid_str);
 }
 
-void ObjectManifestController::workerLoop(ObjectManifestController *controller)
+void ObjectManifestController::scheduledPull()
 {
+    // Woken again when the manifest handler is set
+    if (!manifestHandler()) return;
 
-    while (true) {
-        {
-            std::lock_guard<std::recursive_mutex> lock(controller->m_manifestHandlerMutex);
-            if ( controller->m_scheduledPullCancel || controller->m_manifestHandler != nullptr) {
-                break;
-            }
-        }
-        // Avoid a tight busy-loop: yield or sleep for a short time.
-        std::this_thread::sleep_for(std::chrono::milliseconds(10));
-    }
-
-    if (controller->m_scheduledPullCancel) return;
-
-    while (!controller->m_scheduledPullCancel) {
+    // Items not yet fetched came from the old manifest, work them out again
+    if (m_manifestUpdated.exchange(false)) m_nextIngestItems.reset();
 
-        std::pair<ManifestHandler::time_type, ManifestHandler::ingest_list> next_ingest_items;
+    if (!m_nextIngestItems) {
         // Get the next ingest items
 	try {
-            next_ingest_items = controller->manifestHandler()->nextIngestItems();
+            m_nextIngestItems = manifestHandler()->nextIngestItems();
 	} catch ( std::domain_error &err) {
 	    ogs_error("Next Ingest Item: %s", err.what());
+            return;
 	}
 
-	if(next_ingest_items.second.empty()) break;
+        m_prewarmed = false;
 
-	auto fetch_time = next_ingest_items.first; // Get fetch_time using .first
-
-	std::list<PullObjectIngester::IngestItem> urls;
+	if (m_nextIngestItems->second.empty()) {
+            // Nothing more to schedule until startWorker() is called again
+            m_nextIngestItems.reset();
+            return;
+        }
 
-        std::list<std::shared_ptr<PullObjectIngester>> &ingesters = controller->getPullObjectIngesters();
-	while(ingesters.size() < next_ingest_items.second.size()) {
-	    controller->addPullObjectIngester(new PullObjectIngester(controller->objectStore(), *controller, urls));
-	}
+        // One ingester will do, the CurlFetchEngine fetches its items in parallel
+        if (getPullObjectIngesters().empty()) {
+            addPullObjectIngester(new PullObjectIngester(objectStore(), *this,
+                                                         std::list<PullObjectIngester::IngestItem>()));
+        }
+    }
 
-        // Wait until the fetch_time
-	{
-            std::ostringstream oss;
-	    oss << fetch_time ;
-	    ogs_debug("Sleeping until...%s", oss.str().c_str());
-	}
-	std::this_thread::sleep_until(fetch_time);
-
-        // Add the URLs to the PullObjectIngester instances
-        for (auto ingester_it = ingesters.begin(); ingester_it!= ingesters.end(); ++ingester_it) {
-            if(next_ingest_items.second.empty()) break;
-            auto ingest_item = next_ingest_items.second.front();
-            next_ingest_items.second.pop_front();  // remove the item
-	    ingest_item.deadline(std::nullopt);
-            ingest_item.deadline(std::chrono::system_clock::now() + controller->manifestHandler()->getDefaultDeadline());
-            if (!(*ingester_it)->fetch(ingest_item)) {
-                ogs_debug("Failed to fetch item: %s", ingest_item.url().c_str());
+    // Wait until the fetch_time, warming up connections to the origins a little before
+    auto fetch_time = m_nextIngestItems->first;
+    auto now = std::chrono::system_clock::now();
+    if (fetch_time > now) {
+        auto wake_time = fetch_time;
+        if (!m_prewarmed) {
+            auto prewarm_time = fetch_time - CurlFetchEngine::prewarmLeadTime();
+            if (prewarm_time <= now) {
+                CurlFetchEngine &engine(CurlFetchEngine::instance());
+                for (auto &ingest_item : m_nextIngestItems->second) {
+                    engine.prewarm(ingest_item.url());
+                }
+                m_prewarmed = true;
+            } else {
+                wake_time = prewarm_time;
             }
-	}
+        }
+        std::ostringstream oss;
+        oss << wake_time ;
+        ogs_debug("Waiting until...%s", oss.str().c_str());
+        TimerWheel &timer_wheel(TimerWheel::instance());
+        if (m_fetchTimer == TimerWheel::c_noTimer || !timer_wheel.reschedule(m_fetchTimer, wake_time)) {
+            m_fetchTimer = timer_wheel.schedule(wake_time, [this]() { m_scheduledPullTask.wake(); });
+        }
+        return;
+    }
+    TimerWheel::instance().cancel(m_fetchTimer);
+    m_fetchTimer = TimerWheel::c_noTimer;
+
+    // Add the URLs to the PullObjectIngester
+    const std::shared_ptr<PullObjectIngester> &ingester(getPullObjectIngesters().front());
+    auto deadline = std::chrono::system_clock::now() + manifestHandler()->getDefaultDeadline();
+    for (auto &ingest_item : m_nextIngestItems->second) {
+        ingest_item.deadline(deadline);
+        if (!ingester->fetch(ingest_item)) {
+            ogs_debug("Failed to fetch item: %s", ingest_item.url().c_str());
+        }
     }
+    m_nextIngestItems.reset();
+
+    // Go round again for the next set of ingest items
+    m_scheduledPullTask.wake();
 }
 
 void ObjectManifestController::startWorker()
 {
-    if(m_scheduledPullThread.get_id() == std::thread::id()) {
-        m_scheduledPullThread = std::thread(&ObjectManifestController::workerLoop, this);
-    }
+    m_scheduledPullTask.wake();
+}
+
+void ObjectManifestController::manifestUpdated()
+{
+    m_manifestUpdated = true;
+    m_scheduledPullTask.wake();
 }
 
 void ObjectManifestController::processEvent(Event &event, SubscriptionService &event_service)
 {
-    if (event.eventName() == "ObjectPushStart") {
-        PushObjectIngester::ObjectPushEvent &obj_push_event = dynamic_cast<PushObjectIngester::ObjectPushEvent&>(event);
+    if (event.is<PushObjectIngester::ObjectPushEvent::Start>()) {
+        PushObjectIngester::ObjectPushEvent &obj_push_event = event.as<PushObjectIngester::ObjectPushEvent>();
         const PushObjectIngester::Request &request(obj_push_event.request());
         const std::optional<std::string> &content_type(request.contentType());
         const std::string &url(request.urlPath());
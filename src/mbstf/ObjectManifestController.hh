@@ -12,14 +12,20 @@
  * https://drive.google.com/file/d/1cinCiA778IErENZ3JN52VFW-1ffHpx7Z/view
  */
 
+#include <atomic>
 #include <memory>
 #include <list>
+#include <mutex>
+#include <optional>
+#include <utility>
 
 #include "common.hh"
 #include "ObjectController.hh"
 #include "ManifestHandler.hh"
 #include "DASHManifestHandler.hh"
+#include "ReactorTask.hh"
 #include "Subscriber.hh"
+#include "TimerWheel.hh"
 
 MBSTF_NAMESPACE_START
 
@@ -38,18 +44,14 @@ public:
         :ObjectController(dist_session)
 	,Subscriber()
         ,m_manifestHandler(nullptr)
-	,m_scheduledPullCancel(false)
         {};
 	*/
     ObjectManifestController(const ObjectManifestController&) = delete;
     ObjectManifestController(ObjectManifestController&&) = delete;
 
     void abort() {
-        m_scheduledPullCancel = true;
-        if (m_scheduledPullThread.joinable()) {
-            m_scheduledPullThread.join();
-        }
-
+        m_scheduledPullTask.cancel();
+        TimerWheel::instance().cancel(m_fetchTimer);
     }
 
     virtual ~ObjectManifestController() {
@@ -65,6 +67,7 @@ public:
 
 protected:
     void startWorker();
+    void manifestUpdated(); // recalculate pending fetches from the new manifest
     void initObjectIngester();
     void initPullObjectIngester();
     void initPushObjectIngester();
@@ -72,7 +75,7 @@ protected:
     ObjectManifestController &manifestHandler(std::unique_ptr<ManifestHandler> manifest_handler) {
         std::lock_guard guard(m_manifestHandlerMutex);
         m_manifestHandler = std::move(manifest_handler);
-        m_manifestHandlerChange.notify_all();
+        m_scheduledPullTask.wake();
         return *this;
     };
     ManifestHandler *manifestHandler() const {
@@ -84,15 +87,17 @@ protected:
 
 
 private:
-    static void workerLoop(ObjectManifestController *controller);
+    void scheduledPull();
     std::string generateUUID();
 
     std::string m_manifestUrl;
     std::unique_ptr<ManifestHandler> m_manifestHandler;
-    std::condition_variable_any m_manifestHandlerChange;
     mutable std::recursive_mutex m_manifestHandlerMutex;
-    std::thread m_scheduledPullThread;
-    std::atomic_bool m_scheduledPullCancel;
+    ReactorTask m_scheduledPullTask;
+    std::optional<std::pair<ManifestHandler::time_type, ManifestHandler::ingest_list> > m_nextIngestItems; // waiting for their fetch time
+    TimerWheel::TimerId m_fetchTimer; // wakes m_scheduledPullTask to pre-warm or fetch m_nextIngestItems
+    std::atomic_bool m_manifestUpdated;
+    bool m_prewarmed; // connections for m_nextIngestItems have been warmed up
 };
 
 MBSTF_NAMESPACE_STOP
@@ -10,7 +10,14 @@
  * https://drive.google.com/file/d/1cinCiA778IErENZ3JN52VFW-1ffHpx7Z/view
  */
 
+#include <exception>
+#include <thread>
+
+#include <boost/asio/executor_work_guard.hpp>
+
+#include "ogs-app.h" // ogs_error()
 #include "spdlog/spdlog.h"
+#include "Transmitter.h" // LibFlute
 
 #include "common.hh"
 #include "ObjectPackager.hh"
@@ -20,15 +27,9 @@ MBSTF_NAMESPACE_START
 // Prevent spdlog default logger being deleted too early on exit.
 auto spdlog_logger = spdlog::default_logger();
 
-void ObjectPackager::workerLoop(ObjectPackager *packager)
-{
-    while(!packager->m_workerCancel){
-       packager->doObjectPackage();
-    }
-}
-
 ObjectPackager& ObjectPackager::setDestIpAddr(const std::optional<std::string> &dest_ip_addr) {
     m_destIpAddr = dest_ip_addr;
+    wakeWorker();
     return *this;
 }
 
@@ -47,6 +48,31 @@ ObjectPackager& ObjectPackager::setRateLimit(uint32_t rateLimit) {
     return *this;
 }
 
+void ObjectPackager::startTransmitterThread()
+{
+    if (m_fluteThread.joinable()) return;
+    m_fluteThread = std::thread([this]() {
+        auto work_guard = boost::asio::make_work_guard(m_fluteIo);
+        while (!m_fluteIo.stopped()) {
+            try {
+                m_fluteIo.run();
+            } catch (std::exception &ex) {
+                ogs_error("Unhandled exception in FLUTE transmitter: %s", ex.what());
+            }
+        }
+    });
+}
+
+void ObjectPackager::destroyTransmitter()
+{
+    // Once the thread has stopped nothing is running on m_fluteIo, so the Transmitter can go. Any of its handlers left
+    // queued are destroyed, without being called, along with m_fluteIo.
+    m_fluteIo.stop();
+    if (m_fluteThread.joinable()) m_fluteThread.join();
+    delete m_transmitter;
+    m_transmitter = nullptr;
+}
+
 MBSTF_NAMESPACE_STOP
 
 /* vim:ts=8:sts=4:sw=4:expandtab:
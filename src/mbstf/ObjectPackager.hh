@@ -13,16 +13,19 @@
  */
 
 #include <atomic>
+#include <chrono>
+#include <cstdint>
 #include <memory>
 #include <optional>
 #include <thread>
 
 #include <netinet/in.h>
 
-#include <boost/asio/io_service.hpp>
+#include <boost/asio/io_context.hpp>
 
 #include "common.hh"
 #include "Event.hh"
+#include "ReactorTask.hh"
 #include "SubscriptionService.hh"
 
 namespace LibFlute{
@@ -39,8 +42,10 @@ class ObjectPackager: public SubscriptionService {
 public:
    class ObjectSendCompleted : public Event {
     public:
+        static constexpr const char c_eventName[] = "ObjectSendCompleted";
+
         ObjectSendCompleted(const std::string& object_id)
-            : Event("ObjectSendCompleted"), m_object_id(object_id) {}
+            : Event(typeIdOf<ObjectSendCompleted>()), m_object_id(object_id) {}
 
         std::string objectId() const { return m_object_id; }
         virtual ~ObjectSendCompleted() {};
@@ -55,18 +60,16 @@ public:
     ObjectPackager(const ObjectPackager &) = delete;
 
     ObjectPackager(ObjectStore &objectStore, ObjectController &controller, std::optional<std::string> destIpAddr = std::nullopt, uint32_t rateLimit = 0, unsigned short mtu = 0, in_port_t port = 0, const std::optional<std::string> &tunnel_address = std::nullopt, in_port_t tunnel_port = 0 )
-        :m_transmitter(nullptr), m_io(), m_queuedToi(0), m_queued(false), m_queuedObjectId()
+        :m_transmitter(nullptr), m_packageTask([this]() { doObjectPackage(); }), m_fluteIo(1), m_fluteThread()
+        ,m_queuedToi(0), m_queued(false), m_queuedObjectId()
         ,m_objectStore(objectStore), m_controller(controller), m_destIpAddr(destIpAddr), m_rateLimit(rateLimit), m_mtu(mtu)
-        ,m_port(port), m_workerThread(), m_workerCancel(false)
+        ,m_port(port), m_workerStarted(false)
         ,m_tunnelAddress(tunnel_address), m_tunnelPort(tunnel_port)
     {
     };
 
     void abort() {
-        m_workerCancel = true;
-        if (m_workerThread.joinable()) {
-            m_workerThread.join();
-        }
+        m_packageTask.cancel();
     };
 
     virtual ~ObjectPackager() {
@@ -77,10 +80,12 @@ public:
     ObjectPackager& setPort(in_port_t port);
     ObjectPackager& setMtu(unsigned short mtu);
     ObjectPackager& setRateLimit(uint32_t rateLimit);
+
+    // Number of times the worker has woken to package objects, an idle packager should not be adding to this
+    std::uint64_t workerWakeups() const { return m_packageTask.runs(); };
     void startWorker() {
-        if (m_workerThread.get_id() != std::thread::id()) return;
-        if (!!m_workerCancel) return;
-        m_workerThread = std::thread(workerLoop, this);
+        m_workerStarted = true;
+        m_packageTask.wake();
     };
 
 protected:
@@ -95,24 +100,33 @@ protected:
     in_port_t port() const { return m_port; };
     in_port_t tunnelPort() const { return m_tunnelPort; };
 
+    // Ask for doObjectPackage() to be called on the Reactor, e.g. after queuing more work or when a send completes
+    void wakeWorker() { if (m_workerStarted) m_packageTask.wake(); };
+    void wakeWorkerAfter(const std::chrono::steady_clock::duration &delay) { if (m_workerStarted) m_packageTask.wakeAfter(delay); };
+
     virtual void doObjectPackage() = 0;
 
+    void startTransmitterThread(); // once m_transmitter has been created
+    void destroyTransmitter();
+
     LibFlute::Transmitter *m_transmitter;
-    boost::asio::io_service m_io;
+    ReactorTask m_packageTask;
+    // The Transmitter's handlers are bound to it, so it has an io_context of its own which is stopped before it is
+    // destroyed, leaving any handlers still queued to be dropped unrun. All calls on the Transmitter are made there.
+    boost::asio::io_context m_fluteIo;
+    std::thread m_fluteThread;
     uint32_t m_queuedToi;
     bool m_queued;
     std::string m_queuedObjectId;
 
 private:
-    static void workerLoop(ObjectPackager*);
     ObjectStore &m_objectStore;
     ObjectController &m_controller;
     std::optional<std::string> m_destIpAddr;
     uint32_t m_rateLimit;
     unsigned short m_mtu;
     in_port_t m_port;
-    std::thread m_workerThread;
-    std::atomic_bool m_workerCancel;
+    std::atomic_bool m_workerStarted;
     std::optional<std::string> m_tunnelAddress;
     in_port_t m_tunnelPort;
 };
@@ -10,24 +10,46 @@
  * https://drive.google.com/file/d/1cinCiA778IErENZ3JN52VFW-1ffHpx7Z/view
  */
 
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <fstream>
+#include <functional>
 #include <memory>
+#include <shared_mutex>
 #include <stdexcept>
+#include <system_error>
 #include <utility>
 #include <chrono>
 #include <thread>
 #include <mutex>
 #include <iostream>
 #include <new>
+#include <set>
 
 #include "ogs-app.h"
 #include "common.hh"
 
 #include "SubscriptionService.hh"
 #include "Event.hh"
+#include "MappedObjectBuffer.hh"
 #include "ObjectStore.hh"
 
+using namespace std::literals::chrono_literals;
+
 MBSTF_NAMESPACE_START
 
+static ObjectStore::MemoryBudget g_memoryBudget{0, 0, 90, 1, std::nullopt};
+static ObjectStore::SpoolConfig g_spoolConfig{std::string(), 0};
+static std::atomic<std::size_t> g_totalBytesUsed(0);
+static std::mutex g_storesMutex;
+static std::set<ObjectStore*> g_stores;
+
+static std::size_t effective_total_limit();
+static std::optional<double> read_memory_pressure();
+static std::shared_ptr<const ObjectBuffer> make_object_buffer(const std::string &object_id, ObjectStore::ObjectData &&object);
+static bool is_stale(const ObjectStore::Metadata &metadata, const std::chrono::system_clock::time_point &now);
+
 ObjectStore::Metadata::Metadata()
     :m_objectId()
     ,m_mediaType()
@@ -37,10 +59,16 @@ ObjectStore::Metadata::Metadata()
     ,m_keepAfterSend(false)
     ,m_objIngestBaseUrl()
     ,m_objDistributionBaseUrl()
+    ,m_entityTag()
+    ,m_lastModified()
     ,m_cacheExpires(std::nullopt)
+    ,m_freshUntil()
+    ,m_noStore(false)
     ,m_receivedTime(std::chrono::system_clock::now())
     ,m_created(std::chrono::system_clock::now())
     ,m_modified(std::chrono::system_clock::now())
+    ,m_version(1)
+    ,m_previousVersion()
 {
 }
 
@@ -58,10 +86,16 @@ ObjectStore::Metadata::Metadata(const std::string &object_id, const std::string
     ,m_keepAfterSend(false)
     ,m_objIngestBaseUrl(obj_ingest_base_url)
     ,m_objDistributionBaseUrl(obj_distribution_base_url)
+    ,m_entityTag()
+    ,m_lastModified()
     ,m_cacheExpires(cache_expires)
+    ,m_freshUntil()
+    ,m_noStore(false)
     ,m_receivedTime(std::chrono::system_clock::now())
     ,m_created(std::chrono::system_clock::now())
     ,m_modified(last_modified)
+    ,m_version(1)
+    ,m_previousVersion()
 {
 }
 
@@ -74,10 +108,16 @@ ObjectStore::Metadata::Metadata(const Metadata &other)
     ,m_keepAfterSend(other.m_keepAfterSend)
     ,m_objIngestBaseUrl(other.m_objIngestBaseUrl)
     ,m_objDistributionBaseUrl(other.m_objDistributionBaseUrl)
+    ,m_entityTag(other.m_entityTag)
+    ,m_lastModified(other.m_lastModified)
     ,m_cacheExpires(other.m_cacheExpires)
+    ,m_freshUntil(other.m_freshUntil)
+    ,m_noStore(other.m_noStore)
     ,m_receivedTime(other.m_receivedTime)
     ,m_created(other.m_created)
     ,m_modified(other.m_modified)
+    ,m_version(other.m_version)
+    ,m_previousVersion(other.m_previousVersion)
 {
 }
 
@@ -90,10 +130,16 @@ ObjectStore::Metadata::Metadata(Metadata &&other)
     ,m_keepAfterSend(std::move(other.m_keepAfterSend))
     ,m_objIngestBaseUrl(std::move(other.m_objIngestBaseUrl))
     ,m_objDistributionBaseUrl(std::move(other.m_objDistributionBaseUrl))
+    ,m_entityTag(std::move(other.m_entityTag))
+    ,m_lastModified(std::move(other.m_lastModified))
     ,m_cacheExpires(std::move(other.m_cacheExpires))
+    ,m_freshUntil(std::move(other.m_freshUntil))
+    ,m_noStore(other.m_noStore)
     ,m_receivedTime(std::move(other.m_receivedTime))
     ,m_created(std::move(other.m_created))
     ,m_modified(std::move(other.m_modified))
+    ,m_version(other.m_version)
+    ,m_previousVersion(std::move(other.m_previousVersion))
 {
 }
 
@@ -101,125 +147,805 @@ ObjectStore::Metadata::Metadata(Metadata &&other)
 ObjectStore::ObjectStore(ObjectController &controller)
     :SubscriptionService()
     ,m_controller(controller)
+    ,m_shards()
+    ,m_bytesUsed(0)
+    ,m_expiryMutex()
+    ,m_expiryIndex()
+    ,m_expiryPositions()
+    ,m_evictionMutex()
+    ,m_evictionOrder()
+    ,m_evictionPositions()
+    ,m_sendHoldsMutex()
+    ,m_sendHolds()
+    ,m_urlIndexMutex()
+    ,m_urlIndex()
+    ,m_growingMutex()
+    ,m_growingObjects()
+    ,m_nextGrowingListenerId(c_noGrowingListener + 1)
 {
+    std::lock_guard<std::mutex> lock(g_storesMutex);
+    g_stores.insert(this);
 }
 
 ObjectStore::~ObjectStore()
 {
+    {
+        std::lock_guard<std::mutex> lock(g_storesMutex);
+        g_stores.erase(this);
+    }
+    // Session teardown: take everything out as one batch. Subscribers are not told, they are going with the store and
+    // the StateJournal removes the session's objects with the session.
+    try {
+        Batch batch;
+        for (const Shard &shd : m_shards) {
+            std::shared_lock<std::shared_mutex> lock(shd.mutex);
+            for (const auto &[object_id, object] : shd.objects) batch.deleteObject(object_id);
+        }
+        applyBatch(std::move(batch), false);
+    } catch (const std::bad_alloc& e) {
+        ogs_error("memory allocation failed: %s", e.what());
+    }
+    g_totalBytesUsed -= m_bytesUsed;
 }
 
 void ObjectStore::addObject(const std::string& object_id, ObjectData &&object, Metadata &&metadata) {
-    std::lock_guard<std::recursive_mutex> lock(m_mutex);
-    //std::unique_lock<std::shared_mutex> lock(m_mutex);
+    std::shared_ptr<const ObjectBuffer> buffer(make_object_buffer(object_id, std::move(object)));
+    if (!buffer) return;
+    addObject(object_id, buffer, std::move(metadata));
+}
+
+void ObjectStore::addObject(const std::string& object_id, const std::shared_ptr<const ObjectBuffer> &object,
+                            Metadata &&metadata) {
+    insertObject(object_id, object, std::move(metadata), false);
+}
+
+bool ObjectStore::addObjectIfNew(const std::string& object_id, const std::shared_ptr<const ObjectBuffer> &object,
+                                 Metadata &&metadata) {
+    return insertObject(object_id, object, std::move(metadata), true);
+}
 
+bool ObjectStore::insertObject(const std::string& object_id, const std::shared_ptr<const ObjectBuffer> &object,
+                               Metadata &&metadata, bool only_if_new) {
+    // Build the new hash table node outside of the lock so that only the node relinking happens while locked
+    ShardMap new_node_map;
+    ShardMap::node_type old_node;
+    std::shared_ptr<const Metadata> new_metadata;
+    std::optional<std::string> superseded_id;
+    bool indexing = false;
     try {
-        m_store.insert_or_assign(object_id, std::make_pair(std::move(object), std::move(metadata)));
+        std::shared_ptr<Metadata> node_metadata(std::make_shared<Metadata>(std::move(metadata)));
+        new_metadata = node_metadata;
+        new_node_map.emplace(object_id, Object(object, node_metadata));
+        // Index the URLs last, so that a failed allocation cannot leave the index pointing at an object never added
+        indexing = true;
+        if (!indexUrls(object_id, *node_metadata, superseded_id, only_if_new)) return false;
     } catch (const std::bad_alloc& e) {
         ogs_error("memory allocation failed: %s", e.what());
+        if (indexing) unindexUrls(object_id, *new_metadata);
+        endGrowing(object_id);
+        return false;
+    }
 
+    {
+        Shard &shd(shard(object_id));
+        std::unique_lock<std::shared_mutex> lock(shd.mutex);
+        old_node = extractObject(shd, object_id);
+        shd.objects.insert(new_node_map.extract(new_node_map.begin()));
+        m_bytesUsed += object->residentSize();
+        g_totalBytesUsed += object->residentSize();
+        indexExpiry(object_id, *new_metadata);
+        indexEviction(object_id, *new_metadata);
     }
+    old_node = ShardMap::node_type(); // release any replaced object outside of the shard lock
+    // Only once the complete object can be found, so that packagers looking for it find one or the other
+    bool was_growing = endGrowing(object_id);
+
+    if (superseded_id) {
+        // The previous version for this URL leaves the store, its memory goes when the last handle to it is dropped
+        {
+            Shard &shd(shard(superseded_id.value()));
+            std::unique_lock<std::shared_mutex> lock(shd.mutex);
+            old_node = extractObject(shd, superseded_id.value());
+        }
+        if (!old_node.empty()) {
+            old_node = ShardMap::node_type();
+            ogs_debug("Object [%s] superseded by [%s]", superseded_id.value().c_str(), object_id.c_str());
+            std::shared_ptr<Event> event(Event::make<ObjectStore::ObjectDeletedEvent>(superseded_id.value()));
+            sendEventAsynchronous(event);
+        }
+    }
+
+    enforceMemoryBudget({object_id});
 
-    std::shared_ptr<Event> event(new ObjectStore::ObjectAddedEvent(object_id));
+    std::shared_ptr<Event> event(Event::make<ObjectStore::ObjectAddedEvent>(object_id, was_growing));
     sendEventAsynchronous(event);
+    return true;
+}
+
+ObjectStore::Object ObjectStore::getObject(const std::string& object_id) const {
+    const Shard &shd(shard(object_id));
+    std::shared_lock<std::shared_mutex> lock(shd.mutex);
+    return shd.objects.at(object_id);
+}
+
+std::optional<ObjectStore::Object> ObjectStore::findObject(const std::string& object_id) const {
+    const Shard &shd(shard(object_id));
+    std::shared_lock<std::shared_mutex> lock(shd.mutex);
+    auto it = shd.objects.find(object_id);
+    if (it == shd.objects.end()) return std::nullopt;
+    return it->second;
+}
+
+std::optional<std::string> ObjectStore::currentObjectId(const std::string& url) const {
+    std::shared_lock<std::shared_mutex> lock(m_urlIndexMutex);
+    auto it = m_urlIndex.find(url);
+    if (it == m_urlIndex.end()) return std::nullopt;
+    return it->second.objectId;
 }
 
-const ObjectStore::ObjectData& ObjectStore::getObjectData(const std::string& object_id) const {
-    std::lock_guard<std::recursive_mutex> lock(m_mutex);
-    //std::shared_lock<std::shared_mutex> lock(m_mutex);
-    return  m_store.at(object_id).first;
+std::optional<ObjectStore::Object> ObjectStore::findObjectByUrl(const std::string& url) const {
+    std::optional<std::string> object_id(currentObjectId(url));
+    if (!object_id) return std::nullopt;
+    return findObject(object_id.value());
 }
 
-ObjectStore::ObjectData& ObjectStore::getObjectData(const std::string& object_id) {
-    std::lock_guard<std::recursive_mutex> lock(m_mutex);
-    return m_store.at(object_id).first;
+ObjectStore::ObjectData ObjectStore::getObjectData(const std::string& object_id) const {
+    return getObject(object_id).data().toVector();
 }
 
-const ObjectStore::Metadata& ObjectStore::getMetadata(const std::string& object_id) const {
-   std::lock_guard<std::recursive_mutex> lock(m_mutex);
-   return m_store.at(object_id).second;
+ObjectStore::Metadata ObjectStore::getMetadata(const std::string& object_id) const {
+    return getObject(object_id).metadata();
 }
 
-ObjectStore::Metadata& ObjectStore::getMetadata(const std::string& object_id) {
-   std::lock_guard<std::recursive_mutex> lock(m_mutex);
-   return m_store.at(object_id).second;
+bool ObjectStore::updateMetadata(const std::string& object_id, const std::function<void(Metadata&)> &update_fn) {
+    // Copy-on-write: handles already given out keep the metadata snapshot they were created with
+    Shard &shd(shard(object_id));
+    std::unique_lock<std::shared_mutex> lock(shd.mutex);
+    auto it = shd.objects.find(object_id);
+    if (it == shd.objects.end()) return false;
+    std::shared_ptr<Metadata> new_metadata(std::make_shared<Metadata>(*it->second.m_metadata));
+    update_fn(*new_metadata);
+    bool expiry_changed = new_metadata->cacheExpires() != it->second.m_metadata->cacheExpires();
+    bool eviction_changed = new_metadata->keepAfterSend() != it->second.m_metadata->keepAfterSend() ||
+                            new_metadata->receivedTime() != it->second.m_metadata->receivedTime();
+    it->second.m_metadata = new_metadata;
+    if (expiry_changed) indexExpiry(object_id, *new_metadata);
+    if (eviction_changed) indexEviction(object_id, *new_metadata);
+    return true;
+}
+
+bool ObjectStore::refreshObject(const std::string& object_id, const std::function<void(Metadata&)> &update_fn) {
+    if (!updateMetadata(object_id, update_fn)) return false;
+
+    std::shared_ptr<Event> event(Event::make<ObjectStore::ObjectRefreshedEvent>(object_id));
+    sendEventAsynchronous(event);
+    return true;
 }
 
 void ObjectStore::deleteObject(const std::string& object_id) {
-    std::lock_guard<std::recursive_mutex> lock(m_mutex);
-    //std::unique_lock<std::shared_mutex> lock(m_mutex);
-    m_store.erase(object_id);
-    std::shared_ptr<Event> event(new ObjectStore::ObjectDeletedEvent(object_id));
+    ShardMap::node_type old_node;
+    {
+        Shard &shd(shard(object_id));
+        std::unique_lock<std::shared_mutex> lock(shd.mutex);
+        old_node = extractObject(shd, object_id);
+    }
+    std::shared_ptr<Event> event(Event::make<ObjectStore::ObjectDeletedEvent>(object_id));
     sendEventAsynchronous(event);
 }
 
-const ObjectStore::Object& ObjectStore::operator[](const std::string& object_id) const {
-    std::lock_guard<std::recursive_mutex> lock(m_mutex);
-    return m_store.at(object_id);
+void ObjectStore::deleteObjects(const std::list<std::string>& object_ids) {
+    Batch batch;
+    for (const auto &object_id : object_ids) {
+        batch.deleteObject(object_id);
+    }
+    commit(std::move(batch));
+}
+
+void ObjectStore::commit(Batch &&batch) {
+    applyBatch(std::move(batch), true);
 }
 
-/*
-bool ObjectStore::hasExpired(const std::string& object_id) const {
-    std::lock_guard<std::recursive_mutex> lock(m_mutex);
-    const auto& metadata = m_store.at(object_id).second;
-    if (metadata.cacheExpires().has_value()) {
-        return std::chrono::system_clock::now() > metadata.cacheExpires().value();
+std::size_t ObjectStore::applyBatch(Batch &&batch, bool notify) {
+    if (batch.empty()) return 0;
+
+    // Build the new hash table nodes and index the URLs outside of the shard locks
+    struct PreparedAddition {
+        std::string objectId;
+        ShardMap nodeMap;
+        std::shared_ptr<const Metadata> metadata;
+        std::size_t residentSize;
+        std::optional<std::string> supersededId;
+    };
+    std::list<PreparedAddition> additions;
+    std::set<std::string> added_ids;
+    for (auto &addition : batch.m_additions) {
+        auto prepared = additions.end();
+        std::shared_ptr<Metadata> metadata;
+        bool indexing = false;
+        try {
+            metadata = std::make_shared<Metadata>(std::move(addition.metadata));
+            additions.push_back(PreparedAddition{addition.objectId, ShardMap(), metadata, addition.buffer->residentSize(),
+                                                 std::nullopt});
+            prepared = std::prev(additions.end());
+            prepared->nodeMap.emplace(addition.objectId, Object(addition.buffer, metadata));
+            added_ids.insert(addition.objectId);
+            // Index the URLs last, so that a failed allocation cannot leave the index pointing at an object never added
+            indexing = true;
+            indexUrls(addition.objectId, *metadata, prepared->supersededId);
+        } catch (const std::bad_alloc& e) {
+            ogs_error("memory allocation failed: %s", e.what());
+            if (indexing) unindexUrls(addition.objectId, *metadata);
+            if (prepared != additions.end()) {
+                added_ids.erase(addition.objectId);
+                additions.erase(prepared);
+            }
+            continue;
+        }
+        if (prepared->supersededId && added_ids.count(prepared->supersededId.value())) {
+            // Superseding an object earlier in this batch, that object never needs to enter the store
+            auto it = std::find_if(additions.begin(), prepared, [&prepared](const PreparedAddition &a) {
+                return a.objectId == prepared->supersededId.value();
+            });
+            added_ids.erase(it->objectId);
+            prepared->supersededId = it->supersededId;
+            additions.erase(it);
+        }
     }
-    return false;
+
+    // Lock every shard the batch touches, always in shard order so that concurrent batches cannot deadlock
+    std::array<bool, c_numShards> involved{};
+    for (const auto &object_id : batch.m_deletions) involved[shardIndex(object_id)] = true;
+    for (const auto &prepared : additions) {
+        involved[shardIndex(prepared.objectId)] = true;
+        if (prepared.supersededId) involved[shardIndex(prepared.supersededId.value())] = true;
+    }
+
+    std::list<ShardMap::node_type> old_nodes;
+    std::list<std::string> deleted_ids;
+    std::list<std::string> added_list;
+    {
+        std::vector<std::unique_lock<std::shared_mutex> > locks;
+        for (std::size_t i = 0; i < c_numShards; i++) {
+            if (involved[i]) locks.emplace_back(m_shards[i].mutex);
+        }
+
+        for (const auto &object_id : batch.m_deletions) {
+            auto node = extractObject(shard(object_id), object_id);
+            if (!node.empty()) {
+                old_nodes.push_back(std::move(node));
+                deleted_ids.push_back(object_id);
+            }
+        }
+        for (auto &prepared : additions) {
+            Shard &shd(shard(prepared.objectId));
+            auto node = extractObject(shd, prepared.objectId);
+            if (!node.empty()) old_nodes.push_back(std::move(node));
+            shd.objects.insert(prepared.nodeMap.extract(prepared.nodeMap.begin()));
+            m_bytesUsed += prepared.residentSize;
+            g_totalBytesUsed += prepared.residentSize;
+            indexExpiry(prepared.objectId, *prepared.metadata);
+            indexEviction(prepared.objectId, *prepared.metadata);
+            added_list.push_back(prepared.objectId);
+        }
+        for (const auto &prepared : additions) {
+            if (!prepared.supersededId) continue;
+            const std::string &superseded_id(prepared.supersededId.value());
+            auto node = extractObject(shard(superseded_id), superseded_id);
+            if (!node.empty()) {
+                old_nodes.push_back(std::move(node));
+                deleted_ids.push_back(superseded_id);
+            }
+        }
+    }
+    old_nodes.clear(); // release removed objects outside of the shard locks
+
+    if (!added_ids.empty()) enforceMemoryBudget(added_ids);
+
+    std::size_t num_deleted = deleted_ids.size();
+    if (notify && !deleted_ids.empty()) {
+        std::shared_ptr<Event> event(Event::make<ObjectStore::ObjectsDeletedEvent>(std::move(deleted_ids)));
+        sendEventAsynchronous(event);
+    }
+    if (notify && !added_list.empty()) {
+        std::shared_ptr<Event> event(Event::make<ObjectStore::ObjectsAddedEvent>(std::move(added_list)));
+        sendEventAsynchronous(event);
+    }
+    return num_deleted;
 }
-*/
 
 bool ObjectStore::isStale(const std::string& object_id) const {
-    std::lock_guard<std::recursive_mutex> lock(m_mutex);
-    auto it = m_store.find(object_id);
-    if (it == m_store.end()) {
+    const Shard &shd(shard(object_id));
+    std::shared_lock<std::shared_mutex> lock(shd.mutex);
+    auto it = shd.objects.find(object_id);
+    if (it == shd.objects.end()) {
         return false;
     }
 
-    const Metadata& metadata = it->second.second;
-    return metadata.cacheExpires().has_value() && metadata.cacheExpires().value() < std::chrono::system_clock::now();
+    return is_stale(it->second.metadata(), std::chrono::system_clock::now());
+}
+
+void ObjectStore::holdForSending(const std::string& object_id)
+{
+    std::lock_guard<std::mutex> lock(m_sendHoldsMutex);
+    m_sendHolds[object_id]++;
 }
 
-std::map<std::string, const ObjectStore::Object&> ObjectStore::getStale() const {
-    std::lock_guard<std::recursive_mutex> lock(m_mutex);
-    std::map<std::string, const ObjectStore::Object&> staleObjects;
+void ObjectStore::releaseSendHold(const std::string& object_id)
+{
+    std::lock_guard<std::mutex> lock(m_sendHoldsMutex);
+    auto it = m_sendHolds.find(object_id);
+    if (it == m_sendHolds.end()) return;
+    if (--it->second == 0) m_sendHolds.erase(it);
+}
 
-    for (const auto& pair : m_store) {
-        const std::string& object_id = pair.first;
-        if (isStale(object_id)) {
-            staleObjects.emplace(object_id, pair.second);
+std::map<std::string, ObjectStore::Object> ObjectStore::getStale() const {
+    // Objects usually go stale before they expire, so this has to look at every object rather than the expiry index
+    std::map<std::string, ObjectStore::Object> staleObjects;
+    const auto now = std::chrono::system_clock::now();
+    for (const Shard &shd : m_shards) {
+        std::shared_lock<std::shared_mutex> lock(shd.mutex);
+        for (const auto &[object_id, object] : shd.objects) {
+            if (is_stale(object.metadata(), now)) staleObjects.emplace(object_id, object);
         }
     }
-
     return staleObjects;
 }
 
-bool ObjectStore::removeObject(const std::string& objectId) {
-    std::lock_guard<std::recursive_mutex> lock(m_mutex);
-    //std::unique_lock<std::shared_mutex> lock(m_mutex);
-    auto it = m_store.find(objectId);
-    if (it != m_store.end()) {
-        m_store.erase(it);
-	return true;
-    } else {
-        return false;
+std::list<std::pair<std::string, ObjectStore::Object> > ObjectStore::getExpired() const {
+    // Only the expired part of the index is visited
+    std::list<std::pair<std::string, Object> > expired;
+    for (const auto &entry : expiredEntries(std::chrono::system_clock::now())) {
+        const Shard &shd(shard(entry.objectId));
+        std::shared_lock<std::shared_mutex> lock(shd.mutex);
+        if (isCurrentExpiryEntry(shd, entry)) {
+            expired.emplace_back(entry.objectId, shd.objects.at(entry.objectId));
+        }
+    }
+    return expired;
+}
+
+bool ObjectStore::addGrowingObject(const std::string& object_id, const std::string& url,
+                                   const std::shared_ptr<const IngestProgress> &progress)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_growingMutex);
+        if (!m_growingObjects.emplace(object_id, GrowingEntry{progress, {}}).second) return false;
+    }
+    ogs_debug("Object [%s] for %s is growing", object_id.c_str(), url.c_str());
+    std::shared_ptr<Event> event(Event::make<ObjectStore::ObjectGrowingEvent>(object_id, url));
+    sendEventAsynchronous(event);
+    return true;
+}
+
+std::shared_ptr<const IngestProgress> ObjectStore::findGrowingObject(const std::string& object_id) const
+{
+    std::lock_guard<std::mutex> lock(m_growingMutex);
+    auto it = m_growingObjects.find(object_id);
+    if (it == m_growingObjects.end()) return nullptr;
+    return it->second.progress;
+}
+
+void ObjectStore::abandonGrowingObject(const std::string& object_id)
+{
+    if (endGrowing(object_id)) ogs_debug("Growing object [%s] abandoned", object_id.c_str());
+}
+
+ObjectStore::GrowingListenerId ObjectStore::notifyWhenAdded(const std::string& object_id, GrowingListener &&listener)
+{
+    std::lock_guard<std::mutex> lock(m_growingMutex);
+    auto it = m_growingObjects.find(object_id);
+    if (it == m_growingObjects.end()) return c_noGrowingListener;
+    GrowingListenerId listener_id = m_nextGrowingListenerId++;
+    it->second.listeners.emplace(listener_id, std::move(listener));
+    return listener_id;
+}
+
+void ObjectStore::cancelNotifyWhenAdded(const std::string& object_id, GrowingListenerId listener_id)
+{
+    std::lock_guard<std::mutex> lock(m_growingMutex);
+    auto it = m_growingObjects.find(object_id);
+    if (it != m_growingObjects.end()) it->second.listeners.erase(listener_id);
+}
+
+void ObjectStore::checkExpiredObjectsInAllStores()
+{
+    std::lock_guard<std::mutex> lock(g_storesMutex);
+    for (auto store : g_stores) {
+        store->checkExpiredObjects();
+        store->logAsyncEventStatistics("ObjectStore");
     }
 }
 
+bool ObjectStore::removeObject(const std::string& objectId) {
+    return removeObjects({objectId});
+}
+
 bool ObjectStore::removeObjects(const std::list<std::string>& objectIds) {
-    std::lock_guard<std::recursive_mutex> lock(m_mutex);
-    //std::unique_lock<std::shared_mutex> lock(m_mutex);
+    Batch batch;
     for (const auto& objectId : objectIds) {
-        auto it = m_store.find(objectId);
-        if (it != m_store.end()) {
-            m_store.erase(it);
-        } /*else {
-            return false;
-            // Optionally handle the case where the objectId is not found
-        } */
+        batch.deleteObject(objectId);
+    }
+    return applyBatch(std::move(batch), false) > 0;
+}
+
+const ObjectStore::SpoolConfig &ObjectStore::spoolConfig()
+{
+    return g_spoolConfig;
+}
+
+void ObjectStore::spoolConfig(const SpoolConfig &config)
+{
+    g_spoolConfig = config;
+}
+
+bool ObjectStore::shouldSpool(std::size_t object_size)
+{
+    return !g_spoolConfig.directory.empty() && object_size >= g_spoolConfig.threshold;
+}
+
+const ObjectStore::MemoryBudget &ObjectStore::memoryBudget()
+{
+    return g_memoryBudget;
+}
+
+void ObjectStore::memoryBudget(const MemoryBudget &budget)
+{
+    g_memoryBudget = budget;
+}
+
+std::size_t ObjectStore::totalBytesUsed()
+{
+    return g_totalBytesUsed;
+}
+
+bool ObjectStore::overHighWaterMark(std::size_t pending_bytes) const
+{
+    const MemoryBudget &budget(g_memoryBudget);
+    std::size_t total_limit = effective_total_limit();
+
+    if (budget.sessionLimit && m_bytesUsed + pending_bytes >= budget.sessionLimit / 100 * budget.highWaterMarkPercent) {
+        return true;
     }
+    if (total_limit && g_totalBytesUsed + pending_bytes >= total_limit / 100 * budget.highWaterMarkPercent) return true;
+    return false;
+}
+
+ObjectStore::ShardMap::node_type ObjectStore::extractObject(Shard &shd, const std::string &object_id)
+{
+    // Must be called with the shard write lock held
+    auto node = shd.objects.extract(object_id);
+    if (!node.empty()) {
+        std::size_t size = node.mapped().data().residentSize();
+        m_bytesUsed -= size;
+        g_totalBytesUsed -= size;
+        unindexUrls(object_id, node.mapped().metadata());
+        unindexExpiry(object_id);
+        unindexEviction(object_id);
+    }
+    return node;
+}
+
+bool ObjectStore::indexUrls(const std::string &object_id, Metadata &metadata, std::optional<std::string> &superseded_id,
+                            bool only_if_new)
+{
+    // Make object_id the current version for its URLs, setting superseded_id to any version it supersedes. If
+    // only_if_new is set, nothing changes and false is returned when a URL already has another object.
+    superseded_id.reset();
+    unsigned long version = 1;
+    std::unique_lock<std::shared_mutex> lock(m_urlIndexMutex);
+
+    for (const std::string *url : {&metadata.getOriginalUrl(), &metadata.getFetchedUrl()}) {
+        if (url->empty()) continue;
+        auto it = m_urlIndex.find(*url);
+        if (it == m_urlIndex.end()) continue;
+        if (it->second.objectId != object_id) {
+            if (only_if_new) return false;
+            superseded_id = it->second.objectId;
+        }
+        version = std::max(version, it->second.version + 1);
+    }
+
+    // Set the version first so that unindexUrls() can undo a partial update if an insertion fails
+    metadata.version(version).previousVersion(superseded_id);
+    for (const std::string *url : {&metadata.getOriginalUrl(), &metadata.getFetchedUrl()}) {
+        if (url->empty()) continue;
+        m_urlIndex.insert_or_assign(*url, UrlIndexEntry{object_id, version});
+    }
+    return true;
+}
+
+void ObjectStore::unindexUrls(const std::string &object_id, const Metadata &metadata)
+{
+    // Only remove URL entries still pointing at this version, a newer version may already have replaced them
+    std::unique_lock<std::shared_mutex> lock(m_urlIndexMutex);
+    for (const std::string *url : {&metadata.getOriginalUrl(), &metadata.getFetchedUrl()}) {
+        auto it = m_urlIndex.find(*url);
+        if (it != m_urlIndex.end() && it->second.objectId == object_id && it->second.version == metadata.version()) {
+            m_urlIndex.erase(it);
+        }
+    }
+}
+
+void ObjectStore::enforceMemoryBudget(const std::set<std::string> &added_object_ids)
+{
+    const std::size_t session_limit = g_memoryBudget.sessionLimit;
+    const std::size_t total_limit = effective_total_limit();
+    auto over_budget = [&]() {
+        return (session_limit && m_bytesUsed > session_limit) || (total_limit && g_totalBytesUsed > total_limit);
+    };
+
+    if (!over_budget()) return;
+
+    // Eviction policy: expired objects first, then the oldest objects not marked keepAfterSend.
+    // Objects that have just been added are never candidates.
+    checkExpiredObjects(added_object_ids);
+    if (!over_budget()) return;
+
+    std::list<ShardMap::node_type> evicted_nodes;
+    std::list<std::string> evicted_ids;
+    while (over_budget()) {
+        std::string object_id;
+        {
+            std::lock_guard<std::mutex> lock(m_evictionMutex);
+            auto it = m_evictionOrder.begin();
+            while (it != m_evictionOrder.end() && added_object_ids.count(it->second)) ++it;
+            if (it == m_evictionOrder.end()) break;
+            object_id = it->second;
+        }
+        // Extracting the object takes it out of the eviction order, unless another thread got there first
+        Shard &shd(shard(object_id));
+        std::unique_lock<std::shared_mutex> lock(shd.mutex);
+        auto node = extractObject(shd, object_id);
+        if (node.empty()) continue;
+        evicted_nodes.push_back(std::move(node));
+        evicted_ids.push_back(object_id);
+    }
+    evicted_nodes.clear();
+
+    if (over_budget()) {
+        ogs_warn("Object store over memory budget after eviction: session %zu bytes, total %zu bytes",
+                 static_cast<std::size_t>(m_bytesUsed), static_cast<std::size_t>(g_totalBytesUsed));
+    }
+
+    if (evicted_ids.empty()) return;
+    for (const auto &object_id : evicted_ids) {
+        ogs_debug("Evicted object [%s] to stay within the memory budget", object_id.c_str());
+    }
+    std::shared_ptr<Event> event(Event::make<ObjectStore::ObjectsDeletedEvent>(std::move(evicted_ids)));
+    sendEventAsynchronous(event);
+}
+
+bool ObjectStore::endGrowing(const std::string &object_id)
+{
+    // Listeners are called with the lock held so that once cancelNotifyWhenAdded() returns none is running
+    std::lock_guard<std::mutex> lock(m_growingMutex);
+    auto it = m_growingObjects.find(object_id);
+    if (it == m_growingObjects.end()) return false;
+    for (auto &[listener_id, listener] : it->second.listeners) {
+        try {
+            listener();
+        } catch (std::exception &ex) {
+            ogs_error("Unhandled exception in growing object listener: %s", ex.what());
+        }
+    }
+    m_growingObjects.erase(it);
     return true;
 }
 
+void ObjectStore::indexExpiry(const std::string &object_id, const Metadata &metadata)
+{
+    // Must be called with the shard write lock held, replaces any entry the object already has
+    std::lock_guard<std::mutex> lock(m_expiryMutex);
+    auto pos = m_expiryPositions.find(object_id);
+    if (pos != m_expiryPositions.end()) {
+        m_expiryIndex.erase(pos->second);
+        if (!metadata.cacheExpires()) {
+            m_expiryPositions.erase(pos);
+            return;
+        }
+        pos->second = m_expiryIndex.emplace(metadata.cacheExpires().value(), object_id);
+    } else if (metadata.cacheExpires()) {
+        m_expiryPositions.emplace(object_id, m_expiryIndex.emplace(metadata.cacheExpires().value(), object_id));
+    }
+}
+
+void ObjectStore::unindexExpiry(const std::string &object_id)
+{
+    // Must be called with the shard write lock held
+    std::lock_guard<std::mutex> lock(m_expiryMutex);
+    auto pos = m_expiryPositions.find(object_id);
+    if (pos == m_expiryPositions.end()) return;
+    m_expiryIndex.erase(pos->second);
+    m_expiryPositions.erase(pos);
+}
+
+void ObjectStore::indexEviction(const std::string &object_id, const Metadata &metadata)
+{
+    // Must be called with the shard write lock held, replaces any entry the object already has
+    std::lock_guard<std::mutex> lock(m_evictionMutex);
+    auto pos = m_evictionPositions.find(object_id);
+    if (pos != m_evictionPositions.end()) {
+        m_evictionOrder.erase(pos->second);
+        if (metadata.keepAfterSend()) {
+            m_evictionPositions.erase(pos);
+            return;
+        }
+        pos->second = m_evictionOrder.emplace(metadata.receivedTime(), object_id);
+    } else if (!metadata.keepAfterSend()) {
+        m_evictionPositions.emplace(object_id, m_evictionOrder.emplace(metadata.receivedTime(), object_id));
+    }
+}
+
+void ObjectStore::unindexEviction(const std::string &object_id)
+{
+    // Must be called with the shard write lock held
+    std::lock_guard<std::mutex> lock(m_evictionMutex);
+    auto pos = m_evictionPositions.find(object_id);
+    if (pos == m_evictionPositions.end()) return;
+    m_evictionOrder.erase(pos->second);
+    m_evictionPositions.erase(pos);
+}
+
+std::vector<ObjectStore::ExpiryEntry> ObjectStore::expiredEntries(const std::chrono::system_clock::time_point &now) const
+{
+    // Copies, as the entries can't be acted on until the expiry lock is released and the shard lock taken
+    std::vector<ExpiryEntry> entries;
+    std::lock_guard<std::mutex> lock(m_expiryMutex);
+    for (auto it = m_expiryIndex.begin(); it != m_expiryIndex.end() && it->first <= now; ++it) {
+        entries.push_back(ExpiryEntry{it->first, it->second});
+    }
+    return entries;
+}
+
+bool ObjectStore::isCurrentExpiryEntry(const Shard &shd, const ExpiryEntry &entry) const
+{
+    // Must be called with the shard lock held. A copied entry is stale if, since it was copied, the object has gone
+    // or its expiry has changed.
+    auto it = shd.objects.find(entry.objectId);
+    if (it == shd.objects.end()) return false;
+    const auto &cache_expires = it->second.metadata().cacheExpires();
+    return cache_expires.has_value() && cache_expires.value() == entry.expires;
+}
+
+void ObjectStore::checkExpiredObjects(const std::set<std::string> &except_object_ids)
+{
+    std::vector<ExpiryEntry> entries(expiredEntries(std::chrono::system_clock::now()));
+    if (entries.empty()) return;
+
+    // Removing an object from its shard also removes its expiry entry, any skipped stay for the next check
+    std::list<ShardMap::node_type> expired_nodes;
+    std::list<std::string> expired_ids;
+    for (auto &entry : entries) {
+        if (except_object_ids.count(entry.objectId) || heldForSending(entry.objectId)) continue;
+        Shard &shd(shard(entry.objectId));
+        std::unique_lock<std::shared_mutex> lock(shd.mutex);
+        if (isCurrentExpiryEntry(shd, entry)) {
+            expired_nodes.push_back(extractObject(shd, entry.objectId));
+            expired_ids.push_back(entry.objectId);
+        }
+    }
+    expired_nodes.clear();
+
+    if (expired_ids.empty()) return;
+    for (const auto &object_id : expired_ids) {
+        ogs_debug("Object [%s] has expired, removed from the object store", object_id.c_str());
+    }
+    std::shared_ptr<Event> event(Event::make<ObjectStore::ObjectsDeletedEvent>(std::move(expired_ids)));
+    sendEventAsynchronous(event);
+}
+
+bool ObjectStore::heldForSending(const std::string &object_id) const
+{
+    std::lock_guard<std::mutex> lock(m_sendHoldsMutex);
+    return m_sendHolds.find(object_id) != m_sendHolds.end();
+}
+
+std::size_t ObjectStore::shardIndex(const std::string &object_id) const
+{
+    return std::hash<std::string>{}(object_id) % c_numShards;
+}
+
+ObjectStore::Shard &ObjectStore::shard(const std::string &object_id)
+{
+    return m_shards[shardIndex(object_id)];
+}
+
+const ObjectStore::Shard &ObjectStore::shard(const std::string &object_id) const
+{
+    return m_shards[shardIndex(object_id)];
+}
+
+ObjectStore::Batch &ObjectStore::Batch::addObject(const std::string &object_id, ObjectData &&object, Metadata &&metadata)
+{
+    std::shared_ptr<const ObjectBuffer> buffer(make_object_buffer(object_id, std::move(object)));
+    if (buffer) addObject(object_id, buffer, std::move(metadata));
+    return *this;
+}
+
+ObjectStore::Batch &ObjectStore::Batch::addObject(const std::string &object_id, const std::shared_ptr<const ObjectBuffer> &object,
+                                                  Metadata &&metadata)
+{
+    m_additions.push_back(Addition{object_id, object, std::move(metadata)});
+    m_residentSize += object->residentSize();
+    return *this;
+}
+
+ObjectStore::Batch &ObjectStore::Batch::deleteObject(const std::string &object_id)
+{
+    m_deletions.push_back(object_id);
+    return *this;
+}
+
+static std::size_t effective_total_limit()
+{
+    std::size_t limit = g_memoryBudget.totalLimit;
+    if (limit && g_memoryBudget.pressureThreshold) {
+        std::optional<double> pressure(read_memory_pressure());
+        if (pressure && pressure.value() > g_memoryBudget.pressureThreshold.value()) limit /= 2;
+    }
+    return limit;
+}
+
+static std::optional<double> read_memory_pressure()
+{
+    // PSI is a rolling average so only re-read it once a second
+    static std::mutex cache_mutex;
+    static std::chrono::steady_clock::time_point next_read;
+    static std::optional<double> cached_pressure;
+
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    auto now = std::chrono::steady_clock::now();
+    if (now < next_read) return cached_pressure;
+    next_read = now + 1s;
+    cached_pressure.reset();
+
+    // Prefer the cgroup v2 figure for our container, fall back to the system-wide one
+    for (const char *path : {"/sys/fs/cgroup/memory.pressure", "/proc/pressure/memory"}) {
+        std::ifstream psi(path);
+        std::string kind, avg10;
+        if (psi >> kind >> avg10 && kind == "some" && avg10.starts_with("avg10=")) {
+            try {
+                cached_pressure = std::stod(avg10.substr(6));
+                break;
+            } catch (std::exception &ex) {
+                ogs_debug("Unable to parse %s: %s", path, ex.what());
+            }
+        }
+    }
+
+    return cached_pressure;
+}
+
+static bool is_stale(const ObjectStore::Metadata &metadata, const std::chrono::system_clock::time_point &now)
+{
+    // Stale once past freshUntil, or cacheExpires for objects without a freshness lifetime
+    const auto &fresh_until = metadata.freshUntil()?metadata.freshUntil():metadata.cacheExpires();
+    return fresh_until.has_value() && fresh_until.value() < now;
+}
+
+static std::shared_ptr<const ObjectBuffer> make_object_buffer(const std::string &object_id, ObjectStore::ObjectData &&object)
+{
+    std::shared_ptr<const ObjectBuffer> buffer;
+    if (ObjectStore::shouldSpool(object.size())) {
+        try {
+            std::shared_ptr<MappedObjectBuffer> spool_buffer(new MappedObjectBuffer(g_spoolConfig.directory));
+            spool_buffer->append(object).seal();
+            buffer = spool_buffer;
+            object = ObjectStore::ObjectData();
+        } catch (const std::system_error& e) {
+            ogs_warn("Unable to spool object [%s], keeping it in memory: %s", object_id.c_str(), e.what());
+        }
+    }
+    if (!buffer) {
+        try {
+            buffer.reset(new ObjectBuffer(std::move(object)));
+        } catch (const std::bad_alloc& e) {
+            ogs_error("memory allocation failed: %s", e.what());
+        }
+    }
+    return buffer;
+}
+
 MBSTF_NAMESPACE_STOP
 
 /* vim:ts=8:sts=4:sw=4:expandtab:
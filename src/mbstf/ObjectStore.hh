@@ -15,49 +15,81 @@
 
 #pragma once
 
+#include <array>
+#include <atomic>
 #include <chrono>
+#include <cstdint>
 #include <functional>
 #include <list>
 #include <map>
 #include <memory>
 #include <mutex>
 #include <optional>
+#include <set>
 #include <shared_mutex>
+#include <string>
 #include <thread>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
 #include "common.hh"
 #include "Event.hh"
+#include "ObjectBuffer.hh"
 #include "SubscriptionService.hh"
 
 MBSTF_NAMESPACE_START
 
+class IngestProgress;
 class ObjectController;
 class SubscriptionService;
 class Event;
 
 #define CACHE_EXPIRES 10
+#define CACHE_MINIMUM_HOLD 30
 #define CHECK_EXPIRY_INTERVAL 10
 
 class ObjectStore: public SubscriptionService {
 public:
     class ObjectAddedEvent : public Event {
     public:
-        ObjectAddedEvent(const std::string& object_id)
-            : Event("ObjectAdded"), m_object_id(object_id) {}
+        static constexpr const char c_eventName[] = "ObjectAdded";
+
+        ObjectAddedEvent(const std::string& object_id, bool was_growing = false)
+            : Event(typeIdOf<ObjectAddedEvent>()), m_object_id(object_id), m_wasGrowing(was_growing) {}
 
         std::string objectId() const { return m_object_id; }
+        bool wasGrowing() const { return m_wasGrowing; } // an ObjectGrowingEvent was sent for it while it was received
         virtual ~ObjectAddedEvent() {};
 
     private:
         std::string m_object_id;
+        bool m_wasGrowing;
+    };
+
+    // An object has started to arrive, see addGrowingObject()
+    class ObjectGrowingEvent : public Event {
+    public:
+        static constexpr const char c_eventName[] = "ObjectGrowing";
+
+        ObjectGrowingEvent(const std::string& object_id, const std::string& url)
+            : Event(typeIdOf<ObjectGrowingEvent>()), m_object_id(object_id), m_url(url) {}
+
+        std::string objectId() const { return m_object_id; }
+        const std::string &url() const { return m_url; }
+        virtual ~ObjectGrowingEvent() {};
+
+    private:
+        std::string m_object_id;
+        std::string m_url;
     };
 
     class ObjectDeletedEvent : public Event {
     public:
+        static constexpr const char c_eventName[] = "ObjectDeleted";
+
         ObjectDeletedEvent(const std::string& object_id)
-            : Event("ObjectDeleted"), m_object_id(object_id) {}
+            : Event(typeIdOf<ObjectDeletedEvent>()), m_object_id(object_id) {}
 
         std::string objectId() const { return m_object_id; }
         virtual ~ObjectDeletedEvent() {};
@@ -66,6 +98,50 @@ public:
         std::string m_object_id;
     };
 
+    // Sent once per committed Batch, or set of expired/evicted objects, in place of an event per object
+    class ObjectsAddedEvent : public Event {
+    public:
+        static constexpr const char c_eventName[] = "ObjectsAdded";
+
+        ObjectsAddedEvent(std::list<std::string> &&object_ids)
+            : Event(typeIdOf<ObjectsAddedEvent>()), m_object_ids(std::move(object_ids)) {}
+
+        const std::list<std::string> &objectIds() const { return m_object_ids; }
+        virtual ~ObjectsAddedEvent() {};
+
+    private:
+        std::list<std::string> m_object_ids;
+    };
+
+    class ObjectsDeletedEvent : public Event {
+    public:
+        static constexpr const char c_eventName[] = "ObjectsDeleted";
+
+        ObjectsDeletedEvent(std::list<std::string> &&object_ids)
+            : Event(typeIdOf<ObjectsDeletedEvent>()), m_object_ids(std::move(object_ids)) {}
+
+        const std::list<std::string> &objectIds() const { return m_object_ids; }
+        virtual ~ObjectsDeletedEvent() {};
+
+    private:
+        std::list<std::string> m_object_ids;
+    };
+
+    // Object was revalidated with the origin (e.g. HTTP 304 Not Modified) and its metadata refreshed, payload unchanged
+    class ObjectRefreshedEvent : public Event {
+    public:
+        static constexpr const char c_eventName[] = "ObjectRefreshed";
+
+        ObjectRefreshedEvent(const std::string& object_id)
+            : Event(typeIdOf<ObjectRefreshedEvent>()), m_object_id(object_id) {}
+
+        std::string objectId() const { return m_object_id; }
+        virtual ~ObjectRefreshedEvent() {};
+
+    private:
+        std::string m_object_id;
+    };
+
     class Metadata {
     public:
         Metadata();
@@ -96,14 +172,28 @@ public:
         const std::optional<std::chrono::system_clock::time_point>& cacheExpires() const { return m_cacheExpires;};
         std::optional<std::chrono::system_clock::time_point>& cacheExpires(std::chrono::system_clock::time_point cacheExpires) { m_cacheExpires = cacheExpires; return m_cacheExpires;};
         static int cacheExpiry()  {return CACHE_EXPIRES;};
+        static int cacheMinimumHold()  {return CACHE_MINIMUM_HOLD;}; // seconds an object is kept for, however stale
         static int cacheExpiryInterval()  {return CHECK_EXPIRY_INTERVAL;};
 
+        // When the object stops being fresh and must be revalidated before it is reused. This is only advice to the
+        // store, which keeps the object until cacheExpires().
+        const std::optional<std::chrono::system_clock::time_point> &freshUntil() const { return m_freshUntil;};
+        Metadata &freshUntil(const std::optional<std::chrono::system_clock::time_point> &fresh_until) {m_freshUntil = fresh_until; return *this;};
+
+        // The origin asked that the object is not kept in non-volatile storage (Cache-Control: no-store)
+        bool noStore() const { return m_noStore;};
+        Metadata &noStore(bool no_store) {m_noStore = no_store; return *this;};
+
         const std::optional<std::string> &entityTag() const { return m_entityTag;};
 
         bool hasEntityTag() {return m_entityTag.has_value();};
 
         Metadata &entityTag(const std::optional<std::string>& entityTag) {m_entityTag = entityTag; return *this;};
 
+        // Last-Modified as given by the origin, used with entityTag() to revalidate the object
+        const std::optional<std::chrono::system_clock::time_point> &lastModified() const { return m_lastModified;};
+        Metadata &lastModified(const std::optional<std::chrono::system_clock::time_point> &last_modified) {m_lastModified = last_modified; return *this;};
+
 	Metadata &keepAfterSend(bool keep_after_send) {m_keepAfterSend = keep_after_send; return *this;};
         bool keepAfterSend() const { return m_keepAfterSend;};
 
@@ -118,9 +208,17 @@ public:
         Metadata &objDistributionBaseUrl(std::nullopt_t) {m_objDistributionBaseUrl.reset(); return *this;};
 
 	const std::chrono::system_clock::time_point receivedTime() const { return m_receivedTime;};
+        Metadata &receivedTime(const std::chrono::system_clock::time_point &received_time) { m_receivedTime = received_time; return *this;};
 	const std::chrono::system_clock::time_point created() const { return m_created;};
+        Metadata &created(const std::chrono::system_clock::time_point &created) { m_created = created; return *this;};
 	const std::chrono::system_clock::time_point modified() const { return m_modified;};
 
+        // Version chaining: objects fetched from the same URL supersede each other, see ObjectStore::addObject()
+        unsigned long version() const { return m_version; };
+        Metadata &version(unsigned long version) { m_version = version; return *this; };
+        const std::optional<std::string> &previousVersion() const { return m_previousVersion; };
+        Metadata &previousVersion(const std::optional<std::string> &previous_object_id) { m_previousVersion = previous_object_id; return *this; };
+
     private:
 	std::string m_objectId;
         std::string m_mediaType;
@@ -131,14 +229,110 @@ public:
         std::optional<std::string> m_objIngestBaseUrl;
         std::optional<std::string> m_objDistributionBaseUrl;
         std::optional<std::string> m_entityTag;
+        std::optional<std::chrono::system_clock::time_point> m_lastModified;
         std::optional<std::chrono::system_clock::time_point> m_cacheExpires;
+        std::optional<std::chrono::system_clock::time_point> m_freshUntil;
+        bool m_noStore;
         std::chrono::system_clock::time_point m_receivedTime;
         std::chrono::system_clock::time_point m_created;
         std::chrono::system_clock::time_point m_modified;
+        unsigned long m_version;
+        std::optional<std::string> m_previousVersion;
     };
 
     using ObjectData = std::vector<unsigned char>;
-    using Object = std::pair<ObjectData, Metadata>;
+
+    /* Handle to a stored object
+     *
+     * Holding an Object pins both the payload and the metadata snapshot it was created with, so the bytes can be
+     * used without any store lock held and remain valid even if the store entry is replaced or deleted. The memory
+     * is released when the last Object referring to it goes away.
+     */
+    class Object {
+    public:
+        Object() = delete;
+        Object(const std::shared_ptr<const ObjectBuffer> &buffer, const std::shared_ptr<const Metadata> &metadata)
+            :m_buffer(buffer), m_metadata(metadata) {};
+        Object(const Object &other) = default;
+        Object(Object &&other) = default;
+        virtual ~Object() {};
+
+        Object &operator=(const Object &other) = default;
+        Object &operator=(Object &&other) = default;
+
+        const ObjectBuffer &data() const { return *m_buffer; };
+        const std::shared_ptr<const ObjectBuffer> &buffer() const { return m_buffer; };
+        const Metadata &metadata() const { return *m_metadata; };
+        const std::shared_ptr<const Metadata> &metadataPtr() const { return m_metadata; };
+
+    private:
+        friend class ObjectStore;
+
+        std::shared_ptr<const ObjectBuffer> m_buffer;
+        std::shared_ptr<const Metadata> m_metadata;
+    };
+
+    /* A set of additions and deletions to apply to the store in one go
+     *
+     * Build the batch without any store locks held and then pass it to ObjectStore::commit(). All the shards involved are
+     * locked once for the whole batch and subscribers receive a single ObjectsDeleted and/or ObjectsAdded event listing
+     * the affected object ids rather than an event per object. Deletions are applied before additions.
+     */
+    class Batch {
+    public:
+        Batch() :m_additions(), m_deletions(), m_residentSize(0) {};
+        Batch(const Batch &) = delete;
+        Batch(Batch &&) = default;
+        virtual ~Batch() {};
+
+        Batch &operator=(const Batch &) = delete;
+        Batch &operator=(Batch &&) = default;
+
+        Batch &addObject(const std::string &object_id, ObjectData &&object, Metadata &&metadata);
+        Batch &addObject(const std::string &object_id, const std::shared_ptr<const ObjectBuffer> &object, Metadata &&metadata);
+        Batch &deleteObject(const std::string &object_id);
+
+        bool empty() const { return m_additions.empty() && m_deletions.empty(); };
+        std::size_t size() const { return m_additions.size() + m_deletions.size(); };
+        std::size_t residentSize() const { return m_residentSize; }; // memory used by the added payloads
+
+    private:
+        friend class ObjectStore;
+
+        struct Addition {
+            std::string objectId;
+            std::shared_ptr<const ObjectBuffer> buffer;
+            Metadata metadata;
+        };
+
+        std::list<Addition> m_additions;
+        std::list<std::string> m_deletions;
+        std::size_t m_residentSize;
+    };
+
+    /* Memory budget shared by all ObjectStore instances
+     *
+     * Limits are in payload bytes, 0 means unlimited. Each ObjectStore belongs to one distribution session so
+     * sessionLimit applies per store and totalLimit across every store in the process. When PSI memory pressure
+     * (some avg10) goes above pressureThreshold the total limit is halved until the pressure subsides.
+     */
+    struct MemoryBudget {
+        std::size_t sessionLimit;
+        std::size_t totalLimit;
+        unsigned int highWaterMarkPercent;
+        unsigned int retryAfter; // seconds to suggest to clients when backpressure is applied
+        std::optional<double> pressureThreshold;
+    };
+
+    /* Spool configuration shared by all ObjectStore instances
+     *
+     * Objects of at least threshold bytes are written to a file in directory and mapped rather than being kept on
+     * the heap. An empty directory disables spooling.
+     */
+    struct SpoolConfig {
+        std::string directory;
+        std::size_t threshold;
+    };
 
     ObjectStore() = delete;
     ObjectStore(ObjectController &controller);
@@ -149,26 +343,137 @@ public:
     ObjectStore &operator=(ObjectStore&&) = delete;
 
     void addObject(const std::string& object_id, ObjectData &&object, Metadata &&metadata);
-    const ObjectData& getObjectData(const std::string& object_id) const;
-    ObjectData& getObjectData(const std::string& object_id);
-    const Metadata& getMetadata(const std::string& object_id) const;
-    Metadata& getMetadata(const std::string& object_id);
+    void addObject(const std::string& object_id, const std::shared_ptr<const ObjectBuffer> &object, Metadata &&metadata);
+    // As addObject() but only if none of the object's URLs already has an object in the store, false if not added
+    bool addObjectIfNew(const std::string& object_id, const std::shared_ptr<const ObjectBuffer> &object, Metadata &&metadata);
+    Object getObject(const std::string& object_id) const; // throws std::out_of_range if object_id is not in the store
+    std::optional<Object> findObject(const std::string& object_id) const;
+    std::optional<std::string> currentObjectId(const std::string& url) const;
+    std::optional<Object> findObjectByUrl(const std::string& url) const;
+    ObjectData getObjectData(const std::string& object_id) const; // copies the payload, use getObject() to avoid the copy
+    Metadata getMetadata(const std::string& object_id) const;
+    bool updateMetadata(const std::string& object_id, const std::function<void(Metadata&)> &update_fn);
+    bool refreshObject(const std::string& object_id, const std::function<void(Metadata&)> &update_fn); // updateMetadata() and send ObjectRefreshedEvent
     void deleteObject(const std::string& object_id);
-    bool removeObject(const std::string& objectId);
-    bool removeObjects(const std::list<std::string>& objectIds);
-    std::list<std::pair<const std::string*, const Object*>> getExpired();
-    const Object &operator[](const std::string& object_id) const;
-    bool isStale(const std::string& object_id) const;
-    std::map<std::string, const Object&> getStale() const;
+    void deleteObjects(const std::list<std::string>& object_ids);
+    void commit(Batch &&batch);
+    bool removeObject(const std::string& objectId); // removes without notifying subscribers, true if it was present
+    bool removeObjects(const std::list<std::string>& objectIds); // as a Batch without notifying subscribers, true if any were present
+    std::list<std::pair<std::string, Object> > getExpired() const;
+    Object operator[](const std::string& object_id) const { return getObject(object_id); };
+    bool isStale(const std::string& object_id) const; // no longer fresh, see Metadata::freshUntil()
+    std::map<std::string, Object> getStale() const;
+
+    // Objects queued for sending are not removed when they expire. Each holdForSending() needs a releaseSendHold().
+    void holdForSending(const std::string& object_id);
+    void releaseSendHold(const std::string& object_id);
 
     const ObjectController &objectController() const { return m_controller; };
 
+    /* Objects still being received
+     *
+     * An ingester can list an object with addGrowingObject() as soon as it starts to arrive, so that packagers can
+     * queue it straight away rather than waiting for its ObjectAddedEvent. Only its IngestProgress is listed, the body
+     * stays in the ingester's receive buffer. The growing object is replaced when the complete object is added with
+     * addObject() (whose ObjectAddedEvent then has wasGrowing() set), or removed if the ingest fails with
+     * abandonGrowingObject(). A notifyWhenAdded() listener is called once, with the store's growing object lock held,
+     * when either happens. Listeners should be quick, e.g. wake a ReactorTask.
+     */
+    using GrowingListenerId = std::uint64_t;
+    using GrowingListener = std::function<void()>;
+    static constexpr GrowingListenerId c_noGrowingListener = 0;
+
+    bool addGrowingObject(const std::string& object_id, const std::string& url,
+                          const std::shared_ptr<const IngestProgress> &progress); // false if already growing
+    std::shared_ptr<const IngestProgress> findGrowingObject(const std::string& object_id) const;
+    void abandonGrowingObject(const std::string& object_id);
+    GrowingListenerId notifyWhenAdded(const std::string& object_id, GrowingListener &&listener); // c_noGrowingListener if not growing
+    void cancelNotifyWhenAdded(const std::string& object_id, GrowingListenerId listener_id);
+
+    static void checkExpiredObjectsInAllStores();
+
+    static const SpoolConfig &spoolConfig();
+    static void spoolConfig(const SpoolConfig &config);
+    static bool shouldSpool(std::size_t object_size);
+
+    static const MemoryBudget &memoryBudget();
+    static void memoryBudget(const MemoryBudget &budget);
+    std::size_t bytesUsed() const { return m_bytesUsed; };
+    static std::size_t totalBytesUsed();
+    bool overHighWaterMark(std::size_t pending_bytes = 0) const; // pending_bytes are about to be added
+
 private:
-    void checkExpiredObjects();
-    mutable std::recursive_mutex m_mutex;
-    ObjectController &m_controller;
-    std::map<std::string, Object> m_store;
+    // The store is split into shards, each with its own reader/writer lock, so that lookups from the packager only
+    // contend with writers to the same shard and then only for the duration of a hash table node insert/extract.
+    static constexpr std::size_t c_numShards = 16;
+    using ShardMap = std::unordered_map<std::string, Object>;
+    struct Shard {
+        mutable std::shared_mutex mutex;
+        ShardMap objects;
+    };
 
+    // Cache expiry times in order. Each object with an expiry time has exactly one entry, found through
+    // m_expiryPositions, which is updated under the object's shard write lock as the object enters or leaves the store
+    // or its expiry time changes.
+    struct ExpiryEntry {
+        std::chrono::system_clock::time_point expires;
+        std::string objectId;
+    };
+    using ExpiryIndex = std::multimap<std::chrono::system_clock::time_point, std::string>;
+
+    // Objects that may be evicted to stay within the memory budget, oldest received first. Objects marked
+    // keepAfterSend are left out. Kept up to date in the same way as the ExpiryIndex.
+    using EvictionOrder = std::multimap<std::chrono::system_clock::time_point, std::string>;
+
+    // Original and fetched URLs map to the object id and version currently held for that URL
+    struct UrlIndexEntry {
+        std::string objectId;
+        unsigned long version;
+    };
+    using UrlIndex = std::unordered_map<std::string, UrlIndexEntry>;
+
+    struct GrowingEntry {
+        std::shared_ptr<const IngestProgress> progress;
+        std::map<GrowingListenerId, GrowingListener> listeners;
+    };
+
+    std::size_t shardIndex(const std::string &object_id) const;
+    Shard &shard(const std::string &object_id);
+    const Shard &shard(const std::string &object_id) const;
+
+    ShardMap::node_type extractObject(Shard &shd, const std::string &object_id);
+    bool insertObject(const std::string& object_id, const std::shared_ptr<const ObjectBuffer> &object, Metadata &&metadata,
+                      bool only_if_new);
+    std::size_t applyBatch(Batch &&batch, bool notify); // returns the number of objects taken out of the store
+    bool indexUrls(const std::string &object_id, Metadata &metadata, std::optional<std::string> &superseded_id,
+                   bool only_if_new = false);
+    void unindexUrls(const std::string &object_id, const Metadata &metadata);
+    void enforceMemoryBudget(const std::set<std::string> &added_object_ids);
+    void indexExpiry(const std::string &object_id, const Metadata &metadata);
+    void unindexExpiry(const std::string &object_id);
+    void indexEviction(const std::string &object_id, const Metadata &metadata);
+    void unindexEviction(const std::string &object_id);
+    std::vector<ExpiryEntry> expiredEntries(const std::chrono::system_clock::time_point &now) const;
+    bool isCurrentExpiryEntry(const Shard &shd, const ExpiryEntry &entry) const;
+    void checkExpiredObjects(const std::set<std::string> &except_object_ids = {});
+    bool heldForSending(const std::string &object_id) const;
+    bool endGrowing(const std::string &object_id);
+    ObjectController &m_controller;
+    std::array<Shard, c_numShards> m_shards;
+    std::atomic<std::size_t> m_bytesUsed;
+    mutable std::mutex m_expiryMutex; // taken after a shard lock, never before one
+    ExpiryIndex m_expiryIndex;
+    std::unordered_map<std::string, ExpiryIndex::iterator> m_expiryPositions;
+    mutable std::mutex m_evictionMutex; // taken after a shard lock, never before one
+    EvictionOrder m_evictionOrder;
+    std::unordered_map<std::string, EvictionOrder::iterator> m_evictionPositions;
+    mutable std::mutex m_sendHoldsMutex; // not held while taking any other lock
+    std::unordered_map<std::string, unsigned int> m_sendHolds;
+    mutable std::shared_mutex m_urlIndexMutex;
+    UrlIndex m_urlIndex;
+    mutable std::mutex m_growingMutex;
+    std::unordered_map<std::string, GrowingEntry> m_growingObjects;
+    GrowingListenerId m_nextGrowingListenerId;
 };
 
 MBSTF_NAMESPACE_STOP
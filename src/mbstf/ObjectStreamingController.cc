@@ -78,66 +78,115 @@ std::shared_ptr<ObjectListPackager> ObjectStreamingController::getObjectListPack
 
 void ObjectStreamingController::processEvent(Event &event, SubscriptionService &event_service)
 {
-    if (event.eventName() == "ObjectAdded") {
-        ObjectStore::ObjectAddedEvent &objAddedEvent = dynamic_cast<ObjectStore::ObjectAddedEvent&>(event);
+    if (event.is<ObjectStore::ObjectAddedEvent>()) {
+        ObjectStore::ObjectAddedEvent &objAddedEvent = event.as<ObjectStore::ObjectAddedEvent>();
         std::string objectId = objAddedEvent.objectId();
         ogs_info("Object added with ID: %s", objectId.c_str());
-	if(check_if_object_added_is_manifest(objectId, objectStore(), getManifestUrl())) {
-	    const ObjectStore::Object &object = objectStore()[objectId];
-	    if(manifestHandler()) {
-	        try {
-	            if(!manifestHandler()->update(object)) {
-		        ogs_error("Failed to update Manifest");
-			unsetObjectListPackager();
-			event.stopProcessing();
-			return;
-		    }
-		    startWorker();
-
-                    if (!packager()) {
-                        setObjectListPackager();
-                    }
-
-		    ObjectListPackager::PackageItem item(objectId);
-		    getObjectListPackager()->add(item);
-	        } catch (std::exception &ex) {
-                    ogs_error("Invalid Manifest update: %s", ex.what());
-		    unsetObjectListPackager();
-		    event.stopProcessing();
-		    return;
-                }
+        // Anything but the manifest was queued with the packager when it started to grow
+        if ((!objAddedEvent.wasGrowing() || check_if_object_added_is_manifest(objectId, objectStore(), getManifestUrl()))
+            && !objectAdded(objectId)) {
+            event.stopProcessing();
+            return;
+        }
+    } else if (event.is<ObjectStore::ObjectsAddedEvent>()) {
+        ObjectStore::ObjectsAddedEvent &objsAddedEvent = event.as<ObjectStore::ObjectsAddedEvent>();
+        ogs_info("%zu objects added", objsAddedEvent.objectIds().size());
+        for (std::string objectId : objsAddedEvent.objectIds()) {
+            if (!objectAdded(objectId)) {
+                event.stopProcessing();
+                return;
+            }
+        }
+    } else if (event.is<ObjectStore::ObjectGrowingEvent>()) {
+        ObjectStore::ObjectGrowingEvent &obj_growing_event = event.as<ObjectStore::ObjectGrowingEvent>();
+        // The manifest has to be complete before it can be parsed, so it waits for the ObjectAddedEvent
+        if (obj_growing_event.url() != getManifestUrl()) {
+            ogs_debug("Object growing with ID: %s", obj_growing_event.objectId().c_str());
+            if (!packager()) {
+                setObjectListPackager();
+            }
+            ObjectListPackager::PackageItem item(obj_growing_event.objectId());
+            getObjectListPackager()->add(item);
+        }
+    } else if (event.is<ObjectStore::ObjectRefreshedEvent>()) {
+        ObjectStore::ObjectRefreshedEvent &objRefreshedEvent = event.as<ObjectStore::ObjectRefreshedEvent>();
+        std::string objectId = objRefreshedEvent.objectId();
+        if (manifestHandler() && check_if_object_added_is_manifest(objectId, objectStore(), getManifestUrl())) {
+            // Manifest not modified, it doesn't need parsing again but the handler needs to schedule the next refresh
+            std::optional<ObjectStore::Object> found_object(objectStore().findObject(objectId));
+            if (found_object && manifestHandler()->refreshed(found_object.value())) manifestUpdated();
+        }
+        // Send the refreshed manifest or init segment again, as objectAdded() would, for receivers that joined since
+        if (!packager()) {
+            setObjectListPackager();
+        }
+        ObjectListPackager::PackageItem item(objectId);
+        getObjectListPackager()->add(item);
+    }
+    ObjectManifestController::processEvent(event, event_service);
+}
 
-	    } else {
-		std::unique_ptr<ManifestHandler> manifest_handler(ManifestHandlerFactory::makeManifestHandler(object, this, distributionSession().getObjectAcquisitionMethod() == "PULL"));
-                manifestHandler(std::move(manifest_handler));
-                /*
-                const ObjectStore::Metadata &metadata = objectStore().getMetadata(objectId);
-                try {
-                    manifestHandler()->validateManifest(object, object_data, metadata);
-                }  catch (std::exception &ex) {
-                    ogs_info("InVALID Manifest Validation: %s", ex.what());
+bool ObjectStreamingController::objectAdded(std::string &objectId)
+{
+    if(check_if_object_added_is_manifest(objectId, objectStore(), getManifestUrl())) {
+        std::optional<ObjectStore::Object> found_object(objectStore().findObject(objectId));
+        if (!found_object) {
+            ogs_debug("Manifest object [%s] already superseded", objectId.c_str());
+            return true;
+        }
+        ObjectStore::Object &object(found_object.value());
+        if(manifestHandler()) {
+            try {
+                if(!manifestHandler()->update(object)) {
+                    ogs_error("Failed to update Manifest");
                     unsetObjectListPackager();
-                    return;
+                    return false;
                 }
-                */
+                manifestUpdated();
+
                 if (!packager()) {
                     setObjectListPackager();
                 }
 
-		ObjectListPackager::PackageItem item(objectId);
-		getObjectListPackager()->add(item);
+                ObjectListPackager::PackageItem item(objectId);
+                getObjectListPackager()->add(item);
+            } catch (std::exception &ex) {
+                ogs_error("Invalid Manifest update: %s", ex.what());
+                unsetObjectListPackager();
+                return false;
             }
-	} else {
+
+        } else {
+            std::unique_ptr<ManifestHandler> manifest_handler(ManifestHandlerFactory::makeManifestHandler(object, this, distributionSession().getObjectAcquisitionMethod() == "PULL"));
+            manifestHandler(std::move(manifest_handler));
+            /*
+            const ObjectStore::Metadata &metadata = objectStore().getMetadata(objectId);
+            try {
+                manifestHandler()->validateManifest(object, object_data, metadata);
+            }  catch (std::exception &ex) {
+                ogs_info("InVALID Manifest Validation: %s", ex.what());
+                unsetObjectListPackager();
+                return;
+            }
+            */
             if (!packager()) {
                 setObjectListPackager();
             }
 
-	    ObjectListPackager::PackageItem item(objectId);
+            ObjectListPackager::PackageItem item(objectId);
             getObjectListPackager()->add(item);
         }
+    } else {
+        if (!packager()) {
+            setObjectListPackager();
+        }
+
+        ObjectListPackager::PackageItem item(objectId);
+        getObjectListPackager()->add(item);
     }
-    ObjectManifestController::processEvent(event, event_service);
+    return true;
 }
+
 /*
 std::string ObjectStreamingController::generateUUID() {
     uuid_t uuid;
@@ -169,9 +218,9 @@ static void validate_distribution_session(DistributionSession &distributionSessi
 }
 
 static bool check_if_object_added_is_manifest(std::string &objectId, ObjectStore &objectStore, std::string &manifest_url) {
-    ObjectStore::Metadata &metadata = objectStore.getMetadata(objectId);
-    if(metadata.getOriginalUrl() == manifest_url || metadata.getFetchedUrl() == manifest_url) {
-        metadata.keepAfterSend(true);
+    std::optional<std::string> current_manifest_id(objectStore.currentObjectId(manifest_url));
+    if (current_manifest_id && current_manifest_id.value() == objectId) {
+        objectStore.updateMetadata(objectId, [](ObjectStore::Metadata &m) { m.keepAfterSend(true); });
         return true;
     }
     /*
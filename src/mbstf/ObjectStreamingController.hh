@@ -65,6 +65,7 @@ public:
 
 
 private:
+    bool objectAdded(std::string &objectId);
     //std::string generateUUID();
     //std::shared_ptr<ObjectListPackager> m_objectListPackager;
 //    std::thread m_ingestSchedulingThread;
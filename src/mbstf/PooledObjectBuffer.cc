@@ -0,0 +1,83 @@
+/******************************************************************************
+ * 5G-MAG Reference Tools: MBS Traffic Function: Pooled Object Buffer class
+ ******************************************************************************
+ * Copyright: (C)2025 British Broadcasting Corporation
+ * Author(s): David Waring <david.waring2@bbc.co.uk>
+ * License: 5G-MAG Public License v1
+ *
+ * For full license terms please see the LICENSE file distributed with this
+ * program. If this file is missing then the license can be retrieved from
+ * https://drive.google.com/file/d/1cinCiA778IErENZ3JN52VFW-1ffHpx7Z/view
+ */
+
+#include <cstring>
+#include <stdexcept>
+
+#include "common.hh"
+#include "BufferPool.hh"
+
+#include "PooledObjectBuffer.hh"
+
+MBSTF_NAMESPACE_START
+
+PooledObjectBuffer::PooledObjectBuffer(size_type initial_capacity)
+    :ObjectBuffer()
+    ,m_block{nullptr, 0}
+{
+    if (initial_capacity > 0) reserve(initial_capacity);
+}
+
+PooledObjectBuffer::~PooledObjectBuffer()
+{
+    BufferPool::instance().release(m_block);
+}
+
+PooledObjectBuffer &PooledObjectBuffer::append(const value_type *data, size_type size)
+{
+    if (size == 0) return *this;
+
+    size_type used = this->size();
+    if (used + size > capacity()) reserve(used + size);
+    std::memcpy(m_block.data + used, data, size);
+    view(m_block.data, used + size);
+
+    return *this;
+}
+
+PooledObjectBuffer &PooledObjectBuffer::reserve(size_type capacity)
+{
+    if (capacity <= this->capacity()) return *this;
+
+    BufferPool &pool(BufferPool::instance());
+    BufferPool::Block new_block(pool.allocate(capacity));
+    size_type used = size();
+    if (used > 0) std::memcpy(new_block.data, m_block.data, used);
+    pool.release(m_block);
+    m_block = new_block;
+    view(m_block.data, used);
+
+    return *this;
+}
+
+PooledObjectBuffer &PooledObjectBuffer::resize(size_type size)
+{
+    reserve(size);
+    view(m_block.data, size);
+
+    return *this;
+}
+
+PooledObjectBuffer &PooledObjectBuffer::write(size_type offset, const value_type *data, size_type size)
+{
+    if (offset > this->size() || size > this->size() - offset) {
+        throw std::out_of_range("Write beyond the end of a PooledObjectBuffer");
+    }
+    std::memcpy(m_block.data + offset, data, size);
+
+    return *this;
+}
+
+MBSTF_NAMESPACE_STOP
+
+/* vim:ts=8:sts=4:sw=4:expandtab:
+ */
@@ -0,0 +1,61 @@
+#ifndef _MBS_TF_POOLED_OBJECT_BUFFER_HH_
+#define _MBS_TF_POOLED_OBJECT_BUFFER_HH_
+/******************************************************************************
+ * 5G-MAG Reference Tools: MBS Traffic Function: Pooled Object Buffer class
+ ******************************************************************************
+ * Copyright: (C)2025 British Broadcasting Corporation
+ * Author(s): David Waring <david.waring2@bbc.co.uk>
+ * License: 5G-MAG Public License v1
+ *
+ * For full license terms please see the LICENSE file distributed with this
+ * program. If this file is missing then the license can be retrieved from
+ * https://drive.google.com/file/d/1cinCiA778IErENZ3JN52VFW-1ffHpx7Z/view
+ */
+
+#include <vector>
+
+#include "common.hh"
+#include "BufferPool.hh"
+#include "ObjectBuffer.hh"
+
+MBSTF_NAMESPACE_START
+
+/* Object payload held in a BufferPool block
+ *
+ * Ingesters fill one of these with append() before handing it to the ObjectStore, after which it is only used through
+ * std::shared_ptr<const ObjectBuffer>. When the last handle is dropped the block goes back to the pool for reuse.
+ * Growing past the current block moves the payload to a block of the next size class.
+ *
+ * Alternatively resize() to the full payload size and fill it in any order with write(), e.g. from byte ranges fetched
+ * in parallel. write() throws std::out_of_range for bytes beyond size().
+ */
+class PooledObjectBuffer : public ObjectBuffer {
+public:
+    PooledObjectBuffer(size_type initial_capacity = 0);
+    PooledObjectBuffer(const PooledObjectBuffer &) = delete;
+    PooledObjectBuffer(PooledObjectBuffer &&) = delete;
+
+    virtual ~PooledObjectBuffer();
+
+    PooledObjectBuffer &operator=(const PooledObjectBuffer &) = delete;
+    PooledObjectBuffer &operator=(PooledObjectBuffer &&) = delete;
+
+    PooledObjectBuffer &append(const value_type *data, size_type size);
+    PooledObjectBuffer &append(const std::vector<value_type> &data) { return append(data.data(), data.size()); };
+    PooledObjectBuffer &reserve(size_type capacity);
+    PooledObjectBuffer &resize(size_type size); // any new bytes are left uninitialised for write() to fill
+    PooledObjectBuffer &write(size_type offset, const value_type *data, size_type size);
+
+    size_type capacity() const { return m_block.size; };
+
+    virtual size_type residentSize() const { return capacity(); };
+
+private:
+    BufferPool::Block m_block;
+};
+
+MBSTF_NAMESPACE_STOP
+
+/* vim:ts=8:sts=4:sw=4:expandtab:
+ */
+#endif /* _MBS_TF_POOLED_OBJECT_BUFFER_HH_ */
@@ -10,8 +10,10 @@
  * https://drive.google.com/file/d/1cinCiA778IErENZ3JN52VFW-1ffHpx7Z/view
  */
 
+#include <algorithm>
 #include <memory>
 #include <stdexcept>
+#include <system_error>
 #include <utility>
 #include <chrono>
 #include <iostream>
@@ -22,12 +24,18 @@
 #include "PullObjectIngester.hh"
 #include "hash.hh"
 #include "Curl.hh"
+#include "CurlFetchEngine.hh"
+#include "HttpFreshness.hh"
+#include "IngestProgress.hh"
 #include "ObjectStore.hh"
+#include "RangedObjectBuffer.hh"
 
 using namespace std::literals::chrono_literals;
 
 MBSTF_NAMESPACE_START
 
+static PullObjectIngester::RangedFetchConfig g_rangedFetchConfig{32 * 1024 * 1024, 8 * 1024 * 1024, 4};
+
 PullObjectIngester::IngestItem::IngestItem(const ObjectStore::Metadata &object_meta,
                                            const std::optional<time_type> &download_deadline)
     :m_objectId(object_meta.objectId())
@@ -69,7 +77,28 @@ PullObjectIngester::IngestItem::IngestItem(IngestItem &&other)
 {
 }
 
-PullObjectIngester::~PullObjectIngester() {abort();}
+PullObjectIngester::~PullObjectIngester()
+{
+    abort();
+
+    // Make sure the CurlFetchEngine won't call back into this object
+    std::list<CurlFetchEngine::FetchId> fetch_ids;
+    {
+        std::lock_guard<std::recursive_mutex> lock(*m_ingestItemsMutex);
+        for (auto &[fetch_id, fetch] : m_fetchesInProgress) fetch_ids.push_back(fetch_id);
+    }
+    CurlFetchEngine &engine(CurlFetchEngine::instance());
+    for (auto fetch_id : fetch_ids) engine.cancel(fetch_id);
+
+    // None of the growing objects will be completed now
+    std::lock_guard<std::recursive_mutex> lock(*m_ingestItemsMutex);
+    for (auto &[fetch_id, fetch] : m_fetchesInProgress) {
+        if (fetch.growing) this->objectStore().abandonGrowingObject(fetch.item.objectId());
+    }
+    for (auto &fetch : m_completedFetches) {
+        if (fetch.growing) this->objectStore().abandonGrowingObject(fetch.item.objectId());
+    }
+}
 
 bool PullObjectIngester::fetch(const std::string &object_id, const std::optional<time_type> &download_deadline)
 {
@@ -92,7 +121,7 @@ bool PullObjectIngester::fetch(const std::string &object_id, const std::optional
     }
 
     sortListByPolicy();
-    m_ingestItemsCondVar.notify_all();
+    wakeWorker();
 
     return true;
 }
@@ -101,7 +130,7 @@ bool PullObjectIngester::fetch(const IngestItem &item) {
     std::lock_guard<std::recursive_mutex> lock(*m_ingestItemsMutex);
     m_fetchList.push_back(item);
     sortListByPolicy();
-    m_ingestItemsCondVar.notify_all();
+    wakeWorker();
     return true;
 }
 
@@ -109,10 +138,20 @@ bool PullObjectIngester::fetch(IngestItem &&item) {
     std::lock_guard<std::recursive_mutex> lock(*m_ingestItemsMutex);
     m_fetchList.push_back(std::move(item));
     sortListByPolicy();
-    m_ingestItemsCondVar.notify_all();
+    wakeWorker();
     return true;
 }
 
+const PullObjectIngester::RangedFetchConfig &PullObjectIngester::rangedFetchConfig()
+{
+    return g_rangedFetchConfig;
+}
+
+void PullObjectIngester::rangedFetchConfig(const RangedFetchConfig &config)
+{
+    g_rangedFetchConfig = config;
+}
+
 void PullObjectIngester::sortListByPolicy() {
     m_fetchList.sort([](const IngestItem &a, const IngestItem &b) {
         if (a.deadline().has_value() && b.deadline().has_value()) {
@@ -123,54 +162,286 @@ void PullObjectIngester::sortListByPolicy() {
 }
 
 void PullObjectIngester::doObjectIngest() {
-    if(!m_curl) m_curl = std::make_shared<Curl>();
-    {
-        std::lock_guard<std::recursive_mutex> lock(*m_ingestItemsMutex);
-        if (m_fetchList.empty()) {
-            m_ingestItemsCondVar.wait_for(*m_ingestItemsMutex, 500ms);
+    std::unique_lock<std::recursive_mutex> lock(*m_ingestItemsMutex);
+
+    // Deal with the fetches the CurlFetchEngine has finished
+    while (!m_completedFetches.empty()) {
+        Fetch fetch(std::move(m_completedFetches.front()));
+        m_completedFetches.pop_front();
+        lock.unlock();
+        fetchCompleted(fetch);
+        lock.lock();
+        m_idleCurls.push_back(std::move(fetch.curl));
+        if (m_pendingObjects.size() >= c_maxBatchObjects) commitPendingObjects();
+    }
+    if (!m_pendingObjects.empty() && std::chrono::steady_clock::now() - m_pendingSince >= c_maxBatchDelay) {
+        commitPendingObjects();
+    }
+
+    if (!m_fetchList.empty()) {
+        // Objects waiting to be committed will be in the store shortly, so count them too
+        if (this->objectStore().overHighWaterMark(m_pendingObjects.residentSize())) {
+            commitPendingObjects();
+            // Backpressure: defer fetches until the packager has drained the store below its high-water mark
+            ogs_debug("Object store over high-water mark, deferring %zu fetches", m_fetchList.size());
+            wakeWorkerAfter(100ms);
+            return;
         }
-        if (!m_fetchList.empty()) {
-            // Make the GET request and get the number of bytes received
-            auto item = m_fetchList.front();
-	    m_fetchList.pop_front();
-	    m_ingestItemsMutex->unlock(); // temp unlock while we fetch
-            ogs_debug("Fetching %s...", item.url().c_str());
-            const auto &deadline = item.deadline();
-            std::chrono::milliseconds timeout(10000);
-            if (deadline) {
-                timeout = std::chrono::duration_cast<std::chrono::milliseconds>(
-                                                            deadline.value() - std::chrono::system_clock::now());
-            }
-            long bytesReceived = -1;
-            if (timeout > 0s) {
-	        bytesReceived = m_curl->get(item.url(), timeout);
-            }
+        // The engine runs these in parallel, fetchDone() wakes us as each one finishes
+        while (!m_fetchList.empty() && m_fetchesInProgress.size() < c_maxFetchesInProgress) {
+            IngestItem item(std::move(m_fetchList.front()));
+            m_fetchList.pop_front();
+            startFetch(std::move(item));
+        }
+    }
+
+    if (m_fetchList.empty() && m_fetchesInProgress.empty()) commitPendingObjects();
+}
+
+std::shared_ptr<Curl> PullObjectIngester::idleCurl()
+{
+    std::shared_ptr<Curl> curl;
+    if (m_idleCurls.empty()) {
+        curl = std::make_shared<Curl>();
+        const ObjectStore::SpoolConfig &spool_config(ObjectStore::spoolConfig());
+        if (!spool_config.directory.empty()) curl->spool(spool_config.directory, spool_config.threshold);
+    } else {
+        curl = std::move(m_idleCurls.front());
+        m_idleCurls.pop_front();
+    }
+    return curl;
+}
+
+void PullObjectIngester::startFetch(IngestItem &&item)
+{
+    std::shared_ptr<Curl> curl(idleCurl());
+
+    // If we already have this URL, only transfer it again if it has changed
+    std::optional<std::string> revalidating;
+    std::optional<ObjectStore::Object> current(this->objectStore().findObjectByUrl(item.url()));
+    if (current) {
+        const ObjectStore::Metadata &current_meta(current->metadata());
+        if (current_meta.entityTag() || current_meta.lastModified()) {
+            curl->conditional(current_meta.entityTag(), current_meta.lastModified());
+            revalidating = current_meta.objectId();
+        }
+    }
 
-            // Check the result
-            if (bytesReceived >= 0) {
-                ogs_debug("Received %ld bytes of data", bytesReceived);
-	        auto lastModified = std::chrono::system_clock::now();
-                std::string fetched_url = m_curl->getPermanentRedirectUrl();
-                if (fetched_url.empty()) fetched_url = item.url();
-	        ObjectStore::Metadata metadata(item.objectId(), m_curl->getContentType(), item.url(), fetched_url, item.acquisitionId(), lastModified, item.objIngestBaseUrl(), item.objDistributionBaseUrl());
-                unsigned long max_age = m_curl->getCacheControlMaxAge();
-	        metadata.cacheExpires(max_age ? std::chrono::system_clock::now() + std::chrono::seconds(max_age) : std::chrono::system_clock::now() + std::chrono::seconds(ObjectStore::Metadata::cacheExpiry()));
-                const std::string& etag = m_curl->getEtag();
-	        if (!etag.empty()) {
-                    metadata.entityTag(etag);
-	        }
-	        this->objectStore().addObject(item.objectId(), std::move(m_curl->getData()), std::move(metadata));
-
-            } else if (bytesReceived == -1) {
-                ogs_error("Request timed out.");
-                // emitObjectIngestFailedEvent();
-            } else {
-                ogs_error("An error occurred while fetching the data.");
-                // emitObjectIngestFailedEvent();
+    // Objects needed by a deadline (e.g. live media segments) are listed in the store while they arrive, so that a
+    // packager can queue them without waiting for the ObjectAddedEvent
+    bool growing = false;
+    if (item.hasDeadline() && !revalidating) {
+        std::shared_ptr<IngestProgress> progress(std::make_shared<IngestProgress>());
+        if (this->objectStore().addGrowingObject(item.objectId(), item.url(), progress)) {
+            curl->reportProgress(progress);
+            growing = true;
+        }
+    }
+    if (!growing && g_rangedFetchConfig.threshold && g_rangedFetchConfig.rangeSize &&
+        m_unsplitObjectIds.erase(item.objectId()) == 0) {
+        curl->splitLargeResponse(g_rangedFetchConfig.threshold, g_rangedFetchConfig.rangeSize);
+    }
+
+    ogs_debug("Fetching %s...", item.url().c_str());
+    // fetchDone() needs m_ingestItemsMutex, which we hold, so it will find the fetch in m_fetchesInProgress
+    CurlFetchEngine::FetchId fetch_id = CurlFetchEngine::instance().fetch(curl, item.url(), item.deadline(),
+                                                [this](CurlFetchEngine::FetchId id, long result) {
+                                                    fetchDone(id, result);
+                                                });
+    m_fetchesInProgress.emplace(fetch_id, Fetch(std::move(item), std::move(curl), revalidating, growing));
+}
+
+void PullObjectIngester::fetchDone(CurlFetchEngine::FetchId fetch_id, long result)
+{
+    std::lock_guard<std::recursive_mutex> lock(*m_ingestItemsMutex);
+    auto it = m_fetchesInProgress.find(fetch_id);
+    if (it == m_fetchesInProgress.end()) return;
+    it->second.result = result;
+    m_completedFetches.push_back(std::move(it->second));
+    m_fetchesInProgress.erase(it);
+    wakeWorker();
+}
+
+void PullObjectIngester::fetchCompleted(const Fetch &fetch)
+{
+    if (fetch.ranged) {
+        rangeCompleted(fetch);
+        return;
+    }
+
+    const IngestItem &item(fetch.item);
+    Curl &curl(*fetch.curl);
+    long bytesReceived = fetch.result;
+
+    // Check the result
+    if (bytesReceived >= 0) {
+        // For a 304 the freshness comes from the validating response (RFC 9111 section 4.3.4). The freshness lifetime
+        // only says when to revalidate, a response can be stale on arrival but still needs to be held while it is sent.
+        const HttpFreshness &freshness(curl.getFreshness());
+        auto now = std::chrono::system_clock::now();
+        auto fresh_until = freshness.expires(std::chrono::seconds(ObjectStore::Metadata::cacheExpiry()));
+        auto cache_expires = std::max(fresh_until, now + std::chrono::seconds(ObjectStore::Metadata::cacheMinimumHold()));
+        if (curl.getStatusCode() == 304 && fetch.revalidating) {
+            // Not modified: keep the stored object, just bring its expiry up to date (no ObjectAdded event)
+            ogs_debug("%s not modified", item.url().c_str());
+            if (!this->objectStore().refreshObject(fetch.revalidating.value(),
+                                                   [&](ObjectStore::Metadata &meta) {
+                    meta.cacheExpires(cache_expires);
+                    meta.freshUntil(fresh_until);
+                    meta.noStore(freshness.noStore());
+                    meta.receivedTime(now);
+                })) {
+                ogs_error("Object %s for %s went from the store during revalidation",
+                          fetch.revalidating.value().c_str(), item.url().c_str());
             }
-            m_ingestItemsMutex->lock();
-	}
+            return;
+        }
+        ogs_debug("Received %ld bytes of data", bytesReceived);
+        auto lastModified = std::chrono::system_clock::now();
+        std::string fetched_url = curl.getPermanentRedirectUrl();
+        if (fetched_url.empty()) fetched_url = item.url();
+        ObjectStore::Metadata metadata(item.objectId(), curl.getContentType(), item.url(), fetched_url, item.acquisitionId(), lastModified, item.objIngestBaseUrl(), item.objDistributionBaseUrl());
+        metadata.cacheExpires(cache_expires);
+        metadata.freshUntil(fresh_until);
+        metadata.noStore(freshness.noStore());
+        const std::string& etag = curl.getEtag();
+        if (!etag.empty()) {
+            metadata.entityTag(etag);
+        }
+        metadata.lastModified(curl.getLastModified());
+        if (curl.responseSplit()) {
+            startRangedFetch(item, curl, bytesReceived, std::move(metadata));
+        } else {
+            addFetchedObject(item, curl.takeBuffer(), std::move(metadata));
+        }
+
+    } else if (bytesReceived == -1) {
+        ogs_error("Request timed out.");
+        if (fetch.growing) this->objectStore().abandonGrowingObject(item.objectId());
+        // emitObjectIngestFailedEvent();
+    } else {
+        ogs_error("An error occurred while fetching the data.");
+        if (fetch.growing) this->objectStore().abandonGrowingObject(item.objectId());
+        // emitObjectIngestFailedEvent();
+    }
+}
+
+void PullObjectIngester::addFetchedObject(const IngestItem &item, const std::shared_ptr<const ObjectBuffer> &buffer,
+                                          ObjectStore::Metadata &&metadata)
+{
+    if (item.hasDeadline()) {
+        this->objectStore().addObject(item.objectId(), buffer, std::move(metadata));
+    } else {
+        // Objects without a deadline (e.g. a long object list) are added in batches to avoid an event storm
+        if (m_pendingObjects.empty()) {
+            m_pendingSince = std::chrono::steady_clock::now();
+            wakeWorkerAfter(c_maxBatchDelay);
+        }
+        m_pendingObjects.addObject(item.objectId(), buffer, std::move(metadata));
+    }
+}
+
+void PullObjectIngester::startRangedFetch(const IngestItem &item, Curl &curl, std::size_t received,
+                                          ObjectStore::Metadata &&metadata)
+{
+    // Only a strong validator makes sure the ranges are all from the same version of the object (RFC 9110 13.1.5)
+    std::optional<std::string> validator;
+    const std::string &etag(curl.getEtag());
+    if (!etag.empty() && !etag.starts_with("W/")) {
+        validator = etag;
+    } else if (auto last_modified = curl.getHeaders().get("Last-Modified")) {
+        validator = std::string(last_modified.value());
+    }
+    std::string url(curl.getEffectiveUrl());
+    if (url.empty()) url = item.url();
+
+    std::shared_ptr<RangedFetch> ranged(std::make_shared<RangedFetch>(item, std::move(metadata),
+                                                                      curl.takeRangedBuffer(), url, validator));
+    // The response to the first request gave us the start of the object
+    std::size_t object_size = ranged->buffer->size();
+    std::size_t range_size = std::max(g_rangedFetchConfig.rangeSize, received);
+    for (std::size_t first = received; first < object_size; first += range_size) {
+        ranged->pending.push_back(ByteRange{first, std::min(first + range_size, object_size) - 1, 0});
     }
+    ogs_debug("Fetching the remaining %zu bytes of %s as %zu byte ranges", object_size - received, url.c_str(),
+              ranged->pending.size());
+
+    std::lock_guard<std::recursive_mutex> lock(*m_ingestItemsMutex);
+    startRanges(ranged);
+}
+
+void PullObjectIngester::startRanges(const std::shared_ptr<RangedFetch> &ranged)
+{
+    // Must be called with m_ingestItemsMutex held
+    unsigned int max_ranges = std::max(g_rangedFetchConfig.maxRanges, 1u);
+    while (!ranged->pending.empty() && ranged->inProgress < max_ranges) {
+        ByteRange range(ranged->pending.front());
+        ranged->pending.pop_front();
+        std::shared_ptr<Curl> curl(idleCurl());
+        curl->byteRange(ranged->buffer, range.first, range.last, ranged->validator);
+        CurlFetchEngine::FetchId fetch_id = CurlFetchEngine::instance().fetch(curl, ranged->url,
+                                                ranged->item.deadline(),
+                                                [this](CurlFetchEngine::FetchId id, long result) {
+                                                    fetchDone(id, result);
+                                                });
+        m_fetchesInProgress.emplace(fetch_id, Fetch(std::move(curl), ranged, range));
+        ranged->inProgress++;
+    }
+}
+
+void PullObjectIngester::rangeCompleted(const Fetch &fetch)
+{
+    std::lock_guard<std::recursive_mutex> lock(*m_ingestItemsMutex);
+    RangedFetch &ranged(*fetch.ranged);
+    const ByteRange &range(fetch.range);
+    ranged.inProgress--;
+
+    if (fetch.result == static_cast<long>(range.last - range.first + 1)) {
+        ogs_debug("Received bytes %zu-%zu of %s", range.first, range.last, ranged.url.c_str());
+    } else if (fetch.curl->getStatusCode() == 200) {
+        // The If-Range validator didn't match, so the object has changed since the first request
+        if (!ranged.failed) {
+            ogs_warn("%s changed while being fetched as byte ranges, fetching it again", ranged.url.c_str());
+            ranged.failed = true;
+            // In one request this time, so that it can't keep changing under us
+            m_unsplitObjectIds.insert(ranged.item.objectId());
+            m_fetchList.push_back(ranged.item);
+            sortListByPolicy();
+            wakeWorker();
+        }
+    } else if (range.attempts + 1 < c_maxRangeAttempts) {
+        ogs_warn("Failed to fetch bytes %zu-%zu of %s, retrying", range.first, range.last, ranged.url.c_str());
+        ranged.pending.push_front(ByteRange{range.first, range.last, range.attempts + 1});
+    } else if (!ranged.failed) {
+        ogs_error("Failed to fetch bytes %zu-%zu of %s, giving up on the object", range.first, range.last,
+                  ranged.url.c_str());
+        ranged.failed = true;
+    }
+
+    if (ranged.failed) {
+        // Any ranges still in progress are left to finish, but no more are started
+        ranged.pending.clear();
+        return;
+    }
+
+    if (ranged.pending.empty() && ranged.inProgress == 0) {
+        ogs_debug("Received all %zu bytes of %s", ranged.buffer->size(), ranged.url.c_str());
+        try {
+            addFetchedObject(ranged.item, ranged.buffer->complete(), std::move(ranged.metadata));
+        } catch (const std::system_error &ex) {
+            ogs_error("Unable to map spooled object %s: %s", ranged.url.c_str(), ex.what());
+        }
+        return;
+    }
+
+    startRanges(fetch.ranged);
+}
+
+void PullObjectIngester::commitPendingObjects()
+{
+    if (m_pendingObjects.empty()) return;
+    this->objectStore().commit(std::move(m_pendingObjects));
+    m_pendingObjects = ObjectStore::Batch();
 }
 
 MBSTF_NAMESPACE_STOP
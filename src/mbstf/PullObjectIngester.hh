@@ -11,12 +11,17 @@
  * program. If this file is missing then the license can be retrieved from
  * https://drive.google.com/file/d/1cinCiA778IErENZ3JN52VFW-1ffHpx7Z/view
  */
-#include <condition_variable>
+#include <chrono>
 #include <list>
+#include <map>
+#include <memory>
 #include <mutex>
+#include <optional>
+#include <set>
 #include <string>
 
 #include "common.hh"
+#include "CurlFetchEngine.hh"
 #include "ObjectIngester.hh"
 #include "ObjectStore.hh"
 
@@ -24,6 +29,7 @@ MBSTF_NAMESPACE_START
 
 class ObjectController;
 class Curl;
+class RangedObjectBuffer;
 
 class PullObjectIngester : public ObjectIngester {
 public:
@@ -76,11 +82,30 @@ public:
         std::optional<time_type> m_deadline;
     };
 
+    /* Fetching large objects as parallel byte ranges
+     *
+     * When the response for an object of threshold bytes or more says the origin accepts byte ranges, only the first
+     * rangeSize bytes are taken from it. The rest of the object is fetched rangeSize bytes at a time, with up to
+     * maxRanges requests in progress at once, each written straight to its place in the object. A threshold of 0
+     * fetches every object in one request.
+     */
+    struct RangedFetchConfig {
+        std::size_t threshold;
+        std::size_t rangeSize;
+        unsigned int maxRanges;
+    };
+
     PullObjectIngester() = delete;
     PullObjectIngester(ObjectStore& object_store, ObjectController &controller, const std::list<IngestItem> &id_to_url_map)
       :ObjectIngester(object_store, controller)
       ,m_fetchList(id_to_url_map)
       ,m_ingestItemsMutex (new std::recursive_mutex)
+      ,m_idleCurls()
+      ,m_fetchesInProgress()
+      ,m_completedFetches()
+      ,m_pendingObjects()
+      ,m_pendingSince()
+      ,m_unsplitObjectIds()
 
     { sortListByPolicy(); startWorker(); };
 
@@ -88,6 +113,12 @@ public:
       :ObjectIngester(object_store, controller)
       ,m_fetchList(std::move(id_to_url_map))
       ,m_ingestItemsMutex (new std::recursive_mutex)
+      ,m_idleCurls()
+      ,m_fetchesInProgress()
+      ,m_completedFetches()
+      ,m_pendingObjects()
+      ,m_pendingSince()
+      ,m_unsplitObjectIds()
 
     { sortListByPolicy(); startWorker();};
 
@@ -97,18 +128,105 @@ public:
     bool fetch(IngestItem &&item);
     bool fetch(const std::string &object_id, const std::optional<time_type> &download_deadline);
 
-    std::shared_ptr<Curl> curl() {return m_curl;};
+    static const RangedFetchConfig &rangedFetchConfig();
+    static void rangedFetchConfig(const RangedFetchConfig &config);
+
     //static int client_notify_cb(int status, ogs_sbi_response_t *response, void *data);
 
 protected:
     virtual void doObjectIngest();
 
 private:
+    // Maximum number of fetched objects without a deadline to hold back and add to the ObjectStore as one batch
+    static constexpr std::size_t c_maxBatchObjects = 32;
+    // Longest a fetched object is held back waiting for the rest of its batch
+    static constexpr std::chrono::milliseconds c_maxBatchDelay{200};
+    // Maximum number of fetches handed to the CurlFetchEngine at once, the rest wait in m_fetchList
+    static constexpr std::size_t c_maxFetchesInProgress = 32;
+    // Number of times a byte range is requested before giving up on the object
+    static constexpr unsigned int c_maxRangeAttempts = 3;
+
+    struct ByteRange {
+        std::size_t first;
+        std::size_t last;
+        unsigned int attempts;
+    };
+
+    // An object being fetched as byte ranges, shared by the Fetch for each range
+    struct RangedFetch {
+        RangedFetch(const IngestItem &ingest_item, ObjectStore::Metadata &&object_meta,
+                    std::shared_ptr<RangedObjectBuffer> &&ranged_buffer, const std::string &range_url,
+                    const std::optional<std::string> &if_range)
+            :item(ingest_item)
+            ,metadata(std::move(object_meta))
+            ,buffer(std::move(ranged_buffer))
+            ,url(range_url)
+            ,validator(if_range)
+            ,pending()
+            ,inProgress(0)
+            ,failed(false)
+        {};
+
+        IngestItem item;
+        ObjectStore::Metadata metadata; // from the response to the first request
+        std::shared_ptr<RangedObjectBuffer> buffer;
+        std::string url; // after any redirects, so every range comes from the same place
+        std::optional<std::string> validator; // sent as If-Range so that all the ranges are of the same object
+        std::list<ByteRange> pending;
+        unsigned int inProgress;
+        bool failed;
+    };
+
+    struct Fetch {
+        Fetch(IngestItem &&ingest_item, std::shared_ptr<Curl> &&curl_obj,
+              const std::optional<std::string> &revalidating_id = std::nullopt, bool is_growing = false)
+            :item(std::move(ingest_item))
+            ,curl(std::move(curl_obj))
+            ,revalidating(revalidating_id)
+            ,growing(is_growing)
+            ,ranged()
+            ,range{0, 0, 0}
+            ,result(-2)
+        {};
+        Fetch(std::shared_ptr<Curl> &&curl_obj, const std::shared_ptr<RangedFetch> &ranged_fetch,
+              const ByteRange &byte_range)
+            :item(ranged_fetch->item)
+            ,curl(std::move(curl_obj))
+            ,revalidating()
+            ,growing(false)
+            ,ranged(ranged_fetch)
+            ,range(byte_range)
+            ,result(-2)
+        {};
+
+        IngestItem item;
+        std::shared_ptr<Curl> curl;
+        std::optional<std::string> revalidating; // id of the stored object for this URL if the GET is conditional
+        bool growing; // listed in the ObjectStore as a growing object while it is received
+        std::shared_ptr<RangedFetch> ranged; // set if this fetches a range of a larger object
+        ByteRange range;
+        long result; // as returned by Curl::get()
+    };
+
     void sortListByPolicy();
+    void commitPendingObjects();
+    std::shared_ptr<Curl> idleCurl();
+    void startFetch(IngestItem &&item);
+    void fetchDone(CurlFetchEngine::FetchId fetch_id, long result);
+    void fetchCompleted(const Fetch &fetch);
+    void addFetchedObject(const IngestItem &item, const std::shared_ptr<const ObjectBuffer> &buffer,
+                          ObjectStore::Metadata &&metadata);
+    void startRangedFetch(const IngestItem &item, Curl &curl, std::size_t received, ObjectStore::Metadata &&metadata);
+    void startRanges(const std::shared_ptr<RangedFetch> &ranged);
+    void rangeCompleted(const Fetch &fetch);
     std::list<IngestItem> m_fetchList;
     std::unique_ptr<std::recursive_mutex> m_ingestItemsMutex;
-    std::condition_variable_any m_ingestItemsCondVar;
-    std::shared_ptr<Curl> m_curl;
+    std::list<std::shared_ptr<Curl> > m_idleCurls;
+    std::map<CurlFetchEngine::FetchId, Fetch> m_fetchesInProgress;
+    std::list<Fetch> m_completedFetches;
+    ObjectStore::Batch m_pendingObjects;
+    std::chrono::steady_clock::time_point m_pendingSince; // when the first of m_pendingObjects was fetched
+    std::set<std::string> m_unsplitObjectIds; // to fetch in one request next time, having changed while fetching ranges
 
 };
 
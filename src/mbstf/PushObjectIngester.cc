@@ -13,12 +13,17 @@
 #include <arpa/inet.h>
 #include <sys/socket.h>
 
+#include <algorithm>
+#include <charconv>
 #include <memory>
+#include <new>
 #include <stdexcept>
 #include <utility>
 #include <chrono>
 #include <iostream>
 #include <string>
+#include <string_view>
+#include <system_error>
 
 #include <microhttpd.h>
 #include <netdb.h>
@@ -27,8 +32,14 @@
 #include "common.hh"
 #include "App.hh"
 #include "hash.hh"
+#include "HttpFreshness.hh"
+#include "HttpHeaders.hh"
+#include "IngestProgress.hh"
+#include "MappedObjectBuffer.hh"
+#include "ObjectBuffer.hh"
 #include "ObjectListController.hh"
 #include "ObjectStore.hh"
+#include "PooledObjectBuffer.hh"
 
 #include "PushObjectIngester.hh"
 
@@ -39,7 +50,8 @@ static void request_completion_callback(void *cls, struct MHD_Connection *connec
                                         enum MHD_RequestTerminationCode termination_code);
 static MHD_Result handle_request(void *cls, struct MHD_Connection *connection, const char *url, const char *method,
                                  const char *version, const char *upload_data, size_t *upload_data_size, void **con_cls);
-static std::optional<PushObjectIngester::Request::time_type> parse_http_date_time(const std::optional<std::string> &date_time_str);
+static MHD_Result add_header(void *cls, enum MHD_ValueKind kind, const char *key, const char *value);
+static std::optional<std::string> to_optional_string(const std::optional<std::string_view> &value);
 
 /********************** PushObjectIngester::Request ***********************/
 
@@ -55,8 +67,11 @@ PushObjectIngester::Request::Request(struct MHD_Connection *mhd_connection, Push
     ,m_contentType()
     ,m_expires()
     ,m_lastModified()
-    ,m_bodyBlocks()
+    ,m_noStore(false)
+    ,m_body()
     ,m_totalBodySize(0)
+    ,m_spoolBuffer()
+    ,m_progress()
     ,m_statusCode(0)
     ,m_errorReason()
     ,m_noMoreBodyData(false)
@@ -65,11 +80,40 @@ PushObjectIngester::Request::Request(struct MHD_Connection *mhd_connection, Push
 {
 }
 
-bool PushObjectIngester::Request::addBodyBlock(const std::vector<unsigned char> &body_block)
+PushObjectIngester::Request::~Request()
+{
+    // Request ended without the object being added to the store
+    if (m_progress && !m_progress->isComplete()) m_pushObjectIngester.objectStore().abandonGrowingObject(m_objectId);
+}
+
+bool PushObjectIngester::Request::addBodyBlock(const data_type::value_type *data, data_size_type size)
 {
     std::lock_guard<std::recursive_mutex> lock(*m_mutex);
-    m_bodyBlocks.push_back(body_block);
-    m_totalBodySize += body_block.size();
+    try {
+        if (!m_progress) startBody();
+        if (!m_spoolBuffer && ObjectStore::shouldSpool(m_totalBodySize + size)) {
+            // Body has grown large enough to be spooled, move what has been received so far to a spool file
+            m_spoolBuffer.reset(new MappedObjectBuffer(ObjectStore::spoolConfig().directory));
+            if (m_body) m_spoolBuffer->append(m_body->data(), m_body->size());
+            m_body.reset();
+        }
+        if (m_spoolBuffer) {
+            m_spoolBuffer->append(data, size);
+        } else {
+            if (!m_body) m_body.reset(new PooledObjectBuffer());
+            m_body->append(data, size);
+        }
+    } catch (const std::system_error &ex) {
+        ogs_error("Unable to spool pushed object body: %s", ex.what());
+        setError(507, "Insufficient Storage");
+        return false;
+    } catch (const std::bad_alloc &ex) {
+        ogs_error("Unable to allocate buffer for pushed object body: %s", ex.what());
+        setError(507, "Insufficient Storage");
+        return false;
+    }
+    m_totalBodySize += size;
+    m_progress->received(size);
 
     return true;
 }
@@ -94,6 +138,31 @@ bool PushObjectIngester::Request::setError(unsigned int status_code, const std::
     return true;
 }
 
+std::string PushObjectIngester::Request::objectUrl() const
+{
+    if (!m_urlPath.empty() && m_urlPath.front() == '/') {
+        return m_pushObjectIngester.getIngestServerPrefix() + m_urlPath.substr(1);
+    }
+    return m_urlPath;
+}
+
+void PushObjectIngester::Request::startBody()
+{
+    // List the object in the store as soon as its body starts to arrive, so that it can be queued for sending
+    m_progress = std::make_shared<IngestProgress>();
+    std::optional<std::string> content_length(getHeader("Content-Length"));
+    if (content_length) {
+        const std::string &value(content_length.value());
+        data_size_type transfer_length = 0;
+        auto [end, ec] = std::from_chars(value.data(), value.data() + value.size(), transfer_length);
+        if (ec == std::errc() && end == value.data() + value.size()) m_progress->transferLength(transfer_length);
+    }
+    if (m_objectId.empty()) {
+        m_objectId = m_pushObjectIngester.controller().nextObjectId();
+    }
+    m_pushObjectIngester.objectStore().addGrowingObject(m_objectId, objectUrl(), m_progress);
+}
+
 std::optional<std::string> PushObjectIngester::Request::getHeader(const std::string &field) const
 {
     std::lock_guard<std::recursive_mutex> lock(*m_mutex);
@@ -114,10 +183,7 @@ void PushObjectIngester::Request::processRequest()
     const auto &last_modified = m_lastModified.value_or(now);
     const auto &content_type = m_contentType.value_or(app_octet);
 
-    std::string url(m_urlPath);
-    if (url.front() == '/') {
-        url = m_pushObjectIngester.getIngestServerPrefix() + url.substr(1,url.size()-1);
-    }
+    std::string url(objectUrl());
 
     std::optional<std::string> object_distrib_base_url = std::nullopt;
     try {
@@ -133,23 +199,37 @@ void PushObjectIngester::Request::processRequest()
         ogs_debug("%s", oss.str().c_str());
     }
 
-    ObjectStore::Metadata metadata(m_objectId, content_type, url, url, m_urlPath, last_modified, m_pushObjectIngester.getIngestServerPrefix(), object_distrib_base_url);
-    metadata.cacheExpires(m_expires?m_expires.value():(std::chrono::system_clock::now() + std::chrono::minutes(ObjectStore::Metadata::cacheExpiry())));
-
-    // Pull all body blocks together into one vector
-    std::vector<unsigned char> body;
-    ogs_debug("Building body of %zu bytes", m_totalBodySize);
-    body.reserve(m_totalBodySize);
-    for (auto& block : m_bodyBlocks) {
-        ogs_debug("Adding body block of %zu bytes", block.size());
-        body.insert(body.end(), block.begin(), block.end());
-    }
-
     if (m_objectId.empty()) {
         m_objectId = m_pushObjectIngester.controller().nextObjectId();
     }
 
-    m_pushObjectIngester.objectStore().addObject(m_objectId, std::move(body), std::move(metadata));
+    ObjectStore::Metadata metadata(m_objectId, content_type, url, url, m_urlPath, last_modified, m_pushObjectIngester.getIngestServerPrefix(), object_distrib_base_url);
+    // Pushed objects may already be stale, keep them for long enough to send them anyway
+    auto fresh_until = m_expires.value_or(now + std::chrono::minutes(ObjectStore::Metadata::cacheExpiry()));
+    metadata.cacheExpires(std::max(fresh_until, now + std::chrono::seconds(ObjectStore::Metadata::cacheMinimumHold())));
+    metadata.freshUntil(fresh_until);
+    metadata.noStore(m_noStore);
+
+    std::shared_ptr<const ObjectBuffer> body;
+    if (m_spoolBuffer) {
+        ogs_debug("Using spooled body of %zu bytes", m_totalBodySize);
+        try {
+            m_spoolBuffer->seal();
+        } catch (const std::system_error &ex) {
+            ogs_error("Unable to map spooled object body: %s", ex.what());
+            m_pushObjectIngester.objectStore().abandonGrowingObject(m_objectId);
+            setError(507, "Insufficient Storage");
+            return;
+        }
+        body = std::move(m_spoolBuffer);
+    } else if (m_body) {
+        body = std::move(m_body);
+    } else {
+        body = std::make_shared<ObjectBuffer>();
+    }
+    if (m_progress) m_progress->complete();
+
+    m_pushObjectIngester.objectStore().addObject(m_objectId, body, std::move(metadata));
     m_statusCode = 200;
 }
 
@@ -164,8 +244,15 @@ void PushObjectIngester::Request::requestHandler(struct MHD_Connection *connecti
     //if (m_urlPath.substr(0, 4) != "http" || m_urlPath.substr(0, 2) == "//") {
     //    setError(404, "Not Found");
     //} else
-    if (m_method != "PUSH" && m_method != "PUT" && m_method != "POST") {
+    if (m_statusCode != 0) {
+        // An error has already been set while receiving the request, just send it
+    } else if (m_method != "PUSH" && m_method != "PUT" && m_method != "POST") {
         setError(405, "Method Not Allowed");
+    } else if (m_pushObjectIngester.objectStore().overHighWaterMark()) {
+        // Backpressure: the object store is close to its memory budget, ask the client to try again later
+        setError(503, "Service Unavailable");
+        MHD_add_response_header(m_mhdResponse, MHD_HTTP_HEADER_RETRY_AFTER,
+                                std::to_string(ObjectStore::memoryBudget().retryAfter).c_str());
     } else {
         processRequest();
     }
@@ -178,27 +265,27 @@ void PushObjectIngester::Request::requestHandler(struct MHD_Connection *connecti
 
 /********************** PushObjectIngester::ObjectPushEvent ***************/
 
-PushObjectIngester::ObjectPushEvent *PushObjectIngester::ObjectPushEvent::makeStartEvent(const std::shared_ptr<Request> &request)
+std::shared_ptr<PushObjectIngester::ObjectPushEvent> PushObjectIngester::ObjectPushEvent::makeStartEvent(const std::shared_ptr<Request> &request)
 {
-    return new PushObjectIngester::ObjectPushEvent("ObjectPushStart", request);
+    return Event::make<PushObjectIngester::ObjectPushEvent>(typeIdOf<Start>(), request);
 }
 
-PushObjectIngester::ObjectPushEvent *PushObjectIngester::ObjectPushEvent::makeBlockReceivedEvent(const std::shared_ptr<Request> &request)
+std::shared_ptr<PushObjectIngester::ObjectPushEvent> PushObjectIngester::ObjectPushEvent::makeBlockReceivedEvent(const std::shared_ptr<Request> &request)
 {
-    return new PushObjectIngester::ObjectPushEvent("ObjectPushBlockReceived", request);
+    return Event::make<PushObjectIngester::ObjectPushEvent>(typeIdOf<BlockReceived>(), request);
 }
 
-PushObjectIngester::ObjectPushEvent *PushObjectIngester::ObjectPushEvent::makeTrailersReceivedEvent(const std::shared_ptr<Request> &request)
+std::shared_ptr<PushObjectIngester::ObjectPushEvent> PushObjectIngester::ObjectPushEvent::makeTrailersReceivedEvent(const std::shared_ptr<Request> &request)
 {
-    return new PushObjectIngester::ObjectPushEvent("ObjectPushTrailersReceived", request);
+    return Event::make<PushObjectIngester::ObjectPushEvent>(typeIdOf<TrailersReceived>(), request);
 }
 
 PushObjectIngester::ObjectPushEvent::~ObjectPushEvent()
 {
 }
 
-PushObjectIngester::ObjectPushEvent::ObjectPushEvent(const std::string &typ, const std::shared_ptr<Request> &request)
-    :Event(typ)
+PushObjectIngester::ObjectPushEvent::ObjectPushEvent(Event::TypeId type_id, const std::shared_ptr<Request> &request)
+    :Event(type_id)
     ,m_request(request)
 {
 }
@@ -266,17 +353,18 @@ bool PushObjectIngester::addRequest(const std::shared_ptr<PushObjectIngester::Re
         m_activeRequests.push_back(req);
         ogs_debug( "Added new request, there are now %ld active requests", m_activeRequests.size());
     }
-    ObjectPushEvent *evt = ObjectPushEvent::makeStartEvent(req);
-    bool result = sendEventSynchronous(*evt);
+    ObjectPushEvent evt(Event::typeIdOf<ObjectPushEvent::Start>(), req);
+    bool result = sendEventSynchronous(evt);
     if (result) {
         ogs_debug("Request accepted, receiving...");
     }
-    delete evt;
     return result;
 }
 
 void PushObjectIngester::removeRequest(const std::shared_ptr<PushObjectIngester::Request> &req)
 {
+    // Make sure the last block received progress for this request gets delivered
+    flushCoalescedEvents(req.get());
 
     std::lock_guard<std::recursive_mutex> lock(m_mtx);
     for (std::list<std::shared_ptr<PushObjectIngester::Request> >::iterator it = m_activeRequests.begin();
@@ -300,8 +388,9 @@ void PushObjectIngester::doObjectIngest() {
 void PushObjectIngester::addedBodyBlock(const std::shared_ptr<Request> &request, std::vector<unsigned char>::size_type block_size,
                         std::vector<unsigned char>::size_type body_size)
 {
-    std::shared_ptr<Event> evt(ObjectPushEvent::makeBlockReceivedEvent(request));
-    sendEventAsynchronous(evt);
+    // Called for every upload chunk from microhttpd, so don't even make the event unless someone wants it
+    if (!hasSubscribers<ObjectPushEvent::BlockReceived>()) return;
+    sendEventAsynchronousCoalesced(ObjectPushEvent::makeBlockReceivedEvent(request), request.get());
 }
 
 const std::string &PushObjectIngester::getIngestServerPrefix()
@@ -439,38 +528,42 @@ static MHD_Result handle_request(void *cls, struct MHD_Connection *connection, c
         req->urlPath(url);
         req->method(method);
         req->protocolVersion(version);
-        req->etag(req->getHeader("ETag"));
-        req->contentType(req->getHeader("Content-Type"));
-        std::optional<std::string> cache_control(req->getHeader("Cache-Control"));
-        if (cache_control) {
-            const std::string &cache_control_value(cache_control.value());
-            if (cache_control_value.starts_with("max-age=")) {
-                std::optional<std::string> age(req->getHeader("Age"));
-                unsigned long max_age = std::stoul(cache_control_value.substr(8,cache_control_value.size()-8));
-                if (age) {
-                    unsigned long age_val = std::stoul(age.value());
-                    if (age_val >= max_age) {
-                        max_age = 0;
-                    } else {
-                        max_age -= age_val;
-                    }
-                }
-                req->expiryTime(std::chrono::system_clock::now() + std::chrono::seconds(max_age));
-            }
-        }
-        req->lastModified(parse_http_date_time(req->getHeader("Last-Modified")));
+        // Reused by each request handled on this thread, so indexing the headers doesn't allocate
+        static thread_local HttpHeaders headers;
+        headers.clear();
+        MHD_get_connection_values(connection, MHD_HEADER_KIND, add_header, &headers);
+        auto now = std::chrono::system_clock::now();
+        HttpFreshness freshness(headers, now, now);
+        req->etag(to_optional_string(headers.get("ETag")));
+        req->contentType(to_optional_string(headers.get("Content-Type")));
+        req->expiryTime(freshness.expires());
+        req->lastModified(freshness.lastModified());
+        req->noStore(freshness.noStore());
         std::shared_ptr<PushObjectIngester::Request> *req_ptr = new std::shared_ptr<PushObjectIngester::Request>(req);
         *con_cls = req_ptr;
-        if(ingester->addRequest(*req_ptr)) return MHD_YES;
-        return MHD_NO;
+        if(!ingester->addRequest(*req_ptr)) return MHD_NO;
+        if (ingester->overHighWaterMark()) {
+            // Reject now rather than buffering a body we would have to throw away
+            req->requestHandler(connection);
+        }
+        return MHD_YES;
     }
 
     std::shared_ptr<PushObjectIngester::Request> req = *reinterpret_cast<std::shared_ptr<PushObjectIngester::Request>*>(*con_cls);
 
+    if (req->statusCode() != 0) {
+        // Response already queued, discard any remaining upload data
+        *upload_data_size = 0;
+        return MHD_YES;
+    }
+
     if (*upload_data_size > 0) {
         ogs_debug("handle_request: Adding %zu bytes of ingest data", *upload_data_size);
-        req->addBodyBlock(std::vector<unsigned char>(upload_data, upload_data + *upload_data_size));
-        ingester->addedBodyBlock(req, *upload_data_size, req->bodySize());
+        if (req->addBodyBlock(reinterpret_cast<const unsigned char*>(upload_data), *upload_data_size)) {
+            ingester->addedBodyBlock(req, *upload_data_size, req->bodySize());
+        } else {
+            req->requestHandler(connection);
+        }
         *upload_data_size = 0;
     } else if (*upload_data_size == 0) {
         ogs_debug("handle_request: Completed request processing.");
@@ -487,25 +580,17 @@ static MHD_Result handle_request(void *cls, struct MHD_Connection *connection, c
     return MHD_YES;
 }
 
-static std::optional<PushObjectIngester::Request::time_type> parse_http_date_time(const std::optional<std::string> &date_time_str)
+static MHD_Result add_header(void *cls, enum MHD_ValueKind kind, const char *key, const char *value)
 {
-    if (!date_time_str.has_value()) return std::nullopt;
-
-    PushObjectIngester::Request::time_type date_time;
-    std::istringstream iss(date_time_str.value());
-    iss.imbue(std::locale("C"));
-    iss >> std::chrono::parse("%a, %d %b %Y %H:%M:%S GMT", date_time); // RFC822/RFC1123
-    if (iss.fail()) {
-        iss.str(date_time_str.value());
-        iss >> std::chrono::parse("%A, %d-%b-%y %H:%M:%S GMT", date_time); // RFC1036
-        if (iss.fail()) {
-            iss.str(date_time_str.value());
-            iss >> std::chrono::parse("%a %b %d %H:%M:%S %Y", date_time); // ANSI C asctime format
-        }
-    }
-    if (iss.fail()) return std::nullopt;
+    HttpHeaders *headers = reinterpret_cast<HttpHeaders*>(cls);
+    headers->add(key, value?value:"");
+    return MHD_YES;
+}
 
-    return date_time;
+static std::optional<std::string> to_optional_string(const std::optional<std::string_view> &value)
+{
+    if (!value) return std::nullopt;
+    return std::string(value.value());
 }
 
 MBSTF_NAMESPACE_STOP
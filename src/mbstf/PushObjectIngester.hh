@@ -12,6 +12,7 @@
  * https://drive.google.com/file/d/1cinCiA778IErENZ3JN52VFW-1ffHpx7Z/view
  */
 
+#include <condition_variable>
 #include <list>
 #include <memory>
 #include <string>
@@ -25,7 +26,10 @@
 
 MBSTF_NAMESPACE_START
 
+class IngestProgress;
+class MappedObjectBuffer;
 class ObjectStore;
+class PooledObjectBuffer;
 class ObjectController;
 
 class PushObjectIngester : public ObjectIngester, public SubscriptionService {
@@ -42,7 +46,7 @@ public:
         Request(Request&&) = delete;
 	Request(struct MHD_Connection *mhd_connection, PushObjectIngester &poi);
 
-	virtual ~Request() {};
+	virtual ~Request();
 
         Request &operator=(const Request&) = delete;
         Request &operator=(Request&&) = delete;
@@ -81,10 +85,15 @@ public:
         Request &lastModified(const time_type &last_modified) { m_lastModified = last_modified; return *this; };
         Request &lastModified(const std::optional<time_type> &last_modified) { m_lastModified = last_modified; return *this; };
 
+        bool noStore() const { return m_noStore; };
+        Request &noStore(bool no_store) { m_noStore = no_store; return *this; };
+
 	std::optional<std::string> getHeader(const std::string &field) const;
         data_size_type bodySize() const { return m_totalBodySize; };
+        unsigned int statusCode() const { return m_statusCode; };
 
-	bool addBodyBlock(const data_type &body_block);
+	bool addBodyBlock(const data_type &body_block) { return addBodyBlock(body_block.data(), body_block.size()); };
+	bool addBodyBlock(const data_type::value_type *data, data_size_type size);
 	bool setError(unsigned int status_code = 0, const std::string &reason = std::string());
         void completed(struct MHD_Connection *connection, enum MHD_RequestTerminationCode term_code);
 	virtual void waitClose() {};
@@ -100,6 +109,9 @@ public:
         struct MHD_Response *m_mhdResponse;
 
     private:
+        std::string objectUrl() const;
+        void startBody();
+
         PushObjectIngester &m_pushObjectIngester;
         std::string m_objectId;
         std::string m_method;
@@ -110,9 +122,12 @@ public:
         std::optional<std::string> m_contentType;
         std::optional<time_type> m_expires;
         std::optional<time_type> m_lastModified;
+        bool m_noStore;
 
-        std::list<data_type> m_bodyBlocks;
+        std::shared_ptr<PooledObjectBuffer> m_body;
         data_size_type m_totalBodySize;
+        std::shared_ptr<MappedObjectBuffer> m_spoolBuffer; // used instead of m_body for large bodies
+        std::shared_ptr<IngestProgress> m_progress; // listed in the ObjectStore as a growing object while it arrives
 
         unsigned int m_statusCode;
         std::string m_errorReason;
@@ -130,10 +145,16 @@ public:
             ObjectPushTrailersReceived
         };
 
+        // Event type tags for Event::is<>() and Subscriber::subscribeTo<>()
+        struct Start { static constexpr const char c_eventName[] = "ObjectPushStart"; };
+        struct BlockReceived { static constexpr const char c_eventName[] = "ObjectPushBlockReceived"; };
+        struct TrailersReceived { static constexpr const char c_eventName[] = "ObjectPushTrailersReceived"; };
+
         ObjectPushEvent() = delete;
-        static ObjectPushEvent *makeStartEvent(const std::shared_ptr<Request> &request);
-        static ObjectPushEvent *makeBlockReceivedEvent(const std::shared_ptr<Request> &request);
-        static ObjectPushEvent *makeTrailersReceivedEvent(const std::shared_ptr<Request> &request);
+        ObjectPushEvent(Event::TypeId type_id, const std::shared_ptr<Request> &request);
+        static std::shared_ptr<ObjectPushEvent> makeStartEvent(const std::shared_ptr<Request> &request);
+        static std::shared_ptr<ObjectPushEvent> makeBlockReceivedEvent(const std::shared_ptr<Request> &request);
+        static std::shared_ptr<ObjectPushEvent> makeTrailersReceivedEvent(const std::shared_ptr<Request> &request);
         ObjectPushEvent(const ObjectPushEvent&) = delete;
         ObjectPushEvent(ObjectPushEvent&&) = delete;
 
@@ -145,8 +166,6 @@ public:
         const Request &request() const { return *m_request; };
 
     private:
-        ObjectPushEvent(const std::string &typ, const std::shared_ptr<Request> &request);
-
         std::shared_ptr<Request> m_request;
     };
 
@@ -170,6 +189,7 @@ public:
     //void addConnection(Request *request);
     //void removeConnection(Request *request);
     const std::string &getIngestServerPrefix();
+    bool overHighWaterMark() const { return objectStore().overHighWaterMark(); };
 
     virtual ~PushObjectIngester();
 
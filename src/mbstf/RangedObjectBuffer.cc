@@ -0,0 +1,65 @@
+/******************************************************************************
+ * 5G-MAG Reference Tools: MBS Traffic Function: Ranged Object Buffer class
+ ******************************************************************************
+ * Copyright: (C)2025 British Broadcasting Corporation
+ * Author(s): David Waring <david.waring2@bbc.co.uk>
+ * License: 5G-MAG Public License v1
+ *
+ * For full license terms please see the LICENSE file distributed with this
+ * program. If this file is missing then the license can be retrieved from
+ * https://drive.google.com/file/d/1cinCiA778IErENZ3JN52VFW-1ffHpx7Z/view
+ */
+
+#include <memory>
+#include <string>
+
+#include "common.hh"
+#include "MappedObjectBuffer.hh"
+#include "ObjectBuffer.hh"
+#include "PooledObjectBuffer.hh"
+
+#include "RangedObjectBuffer.hh"
+
+MBSTF_NAMESPACE_START
+
+RangedObjectBuffer::RangedObjectBuffer(size_type size, const std::string &spool_directory, size_type spool_threshold)
+    :m_size(size)
+    ,m_pooledBuffer()
+    ,m_spoolBuffer()
+{
+    if (!spool_directory.empty() && size >= spool_threshold) {
+        m_spoolBuffer.reset(new MappedObjectBuffer(spool_directory));
+        m_spoolBuffer->resize(size);
+    } else {
+        m_pooledBuffer.reset(new PooledObjectBuffer(size));
+        m_pooledBuffer->resize(size);
+    }
+}
+
+RangedObjectBuffer::~RangedObjectBuffer()
+{
+}
+
+RangedObjectBuffer &RangedObjectBuffer::write(size_type offset, const value_type *data, size_type size)
+{
+    if (m_spoolBuffer) {
+        m_spoolBuffer->write(offset, data, size);
+    } else {
+        m_pooledBuffer->write(offset, data, size);
+    }
+    return *this;
+}
+
+std::shared_ptr<const ObjectBuffer> RangedObjectBuffer::complete()
+{
+    if (m_spoolBuffer) {
+        m_spoolBuffer->seal();
+        return m_spoolBuffer;
+    }
+    return m_pooledBuffer;
+}
+
+MBSTF_NAMESPACE_STOP
+
+/* vim:ts=8:sts=4:sw=4:expandtab:
+ */
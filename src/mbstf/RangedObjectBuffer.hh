@@ -0,0 +1,66 @@
+#ifndef _MBS_TF_RANGED_OBJECT_BUFFER_HH_
+#define _MBS_TF_RANGED_OBJECT_BUFFER_HH_
+/******************************************************************************
+ * 5G-MAG Reference Tools: MBS Traffic Function: Ranged Object Buffer class
+ ******************************************************************************
+ * Copyright: (C)2025 British Broadcasting Corporation
+ * Author(s): David Waring <david.waring2@bbc.co.uk>
+ * License: 5G-MAG Public License v1
+ *
+ * For full license terms please see the LICENSE file distributed with this
+ * program. If this file is missing then the license can be retrieved from
+ * https://drive.google.com/file/d/1cinCiA778IErENZ3JN52VFW-1ffHpx7Z/view
+ */
+
+#include <memory>
+#include <string>
+
+#include "common.hh"
+#include "ObjectBuffer.hh"
+
+MBSTF_NAMESPACE_START
+
+class MappedObjectBuffer;
+class PooledObjectBuffer;
+
+/* Object payload of a known size received as byte ranges
+ *
+ * Sized for the whole object when constructed, each byte range is then written straight to its place in the payload
+ * as it arrives, in whatever order the ranges arrive. Different ranges may be written from different threads. Once
+ * every range has been written complete() gives the payload to add to the ObjectStore.
+ *
+ * The payload is held in a BufferPool block, or a spool file if it is at least the spool threshold, in the same way as
+ * Curl buffers a body. The constructor, write() and complete() throw std::system_error if the spool file cannot be
+ * created, written or mapped and std::bad_alloc if memory runs out. write() throws std::out_of_range for bytes beyond
+ * the end of the object.
+ */
+class RangedObjectBuffer {
+public:
+    using value_type = ObjectBuffer::value_type;
+    using size_type = ObjectBuffer::size_type;
+
+    RangedObjectBuffer(size_type size, const std::string &spool_directory = std::string(), size_type spool_threshold = 0);
+    RangedObjectBuffer(const RangedObjectBuffer &) = delete;
+    RangedObjectBuffer(RangedObjectBuffer &&) = delete;
+
+    virtual ~RangedObjectBuffer();
+
+    RangedObjectBuffer &operator=(const RangedObjectBuffer &) = delete;
+    RangedObjectBuffer &operator=(RangedObjectBuffer &&) = delete;
+
+    size_type size() const { return m_size; };
+
+    RangedObjectBuffer &write(size_type offset, const value_type *data, size_type size);
+    std::shared_ptr<const ObjectBuffer> complete(); // all ranges have been written
+
+private:
+    size_type m_size;
+    std::shared_ptr<PooledObjectBuffer> m_pooledBuffer;
+    std::shared_ptr<MappedObjectBuffer> m_spoolBuffer; // used instead of m_pooledBuffer for large payloads
+};
+
+MBSTF_NAMESPACE_STOP
+
+/* vim:ts=8:sts=4:sw=4:expandtab:
+ */
+#endif /* _MBS_TF_RANGED_OBJECT_BUFFER_HH_ */
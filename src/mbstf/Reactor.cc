@@ -0,0 +1,99 @@
+/******************************************************************************
+ * 5G-MAG Reference Tools: MBS Traffic Function: Reactor class
+ ******************************************************************************
+ * Copyright: (C)2025 British Broadcasting Corporation
+ * Author(s): David Waring <david.waring2@bbc.co.uk>
+ * License: 5G-MAG Public License v1
+ *
+ * For full license terms please see the LICENSE file distributed with this
+ * program. If this file is missing then the license can be retrieved from
+ * https://drive.google.com/file/d/1cinCiA778IErENZ3JN52VFW-1ffHpx7Z/view
+ */
+
+#include <pthread.h>
+
+#include <atomic>
+#include <exception>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include <boost/asio/io_context.hpp>
+
+#include "ogs-app.h"
+
+#include "common.hh"
+
+#include "Reactor.hh"
+
+MBSTF_NAMESPACE_START
+
+static std::atomic<unsigned int> g_numThreads(0);
+
+Reactor::Reactor(unsigned int num_threads)
+    :m_workers()
+    ,m_nextWorker(0)
+{
+    if (num_threads == 0) num_threads = std::thread::hardware_concurrency();
+    if (num_threads == 0) num_threads = 1;
+
+    for (unsigned int i = 0; i < num_threads; i++) {
+        m_workers.emplace_back(new Worker);
+    }
+    for (std::size_t i = 0; i < m_workers.size(); i++) {
+        m_workers[i]->thread = std::thread(&Reactor::workerLoop, m_workers[i].get());
+        std::string name("mbstf-io-" + std::to_string(i));
+        pthread_setname_np(m_workers[i]->thread.native_handle(), name.substr(0, 15).c_str());
+    }
+}
+
+Reactor::~Reactor()
+{
+    for (auto &worker : m_workers) {
+        worker->workGuard.reset();
+        worker->ioContext.stop();
+    }
+    for (auto &worker : m_workers) {
+        if (worker->thread.joinable()) worker->thread.join();
+    }
+}
+
+Reactor &Reactor::instance()
+{
+    // Never destroyed: timers and sockets belonging to components may outlive static destruction order
+    static Reactor *reactor = new Reactor(g_numThreads);
+    return *reactor;
+}
+
+unsigned int Reactor::threads()
+{
+    return g_numThreads;
+}
+
+void Reactor::threads(unsigned int num_threads)
+{
+    g_numThreads = num_threads;
+}
+
+boost::asio::io_context &Reactor::ioContext()
+{
+    return m_workers[m_nextWorker++ % m_workers.size()]->ioContext;
+}
+
+void Reactor::workerLoop(Worker *worker)
+{
+    while (true) {
+        try {
+            worker->ioContext.run();
+            break; // only returns once stopped
+        } catch (std::exception &ex) {
+            // Handlers are expected to deal with their own errors, don't let one take down the other sessions
+            ogs_error("Unhandled exception in reactor handler: %s", ex.what());
+        }
+    }
+}
+
+MBSTF_NAMESPACE_STOP
+
+/* vim:ts=8:sts=4:sw=4:expandtab:
+ */
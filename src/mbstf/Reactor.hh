@@ -0,0 +1,77 @@
+#ifndef _MBS_TF_REACTOR_HH_
+#define _MBS_TF_REACTOR_HH_
+/******************************************************************************
+ * 5G-MAG Reference Tools: MBS Traffic Function: Reactor class
+ ******************************************************************************
+ * Copyright: (C)2025 British Broadcasting Corporation
+ * Author(s): David Waring <david.waring2@bbc.co.uk>
+ * License: 5G-MAG Public License v1
+ *
+ * For full license terms please see the LICENSE file distributed with this
+ * program. If this file is missing then the license can be retrieved from
+ * https://drive.google.com/file/d/1cinCiA778IErENZ3JN52VFW-1ffHpx7Z/view
+ */
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <boost/asio/executor_work_guard.hpp>
+#include <boost/asio/io_context.hpp>
+
+#include "common.hh"
+
+MBSTF_NAMESPACE_START
+
+/* Process wide asio reactor shared by all distribution sessions
+ *
+ * This is a pool of io_contexts, each run by exactly one worker thread. Components (packagers, ingesters, controllers)
+ * are given an io_context from the pool, round robin, when they are created and do all their asynchronous work
+ * there. As each io_context only ever has one thread, handlers for one component never run concurrently with each
+ * other, and the number of threads stays fixed however many sessions there are.
+ *
+ * Nothing whose handlers are bound to an object that can be destroyed before the Reactor should be run here unless it
+ * can cancel them first. This is why the FLUTE Transmitter has an io_context of its own (see ObjectPackager).
+ *
+ * Handlers must not block for long, as anything else using the same io_context waits for them.
+ */
+class Reactor {
+public:
+    Reactor(const Reactor &) = delete;
+    Reactor(Reactor &&) = delete;
+    virtual ~Reactor();
+
+    Reactor &operator=(const Reactor &) = delete;
+    Reactor &operator=(Reactor &&) = delete;
+
+    static Reactor &instance();
+    static unsigned int threads();
+    static void threads(unsigned int num_threads); // must be set before first use, 0 means one per CPU core
+
+    boost::asio::io_context &ioContext(); // next io_context from the pool
+    std::size_t size() const { return m_workers.size(); };
+
+private:
+    struct Worker {
+        Worker() :ioContext(1), workGuard(boost::asio::make_work_guard(ioContext)), thread() {};
+
+        boost::asio::io_context ioContext;
+        boost::asio::executor_work_guard<boost::asio::io_context::executor_type> workGuard; // keep run() going when idle
+        std::thread thread;
+    };
+
+    Reactor(unsigned int num_threads);
+
+    static void workerLoop(Worker *worker);
+
+    std::vector<std::unique_ptr<Worker> > m_workers;
+    std::atomic<std::size_t> m_nextWorker;
+};
+
+MBSTF_NAMESPACE_STOP
+
+/* vim:ts=8:sts=4:sw=4:expandtab:
+ */
+#endif /* _MBS_TF_REACTOR_HH_ */
@@ -0,0 +1,143 @@
+/******************************************************************************
+ * 5G-MAG Reference Tools: MBS Traffic Function: Reactor Task class
+ ******************************************************************************
+ * Copyright: (C)2025 British Broadcasting Corporation
+ * Author(s): David Waring <david.waring2@bbc.co.uk>
+ * License: 5G-MAG Public License v1
+ *
+ * For full license terms please see the LICENSE file distributed with this
+ * program. If this file is missing then the license can be retrieved from
+ * https://drive.google.com/file/d/1cinCiA778IErENZ3JN52VFW-1ffHpx7Z/view
+ */
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/steady_timer.hpp>
+
+#include "common.hh"
+#include "Reactor.hh"
+
+#include "ReactorTask.hh"
+
+MBSTF_NAMESPACE_START
+
+/* Shared with the handlers queued on the io_context, so that it outlives the ReactorTask if need be.
+ * The timer fields are only touched from the io_context thread.
+ */
+struct ReactorTask::State {
+    State(Function &&fn, boost::asio::io_context &io_context)
+        :function(std::move(fn))
+        ,ioContext(io_context)
+        ,runMutex()
+        ,cancelled(false)
+        ,wakePending(false)
+        ,runs(0)
+        ,timer(io_context)
+        ,timerExpiry()
+        ,timerGeneration(0)
+    {};
+
+    Function function;
+    boost::asio::io_context &ioContext;
+    std::recursive_mutex runMutex;  // held while function is running
+    std::atomic_bool cancelled;
+    std::atomic_bool wakePending;   // a run is already posted for wake()
+    std::atomic<std::uint64_t> runs;
+    boost::asio::steady_timer timer;
+    std::optional<std::chrono::steady_clock::time_point> timerExpiry;
+    std::uint64_t timerGeneration; // identifies the latest timer wait, earlier ones are stale
+};
+
+ReactorTask::ReactorTask(Function &&function)
+    :m_state(std::make_shared<State>(std::move(function), Reactor::instance().ioContext()))
+{
+}
+
+ReactorTask::~ReactorTask()
+{
+    cancel();
+}
+
+void ReactorTask::wake()
+{
+    if (m_state->cancelled) return;
+    if (m_state->wakePending.exchange(true)) return;
+    std::shared_ptr<State> state(m_state);
+    boost::asio::post(state->ioContext, [state]() { run(state); });
+}
+
+void ReactorTask::wakeAt(const std::chrono::system_clock::time_point &when)
+{
+    wakeAt(std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                                                            when - std::chrono::system_clock::now()));
+}
+
+void ReactorTask::wakeAt(const std::chrono::steady_clock::time_point &when)
+{
+    if (m_state->cancelled) return;
+    std::shared_ptr<State> state(m_state);
+    boost::asio::post(state->ioContext, [state, when]() {
+        if (state->cancelled) return;
+        // Keep the earliest wake-up
+        if (state->timerExpiry && state->timerExpiry.value() <= when) return;
+        state->timerExpiry = when;
+        std::uint64_t generation = ++state->timerGeneration;
+        state->timer.expires_at(when);
+        state->timer.async_wait([state, generation](const boost::system::error_code &ec) {
+            if (ec || generation != state->timerGeneration) return;
+            state->timerExpiry.reset();
+            run(state);
+        });
+    });
+}
+
+void ReactorTask::cancel()
+{
+    m_state->cancelled = true;
+    {
+        // Wait for the function to finish if it's running on another thread
+        std::lock_guard<std::recursive_mutex> guard(m_state->runMutex);
+    }
+    std::shared_ptr<State> state(m_state);
+    boost::asio::post(state->ioContext, [state]() {
+        state->timer.cancel();
+        state->timerExpiry.reset();
+    });
+}
+
+bool ReactorTask::cancelled() const
+{
+    return m_state->cancelled;
+}
+
+std::uint64_t ReactorTask::runs() const
+{
+    return m_state->runs;
+}
+
+boost::asio::io_context &ReactorTask::ioContext() const
+{
+    return m_state->ioContext;
+}
+
+void ReactorTask::run(const std::shared_ptr<State> &state)
+{
+    std::lock_guard<std::recursive_mutex> guard(state->runMutex);
+    if (state->cancelled) return;
+    // Cleared before running so that a wake() from here on gets another run
+    state->wakePending = false;
+    state->runs++;
+    state->function();
+}
+
+MBSTF_NAMESPACE_STOP
+
+/* vim:ts=8:sts=4:sw=4:expandtab:
+ */
@@ -0,0 +1,70 @@
+#ifndef _MBS_TF_REACTOR_TASK_HH_
+#define _MBS_TF_REACTOR_TASK_HH_
+/******************************************************************************
+ * 5G-MAG Reference Tools: MBS Traffic Function: Reactor Task class
+ ******************************************************************************
+ * Copyright: (C)2025 British Broadcasting Corporation
+ * Author(s): David Waring <david.waring2@bbc.co.uk>
+ * License: 5G-MAG Public License v1
+ *
+ * For full license terms please see the LICENSE file distributed with this
+ * program. If this file is missing then the license can be retrieved from
+ * https://drive.google.com/file/d/1cinCiA778IErENZ3JN52VFW-1ffHpx7Z/view
+ */
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+#include <boost/asio/io_context.hpp>
+
+#include "common.hh"
+
+MBSTF_NAMESPACE_START
+
+/* A unit of work run on the shared Reactor whenever it is woken
+ *
+ * This replaces a worker thread per component: instead of looping and sleeping, the owner asks for its function to
+ * be run when there is something to do, either straight away (wake()) or at a time (wakeAt()/wakeAfter()). Several
+ * wake() calls before the function gets to run result in just one run, and only the earliest timed wake-up is kept.
+ *
+ * After cancel() returns the function is not running and won't be run again (unless cancel() was called from within
+ * the function itself, in which case it just won't be run again). The destructor cancels.
+ */
+class ReactorTask {
+public:
+    using Function = std::function<void()>;
+
+    ReactorTask() = delete;
+    ReactorTask(Function &&function);
+    ReactorTask(const ReactorTask &) = delete;
+    ReactorTask(ReactorTask &&) = delete;
+    virtual ~ReactorTask();
+
+    ReactorTask &operator=(const ReactorTask &) = delete;
+    ReactorTask &operator=(ReactorTask &&) = delete;
+
+    void wake();
+    void wakeAt(const std::chrono::system_clock::time_point &when);
+    void wakeAt(const std::chrono::steady_clock::time_point &when);
+    void wakeAfter(const std::chrono::steady_clock::duration &delay) { wakeAt(std::chrono::steady_clock::now() + delay); };
+    void cancel();
+    bool cancelled() const;
+    std::uint64_t runs() const; // number of times the function has been run
+
+    boost::asio::io_context &ioContext() const; // the io_context the function runs on
+
+private:
+    struct State;
+
+    static void run(const std::shared_ptr<State> &state);
+
+    std::shared_ptr<State> m_state;
+};
+
+MBSTF_NAMESPACE_STOP
+
+/* vim:ts=8:sts=4:sw=4:expandtab:
+ */
+#endif /* _MBS_TF_REACTOR_TASK_HH_ */
@@ -0,0 +1,591 @@
+/******************************************************************************
+ * 5G-MAG Reference Tools: MBS Traffic Function: State Journal class
+ ******************************************************************************
+ * Copyright: (C)2025 British Broadcasting Corporation
+ * Author(s): David Waring <david.waring2@bbc.co.uk>
+ * License: 5G-MAG Public License v1
+ *
+ * For full license terms please see the LICENSE file distributed with this
+ * program. If this file is missing then the license can be retrieved from
+ * https://drive.google.com/file/d/1cinCiA778IErENZ3JN52VFW-1ffHpx7Z/view
+ */
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <chrono>
+#include <filesystem>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include "ogs-app.h"
+
+#include "common.hh"
+#include "Context.hh"
+#include "Controller.hh"
+#include "ControllerFactory.hh"
+#include "DistributionSession.hh"
+#include "Event.hh"
+#include "MappedObjectBuffer.hh"
+#include "ObjectController.hh"
+#include "ObjectStore.hh"
+#include "SubscriptionService.hh"
+#include "openapi/model/CJson.hh"
+
+#include "StateJournal.hh"
+
+using fiveg_mag_reftools::CJson;
+
+MBSTF_NAMESPACE_START
+
+static std::string escape_file_name(const std::string &name);
+static std::string escape_value(const std::string &value);
+static std::string unescape_value(const std::string &value);
+static std::string time_point_to_string(const std::chrono::system_clock::time_point &time_point);
+static std::chrono::system_clock::time_point string_to_time_point(const std::string &value);
+static ObjectStore::ObjectData read_file(const std::filesystem::path &path);
+static void write_file(const std::filesystem::path &path, const void *data, std::size_t size);
+static std::string serialise_metadata(const ObjectStore::Metadata &metadata);
+static ObjectStore::Metadata parse_metadata(const ObjectStore::ObjectData &text);
+
+StateJournal::StateJournal(const std::string &directory, bool persist_objects)
+    :Subscriber()
+    ,m_directory(directory)
+    ,m_persistObjects(persist_objects)
+    ,m_subscriptionsMutex()
+    ,m_tasksMutex()
+    ,m_tasksCondVar()
+    ,m_tasks()
+    ,m_queuedObjectWrites()
+    ,m_stopWriter(false)
+    ,m_writerThread()
+{
+    std::error_code ec;
+    std::filesystem::create_directories(m_directory / "sessions", ec);
+    if (!ec && m_persistObjects) std::filesystem::create_directories(m_directory / "objects", ec);
+    if (ec) {
+        throw std::system_error(ec, "Unable to create state journal directory " + directory);
+    }
+    m_writerThread = std::thread(&StateJournal::writerLoop, this);
+}
+
+StateJournal::~StateJournal()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_tasksMutex);
+        m_stopWriter = true;
+    }
+    m_tasksCondVar.notify_all();
+    // The writer drains the queue before exiting so nothing already reported to us is lost
+    if (m_writerThread.joinable()) m_writerThread.join();
+}
+
+void StateJournal::restore(Context &context)
+{
+    std::set<std::filesystem::path> restored_objects_dirs;
+    std::vector<std::filesystem::path> session_files;
+    std::error_code ec;
+
+    for (const auto &entry : std::filesystem::directory_iterator(m_directory / "sessions", ec)) {
+        if (entry.path().extension() == ".json") {
+            session_files.push_back(entry.path());
+        } else {
+            std::filesystem::remove(entry.path(), ec);
+        }
+    }
+
+    for (const auto &path : session_files) {
+        std::shared_ptr<DistributionSession> session;
+        try {
+            ObjectStore::ObjectData contents(read_file(path));
+            CJson json(CJson::parse(std::string(contents.begin(), contents.end()).c_str()));
+            session.reset(new DistributionSession(json, false));
+            session->setController(std::shared_ptr<Controller>(ControllerFactory::makeController(*session)));
+        } catch (std::exception &ex) {
+            ogs_error("Unable to restore distribution session from %s: %s", path.c_str(), ex.what());
+            std::filesystem::remove(path, ec);
+            continue;
+        }
+
+        if (!session->controller()) {
+            ogs_error("No controller available for journalled distribution session [%s], discarding it",
+                      session->distributionSessionId().c_str());
+            std::filesystem::remove(path, ec);
+            continue;
+        }
+
+        if (m_persistObjects) {
+            ObjectController *controller = dynamic_cast<ObjectController*>(session->controller().get());
+            if (controller) {
+                restoreObjects(*controller);
+                restored_objects_dirs.insert(objectsDirectory(session->distributionSessionId()));
+            }
+        }
+
+        context.addDistributionSession(session);
+        ogs_info("Restored distribution session [%s]", session->distributionSessionId().c_str());
+    }
+
+    // Remove objects left behind by sessions that no longer exist
+    for (const auto &entry : std::filesystem::directory_iterator(m_directory / "objects", ec)) {
+        if (restored_objects_dirs.find(entry.path()) == restored_objects_dirs.end()) {
+            std::filesystem::remove_all(entry.path(), ec);
+        }
+    }
+    if (!m_persistObjects) std::filesystem::remove_all(m_directory / "objects", ec);
+}
+
+void StateJournal::sessionAdded(const std::shared_ptr<DistributionSession> &session)
+{
+    queueTask(Task{Task::WRITE_SESSION, session->distributionSessionId(), std::string(),
+                   session->json(false).serialise(), std::nullopt});
+
+    if (m_persistObjects) {
+        ObjectController *controller = dynamic_cast<ObjectController*>(session->controller().get());
+        if (controller) {
+            std::lock_guard<std::mutex> lock(m_subscriptionsMutex);
+            subscribeTo<ObjectStore::ObjectAddedEvent, ObjectStore::ObjectsAddedEvent, ObjectStore::ObjectRefreshedEvent,
+                        ObjectStore::ObjectDeletedEvent, ObjectStore::ObjectsDeletedEvent>(controller->objectStore());
+        }
+    }
+}
+
+void StateJournal::sessionRemoved(const std::string &session_id)
+{
+    queueTask(Task{Task::REMOVE_SESSION, session_id, std::string(), std::string(), std::nullopt});
+}
+
+void StateJournal::processEvent(Event &event, SubscriptionService &event_service)
+{
+    ObjectStore *store = dynamic_cast<ObjectStore*>(&event_service);
+    if (!store) return;
+
+    const std::string &session_id(store->objectController().distributionSession().distributionSessionId());
+
+    if (event.is<ObjectStore::ObjectAddedEvent>()) {
+        ObjectStore::ObjectAddedEvent &added_event = event.as<ObjectStore::ObjectAddedEvent>();
+        std::optional<ObjectStore::Object> object(store->findObject(added_event.objectId()));
+        // If the object has already gone then there will be an ObjectDeleted following
+        if (!object || object->metadata().noStore()) return;
+        queueTask(Task{Task::WRITE_OBJECT, session_id, added_event.objectId(), std::string(), std::move(object)});
+    } else if (event.is<ObjectStore::ObjectsAddedEvent>()) {
+        ObjectStore::ObjectsAddedEvent &added_event = event.as<ObjectStore::ObjectsAddedEvent>();
+        for (const auto &object_id : added_event.objectIds()) {
+            std::optional<ObjectStore::Object> object(store->findObject(object_id));
+            if (object && !object->metadata().noStore()) queueTask(Task{Task::WRITE_OBJECT, session_id, object_id, std::string(), std::move(object)});
+        }
+    } else if (event.is<ObjectStore::ObjectRefreshedEvent>()) {
+        // Revalidated, the payload is the same but the freshness has moved on
+        ObjectStore::ObjectRefreshedEvent &refreshed_event = event.as<ObjectStore::ObjectRefreshedEvent>();
+        std::optional<ObjectStore::Object> object(store->findObject(refreshed_event.objectId()));
+        if (!object) return;
+        if (object->metadata().noStore()) {
+            queueTask(Task{Task::REMOVE_OBJECT, session_id, refreshed_event.objectId(), std::string(), std::nullopt});
+        } else {
+            queueTask(Task{Task::REFRESH_OBJECT, session_id, refreshed_event.objectId(), std::string(), std::move(object)});
+        }
+    } else if (event.is<ObjectStore::ObjectDeletedEvent>()) {
+        ObjectStore::ObjectDeletedEvent &deleted_event = event.as<ObjectStore::ObjectDeletedEvent>();
+        queueTask(Task{Task::REMOVE_OBJECT, session_id, deleted_event.objectId(), std::string(), std::nullopt});
+    } else if (event.is<ObjectStore::ObjectsDeletedEvent>()) {
+        ObjectStore::ObjectsDeletedEvent &deleted_event = event.as<ObjectStore::ObjectsDeletedEvent>();
+        for (const auto &object_id : deleted_event.objectIds()) {
+            queueTask(Task{Task::REMOVE_OBJECT, session_id, object_id, std::string(), std::nullopt});
+        }
+    }
+}
+
+void StateJournal::subscriberRemoved(SubscriptionService &service)
+{
+    std::lock_guard<std::mutex> lock(m_subscriptionsMutex);
+    Subscriber::subscriberRemoved(service);
+}
+
+std::string StateJournal::reprString() const
+{
+    std::ostringstream os;
+    os << "StateJournal(\"" << m_directory.string() << "\", " << (m_persistObjects?"true":"false") << ")";
+    return os.str();
+}
+
+std::filesystem::path StateJournal::sessionFile(const std::string &session_id) const
+{
+    return m_directory / "sessions" / (escape_file_name(session_id) + ".json");
+}
+
+std::filesystem::path StateJournal::objectsDirectory(const std::string &session_id) const
+{
+    return m_directory / "objects" / escape_file_name(session_id);
+}
+
+void StateJournal::restoreObjects(ObjectController &controller)
+{
+    ObjectStore &store(controller.objectStore());
+    std::filesystem::path dir(objectsDirectory(controller.distributionSession().distributionSessionId()));
+    std::vector<std::filesystem::path> metadata_files;
+    std::error_code ec;
+
+    for (const auto &entry : std::filesystem::directory_iterator(dir, ec)) {
+        const std::filesystem::path &path(entry.path());
+        if (path.extension() == ".meta") {
+            metadata_files.push_back(path);
+        } else if (path.extension() == ".data") {
+            // payloads without metadata were not completely written
+            std::filesystem::path metadata_path(path);
+            metadata_path.replace_extension(".meta");
+            if (!std::filesystem::exists(metadata_path, ec)) std::filesystem::remove(path, ec);
+        } else {
+            std::filesystem::remove(path, ec);
+        }
+    }
+
+    std::chrono::system_clock::time_point now(std::chrono::system_clock::now());
+    std::size_t restored = 0;
+    for (const auto &metadata_path : metadata_files) {
+        std::filesystem::path data_path(metadata_path);
+        data_path.replace_extension(".data");
+        try {
+            ObjectStore::Metadata metadata(parse_metadata(read_file(metadata_path)));
+            if (metadata.hasExpiryTime() && metadata.ExpiryTime() <= now) {
+                ogs_debug("Journalled object [%s] has expired, discarding it", metadata.objectId().c_str());
+                std::filesystem::remove(metadata_path, ec);
+                std::filesystem::remove(data_path, ec);
+                continue;
+            }
+            if (metadata.freshUntil() && metadata.freshUntil().value() <= now) {
+                // Stale (or no-cache) objects must be revalidated before they are sent again, leave that to the ingester
+                ogs_debug("Journalled object [%s] is stale, discarding it", metadata.objectId().c_str());
+                std::filesystem::remove(metadata_path, ec);
+                std::filesystem::remove(data_path, ec);
+                continue;
+            }
+            std::string object_id(metadata.objectId());
+            if (store.findObject(object_id)) continue;
+            // The session's ingesters are already running, anything they have fetched since is newer
+            if (!store.addObjectIfNew(object_id, MappedObjectBuffer::mapFile(data_path), std::move(metadata))) {
+                ogs_debug("Journalled object [%s] already fetched again, discarding it", object_id.c_str());
+                std::filesystem::remove(metadata_path, ec);
+                std::filesystem::remove(data_path, ec);
+                continue;
+            }
+            restored++;
+        } catch (std::exception &ex) {
+            ogs_warn("Discarding journalled object %s: %s", metadata_path.c_str(), ex.what());
+            std::filesystem::remove(metadata_path, ec);
+            std::filesystem::remove(data_path, ec);
+        }
+    }
+
+    if (restored) {
+        ogs_info("Restored %zu objects for distribution session [%s]", restored,
+                 controller.distributionSession().distributionSessionId().c_str());
+    }
+}
+
+void StateJournal::queueTask(Task &&task)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_tasksMutex);
+        if (task.type == Task::WRITE_OBJECT || task.type == Task::REFRESH_OBJECT || task.type == Task::REMOVE_OBJECT) {
+            auto queued = m_queuedObjectWrites.find(std::make_pair(task.sessionId, task.objectId));
+            if (queued != m_queuedObjectWrites.end()) {
+                Task &queued_task(*queued->second);
+                if (task.type != Task::REMOVE_OBJECT) {
+                    // Already waiting to be written, write the latest version of it instead
+                    if (task.type == Task::WRITE_OBJECT) queued_task.type = Task::WRITE_OBJECT;
+                    queued_task.object = std::move(task.object);
+                    return;
+                }
+                // Removed before it was written
+                m_tasks.erase(queued->second);
+                m_queuedObjectWrites.erase(queued);
+            } else if (task.type != Task::REMOVE_OBJECT && m_queuedObjectWrites.size() >= c_maxQueuedObjectWrites) {
+                // The journal is only for warm restarts, better to lose an object from it than hold up memory
+                ogs_debug("State journal backed up, not journalling object [%s]", task.objectId.c_str());
+                return;
+            }
+        }
+        m_tasks.push_back(std::move(task));
+        const Task &queued_task(m_tasks.back());
+        if (queued_task.type == Task::WRITE_OBJECT || queued_task.type == Task::REFRESH_OBJECT) {
+            m_queuedObjectWrites.emplace(std::make_pair(queued_task.sessionId, queued_task.objectId),
+                                         std::prev(m_tasks.end()));
+        }
+    }
+    m_tasksCondVar.notify_one();
+}
+
+void StateJournal::performTask(const Task &task)
+{
+    std::error_code ec;
+
+    switch (task.type) {
+    case Task::WRITE_SESSION:
+        write_file(sessionFile(task.sessionId), task.sessionJson.data(), task.sessionJson.size());
+        break;
+    case Task::REMOVE_SESSION:
+        std::filesystem::remove(sessionFile(task.sessionId), ec);
+        std::filesystem::remove_all(objectsDirectory(task.sessionId), ec);
+        break;
+    case Task::WRITE_OBJECT:
+    case Task::REFRESH_OBJECT:
+        {
+            // Objects can still arrive from a session's store after the session was removed
+            if (!std::filesystem::exists(sessionFile(task.sessionId), ec)) break;
+
+            std::filesystem::path dir(objectsDirectory(task.sessionId));
+            std::filesystem::create_directories(dir, ec);
+            if (ec) throw std::system_error(ec, "Unable to create " + dir.string());
+
+            std::string base_name(escape_file_name(task.objectId));
+            std::filesystem::path metadata_path(dir / (base_name + ".meta"));
+            std::filesystem::path data_path(dir / (base_name + ".data"));
+            std::string metadata(serialise_metadata(task.object->metadata()));
+            if (std::filesystem::exists(metadata_path, ec)) {
+                // Unchanged if this object was restored from the journal, otherwise a new version under the same id
+                ObjectStore::ObjectData journalled(read_file(metadata_path));
+                if (std::string(journalled.begin(), journalled.end()) == metadata) break;
+                if (task.type == Task::REFRESH_OBJECT) {
+                    write_file(metadata_path, metadata.data(), metadata.size());
+                    break;
+                }
+                // The payload is being replaced, so its old metadata must not be left pointing at it
+                std::filesystem::remove(metadata_path, ec);
+            }
+
+            const ObjectBuffer &data(task.object->data());
+            write_file(data_path, data.data(), data.size());
+            write_file(metadata_path, metadata.data(), metadata.size());
+        }
+        break;
+    case Task::REMOVE_OBJECT:
+        {
+            std::filesystem::path dir(objectsDirectory(task.sessionId));
+            std::string base_name(escape_file_name(task.objectId));
+            std::filesystem::remove(dir / (base_name + ".meta"), ec);
+            std::filesystem::remove(dir / (base_name + ".data"), ec);
+        }
+        break;
+    }
+}
+
+void StateJournal::writerLoop()
+{
+    std::unique_lock<std::mutex> lock(m_tasksMutex);
+    while (true) {
+        m_tasksCondVar.wait(lock, [this]{ return m_stopWriter || !m_tasks.empty(); });
+        if (m_tasks.empty()) break;
+        Task task(std::move(m_tasks.front()));
+        m_tasks.pop_front();
+        if (task.type == Task::WRITE_OBJECT || task.type == Task::REFRESH_OBJECT) m_queuedObjectWrites.erase(std::make_pair(task.sessionId, task.objectId));
+        lock.unlock();
+        try {
+            performTask(task);
+        } catch (std::exception &ex) {
+            ogs_error("State journal update failed: %s", ex.what());
+        }
+        lock.lock();
+    }
+}
+
+static std::string escape_file_name(const std::string &name)
+{
+    static const char hex[] = "0123456789ABCDEF";
+    std::string ret;
+    ret.reserve(name.size());
+    for (auto c : name) {
+        unsigned char uc = static_cast<unsigned char>(c);
+        if ((uc >= 'A' && uc <= 'Z') || (uc >= 'a' && uc <= 'z') || (uc >= '0' && uc <= '9') || uc == '-' || uc == '_' ||
+            (uc == '.' && !ret.empty())) {
+            ret += c;
+        } else {
+            ret += '%';
+            ret += hex[uc >> 4];
+            ret += hex[uc & 0xf];
+        }
+    }
+    return ret;
+}
+
+static std::string escape_value(const std::string &value)
+{
+    std::string ret;
+    ret.reserve(value.size());
+    for (auto c : value) {
+        if (c == '\\') {
+            ret += "\\\\";
+        } else if (c == '\n') {
+            ret += "\\n";
+        } else {
+            ret += c;
+        }
+    }
+    return ret;
+}
+
+static std::string unescape_value(const std::string &value)
+{
+    std::string ret;
+    ret.reserve(value.size());
+    for (auto it = value.begin(); it != value.end(); ++it) {
+        if (*it == '\\' && it + 1 != value.end()) {
+            ++it;
+            ret += (*it == 'n')?'\n':*it;
+        } else {
+            ret += *it;
+        }
+    }
+    return ret;
+}
+
+static std::string time_point_to_string(const std::chrono::system_clock::time_point &time_point)
+{
+    return std::to_string(std::chrono::duration_cast<std::chrono::microseconds>(time_point.time_since_epoch()).count());
+}
+
+static std::chrono::system_clock::time_point string_to_time_point(const std::string &value)
+{
+    return std::chrono::system_clock::time_point(
+                std::chrono::duration_cast<std::chrono::system_clock::duration>(std::chrono::microseconds(std::stoll(value))));
+}
+
+static ObjectStore::ObjectData read_file(const std::filesystem::path &path)
+{
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        throw std::system_error(errno, std::generic_category(), "Unable to open " + path.string());
+    }
+
+    ObjectStore::ObjectData data;
+    std::error_code ec;
+    auto file_size = std::filesystem::file_size(path, ec);
+    if (!ec) data.reserve(file_size);
+
+    unsigned char buffer[65536];
+    while (true) {
+        ssize_t bytes = read(fd, buffer, sizeof(buffer));
+        if (bytes < 0) {
+            if (errno == EINTR) continue;
+            int err = errno;
+            close(fd);
+            throw std::system_error(err, std::generic_category(), "Unable to read " + path.string());
+        }
+        if (bytes == 0) break;
+        data.insert(data.end(), buffer, buffer + bytes);
+    }
+    close(fd);
+
+    return data;
+}
+
+static void write_file(const std::filesystem::path &path, const void *data, std::size_t size)
+{
+    std::filesystem::path tmp_path(path);
+    tmp_path += ".tmp";
+
+    int fd = open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        throw std::system_error(errno, std::generic_category(), "Unable to create " + tmp_path.string());
+    }
+
+    const unsigned char *ptr = reinterpret_cast<const unsigned char*>(data);
+    while (size > 0) {
+        ssize_t written = write(fd, ptr, size);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            int err = errno;
+            close(fd);
+            unlink(tmp_path.c_str());
+            throw std::system_error(err, std::generic_category(), "Unable to write " + tmp_path.string());
+        }
+        ptr += written;
+        size -= written;
+    }
+
+    // Make sure the contents are on disk before the rename makes the file visible
+    if (fdatasync(fd) < 0 || close(fd) < 0) {
+        int err = errno;
+        unlink(tmp_path.c_str());
+        throw std::system_error(err, std::generic_category(), "Unable to write " + tmp_path.string());
+    }
+
+    if (rename(tmp_path.c_str(), path.c_str()) < 0) {
+        int err = errno;
+        unlink(tmp_path.c_str());
+        throw std::system_error(err, std::generic_category(), "Unable to rename " + tmp_path.string());
+    }
+}
+
+static std::string serialise_metadata(const ObjectStore::Metadata &metadata)
+{
+    std::ostringstream os;
+    os << "objectId=" << escape_value(metadata.objectId()) << "\n"
+       << "mediaType=" << escape_value(metadata.mediaType()) << "\n"
+       << "originalUrl=" << escape_value(metadata.getOriginalUrl()) << "\n"
+       << "fetchedUrl=" << escape_value(metadata.getFetchedUrl()) << "\n"
+       << "acquisitionId=" << escape_value(metadata.acquisitionId()) << "\n"
+       << "keepAfterSend=" << (metadata.keepAfterSend()?1:0) << "\n"
+       << "receivedTime=" << time_point_to_string(metadata.receivedTime()) << "\n"
+       << "created=" << time_point_to_string(metadata.created()) << "\n"
+       << "modified=" << time_point_to_string(metadata.modified()) << "\n";
+    if (metadata.objIngestBaseUrl()) os << "objIngestBaseUrl=" << escape_value(metadata.objIngestBaseUrl().value()) << "\n";
+    if (metadata.objDistributionBaseUrl()) {
+        os << "objDistributionBaseUrl=" << escape_value(metadata.objDistributionBaseUrl().value()) << "\n";
+    }
+    if (metadata.entityTag()) os << "entityTag=" << escape_value(metadata.entityTag().value()) << "\n";
+    if (metadata.lastModified()) os << "lastModified=" << time_point_to_string(metadata.lastModified().value()) << "\n";
+    if (metadata.cacheExpires()) os << "cacheExpires=" << time_point_to_string(metadata.cacheExpires().value()) << "\n";
+    if (metadata.freshUntil()) os << "freshUntil=" << time_point_to_string(metadata.freshUntil().value()) << "\n";
+    return os.str();
+}
+
+static ObjectStore::Metadata parse_metadata(const ObjectStore::ObjectData &text)
+{
+    std::map<std::string, std::string> fields;
+    std::istringstream is(std::string(text.begin(), text.end()));
+    std::string line;
+    while (std::getline(is, line)) {
+        auto eq = line.find('=');
+        if (eq == std::string::npos) continue;
+        fields[line.substr(0, eq)] = unescape_value(line.substr(eq + 1));
+    }
+
+    static const char *required[] = {"objectId", "mediaType", "originalUrl", "fetchedUrl", "acquisitionId", "modified"};
+    for (auto field : required) {
+        if (fields.find(field) == fields.end()) throw std::invalid_argument(std::string("Missing metadata field ") + field);
+    }
+
+    std::optional<std::string> obj_ingest_base_url;
+    std::optional<std::string> obj_distribution_base_url;
+    std::optional<std::chrono::system_clock::time_point> cache_expires;
+    if (fields.count("objIngestBaseUrl")) obj_ingest_base_url = fields["objIngestBaseUrl"];
+    if (fields.count("objDistributionBaseUrl")) obj_distribution_base_url = fields["objDistributionBaseUrl"];
+    if (fields.count("cacheExpires")) cache_expires = string_to_time_point(fields["cacheExpires"]);
+
+    ObjectStore::Metadata metadata(fields["objectId"], fields["mediaType"], fields["originalUrl"], fields["fetchedUrl"],
+                                   fields["acquisitionId"], string_to_time_point(fields["modified"]),
+                                   obj_ingest_base_url, obj_distribution_base_url, cache_expires);
+    metadata.keepAfterSend(fields["keepAfterSend"] == "1");
+    if (fields.count("entityTag")) metadata.entityTag(fields["entityTag"]);
+    if (fields.count("lastModified")) metadata.lastModified(string_to_time_point(fields["lastModified"]));
+    if (fields.count("receivedTime")) metadata.receivedTime(string_to_time_point(fields["receivedTime"]));
+    if (fields.count("created")) metadata.created(string_to_time_point(fields["created"]));
+    if (fields.count("freshUntil")) metadata.freshUntil(string_to_time_point(fields["freshUntil"]));
+
+    return metadata;
+}
+
+MBSTF_NAMESPACE_STOP
+
+/* vim:ts=8:sts=4:sw=4:expandtab:
+ */
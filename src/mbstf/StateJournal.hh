@@ -0,0 +1,120 @@
+#ifndef _MBS_TF_STATE_JOURNAL_HH_
+#define _MBS_TF_STATE_JOURNAL_HH_
+/******************************************************************************
+ * 5G-MAG Reference Tools: MBS Traffic Function: State Journal class
+ ******************************************************************************
+ * Copyright: (C)2025 British Broadcasting Corporation
+ * Author(s): David Waring <david.waring2@bbc.co.uk>
+ * License: 5G-MAG Public License v1
+ *
+ * For full license terms please see the LICENSE file distributed with this
+ * program. If this file is missing then the license can be retrieved from
+ * https://drive.google.com/file/d/1cinCiA778IErENZ3JN52VFW-1ffHpx7Z/view
+ */
+
+#include <condition_variable>
+#include <filesystem>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <utility>
+
+#include "common.hh"
+#include "ObjectStore.hh"
+#include "Subscriber.hh"
+
+MBSTF_NAMESPACE_START
+
+class Context;
+class DistributionSession;
+class Event;
+class ObjectController;
+class SubscriptionService;
+
+/* On-disk journal of MBSTF state used for warm restarts
+ *
+ * The journal directory holds one file per distribution session, containing the CreateReqData JSON for the session,
+ * and, if objects are being persisted, a directory per session holding a payload and metadata file for each object in
+ * the session's ObjectStore, other than those the origin marked no-store. Files are written as sessions and objects
+ * come and go, by a background thread so that neither the SBI handlers nor the ObjectStore event threads wait on disk
+ * I/O. Each file is written to a temporary name and renamed into place, and an object's metadata file is only written
+ * once its payload is complete, so a crash at any point leaves a consistent journal. An object added again under the
+ * same id is written again, and one that is revalidated has its metadata rewritten. Object writes waiting for the
+ * background thread are replaced by later writes of the same object or dropped if the object is removed first, and
+ * new ones are dropped while too many are waiting, so that a slow disk does not hold payloads in memory.
+ *
+ * At startup restore() recreates the journalled sessions, along with their controllers, and repopulates their
+ * ObjectStores with any objects that are still fresh, as restored objects are sent without being revalidated. Payloads
+ * are mapped from the journal rather than read in. Objects are only restored for URLs that the session's ingesters
+ * have not fetched again since it started.
+ */
+class StateJournal : public Subscriber {
+public:
+    StateJournal() = delete;
+    StateJournal(const std::string &directory, bool persist_objects = true); // throws std::system_error if directory is unusable
+    StateJournal(const StateJournal &) = delete;
+    StateJournal(StateJournal &&) = delete;
+    virtual ~StateJournal();
+
+    StateJournal &operator=(const StateJournal &) = delete;
+    StateJournal &operator=(StateJournal &&) = delete;
+
+    const std::filesystem::path &directory() const { return m_directory; };
+    bool persistObjects() const { return m_persistObjects; };
+
+    void restore(Context &context);
+
+    void sessionAdded(const std::shared_ptr<DistributionSession> &session);
+    void sessionRemoved(const std::string &session_id);
+
+    virtual void processEvent(Event &event, SubscriptionService &event_service);
+    virtual void subscriberRemoved(SubscriptionService &service);
+    virtual std::string reprString() const;
+
+private:
+    struct Task {
+        enum Type {
+            WRITE_SESSION,
+            REMOVE_SESSION,
+            WRITE_OBJECT,
+            REFRESH_OBJECT, // only the metadata has changed
+            REMOVE_OBJECT
+        };
+
+        Type type;
+        std::string sessionId;
+        std::string objectId;
+        std::string sessionJson;
+        std::optional<ObjectStore::Object> object;
+    };
+
+    std::filesystem::path sessionFile(const std::string &session_id) const;
+    std::filesystem::path objectsDirectory(const std::string &session_id) const;
+    void restoreObjects(ObjectController &controller);
+    void queueTask(Task &&task);
+    void performTask(const Task &task);
+    void writerLoop();
+
+    // Most object writes waiting for the writer thread at once
+    static constexpr std::size_t c_maxQueuedObjectWrites = 256;
+
+    std::filesystem::path m_directory;
+    bool m_persistObjects;
+    std::mutex m_subscriptionsMutex;
+    std::mutex m_tasksMutex;
+    std::condition_variable m_tasksCondVar;
+    std::list<Task> m_tasks;
+    std::map<std::pair<std::string, std::string>, std::list<Task>::iterator> m_queuedObjectWrites; // by session and object id
+    bool m_stopWriter;
+    std::thread m_writerThread;
+};
+
+MBSTF_NAMESPACE_STOP
+
+/* vim:ts=8:sts=4:sw=4:expandtab:
+ */
+#endif /* _MBS_TF_STATE_JOURNAL_HH_ */
@@ -144,6 +144,13 @@ bool Subscriber::subscribeTo(std::initializer_list<const char*> events_list, Sub
     return ret;
 }
 
+bool Subscriber::subscribeTo(std::initializer_list<Event::TypeId> event_types, SubscriptionService &service)
+{
+    bool ret = service.subscribe(event_types, *this);
+    if (ret) m_subscriptions.insert(&service);
+    return ret;
+}
+
 bool Subscriber::isSubscribedTo(SubscriptionService &service) const
 {
     return (m_subscriptions.find(&service) != m_subscriptions.end());
@@ -18,11 +18,11 @@
 #include <string>
 
 #include "common.hh"
+#include "Event.hh"
 
 MBSTF_NAMESPACE_START
 
 class SubscriptionService;
-class Event;
 
 class Subscriber
 {
@@ -47,6 +47,9 @@ public:
 protected:
     bool subscribeTo(SubscriptionService &service); // subscribe to all events
     bool subscribeTo(std::initializer_list<const char*> events_list, SubscriptionService &service); // subscribe to specific events
+    bool subscribeTo(std::initializer_list<Event::TypeId> event_types, SubscriptionService &service); // subscribe to specific event types
+    template <class... Events>
+    bool subscribeTo(SubscriptionService &service) { return subscribeTo({Event::typeIdOf<Events>()...}, service); }; // e.g. subscribeTo<ObjectStore::ObjectAddedEvent>(store)
     bool isSubscribedTo(SubscriptionService &service) const; // Check if we are subscribed in any way to service
     bool isSubscribedTo(std::initializer_list<const char*> events_list, SubscriptionService &service); // Check if we are subscribed to the given events on service
 
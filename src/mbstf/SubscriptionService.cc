@@ -10,81 +10,140 @@
  * https://drive.google.com/file/d/1cinCiA778IErENZ3JN52VFW-1ffHpx7Z/view
  */
 
+#include <atomic>
 #include <chrono>
+#include <cstdint>
+#include <algorithm>
 #include <deque>
+#include <exception>
 #include <list>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <set>
 #include <sstream>
 #include <string>
 #include <thread>
+#include <utility>
+
+#include "ogs-app.h"
 
 #include "common.hh"
 #include "Subscriber.hh"
 #include "Event.hh"
+#include "EventExecutor.hh"
+#include "MPSCQueue.hh"
 
 #include "SubscriptionService.hh"
 
 MBSTF_NAMESPACE_START
 
+// Maximum events delivered for one service before letting other services have the executor thread
+static const unsigned int g_maxEventsPerStrandRun = 16;
+
+// Minimum time between coalesced events from the same source being queued
+static std::atomic<std::int64_t> g_coalescingIntervalMs(0);
+
+static void atomic_max(std::atomic<std::uint64_t> &current, std::uint64_t value);
+
+// Subscription snapshots being delivered from by sendEventSynchronous() on this thread
+static thread_local std::vector<const void*> t_deliverySnapshots;
+
+struct SubscriptionService::Subscriptions {
+    Subscriptions() :all(), typed(), readers(0) {};
+    Subscriptions(const Subscriptions &other) :all(other.all), typed(other.typed), readers(0) {};
+
+    std::vector<Subscriber*> all;
+    std::vector<std::vector<Subscriber*> > typed; // indexed by Event::TypeId
+    mutable std::atomic<unsigned int> readers;    // sendEventSynchronous() calls delivering from this snapshot
+};
+
+// Latest event for one (event type, source) pair sent with sendEventAsynchronousCoalesced()
+struct SubscriptionService::CoalescedEvent {
+    std::shared_ptr<Event> latest;                    // nullptr once taken for delivery
+    bool queued;                                      // a QueuedEvent referencing this is in the queue
+    std::chrono::steady_clock::time_point lastQueued;
+};
+
+struct SubscriptionService::QueuedEvent {
+    std::shared_ptr<Event> event;
+    std::chrono::steady_clock::time_point enqueued;
+    std::shared_ptr<CoalescedEvent> coalesced;        // if set, deliver coalesced->latest instead of event
+};
+
+struct SubscriptionService::AsyncStrand {
+    using CoalescingKey = std::pair<Event::TypeId, const void*>;
+
+    AsyncStrand(SubscriptionService *svc)
+        :events()
+        ,coalescingMutex()
+        ,coalescing()
+        ,service(svc)
+        ,scheduled(false)
+        ,cancelled(false)
+        ,deliveringThread()
+        ,queueDepth(0)
+        ,maxQueueDepth(0)
+        ,eventsDelivered(0)
+        ,totalLatencyNs(0)
+        ,maxLatencyNs(0)
+    {};
+
+    MPSCQueue<QueuedEvent> events;
+    std::mutex coalescingMutex;
+    std::map<CoalescingKey, std::shared_ptr<CoalescedEvent> > coalescing;
+    SubscriptionService *service;
+    std::atomic_bool scheduled;                    // a runAsyncStrand() task is queued or running
+    std::atomic_bool cancelled;
+    std::atomic<std::thread::id> deliveringThread; // thread currently running runAsyncStrand() for this strand
+
+    // Instrumentation
+    std::atomic<std::uint64_t> queueDepth;
+    std::atomic<std::uint64_t> maxQueueDepth;
+    std::atomic<std::uint64_t> eventsDelivered;
+    std::atomic<std::uint64_t> totalLatencyNs;
+    std::atomic<std::uint64_t> maxLatencyNs;
+};
+
 SubscriptionService::SubscriptionService()
-    :m_allEventSubscriptions()
-    ,m_namedEventSubscriptions()
-    ,m_asyncThread()
-    ,m_asyncEventQueue()
-    ,m_asyncMutex(new std::recursive_mutex)
-    ,m_asyncCondVar()
-    ,m_asyncCancel(false)
+    :m_subscriptionsMutex()
+    ,m_subscriptions(std::make_shared<const Subscriptions>())
+    ,m_asyncStrand(std::make_shared<AsyncStrand>(this))
 {
 }
 
 SubscriptionService::SubscriptionService(const SubscriptionService &other)
-    :m_allEventSubscriptions(std::move(other.m_allEventSubscriptions))
-    ,m_namedEventSubscriptions(std::move(other.m_namedEventSubscriptions))
-    ,m_asyncThread()
-    ,m_asyncEventQueue()
-    ,m_asyncMutex(new std::recursive_mutex)
-    ,m_asyncCondVar()
-    ,m_asyncCancel(false)
-{
-    if (other.m_asyncThread.get_id() != std::thread::id() &&
-        !other.m_asyncCancel) {
-        std::lock_guard other_guard(*other.m_asyncMutex);
-        m_asyncEventQueue = other.m_asyncEventQueue;
-        startAsyncLoop();
-    }
+    :m_subscriptionsMutex()
+    ,m_subscriptions(std::make_shared<const Subscriptions>(*other.m_subscriptions.load()))
+    ,m_asyncStrand(std::make_shared<AsyncStrand>(this))
+{
+    // Events already queued on other are still delivered by other
 }
 
 SubscriptionService::SubscriptionService(SubscriptionService &&other)
-    :m_allEventSubscriptions(std::move(other.m_allEventSubscriptions))
-    ,m_namedEventSubscriptions(std::move(other.m_namedEventSubscriptions))
-    ,m_asyncThread()
-    ,m_asyncEventQueue()
-    ,m_asyncMutex(new std::recursive_mutex)
-    ,m_asyncCondVar()
-    ,m_asyncCancel(false)
-{
-    if (other.m_asyncThread.get_id() != std::thread::id() &&
-        !other.m_asyncCancel) {
-        other.stopAsyncLoop();
-        std::lock_guard other_guard(*other.m_asyncMutex);
-        m_asyncEventQueue = std::move(other.m_asyncEventQueue);
-        startAsyncLoop();
+    :m_subscriptionsMutex()
+    ,m_subscriptions(std::make_shared<const Subscriptions>())
+    ,m_asyncStrand(std::make_shared<AsyncStrand>(this))
+{
+    // Stop other delivering events before taking its subscriptions
+    std::deque<std::shared_ptr<Event> > pending(other.cancelAsyncEvents());
+    {
+        std::lock_guard other_guard(other.m_subscriptionsMutex);
+        m_subscriptions = other.m_subscriptions.exchange(std::make_shared<const Subscriptions>());
+    }
+    for (auto &event : pending) {
+        queueAsyncEvent(event);
     }
 }
 
 SubscriptionService::~SubscriptionService()
 {
-    stopAsyncLoop();
-    std::lock_guard guard(*m_asyncMutex);
-    std::set<Subscriber*> subscribers;
-    for (auto &subsc : m_allEventSubscriptions) {
-        subscribers.insert(subsc);
-    }
-    for (auto& [name, subsc_set]: m_namedEventSubscriptions) {
-        for (auto subsc : subsc_set) {
-            subscribers.insert(subsc);
-        }
+    cancelAsyncEvents();
+    logAsyncEventStatistics("SubscriptionService");
+    std::shared_ptr<const Subscriptions> subscriptions(m_subscriptions.load());
+    std::set<Subscriber*> subscribers(subscriptions->all.begin(), subscriptions->all.end());
+    for (auto &subsc_list : subscriptions->typed) {
+        subscribers.insert(subsc_list.begin(), subsc_list.end());
     }
     for (auto subsc : subscribers) {
         subsc->subscriberRemoved(*this);
@@ -93,152 +152,136 @@ SubscriptionService::~SubscriptionService()
 
 SubscriptionService &SubscriptionService::operator=(const SubscriptionService &other)
 {
-    std::lock_guard guard(*m_asyncMutex);
-    std::lock_guard other_guard(*other.m_asyncMutex);
-    m_allEventSubscriptions = other.m_allEventSubscriptions;
-    m_namedEventSubscriptions = other.m_namedEventSubscriptions;
-    if (other.m_asyncThread.get_id() != std::thread::id() &&
-        !other.m_asyncCancel) {
-        m_asyncEventQueue = other.m_asyncEventQueue;
-        m_asyncCondVar.notify_all();
-        startAsyncLoop();
-    } else {
-        stopAsyncLoop();
-        m_asyncEventQueue.clear();
+    if (&other == this) return *this;
+    cancelAsyncEvents();
+    {
+        std::scoped_lock guard(m_subscriptionsMutex, other.m_subscriptionsMutex);
+        m_subscriptions = std::make_shared<const Subscriptions>(*other.m_subscriptions.load());
     }
-    m_asyncCancel = !!other.m_asyncCancel;
+    // Events already queued on other are still delivered by other
+    m_asyncStrand = std::make_shared<AsyncStrand>(this);
+    if (other.m_asyncStrand->cancelled) cancelAsyncEvents();
 
     return *this;
 }
 
 SubscriptionService &SubscriptionService::operator=(SubscriptionService &&other)
 {
-    std::lock_guard guard(*m_asyncMutex);
-    std::lock_guard other_guard(*other.m_asyncMutex);
-    m_allEventSubscriptions = std::move(other.m_allEventSubscriptions);
-    m_namedEventSubscriptions = std::move(other.m_namedEventSubscriptions);
-    if (other.m_asyncThread.get_id() != std::thread::id() &&
-        !other.m_asyncCancel) {
-        other.stopAsyncLoop();
-        m_asyncEventQueue = std::move(other.m_asyncEventQueue);
-        m_asyncCondVar.notify_all();
-        startAsyncLoop();
-    } else {
-        stopAsyncLoop();
-        m_asyncEventQueue.clear();
-        other.m_asyncEventQueue.clear();
+    if (&other == this) return *this;
+    cancelAsyncEvents();
+    std::deque<std::shared_ptr<Event> > pending(other.cancelAsyncEvents());
+    {
+        std::scoped_lock guard(m_subscriptionsMutex, other.m_subscriptionsMutex);
+        m_subscriptions = other.m_subscriptions.exchange(std::make_shared<const Subscriptions>());
+    }
+    m_asyncStrand = std::make_shared<AsyncStrand>(this);
+    for (auto &event : pending) {
+        queueAsyncEvent(event);
     }
-    m_asyncCancel = !!other.m_asyncCancel;
 
     return *this;
 }
 
 bool SubscriptionService::subscribe(Subscriber &subscriber)
 {
-    std::lock_guard guard(*m_asyncMutex);
-    // Remove named subscriptions if subscriber is now subscribing to all
-    for (auto it = m_namedEventSubscriptions.begin(); it != m_namedEventSubscriptions.end(); /* handle in loop */) {
-        auto &[name, subsc_set] = *it;
-        if (subsc_set.erase(&subscriber) > 0) {
-            if (subsc_set.empty()) {
-                it = m_namedEventSubscriptions.erase(it);
-            } else {
-                ++it;
-            }
-        } else {
-            ++it;
+    return updateSubscriptions([&subscriber](Subscriptions &subscriptions) {
+        if (std::find(subscriptions.all.begin(), subscriptions.all.end(), &subscriber) != subscriptions.all.end()) {
+            return false;
         }
-    }
-    // Add subscriber to all events list
-    return m_allEventSubscriptions.insert(&subscriber).second;
+        // Remove typed subscriptions as subscriber is now subscribing to all
+        for (auto &subsc_list : subscriptions.typed) {
+            std::erase(subsc_list, &subscriber);
+        }
+        subscriptions.all.push_back(&subscriber);
+        return true;
+    }, false);
 }
 
 bool SubscriptionService::subscribe(std::initializer_list<const char*> events_list, Subscriber &subscriber)
 {
-    bool ret = false;
-    if (m_allEventSubscriptions.find(&subscriber) != m_allEventSubscriptions.end()) {
-        // already subscribed to all events, ignore this request
-        return false;
-    }
-    std::lock_guard guard(*m_asyncMutex);
+    std::vector<Event::TypeId> event_types;
     for (auto event_name : events_list) {
-        auto &subsc_list = m_namedEventSubscriptions[std::string(event_name)];
-        ret = subsc_list.insert(&subscriber).second || ret;
+        event_types.push_back(Event::registerType(event_name));
     }
-    return ret;
+    return subscribeTypes(event_types, subscriber);
+}
+
+bool SubscriptionService::subscribe(std::initializer_list<Event::TypeId> event_types, Subscriber &subscriber)
+{
+    return subscribeTypes(std::vector<Event::TypeId>(event_types), subscriber);
 }
 
 bool SubscriptionService::unsubscribe(Subscriber &subscriber)
 {
-    bool ret = false;
-    std::lock_guard guard(*m_asyncMutex);
-    ret = (m_allEventSubscriptions.erase(&subscriber) > 0);
-    if (!ret) {
+    return updateSubscriptions([&subscriber](Subscriptions &subscriptions) {
+        if (std::erase(subscriptions.all, &subscriber) > 0) return true;
         // check for individual events
-        for (auto it = m_namedEventSubscriptions.begin(); it != m_namedEventSubscriptions.end(); /* handle in loop */) {
-            auto &[name, subsc_set] = *it;
-            if (subsc_set.erase(&subscriber) > 0) {
-                ret = true;
-                if (subsc_set.empty()) {
-                    it = m_namedEventSubscriptions.erase(it);
-                } else {
-                    ++it;
-                }
-            } else {
-                ++it;
-            }
+        bool ret = false;
+        for (auto &subsc_list : subscriptions.typed) {
+            if (std::erase(subsc_list, &subscriber) > 0) ret = true;
         }
-    }
-    return ret;
+        return ret;
+    }, true);
 }
 
 bool SubscriptionService::unsubscribe(std::initializer_list<const char*> events_list, Subscriber &subscriber)
 {
-    bool ret = false;
-    for (auto name : events_list) {
-        std::string event_name(name);
-        auto it = m_namedEventSubscriptions.find(event_name);
-        if (it != m_namedEventSubscriptions.end()) {
-            if (it->second.erase(&subscriber) > 0) {
+    std::vector<Event::TypeId> event_types;
+    for (auto event_name : events_list) {
+        event_types.push_back(Event::registerType(event_name));
+    }
+    return updateSubscriptions([&subscriber, &event_types](Subscriptions &subscriptions) {
+        bool ret = false;
+        for (auto type_id : event_types) {
+            if (type_id < subscriptions.typed.size() && std::erase(subscriptions.typed[type_id], &subscriber) > 0) {
                 ret = true;
-                if (it->second.empty()) {
-                    it = m_namedEventSubscriptions.erase(it);
-                }
             }
         }
-    }
-    return ret;
+        return ret;
+    }, true);
 }
 
 std::list<const char*> SubscriptionService::subscribedEvents(Subscriber &subscriber)
 {
+    std::shared_ptr<const Subscriptions> subscriptions(m_subscriptions.load());
     std::list<const char*> ret;
-    if (m_allEventSubscriptions.find(&subscriber) != m_allEventSubscriptions.end()) {
+    if (std::find(subscriptions->all.begin(), subscriptions->all.end(), &subscriber) != subscriptions->all.end()) {
         ret.push_back(nullptr);
     } else {
-        for (auto &[name, subsc_set] : m_namedEventSubscriptions) {
-            if (subsc_set.find(&subscriber) != subsc_set.end()) {
-                ret.push_back(name.c_str());
+        for (Event::TypeId type_id = 0; type_id < subscriptions->typed.size(); type_id++) {
+            const auto &subsc_list(subscriptions->typed[type_id]);
+            if (std::find(subsc_list.begin(), subsc_list.end(), &subscriber) != subsc_list.end()) {
+                ret.push_back(Event::typeName(type_id).c_str());
             }
         }
     }
     return ret;
 }
 
+bool SubscriptionService::hasSubscribers(Event::TypeId type_id) const
+{
+    std::shared_ptr<const Subscriptions> subscriptions(m_subscriptions.load());
+    if (!subscriptions->all.empty()) return true;
+    return type_id < subscriptions->typed.size() && !subscriptions->typed[type_id].empty();
+}
+
 std::string SubscriptionService::reprString() const
 {
+    std::shared_ptr<const Subscriptions> subscriptions(m_subscriptions.load());
     std::ostringstream os;
     os << "SubscriptionService(/* subscriptions=[";
     const char *sep="";
-    for (auto subsc : m_allEventSubscriptions) {
+    for (auto subsc : subscriptions->all) {
         os << sep << *subsc;
         sep = ", ";
     }
-    for (auto &[name, subsc_set] : m_namedEventSubscriptions) {
-        os << sep << "{\"" << name << "\": [";
+    for (Event::TypeId type_id = 0; type_id < subscriptions->typed.size(); type_id++) {
+        const auto &subsc_list(subscriptions->typed[type_id]);
+        if (subsc_list.empty()) continue;
+        os << sep << "{\"" << Event::typeName(type_id) << "\": [";
         sep = ", ";
         const char *sep2 = "";
-        for (auto subsc : subsc_set) {
+        for (auto subsc : subsc_list) {
             os << sep2 << *subsc;
             sep2 = ", ";
         }
@@ -250,90 +293,260 @@ std::string SubscriptionService::reprString() const
 
 bool SubscriptionService::sendEventSynchronous(Event &event)
 {
-    std::lock_guard guard(*m_asyncMutex);
-    auto it = m_namedEventSubscriptions.find(event.eventName());
-    if (it != m_namedEventSubscriptions.end()) {
-        for (auto &subsc : it->second) {
-            m_asyncMutex->unlock();
+    std::shared_ptr<const Subscriptions> subscriptions(m_subscriptions.load());
+    // Count ourselves as a reader of the snapshot, and record it against this thread so that an unsubscribe() from
+    // within processEvent() doesn't wait for itself
+    struct DeliveryGuard {
+        DeliveryGuard(const Subscriptions *snapshot) :m_snapshot(snapshot) {
+            m_snapshot->readers++;
+            t_deliverySnapshots.push_back(m_snapshot);
+        };
+        ~DeliveryGuard() {
+            t_deliverySnapshots.pop_back();
+            m_snapshot->readers--;
+            m_snapshot->readers.notify_all();
+        };
+
+        const Subscriptions *m_snapshot;
+    } delivery_guard(subscriptions.get());
+
+    Event::TypeId type_id = event.typeId();
+    if (type_id < subscriptions->typed.size()) {
+        for (auto subsc : subscriptions->typed[type_id]) {
             subsc->processEvent(event, *this);
-            m_asyncMutex->lock();
-            if (event.stopProcessingFlag()) break;
+            if (event.stopProcessingFlag()) return false;
         }
     }
-    if (event.stopProcessingFlag()) return false;
-    for (auto &subsc : m_allEventSubscriptions) {
-        m_asyncMutex->unlock();
-	subsc->processEvent(event, *this);
-        m_asyncMutex->lock();
-	if (event.stopProcessingFlag()) break;
+    for (auto subsc : subscriptions->all) {
+        subsc->processEvent(event, *this);
+        if (event.stopProcessingFlag()) return false;
     }
     return !event.preventDefaultFlag();
 }
 
+bool SubscriptionService::subscribeTypes(const std::vector<Event::TypeId> &event_types, Subscriber &subscriber)
+{
+    return updateSubscriptions([&subscriber, &event_types](Subscriptions &subscriptions) {
+        if (std::find(subscriptions.all.begin(), subscriptions.all.end(), &subscriber) != subscriptions.all.end()) {
+            // already subscribed to all events, ignore this request
+            return false;
+        }
+        bool ret = false;
+        for (auto type_id : event_types) {
+            if (type_id >= subscriptions.typed.size()) subscriptions.typed.resize(type_id + 1);
+            auto &subsc_list(subscriptions.typed[type_id]);
+            if (std::find(subsc_list.begin(), subsc_list.end(), &subscriber) == subsc_list.end()) {
+                subsc_list.push_back(&subscriber);
+                ret = true;
+            }
+        }
+        return ret;
+    }, false);
+}
+
+bool SubscriptionService::updateSubscriptions(const std::function<bool(Subscriptions&)> &update, bool wait_for_readers)
+{
+    std::shared_ptr<const Subscriptions> old_subscriptions;
+    {
+        std::lock_guard guard(m_subscriptionsMutex);
+        old_subscriptions = m_subscriptions.load();
+        std::shared_ptr<Subscriptions> new_subscriptions(std::make_shared<Subscriptions>(*old_subscriptions));
+        if (!update(*new_subscriptions)) return false;
+        m_subscriptions = std::move(new_subscriptions);
+    }
+    if (wait_for_readers) waitForSnapshotReaders(std::move(old_subscriptions));
+    return true;
+}
+
+void SubscriptionService::waitForSnapshotReaders(std::shared_ptr<const Subscriptions> &&snapshot)
+{
+    // Deliveries on this thread are further up our own call stack, so only wait for the ones on other threads
+    unsigned int held_by_this_thread = std::count(t_deliverySnapshots.begin(), t_deliverySnapshots.end(), snapshot.get());
+    unsigned int readers;
+    while ((readers = snapshot->readers.load()) > held_by_this_thread) {
+        snapshot->readers.wait(readers);
+    }
+}
+
 void SubscriptionService::sendEventAsynchronous(Event &&event)
 {
-    std::lock_guard guard(*m_asyncMutex);
-    m_asyncEventQueue.emplace_back(std::shared_ptr<Event>(new Event(std::move(event))));
-    m_asyncCondVar.notify_all();
-    startAsyncLoop();
+    queueAsyncEvent(Event::make<Event>(std::move(event)));
 }
 
 void SubscriptionService::sendEventAsynchronous(Event *event)
 {
-    std::lock_guard guard(*m_asyncMutex);
-    m_asyncEventQueue.emplace_back(std::shared_ptr<Event>(event));
-    m_asyncCondVar.notify_all();
-    startAsyncLoop();
+    queueAsyncEvent(std::shared_ptr<Event>(event));
 }
 
 void SubscriptionService::sendEventAsynchronous(const std::shared_ptr<Event> &event)
 {
-    std::lock_guard guard(*m_asyncMutex);
-    m_asyncEventQueue.push_back(event);
-    m_asyncCondVar.notify_all();
-    startAsyncLoop();
+    queueAsyncEvent(event);
+}
+
+SubscriptionService::AsyncEventStatistics SubscriptionService::asyncEventStatistics() const
+{
+    const AsyncStrand &strand(*m_asyncStrand);
+    return AsyncEventStatistics{strand.queueDepth, strand.maxQueueDepth, strand.eventsDelivered,
+                                std::chrono::nanoseconds(strand.totalLatencyNs), std::chrono::nanoseconds(strand.maxLatencyNs)};
+}
+
+void SubscriptionService::logAsyncEventStatistics(const char *service_name) const
+{
+    AsyncEventStatistics stats(asyncEventStatistics());
+    if (!stats.eventsDelivered) return;
+    ogs_debug("%s %p: %llu asynchronous events delivered, queue depth %zu (max %zu), latency mean %lldus max %lldus",
+              service_name, static_cast<const void*>(this), static_cast<unsigned long long>(stats.eventsDelivered),
+              stats.queueDepth, stats.maxQueueDepth,
+              static_cast<long long>(std::chrono::duration_cast<std::chrono::microseconds>(stats.totalLatency).count() /
+                                     static_cast<long long>(stats.eventsDelivered)),
+              static_cast<long long>(std::chrono::duration_cast<std::chrono::microseconds>(stats.maxLatency).count()));
 }
 
-void SubscriptionService::startAsyncLoop()
+std::chrono::milliseconds SubscriptionService::coalescingInterval()
 {
-    if (m_asyncThread.get_id() != std::thread::id()) return;
-    if (!!m_asyncCancel) return;
-    m_asyncThread = std::thread(SubscriptionService::asyncEventsLoopRunner, this);
+    return std::chrono::milliseconds(g_coalescingIntervalMs);
 }
 
-void SubscriptionService::stopAsyncLoop()
+void SubscriptionService::coalescingInterval(const std::chrono::milliseconds &interval)
 {
-    if (m_asyncThread.get_id() == std::thread::id()) return;
-    m_asyncCancel = true;
-    m_asyncCondVar.notify_all();
-    m_asyncThread.join();
+    g_coalescingIntervalMs = interval.count();
 }
 
-void SubscriptionService::asyncEventsLoopRunner(SubscriptionService *svc)
+void SubscriptionService::sendEventAsynchronousCoalesced(const std::shared_ptr<Event> &event, const void *source)
 {
-    svc->asyncEventsLoop();
+    if (!hasSubscribers(event->typeId())) return;
+
+    std::shared_ptr<AsyncStrand> strand(m_asyncStrand);
+    std::shared_ptr<CoalescedEvent> coalesced;
+    {
+        std::lock_guard<std::mutex> guard(strand->coalescingMutex);
+        auto &slot(strand->coalescing[AsyncStrand::CoalescingKey(event->typeId(), source)]);
+        if (!slot) slot.reset(new CoalescedEvent{nullptr, false, std::chrono::steady_clock::time_point()});
+        slot->latest = event;
+        if (slot->queued) return; // replaces the event already in the queue
+        auto now = std::chrono::steady_clock::now();
+        if (now - slot->lastQueued < coalescingInterval()) return; // held back
+        slot->queued = true;
+        slot->lastQueued = now;
+        coalesced = slot;
+    }
+    queueAsyncEvent(nullptr, coalesced);
 }
 
-void SubscriptionService::asyncEventsLoop()
+void SubscriptionService::flushCoalescedEvents(const void *source)
 {
-    using namespace std::literals;
-    while (!m_asyncCancel) {
-        std::lock_guard guard(*m_asyncMutex);
-        while (!m_asyncCancel && m_asyncEventQueue.empty()) {
-            m_asyncCondVar.wait_for(*m_asyncMutex, 500ms);
+    std::shared_ptr<AsyncStrand> strand(m_asyncStrand);
+    std::vector<std::shared_ptr<CoalescedEvent> > held_back;
+    {
+        std::lock_guard<std::mutex> guard(strand->coalescingMutex);
+        for (auto it = strand->coalescing.begin(); it != strand->coalescing.end(); ) {
+            if (it->first.second != source) {
+                ++it;
+                continue;
+            }
+            if (it->second->latest && !it->second->queued) {
+                it->second->queued = true;
+                held_back.push_back(it->second);
+            }
+            // Anything still queued keeps its CoalescedEvent alive until delivered
+            it = strand->coalescing.erase(it);
         }
-        while (!m_asyncCancel && !m_asyncEventQueue.empty()) {
-            auto event = m_asyncEventQueue.front();
-            m_asyncEventQueue.pop_front();
-            m_asyncMutex->unlock();
-            try {
-                sendEventSynchronous(*event);
-            } catch (std::exception &ex) {
-                //m_asyncCancel = true;
+    }
+    for (auto &coalesced : held_back) {
+        queueAsyncEvent(nullptr, coalesced);
+    }
+}
+
+void SubscriptionService::queueAsyncEvent(const std::shared_ptr<Event> &event)
+{
+    if (!hasSubscribers(event->typeId())) return;
+    queueAsyncEvent(event, nullptr);
+}
+
+void SubscriptionService::queueAsyncEvent(const std::shared_ptr<Event> &event,
+                                          const std::shared_ptr<CoalescedEvent> &coalesced)
+{
+    std::shared_ptr<AsyncStrand> strand(m_asyncStrand);
+    if (strand->cancelled) return;
+    strand->events.push(QueuedEvent{event, std::chrono::steady_clock::now(), coalesced});
+    atomic_max(strand->maxQueueDepth, ++strand->queueDepth);
+    if (!strand->scheduled.exchange(true)) {
+        EventExecutor::instance().post([strand]() { runAsyncStrand(strand); });
+    }
+}
+
+std::deque<std::shared_ptr<Event> > SubscriptionService::cancelAsyncEvents()
+{
+    AsyncStrand &strand(*m_asyncStrand);
+    std::deque<std::shared_ptr<Event> > pending;
+    strand.cancelled = true;
+    // Wait for any delivery in progress to finish, unless we are being called from within that delivery
+    std::thread::id self(std::this_thread::get_id());
+    std::thread::id delivering;
+    while ((delivering = strand.deliveringThread.load()) != std::thread::id() && delivering != self) {
+        strand.deliveringThread.wait(delivering);
+    }
+    // runAsyncStrand() won't take any more events now, so we can act as the consumer
+    QueuedEvent queued;
+    while (strand.events.pop(queued)) {
+        strand.queueDepth--;
+        std::shared_ptr<Event> event(takeQueuedEvent(strand, queued));
+        if (event) pending.emplace_back(std::move(event));
+    }
+    return pending;
+}
+
+void SubscriptionService::runAsyncStrand(const std::shared_ptr<AsyncStrand> &strand)
+{
+    std::thread::id self(std::this_thread::get_id());
+    strand->deliveringThread = self;
+    for (unsigned int count = 0; count < g_maxEventsPerStrandRun; count++) {
+        QueuedEvent queued;
+        if (strand->cancelled || !strand->events.pop(queued)) {
+            strand->deliveringThread = std::thread::id();
+            strand->deliveringThread.notify_all();
+            strand->scheduled = false;
+            // An event may have been queued after our pop() but before scheduled was cleared
+            if (!strand->cancelled && strand->queueDepth > 0 && !strand->scheduled.exchange(true)) {
+                strand->deliveringThread = self;
+                continue;
             }
-            m_asyncMutex->lock();
+            return;
+        }
+        strand->queueDepth--;
+        std::shared_ptr<Event> event(takeQueuedEvent(*strand, queued));
+        if (!event) continue;
+
+        std::uint64_t latency = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() -
+                                                                                      queued.enqueued).count();
+        strand->eventsDelivered++;
+        strand->totalLatencyNs += latency;
+        atomic_max(strand->maxLatencyNs, latency);
+
+        try {
+            strand->service->sendEventSynchronous(*event);
+        } catch (std::exception &ex) {
+            ogs_error("Unhandled exception delivering %s event: %s", event->eventName().c_str(), ex.what());
         }
     }
+    strand->deliveringThread = std::thread::id();
+    strand->deliveringThread.notify_all();
+    // Still more to do, go to the back of the queue so other services get a look in
+    EventExecutor::instance().post([strand]() { runAsyncStrand(strand); });
+}
+
+std::shared_ptr<Event> SubscriptionService::takeQueuedEvent(AsyncStrand &strand, QueuedEvent &queued)
+{
+    if (!queued.coalesced) return std::move(queued.event);
+    std::lock_guard<std::mutex> guard(strand.coalescingMutex);
+    queued.coalesced->queued = false;
+    return std::move(queued.coalesced->latest);
+}
+
+static void atomic_max(std::atomic<std::uint64_t> &current, std::uint64_t value)
+{
+    std::uint64_t prev = current.load(std::memory_order_relaxed);
+    while (prev < value && !current.compare_exchange_weak(prev, value, std::memory_order_relaxed));
 }
 
 MBSTF_NAMESPACE_STOP
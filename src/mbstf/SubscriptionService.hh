@@ -12,27 +12,37 @@
  * https://drive.google.com/file/d/1cinCiA778IErENZ3JN52VFW-1ffHpx7Z/view
  */
 
-#include <atomic>
-#include <condition_variable>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
 #include <deque>
+#include <functional>
 #include <list>
-#include <map>
+#include <atomic>
 #include <memory>
 #include <mutex>
-#include <set>
 #include <string>
-#include <thread>
+
+#include <vector>
 
 #include "common.hh"
+#include "Event.hh"
 
 MBSTF_NAMESPACE_START
 
 class Subscriber;
-class Event;
 
 class SubscriptionService
 {
 public:
+    struct AsyncEventStatistics {
+        std::size_t queueDepth;                 // events waiting for delivery
+        std::size_t maxQueueDepth;              // high water mark for queueDepth
+        std::uint64_t eventsDelivered;
+        std::chrono::nanoseconds totalLatency;  // sum of enqueue to dispatch times of eventsDelivered
+        std::chrono::nanoseconds maxLatency;    // longest enqueue to dispatch time
+    };
+
     SubscriptionService();
     SubscriptionService(const SubscriptionService &);
     SubscriptionService(SubscriptionService &&);
@@ -44,12 +54,21 @@ public:
 
     bool subscribe(Subscriber &subscriber); // subscribe to all events
     bool subscribe(std::initializer_list<const char*> events_list, Subscriber &subscriber); // subscribe to named events
+    bool subscribe(std::initializer_list<Event::TypeId> event_types, Subscriber &subscriber); // subscribe to typed events
     template <class Iterable>
     bool subscribe(const Iterable &iterable, Subscriber &subscriber); // subscribe to named events
     bool unsubscribe(Subscriber &subscriber); // unsubscribe to any events (named or all)
     bool unsubscribe(std::initializer_list<const char*> events_list, Subscriber &subscriber); // unsubscribe from named events
     std::list<const char*> subscribedEvents(Subscriber &subscriber); // get the list of named events a Subscriber is subscribed to. nullptr in return means subscribed to all events. empty list means Subscriber is not subscribed.
+    bool hasSubscribers(Event::TypeId type_id) const; // true if an event of this type would be delivered to anyone
+    template <class E>
+    bool hasSubscribers() const { return hasSubscribers(Event::typeIdOf<E>()); };
     std::string reprString() const;
+    AsyncEventStatistics asyncEventStatistics() const;
+    void logAsyncEventStatistics(const char *service_name) const; // at debug level, if any events have been delivered
+
+    static std::chrono::milliseconds coalescingInterval();
+    static void coalescingInterval(const std::chrono::milliseconds &interval);
 
 protected:
     bool sendEventSynchronous(Event &event);
@@ -58,32 +77,59 @@ protected:
     void sendEventAsynchronous(Event *event);
     void sendEventAsynchronous(const std::shared_ptr<Event> &event);
 
+    /* Send a progress style event asynchronously, where only the latest state matters.
+     *
+     * While an earlier event of the same type from the same source is still queued, the new event replaces it in the
+     * queue. Events arriving within coalescingInterval() of the last one queued for the source are held back, the latest
+     * of them being queued by the next event after the interval or by flushCoalescedEvents(). Call
+     * flushCoalescedEvents() when the source is finished with, so that its final event is not left held back.
+     */
+    void sendEventAsynchronousCoalesced(const std::shared_ptr<Event> &event, const void *source);
+    void flushCoalescedEvents(const void *source);
+
 private:
-    void startAsyncLoop();
-    void stopAsyncLoop();
-    static void asyncEventsLoopRunner(SubscriptionService *svc);
-    void asyncEventsLoop();
-
-    std::set<Subscriber*> m_allEventSubscriptions;
-    std::map<std::string, std::set<Subscriber*> > m_namedEventSubscriptions;
-    std::thread m_asyncThread;
-    std::deque<std::shared_ptr<Event> > m_asyncEventQueue;
-    std::unique_ptr<std::recursive_mutex> m_asyncMutex;
-    std::condition_variable_any m_asyncCondVar;
-    std::atomic_bool m_asyncCancel;
+    /* Asynchronous events are delivered by the shared EventExecutor. The strand holds the events queued for this
+     * service, in a lock-free MPSCQueue, and makes sure only one executor task at a time delivers them, so they
+     * arrive in the order they were sent.
+     */
+    struct AsyncStrand;
+    struct CoalescedEvent;
+    struct QueuedEvent;
+
+    void queueAsyncEvent(const std::shared_ptr<Event> &event);
+    void queueAsyncEvent(const std::shared_ptr<Event> &event, const std::shared_ptr<CoalescedEvent> &coalesced);
+    static std::shared_ptr<Event> takeQueuedEvent(AsyncStrand &strand, QueuedEvent &queued);
+    std::deque<std::shared_ptr<Event> > cancelAsyncEvents(); // returns the events that were still queued
+    static void runAsyncStrand(const std::shared_ptr<AsyncStrand> &strand);
+
+    /* Subscriptions are copy-on-write: subscribe() and unsubscribe() publish a new immutable snapshot and
+     * sendEventSynchronous() works through whichever snapshot was current when it started, without holding any lock.
+     * Unsubscribing waits for deliveries still using older snapshots, so a Subscriber is never called once
+     * unsubscribe() returns (except by a delivery in progress on the unsubscribing thread itself).
+     *
+     * Lock ordering: as unsubscribe() blocks until deliveries on other threads finish, it must not be called while
+     * holding a lock that any Subscriber::processEvent() of this service may take, or the two threads deadlock. Release
+     * such locks before unsubscribing (calling unsubscribe() from within processEvent() itself is fine).
+     */
+    struct Subscriptions;
+
+    bool subscribeTypes(const std::vector<Event::TypeId> &event_types, Subscriber &subscriber);
+    bool updateSubscriptions(const std::function<bool(Subscriptions&)> &update, bool wait_for_readers);
+    static void waitForSnapshotReaders(std::shared_ptr<const Subscriptions> &&snapshot);
+
+    mutable std::mutex m_subscriptionsMutex; // serialises updates only
+    std::atomic<std::shared_ptr<const Subscriptions> > m_subscriptions;
+    std::shared_ptr<AsyncStrand> m_asyncStrand;
 };
 
 template <class Iterable>
 bool SubscriptionService::subscribe(const Iterable &iterable, Subscriber &subscriber)
 {
-    bool ret = false;
-    if (m_allEventSubscriptions.find(&subscriber) != m_allEventSubscriptions.end()) return ret;
+    std::vector<Event::TypeId> event_types;
     for (auto event_name : iterable) {
-        std::string evt_name(event_name);
-        auto &subsc_set = m_namedEventSubscriptions[evt_name];
-        ret = subsc_set.insert(&subscriber).second || ret;
+        event_types.push_back(Event::registerType(std::string(event_name)));
     }
-    return ret;
+    return subscribeTypes(event_types, subscriber);
 }
 
 MBSTF_NAMESPACE_STOP
@@ -0,0 +1,312 @@
+/******************************************************************************
+ * 5G-MAG Reference Tools: MBS Traffic Function: Timer Wheel class
+ ******************************************************************************
+ * Copyright: (C)2025 British Broadcasting Corporation
+ * Author(s): David Waring <david.waring2@bbc.co.uk>
+ * License: 5G-MAG Public License v1
+ *
+ * For full license terms please see the LICENSE file distributed with this
+ * program. If this file is missing then the license can be retrieved from
+ * https://drive.google.com/file/d/1cinCiA778IErENZ3JN52VFW-1ffHpx7Z/view
+ */
+
+#include <pthread.h>
+
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "ogs-app.h"
+
+#include "common.hh"
+
+#include "TimerWheel.hh"
+
+MBSTF_NAMESPACE_START
+
+static const std::uint64_t g_noTick = std::numeric_limits<std::uint64_t>::max();
+
+struct TimerWheel::Timer {
+    Timer(TimerId timer_id, std::uint64_t expiry_tick, Callback &&cb)
+        :id(timer_id)
+        ,expiry(expiry_tick)
+        ,callback(std::move(cb))
+        ,slot(nullptr)
+        ,position()
+    {};
+
+    TimerId id;
+    std::uint64_t expiry;    // tick the timer is due on
+    Callback callback;
+    Slot *slot;              // nullptr when not on the wheel (collected by the driver ready to fire)
+    Slot::iterator position; // where in slot
+};
+
+TimerWheel::TimerWheel()
+    :TimerWheel(clock_type::now(), true)
+{
+}
+
+TimerWheel::TimerWheel(const clock_type::time_point &epoch, bool start_driver)
+    :m_epoch(epoch)
+    ,m_currentTick(0)
+    ,m_wheel()
+    ,m_timers()
+    ,m_nextTimerId(c_noTimer + 1)
+    ,m_runningTimer(c_noTimer)
+    ,m_runningThread()
+    ,m_mutex()
+    ,m_changed()
+    ,m_driverThread()
+    ,m_stop(false)
+{
+    if (start_driver) {
+        m_driverThread = std::thread(&TimerWheel::driverLoop, this);
+        pthread_setname_np(m_driverThread.native_handle(), "mbstf-timers");
+    }
+}
+
+TimerWheel::~TimerWheel()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_changed.notify_all();
+    if (m_driverThread.joinable()) m_driverThread.join();
+}
+
+TimerWheel &TimerWheel::instance()
+{
+    // Never destroyed: callbacks may refer to objects that are torn down during static destruction
+    static TimerWheel *timer_wheel = new TimerWheel;
+    return *timer_wheel;
+}
+
+TimerWheel::TimerId TimerWheel::schedule(const clock_type::time_point &when, Callback &&callback)
+{
+    TimerId timer_id;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        timer_id = m_nextTimerId++;
+        std::uint64_t expiry = tickFor(when);
+        // Ticks up to m_currentTick have already been dealt with, so the earliest we can do is the next one
+        if (expiry <= m_currentTick) expiry = m_currentTick + 1;
+        auto &timer(m_timers[timer_id] = std::make_unique<Timer>(timer_id, expiry, std::move(callback)));
+        place(*timer);
+    }
+    m_changed.notify_all();
+    return timer_id;
+}
+
+TimerWheel::TimerId TimerWheel::schedule(const std::chrono::system_clock::time_point &when, Callback &&callback)
+{
+    return schedule(to_steady(when), std::move(callback));
+}
+
+bool TimerWheel::reschedule(TimerId timer_id, const clock_type::time_point &when)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_timers.find(timer_id);
+        if (it == m_timers.end()) return false;
+        Timer &timer(*it->second);
+        unplace(timer);
+        timer.expiry = tickFor(when);
+        if (timer.expiry <= m_currentTick) timer.expiry = m_currentTick + 1;
+        place(timer);
+    }
+    m_changed.notify_all();
+    return true;
+}
+
+bool TimerWheel::reschedule(TimerId timer_id, const std::chrono::system_clock::time_point &when)
+{
+    return reschedule(timer_id, to_steady(when));
+}
+
+bool TimerWheel::cancel(TimerId timer_id)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    auto it = m_timers.find(timer_id);
+    if (it != m_timers.end()) {
+        unplace(*it->second);
+        m_timers.erase(it);
+        return true;
+    }
+    // Too late, but wait for the callback to finish if it's running on another thread
+    if (std::this_thread::get_id() != m_runningThread) {
+        m_changed.wait(lock, [this, timer_id]() { return m_runningTimer != timer_id; });
+    }
+    return false;
+}
+
+std::size_t TimerWheel::size() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_timers.size();
+}
+
+TimerWheel::clock_type::time_point TimerWheel::to_steady(const std::chrono::system_clock::time_point &when)
+{
+    return clock_type::now() + std::chrono::duration_cast<clock_type::duration>(when - std::chrono::system_clock::now());
+}
+
+std::uint64_t TimerWheel::tickFor(const clock_type::time_point &when) const
+{
+    if (when <= m_epoch) return 0;
+    auto since_epoch = when - m_epoch;
+    std::uint64_t ticks = std::chrono::duration_cast<std::chrono::milliseconds>(since_epoch).count();
+    // Round up so that timers never fire early
+    if (std::chrono::milliseconds(ticks) < since_epoch) ticks++;
+    return ticks;
+}
+
+void TimerWheel::place(Timer &timer)
+{
+    std::uint64_t expiry = timer.expiry;
+    Slot *slot;
+    if (expiry <= m_currentTick) {
+        // Only happens while cascading during advance(), the current level 0 slot is about to be expired
+        slot = &m_wheel[0][m_currentTick & c_slotMask];
+    } else {
+        std::uint64_t delta = expiry - m_currentTick;
+        if (delta > c_maxTicks) {
+            // Too far off for the wheel, park it as far away as possible and it'll be placed again when reached
+            expiry = m_currentTick + c_maxTicks;
+            delta = c_maxTicks;
+        }
+        unsigned int level = 0;
+        while ((delta >> (c_slotBits * (level + 1))) != 0) level++;
+        slot = &m_wheel[level][(expiry >> (c_slotBits * level)) & c_slotMask];
+    }
+    timer.slot = slot;
+    timer.position = slot->insert(slot->end(), &timer);
+}
+
+void TimerWheel::unplace(Timer &timer)
+{
+    if (!timer.slot) return;
+    timer.slot->erase(timer.position);
+    timer.slot = nullptr;
+}
+
+void TimerWheel::advance(std::vector<TimerId> &expired)
+{
+    m_currentTick++;
+
+    // Cascade timers from higher levels whose slot we have now reached, highest first as they may land in a lower
+    // level slot that we are also reaching now
+    unsigned int cascade_levels = 0;
+    while (cascade_levels + 1 < c_levels &&
+           (m_currentTick & ((std::uint64_t(1) << (c_slotBits * (cascade_levels + 1))) - 1)) == 0) {
+        cascade_levels++;
+    }
+    for (unsigned int level = cascade_levels; level > 0; level--) {
+        Slot cascading;
+        cascading.swap(m_wheel[level][(m_currentTick >> (c_slotBits * level)) & c_slotMask]);
+        for (auto timer : cascading) {
+            timer->slot = nullptr;
+            place(*timer);
+        }
+    }
+
+    Slot &slot(m_wheel[0][m_currentTick & c_slotMask]);
+    for (auto it = slot.begin(); it != slot.end(); ) {
+        Timer *timer = *it;
+        ++it;
+        unplace(*timer);
+        if (timer->expiry <= m_currentTick) {
+            expired.push_back(timer->id);
+        } else {
+            place(*timer);
+        }
+    }
+}
+
+std::uint64_t TimerWheel::nextInterestingTick() const
+{
+    // Earliest tick that will expire or cascade something
+    std::uint64_t next = g_noTick;
+    for (unsigned int level = 0; level < c_levels; level++) {
+        unsigned int shift = c_slotBits * level;
+        std::uint64_t block = m_currentTick >> shift;
+        for (std::uint64_t i = 1; i <= c_slots; i++) {
+            if (!m_wheel[level][(block + i) & c_slotMask].empty()) {
+                std::uint64_t tick = (block + i) << shift;
+                if (tick < next) next = tick;
+                break;
+            }
+        }
+    }
+    return next;
+}
+
+void TimerWheel::expireUntil(const clock_type::time_point &now)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    runExpired(lock, now);
+}
+
+bool TimerWheel::runExpired(std::unique_lock<std::mutex> &lock, const clock_type::time_point &now)
+{
+    std::uint64_t now_tick = now <= m_epoch ? 0 :
+                                std::chrono::duration_cast<std::chrono::milliseconds>(now - m_epoch).count();
+    std::vector<TimerId> expired;
+    while (m_currentTick < now_tick) {
+        // Skip over ticks with nothing to do
+        std::uint64_t next = nextInterestingTick();
+        if (next > now_tick) {
+            m_currentTick = now_tick;
+            break;
+        }
+        m_currentTick = next - 1;
+        advance(expired);
+    }
+
+    for (auto timer_id : expired) {
+        auto it = m_timers.find(timer_id);
+        // Skip if cancelled or rescheduled since being collected
+        if (it == m_timers.end() || it->second->slot) continue;
+        Callback callback(std::move(it->second->callback));
+        m_timers.erase(it);
+        m_runningTimer = timer_id;
+        m_runningThread = std::this_thread::get_id();
+        lock.unlock();
+        try {
+            callback();
+        } catch (std::exception &ex) {
+            ogs_error("Unhandled exception in timer callback: %s", ex.what());
+        }
+        lock.lock();
+        m_runningTimer = c_noTimer;
+        m_runningThread = std::thread::id();
+        m_changed.notify_all();
+    }
+    return !expired.empty();
+}
+
+void TimerWheel::driverLoop()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (!m_stop) {
+        if (runExpired(lock, clock_type::now())) continue;
+
+        std::uint64_t next = nextInterestingTick();
+        if (next == g_noTick) {
+            m_changed.wait(lock);
+        } else {
+            m_changed.wait_until(lock, m_epoch + std::chrono::milliseconds(next));
+        }
+    }
+}
+
+MBSTF_NAMESPACE_STOP
+
+/* vim:ts=8:sts=4:sw=4:expandtab:
+ */
@@ -0,0 +1,110 @@
+#ifndef _MBS_TF_TIMER_WHEEL_HH_
+#define _MBS_TF_TIMER_WHEEL_HH_
+/******************************************************************************
+ * 5G-MAG Reference Tools: MBS Traffic Function: Timer Wheel class
+ ******************************************************************************
+ * Copyright: (C)2025 British Broadcasting Corporation
+ * Author(s): David Waring <david.waring2@bbc.co.uk>
+ * License: 5G-MAG Public License v1
+ *
+ * For full license terms please see the LICENSE file distributed with this
+ * program. If this file is missing then the license can be retrieved from
+ * https://drive.google.com/file/d/1cinCiA778IErENZ3JN52VFW-1ffHpx7Z/view
+ */
+
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "common.hh"
+
+MBSTF_NAMESPACE_START
+
+/* Process wide hierarchical timer wheel
+ *
+ * Timers are kept in 4 levels of 64 slots with a 1ms tick, level 0 holding those due in the next 64ms, level 1 those
+ * due in the next 4s, and so on up to about 4.6 hours (anything further away waits in the last slot of level 3 and is
+ * placed again when it gets there). Scheduling, rescheduling and cancelling are O(1) whatever the number of timers,
+ * and as timers move down a level they get placed on a finer grained wheel, so they fire within 1ms of their time.
+ *
+ * One thread drives the wheel, sleeping until the next slot with timers in it, and calls the callbacks. Callbacks
+ * should be quick, e.g. wake a ReactorTask, as other timers are held up while one is running.
+ */
+class TimerWheel {
+public:
+    using clock_type = std::chrono::steady_clock;
+    using TimerId = std::uint64_t;
+    using Callback = std::function<void()>;
+
+    static constexpr TimerId c_noTimer = 0;
+
+    TimerWheel(const TimerWheel &) = delete;
+    TimerWheel(TimerWheel &&) = delete;
+    virtual ~TimerWheel();
+
+    TimerWheel &operator=(const TimerWheel &) = delete;
+    TimerWheel &operator=(TimerWheel &&) = delete;
+
+    static TimerWheel &instance();
+
+    TimerId schedule(const clock_type::time_point &when, Callback &&callback);
+    TimerId schedule(const std::chrono::system_clock::time_point &when, Callback &&callback);
+    bool reschedule(TimerId timer_id, const clock_type::time_point &when); // false if the timer has fired or is cancelled
+    bool reschedule(TimerId timer_id, const std::chrono::system_clock::time_point &when);
+    bool cancel(TimerId timer_id); // once this returns the callback is not running, unless cancel() is called from it
+    std::size_t size() const; // number of timers pending
+
+protected:
+    // For testing: a wheel with its own epoch and, if start_driver is false, no driver thread, so that time only moves
+    // on when expireUntil() is called
+    TimerWheel(const clock_type::time_point &epoch, bool start_driver);
+    void expireUntil(const clock_type::time_point &now); // collect timers due by now and call their callbacks
+
+private:
+    static constexpr unsigned int c_levels = 4;
+    static constexpr unsigned int c_slotBits = 6;
+    static constexpr std::uint64_t c_slots = 1 << c_slotBits;
+    static constexpr std::uint64_t c_slotMask = c_slots - 1;
+    static constexpr std::uint64_t c_maxTicks = (std::uint64_t(1) << (c_slotBits * c_levels)) - 1;
+
+    struct Timer;
+    using Slot = std::list<Timer*>;
+
+    TimerWheel();
+
+    static clock_type::time_point to_steady(const std::chrono::system_clock::time_point &when);
+    std::uint64_t tickFor(const clock_type::time_point &when) const;
+    void place(Timer &timer);
+    void unplace(Timer &timer);
+    void advance(std::vector<TimerId> &expired);
+    std::uint64_t nextInterestingTick() const;
+    bool runExpired(std::unique_lock<std::mutex> &lock, const clock_type::time_point &now); // true if any fired
+    void driverLoop();
+
+    clock_type::time_point m_epoch;  // time of tick 0
+    std::uint64_t m_currentTick;     // all timers due at or before this have been collected
+    std::array<std::array<Slot, c_slots>, c_levels> m_wheel;
+    std::unordered_map<TimerId, std::unique_ptr<Timer> > m_timers;
+    TimerId m_nextTimerId;
+    TimerId m_runningTimer;          // timer whose callback is being called
+    std::thread::id m_runningThread; // thread calling it
+    mutable std::mutex m_mutex;
+    std::condition_variable m_changed; // timers added/moved (for the driver) or a callback finished (for cancel())
+    std::thread m_driverThread;
+    bool m_stop;
+};
+
+MBSTF_NAMESPACE_STOP
+
+/* vim:ts=8:sts=4:sw=4:expandtab:
+ */
+#endif /* _MBS_TF_TIMER_WHEEL_HH_ */
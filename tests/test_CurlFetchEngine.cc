@@ -0,0 +1,365 @@
+/******************************************************************************
+ * 5G-MAG Reference Tools: MBS Traffic Function: Unit test: CurlFetchEngine
+ ******************************************************************************
+ * Copyright: (C)2025 British Broadcasting Corporation
+ * Author(s): David Waring <david.waring2@bbc.co.uk>
+ * License: 5G-MAG Public License v1
+ *
+ * For full license terms please see the LICENSE file distributed with this
+ * program. If this file is missing then the license can be retrieved from
+ * https://drive.google.com/file/d/1cinCiA778IErENZ3JN52VFW-1ffHpx7Z/view
+ */
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <iostream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "common.hh"
+#include "Curl.hh"
+#include "CurlFetchEngine.hh"
+
+using namespace std::chrono_literals;
+
+MBSTF_NAMESPACE_USING;
+
+/* Minimal HTTP/1.1 origin on the loopback interface
+ *
+ * Each request gets its own connection, which is closed after the response. While held, requests are counted as they
+ * arrive but not answered until release() is called.
+ */
+class TestHttpServer
+{
+public:
+    TestHttpServer() :m_listenSocket(-1),m_port(0),m_requests(0),m_held(false),m_stopping(false),m_mutex(),m_condVar(),
+                      m_acceptThread(),m_connectionThreads() {
+        m_listenSocket = socket(AF_INET, SOCK_STREAM, 0);
+        if (m_listenSocket < 0) return;
+        int reuse = 1;
+        setsockopt(m_listenSocket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        struct sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = 0;
+        socklen_t addr_len = sizeof(addr);
+        if (bind(m_listenSocket, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0 ||
+            listen(m_listenSocket, 16) < 0 ||
+            getsockname(m_listenSocket, reinterpret_cast<struct sockaddr*>(&addr), &addr_len) < 0) {
+            close(m_listenSocket);
+            m_listenSocket = -1;
+            return;
+        }
+        m_port = ntohs(addr.sin_port);
+        m_acceptThread = std::thread([this]() { acceptLoop(); });
+    };
+
+    ~TestHttpServer() {
+        {
+            std::lock_guard lock(m_mutex);
+            m_stopping = true;
+            m_held = false;
+            m_condVar.notify_all();
+        }
+        if (m_acceptThread.joinable()) m_acceptThread.join();
+        for (auto &thread : m_connectionThreads) thread.join();
+        if (m_listenSocket >= 0) close(m_listenSocket);
+    };
+
+    bool ok() const { return m_listenSocket >= 0; };
+    std::string url(const std::string &path) const { return "http://127.0.0.1:" + std::to_string(m_port) + path; };
+
+    void hold() { std::lock_guard lock(m_mutex); m_held = true; };
+    void release() { std::lock_guard lock(m_mutex); m_held = false; m_condVar.notify_all(); };
+
+    unsigned int requests() { std::lock_guard lock(m_mutex); return m_requests; };
+
+    template <class Rep, class Period>
+    bool waitForRequests(unsigned int count, std::chrono::duration<Rep, Period> timeout) {
+        std::unique_lock lock(m_mutex);
+        return m_condVar.wait_for(lock, timeout, [this, count]() { return m_requests >= count; });
+    };
+
+private:
+    void acceptLoop() {
+        while (true) {
+            {
+                std::lock_guard lock(m_mutex);
+                if (m_stopping) return;
+            }
+            struct pollfd pfd = {m_listenSocket, POLLIN, 0};
+            if (poll(&pfd, 1, 50) <= 0) continue;
+            int conn = accept(m_listenSocket, nullptr, nullptr);
+            if (conn < 0) continue;
+            std::lock_guard lock(m_mutex);
+            m_connectionThreads.emplace_back([this, conn]() { handleConnection(conn); });
+        }
+    };
+
+    void handleConnection(int conn) {
+        std::string request;
+        char buf[1024];
+        while (request.find("\r\n\r\n") == std::string::npos) {
+            ssize_t len = recv(conn, buf, sizeof(buf), 0);
+            if (len <= 0) {
+                close(conn);
+                return;
+            }
+            request.append(buf, len);
+        }
+        {
+            std::unique_lock lock(m_mutex);
+            m_requests++;
+            m_condVar.notify_all();
+            m_condVar.wait(lock, [this]() { return !m_held; });
+        }
+        static const char c_response[] = "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nContent-Length: 2\r\n"
+                                         "Connection: close\r\n\r\nok";
+        send(conn, c_response, sizeof(c_response) - 1, MSG_NOSIGNAL);
+        close(conn);
+    };
+
+    int m_listenSocket;
+    unsigned short m_port;
+    unsigned int m_requests;
+    bool m_held;
+    bool m_stopping;
+    std::mutex m_mutex;
+    std::condition_variable m_condVar;
+    std::thread m_acceptThread;
+    std::list<std::thread> m_connectionThreads;
+};
+
+/* Collects fetch results as the engine's callbacks deliver them */
+class FetchResults
+{
+public:
+    FetchResults() :m_results(),m_mutex(),m_condVar() {};
+
+    CurlFetchEngine::Callback callback(unsigned int index) {
+        return [this, index](CurlFetchEngine::FetchId, long result) {
+            std::lock_guard lock(m_mutex);
+            m_results.emplace_back(index, result);
+            m_condVar.notify_all();
+        };
+    };
+
+    template <class Rep, class Period>
+    bool waitFor(std::size_t count, std::chrono::duration<Rep, Period> timeout) {
+        std::unique_lock lock(m_mutex);
+        return m_condVar.wait_for(lock, timeout, [this, count]() { return m_results.size() >= count; });
+    };
+
+    std::vector<std::pair<unsigned int, long> > results() { std::lock_guard lock(m_mutex); return m_results; };
+
+private:
+    std::vector<std::pair<unsigned int, long> > m_results;
+    std::mutex m_mutex;
+    std::condition_variable m_condVar;
+};
+
+enum Result {
+    RESULT_OK = 0,
+    RESULT_ERROR,
+    RESULT_SKIP,
+    RESULT_MAX
+};
+
+/* A queued fetch whose deadline passes before there is room to start it completes as timed out */
+static Result test_deadline_while_queued(TestHttpServer &server)
+{
+    CurlFetchEngine &engine(CurlFetchEngine::instance());
+    FetchResults results;
+    Result ret = RESULT_OK;
+
+    CurlFetchEngine::maxTransfers(1);
+    server.hold();
+    unsigned int requests_before = server.requests();
+    std::shared_ptr<Curl> blocker(std::make_shared<Curl>());
+    std::shared_ptr<Curl> queued(std::make_shared<Curl>());
+    engine.fetch(blocker, server.url("/blocker"), std::nullopt, results.callback(0));
+    if (!server.waitForRequests(requests_before + 1, 5s)) {
+        std::cerr << "First fetch did not reach the server" << std::endl;
+        ret = RESULT_ERROR;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    engine.fetch(queued, server.url("/queued"), std::chrono::system_clock::now() + 300ms, results.callback(1));
+    if (ret == RESULT_OK) {
+        if (!results.waitFor(1, 5s)) {
+            std::cerr << "Queued fetch did not complete at its deadline" << std::endl;
+            ret = RESULT_ERROR;
+        } else if (results.results().front() != std::make_pair(1u, -1L)) {
+            std::cerr << "Queued fetch did not time out, or the blocking fetch completed first" << std::endl;
+            ret = RESULT_ERROR;
+        } else if (std::chrono::steady_clock::now() - start < 250ms) {
+            std::cerr << "Queued fetch timed out before its deadline" << std::endl;
+            ret = RESULT_ERROR;
+        } else if (server.requests() != requests_before + 1) {
+            std::cerr << "Queued fetch was started despite the transfer limit" << std::endl;
+            ret = RESULT_ERROR;
+        }
+    }
+
+    server.release();
+    if (!results.waitFor(2, 15s) && ret == RESULT_OK) {
+        std::cerr << "Blocking fetch did not complete once released" << std::endl;
+        ret = RESULT_ERROR;
+    }
+    CurlFetchEngine::maxTransfers(256);
+    return ret;
+}
+
+/* No more than maxTransfersPerOrigin() fetches to one origin are in progress at once, the rest wait their turn */
+static Result test_per_origin_limit(TestHttpServer &server)
+{
+    CurlFetchEngine &engine(CurlFetchEngine::instance());
+    FetchResults results;
+    Result ret = RESULT_OK;
+    std::vector<std::shared_ptr<Curl> > curls;
+
+    CurlFetchEngine::maxTransfersPerOrigin(2);
+    server.hold();
+    unsigned int requests_before = server.requests();
+    for (unsigned int i = 0; i < 5; i++) {
+        curls.push_back(std::make_shared<Curl>());
+        engine.fetch(curls.back(), server.url("/limited" + std::to_string(i)), std::nullopt, results.callback(i));
+    }
+
+    if (!server.waitForRequests(requests_before + 2, 5s)) {
+        std::cerr << "Fetches up to the per origin limit did not reach the server" << std::endl;
+        ret = RESULT_ERROR;
+    }
+    std::this_thread::sleep_for(300ms);
+    if (ret == RESULT_OK && server.requests() != requests_before + 2) {
+        std::cerr << "More than the per origin limit of fetches were started: " << server.requests() - requests_before
+                  << std::endl;
+        ret = RESULT_ERROR;
+    }
+
+    server.release();
+    if (!results.waitFor(5, 15s)) {
+        if (ret == RESULT_OK) std::cerr << "Fetches held back by the per origin limit did not complete" << std::endl;
+        ret = RESULT_ERROR;
+    }
+    for (const auto &[index, result] : results.results()) {
+        if (result != 2 && ret == RESULT_OK) {
+            std::cerr << "Fetch " << index << " failed with result " << result << std::endl;
+            ret = RESULT_ERROR;
+        }
+    }
+    CurlFetchEngine::maxTransfersPerOrigin(8);
+    return ret;
+}
+
+/* cancel() called away from the engine's io_context thread stops the fetch and its callback is never called */
+static Result test_cancel_from_other_thread(TestHttpServer &server)
+{
+    CurlFetchEngine &engine(CurlFetchEngine::instance());
+    FetchResults results;
+    Result ret = RESULT_OK;
+
+    CurlFetchEngine::maxTransfers(1);
+    server.hold();
+    unsigned int requests_before = server.requests();
+    std::shared_ptr<Curl> active(std::make_shared<Curl>());
+    std::shared_ptr<Curl> queued(std::make_shared<Curl>());
+    CurlFetchEngine::FetchId active_id = engine.fetch(active, server.url("/cancel-active"), std::nullopt, results.callback(0));
+    CurlFetchEngine::FetchId queued_id = engine.fetch(queued, server.url("/cancel-queued"), std::nullopt, results.callback(1));
+    if (!server.waitForRequests(requests_before + 1, 5s)) {
+        std::cerr << "Fetch to cancel did not reach the server" << std::endl;
+        ret = RESULT_ERROR;
+    }
+
+    if (!engine.cancel(queued_id) && ret == RESULT_OK) {
+        std::cerr << "Cancelling a queued fetch failed" << std::endl;
+        ret = RESULT_ERROR;
+    }
+    if (!engine.cancel(active_id) && ret == RESULT_OK) {
+        std::cerr << "Cancelling a fetch in progress failed" << std::endl;
+        ret = RESULT_ERROR;
+    }
+    if (engine.cancel(active_id) && ret == RESULT_OK) {
+        std::cerr << "Cancelling an already cancelled fetch succeeded" << std::endl;
+        ret = RESULT_ERROR;
+    }
+    server.release();
+
+    // A fetch after the cancelled ones completes behind anything they could still have delivered
+    std::shared_ptr<Curl> after(std::make_shared<Curl>());
+    engine.fetch(after, server.url("/after-cancel"), std::nullopt, results.callback(2));
+    if (!results.waitFor(1, 15s)) {
+        if (ret == RESULT_OK) std::cerr << "Fetch after cancelling did not complete" << std::endl;
+        ret = RESULT_ERROR;
+    }
+    std::this_thread::sleep_for(100ms);
+    auto delivered(results.results());
+    if (ret == RESULT_OK && (delivered.size() != 1 || delivered.front().first != 2)) {
+        std::cerr << "Callback called for a cancelled fetch" << std::endl;
+        ret = RESULT_ERROR;
+    }
+    CurlFetchEngine::maxTransfers(256);
+    return ret;
+}
+
+int main(int argc, char *argv[])
+{
+    TestHttpServer server;
+    if (!server.ok()) {
+        std::cerr << "Unable to start the test HTTP server" << std::endl;
+        return 77; /* tests skipped */
+    }
+
+    static const struct TestCase {
+        const char *name;
+        Result (*fn)(TestHttpServer &server);
+    } tests[] = {
+        {"Deadline expiry while queued", test_deadline_while_queued},
+        {"Per origin transfer limit", test_per_origin_limit},
+        {"Cancel from another thread", test_cancel_from_other_thread}
+    };
+
+    size_t results[RESULT_MAX] = {};
+    size_t total = 0;
+    for (auto tc : tests) {
+        std::cout << tc.name << "... ";
+        Result result = tc.fn(server);
+        total++;
+        results[result]++;
+        switch (result) {
+        case RESULT_OK:
+            std::cout << "ok" << std::endl;
+            break;
+        case RESULT_ERROR:
+            std::cout << "ERROR!" << std::endl;
+            break;
+        case RESULT_SKIP:
+            std::cout << "skipped" << std::endl;
+            break;
+        default:
+            std::cout << "runtime error, aborting!" << std::endl;
+            return 1;
+        }
+    }
+
+    if (results[RESULT_OK] == 0 && results[RESULT_ERROR] == 0) return 77; /* tests skipped */
+
+    if (results[RESULT_ERROR] != 0) return 1;
+
+    return 0;
+}
+
+/* vim:ts=8:sts=4:sw=4:expandtab:
+ */
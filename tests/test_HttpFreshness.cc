@@ -0,0 +1,266 @@
+/******************************************************************************
+ * 5G-MAG Reference Tools: MBS Traffic Function: Unit test: HttpHeaders and HttpFreshness
+ ******************************************************************************
+ * Copyright: (C)2025 British Broadcasting Corporation
+ * Author(s): David Waring <david.waring2@bbc.co.uk>
+ * License: 5G-MAG Public License v1
+ *
+ * For full license terms please see the LICENSE file distributed with this
+ * program. If this file is missing then the license can be retrieved from
+ * https://drive.google.com/file/d/1cinCiA778IErENZ3JN52VFW-1ffHpx7Z/view
+ */
+
+#include <chrono>
+#include <ctime>
+#include <initializer_list>
+#include <iostream>
+#include <optional>
+#include <string_view>
+
+#include "common.hh"
+#include "HttpFreshness.hh"
+#include "HttpHeaders.hh"
+
+using namespace std::chrono_literals;
+
+MBSTF_NAMESPACE_USING;
+
+enum Result {
+    RESULT_OK = 0,
+    RESULT_ERROR,
+    RESULT_SKIP,
+    RESULT_MAX
+};
+
+using time_type = HttpFreshness::time_type;
+
+// Sun, 06 Nov 1994 08:49:37 GMT
+static const time_type g_date(std::chrono::system_clock::from_time_t(784111777));
+
+static HttpHeaders make_headers(std::initializer_list<std::string_view> field_lines)
+{
+    HttpHeaders headers;
+    for (auto field_line : field_lines) headers.addLine(field_line);
+    return headers;
+}
+
+static bool check_lifetime(const char *what, const HttpFreshness &freshness, std::optional<long> seconds)
+{
+    const auto &lifetime = freshness.freshnessLifetime();
+    if (lifetime.has_value() == seconds.has_value() && (!lifetime || lifetime.value().count() == seconds.value())) {
+        return true;
+    }
+    std::cout << what << ": lifetime ";
+    if (lifetime) std::cout << lifetime.value().count() << "s"; else std::cout << "unknown";
+    std::cout << ", expected ";
+    if (seconds) std::cout << seconds.value() << "s"; else std::cout << "unknown";
+    std::cout << "... ";
+    return false;
+}
+
+/* All three HTTP-date formats parse to the same time, anything else does not parse */
+static Result test_http_dates()
+{
+    static const char *c_dates[] = {
+        "Sun, 06 Nov 1994 08:49:37 GMT",  // IMF-fixdate
+        "Sunday, 06-Nov-94 08:49:37 GMT", // RFC 850
+        "Sun Nov  6 08:49:37 1994"        // asctime
+    };
+    for (auto date : c_dates) {
+        auto parsed = HttpHeaders::parseHttpDate(date);
+        if (!parsed || parsed.value() != g_date) {
+            std::cout << "\"" << date << "\" did not parse correctly... ";
+            return RESULT_ERROR;
+        }
+    }
+
+    for (auto date : {"0", "", "-1", "Sun, 06 Nov 1994"}) {
+        if (HttpHeaders::parseHttpDate(date)) {
+            std::cout << "\"" << date << "\" parsed as a date... ";
+            return RESULT_ERROR;
+        }
+    }
+
+    HttpHeaders headers(make_headers({"DATE: Sun, 06 Nov 1994 08:49:37 GMT"}));
+    if (headers.getDate("date") != g_date) {
+        std::cout << "getDate() did not find the Date field... ";
+        return RESULT_ERROR;
+    }
+    return RESULT_OK;
+}
+
+/* Field names match without regard to case, repeated fields are kept in order and bad field lines are rejected */
+static Result test_header_fields()
+{
+    HttpHeaders headers;
+    if (!headers.addLine("cache-CONTROL:  public, max-age=60  ") || !headers.addLine("Cache-Control: no-store")) {
+        std::cout << "valid field line rejected... ";
+        return RESULT_ERROR;
+    }
+    if (headers.addLine(" folded continuation") || headers.addLine("Bad : space before colon")) {
+        std::cout << "invalid field line accepted... ";
+        return RESULT_ERROR;
+    }
+    if (headers.get("CACHE-control") != "public, max-age=60") {
+        std::cout << "value not found or not trimmed... ";
+        return RESULT_ERROR;
+    }
+    unsigned int count = 0;
+    headers.forEach("cache-control", [&count](std::string_view) { count++; });
+    if (count != 2 || headers.size() != 2) {
+        std::cout << "repeated field lines not all kept... ";
+        return RESULT_ERROR;
+    }
+    headers.clear();
+    if (!headers.empty() || headers.get("Cache-Control")) {
+        std::cout << "fields left after clear()... ";
+        return RESULT_ERROR;
+    }
+    return RESULT_OK;
+}
+
+/* s-maxage takes precedence over max-age, which takes precedence over Expires, then the Last-Modified heuristic */
+static Result test_lifetime_precedence()
+{
+    const time_type now(g_date);
+    const char *date = "Date: Sun, 06 Nov 1994 08:49:37 GMT";
+    const char *expires = "Expires: Sun, 06 Nov 1994 08:59:37 GMT";
+    const char *last_modified = "Last-Modified: Sun, 06 Nov 1994 07:49:37 GMT";
+
+    if (!check_lifetime("s-maxage", HttpFreshness(make_headers({date, expires, last_modified,
+                                    "Cache-Control: max-age=60, s-maxage=30"}), now, now), 30)) return RESULT_ERROR;
+    if (!check_lifetime("max-age", HttpFreshness(make_headers({date, expires, last_modified,
+                                    "Cache-Control: max-age=60"}), now, now), 60)) return RESULT_ERROR;
+    if (!check_lifetime("Expires", HttpFreshness(make_headers({date, expires, last_modified}), now, now), 600)) {
+        return RESULT_ERROR;
+    }
+    if (!check_lifetime("invalid Expires", HttpFreshness(make_headers({date, "Expires: 0", last_modified}), now, now),
+                        0)) return RESULT_ERROR;
+
+    HttpFreshness heuristic(make_headers({date, last_modified}), now, now);
+    if (!check_lifetime("heuristic", heuristic, 360)) return RESULT_ERROR;
+    if (!heuristic.heuristic()) {
+        std::cout << "heuristic lifetime not flagged... ";
+        return RESULT_ERROR;
+    }
+
+    HttpFreshness unknown(make_headers({date}), now, now);
+    if (!check_lifetime("no freshness information", unknown, std::nullopt)) return RESULT_ERROR;
+    if (unknown.expires() || unknown.expires(10s) != now + 10s) {
+        std::cout << "default lifetime not used... ";
+        return RESULT_ERROR;
+    }
+
+    // The first of a repeated directive is used, even across field lines, and huge values are capped
+    if (!check_lifetime("repeated max-age", HttpFreshness(make_headers({"Cache-Control: max-age=5",
+                                    "Cache-Control: max-age=500"}), now, now), 5)) return RESULT_ERROR;
+    if (!check_lifetime("huge max-age", HttpFreshness(make_headers({"Cache-Control: max-age=99999999999999"}), now,
+                                    now), 2147483648)) return RESULT_ERROR;
+
+    // no-cache responses must always be revalidated, so have no lifetime
+    HttpFreshness no_cache(make_headers({"Cache-Control: max-age=60, no-cache, no-store"}), now, now);
+    if (!check_lifetime("no-cache", no_cache, 0)) return RESULT_ERROR;
+    if (!no_cache.noCache() || !no_cache.noStore()) {
+        std::cout << "no-cache or no-store not seen... ";
+        return RESULT_ERROR;
+    }
+    return RESULT_OK;
+}
+
+/* Quoted directive arguments are unquoted and may contain commas */
+static Result test_quoted_arguments()
+{
+    const time_type now(g_date);
+
+    HttpFreshness quoted(make_headers({"Cache-Control: private=\"Set-Cookie, X-Id\", s-maxage=\"30\", max-age=60"}),
+                         now, now);
+    if (!check_lifetime("quoted s-maxage", quoted, 30)) return RESULT_ERROR;
+
+    // no-cache with a field list only applies to those fields
+    HttpFreshness qualified(make_headers({"Cache-Control: no-cache=\"Set-Cookie, X-Id\", max-age=60"}), now, now);
+    if (!check_lifetime("qualified no-cache", qualified, 60)) return RESULT_ERROR;
+    if (qualified.noCache()) {
+        std::cout << "qualified no-cache applied to the whole response... ";
+        return RESULT_ERROR;
+    }
+
+    // Invalid delta-seconds are ignored
+    if (!check_lifetime("invalid max-age", HttpFreshness(make_headers({"Cache-Control: max-age=abc"}), now, now),
+                        std::nullopt)) return RESULT_ERROR;
+    return RESULT_OK;
+}
+
+/* The age of the response when received is taken off its lifetime */
+static Result test_age()
+{
+    const time_type request_time(g_date - 2s);
+    const time_type response_time(g_date);
+
+    // Age plus the response delay
+    HttpFreshness aged(make_headers({"Date: Sun, 06 Nov 1994 08:49:37 GMT", "Age: 5", "Cache-Control: max-age=30"}),
+                       request_time, response_time);
+    if (aged.initialAge() != 7s || aged.expires() != response_time + 23s) {
+        std::cout << "Age not allowed for: initial age " << aged.initialAge().count() << "s... ";
+        return RESULT_ERROR;
+    }
+
+    // Apparent age from the Date when that is larger
+    HttpFreshness apparent(make_headers({"Date: Sun, 06 Nov 1994 08:49:27 GMT", "Age: 1", "Cache-Control: max-age=30"}),
+                           request_time, response_time);
+    if (apparent.initialAge() != 10s) {
+        std::cout << "apparent age not used: initial age " << apparent.initialAge().count() << "s... ";
+        return RESULT_ERROR;
+    }
+
+    // Stale on arrival: the expiry time is before the response arrived
+    HttpFreshness stale(make_headers({"Age: 2", "Cache-Control: max-age=2"}), request_time, response_time);
+    if (!stale.expires() || stale.expires().value() >= response_time) {
+        std::cout << "response stale on arrival has an expiry time after it arrived... ";
+        return RESULT_ERROR;
+    }
+    return RESULT_OK;
+}
+
+int main(int argc, char *argv[])
+{
+    static const struct TestCase {
+        const char *name;
+        Result (*fn)();
+    } tests[] = {
+        {"HTTP-date formats", test_http_dates},
+        {"Header field lines", test_header_fields},
+        {"Freshness lifetime precedence", test_lifetime_precedence},
+        {"Quoted Cache-Control arguments", test_quoted_arguments},
+        {"Age of response", test_age}
+    };
+
+    size_t results[RESULT_MAX] = {};
+    for (auto tc : tests) {
+        std::cout << tc.name << "... ";
+        Result result = tc.fn();
+        results[result]++;
+        switch (result) {
+        case RESULT_OK:
+            std::cout << "ok" << std::endl;
+            break;
+        case RESULT_ERROR:
+            std::cout << "ERROR!" << std::endl;
+            break;
+        case RESULT_SKIP:
+            std::cout << "skipped" << std::endl;
+            break;
+        default:
+            std::cout << "runtime error, aborting!" << std::endl;
+            return 1;
+        }
+    }
+
+    if (results[RESULT_OK] == 0 && results[RESULT_ERROR] == 0) return 77; /* tests skipped */
+
+    if (results[RESULT_ERROR] != 0) return 1;
+
+    return 0;
+}
+
+/* vim:ts=8:sts=4:sw=4:expandtab:
+ */
@@ -0,0 +1,242 @@
+/******************************************************************************
+ * 5G-MAG Reference Tools: MBS Traffic Function: Unit test: MPSCQueue
+ ******************************************************************************
+ * Copyright: (C)2025 British Broadcasting Corporation
+ * Author(s): David Waring <david.waring2@bbc.co.uk>
+ * License: 5G-MAG Public License v1
+ *
+ * For full license terms please see the LICENSE file distributed with this
+ * program. If this file is missing then the license can be retrieved from
+ * https://drive.google.com/file/d/1cinCiA778IErENZ3JN52VFW-1ffHpx7Z/view
+ */
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "common.hh"
+#include "MPSCQueue.hh"
+
+MBSTF_NAMESPACE_USING;
+
+enum Result {
+    RESULT_OK = 0,
+    RESULT_ERROR,
+    RESULT_SKIP,
+    RESULT_MAX
+};
+
+static thread_local bool t_isProducer = false;
+static std::atomic_bool g_holdStalledPush(false);
+static std::atomic_bool g_pushStalled(false);
+
+/* Queue entry which can be made slow to move in producer threads, which widens the gap between a push() claiming its
+ * place in the ring and the entry being ready to pop. While g_holdStalledPush is set the push is held until it is
+ * cleared. */
+struct Entry {
+    Entry() :producer(0), sequence(0), stall(false) {};
+    Entry(unsigned int p, unsigned int seq, bool stall_on_push = false) :producer(p), sequence(seq), stall(stall_on_push) {};
+    Entry(const Entry &) = default;
+    Entry(Entry &&) = default;
+
+    Entry &operator=(const Entry &) = default;
+    Entry &operator=(Entry &&other) {
+        if (t_isProducer && other.stall) {
+            g_pushStalled = true;
+            while (g_holdStalledPush) std::this_thread::yield();
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+        producer = other.producer;
+        sequence = other.sequence;
+        stall = other.stall;
+        return *this;
+    };
+
+    unsigned int producer;
+    unsigned int sequence;
+    bool stall;
+};
+
+/* Single threaded: entries that overflow the ring come out after the ring entries, in the order pushed */
+static Result test_single_producer_overflow()
+{
+    MPSCQueue<Entry> queue(4);
+    for (unsigned int i = 0; i < 20; i++) queue.push(Entry{0, i});
+
+    Entry entry;
+    unsigned int expected = 0;
+    while (queue.pop(entry)) {
+        if (entry.sequence != expected) {
+            std::cout << "got " << entry.sequence << ", expected " << expected << "... ";
+            return RESULT_ERROR;
+        }
+        expected++;
+        // push some more while the overflow list is still in use
+        if (expected == 5) {
+            for (unsigned int i = 20; i < 30; i++) queue.push(Entry{0, i});
+        }
+    }
+    if (expected != 30) {
+        std::cout << "only got " << expected << " of 30 entries... ";
+        return RESULT_ERROR;
+    }
+    return RESULT_OK;
+}
+
+/* A push that has claimed the head of the ring but not finished must not let another producer's later entries, which
+ * have gone on to the overflow list, overtake that producer's earlier entries in the ring behind it */
+static Result test_stalled_push_overflow()
+{
+    MPSCQueue<Entry> queue(4);
+    g_holdStalledPush = true;
+    g_pushStalled = false;
+    std::thread stalled_producer([&queue]() {
+        t_isProducer = true;
+        queue.push(Entry(1, 0, true));
+    });
+    while (!g_pushStalled) std::this_thread::yield();
+
+    // this thread is producer 0: fill the rest of the ring and then overflow
+    for (unsigned int i = 0; i < 6; i++) queue.push(Entry(0, i));
+
+    Entry entry;
+    unsigned int next[2] = {0, 0};
+    bool in_order = true;
+    while (queue.pop(entry)) {
+        if (entry.sequence != next[entry.producer]) in_order = false;
+        next[entry.producer] = entry.sequence + 1;
+    }
+
+    g_holdStalledPush = false;
+    stalled_producer.join();
+    while (queue.pop(entry)) {
+        if (entry.sequence != next[entry.producer]) in_order = false;
+        next[entry.producer] = entry.sequence + 1;
+    }
+
+    if (!in_order) {
+        std::cout << "entries out of order... ";
+        return RESULT_ERROR;
+    }
+    if (next[0] != 6 || next[1] != 1) {
+        std::cout << "entries missing... ";
+        return RESULT_ERROR;
+    }
+    return RESULT_OK;
+}
+
+/* Several producers against a consumer: each producer's entries must arrive in order and none may be lost */
+static Result test_multi_producer_order(std::size_t capacity, unsigned int consumer_delay_every)
+{
+    static constexpr unsigned int c_numProducers = 8;
+    static constexpr unsigned int c_entriesPerProducer = 50000;
+
+    MPSCQueue<Entry> queue(capacity);
+    std::atomic<unsigned int> producers_done(0);
+    std::vector<std::thread> producers;
+    for (unsigned int p = 0; p < c_numProducers; p++) {
+        producers.emplace_back([&queue, &producers_done, p]() {
+            t_isProducer = true;
+            for (unsigned int i = 0; i < c_entriesPerProducer; i++) {
+                queue.push(Entry(p, i, (i & 0x7) == 0));
+                if ((i & 0xff) == 0) std::this_thread::yield();
+            }
+            producers_done++;
+        });
+    }
+
+    std::vector<unsigned int> next(c_numProducers, 0);
+    unsigned int received = 0;
+    bool in_order = true;
+    while (true) {
+        Entry entry;
+        if (queue.pop(entry)) {
+            if (entry.producer >= c_numProducers || entry.sequence != next[entry.producer]) {
+                if (in_order) {
+                    std::cout << "producer " << entry.producer << " entry " << entry.sequence << " arrived when expecting "
+                              << next[entry.producer] << "... ";
+                }
+                in_order = false;
+            }
+            next[entry.producer] = entry.sequence + 1;
+            received++;
+            // slow the consumer down now and again so that the ring fills and the overflow list gets used
+            if (consumer_delay_every && received % consumer_delay_every == 0) {
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+            }
+        } else if (producers_done == c_numProducers) {
+            // all pushes have finished, so anything left is ready to pop
+            if (!queue.pop(entry)) break;
+            if (entry.producer >= c_numProducers || entry.sequence != next[entry.producer]) in_order = false;
+            next[entry.producer] = entry.sequence + 1;
+            received++;
+        } else {
+            std::this_thread::yield();
+        }
+    }
+
+    for (auto &producer : producers) producer.join();
+
+    if (!in_order) return RESULT_ERROR;
+    if (received != c_numProducers * c_entriesPerProducer) {
+        std::cout << "received " << received << " of " << c_numProducers * c_entriesPerProducer << " entries... ";
+        return RESULT_ERROR;
+    }
+    return RESULT_OK;
+}
+
+static Result test_multi_producer_ring()
+{
+    return test_multi_producer_order(1 << 20, 0);
+}
+
+static Result test_multi_producer_overflow()
+{
+    return test_multi_producer_order(8, 200);
+}
+
+int main(int argc, char *argv[])
+{
+    static const struct TestCase {
+        const char *name;
+        Result (*fn)();
+    } tests[] = {
+        {"Single producer with overflow", test_single_producer_overflow},
+        {"Stalled push with overflow", test_stalled_push_overflow},
+        {"Multiple producers within ring capacity", test_multi_producer_ring},
+        {"Multiple producers with overflow", test_multi_producer_overflow}
+    };
+
+    size_t results[RESULT_MAX] = {};
+    for (auto tc : tests) {
+        std::cout << tc.name << "... ";
+        Result result = tc.fn();
+        results[result]++;
+        switch (result) {
+        case RESULT_OK:
+            std::cout << "ok" << std::endl;
+            break;
+        case RESULT_ERROR:
+            std::cout << "ERROR!" << std::endl;
+            break;
+        case RESULT_SKIP:
+            std::cout << "skipped" << std::endl;
+            break;
+        default:
+            std::cout << "runtime error, aborting!" << std::endl;
+            return 1;
+        }
+    }
+
+    if (results[RESULT_OK] == 0 && results[RESULT_ERROR] == 0) return 77; /* tests skipped */
+
+    if (results[RESULT_ERROR] != 0) return 1;
+
+    return 0;
+}
+
+/* vim:ts=8:sts=4:sw=4:expandtab:
+ */
@@ -25,8 +25,10 @@
 #include <optional>
 #include <map>
 #include <list>
+#include <functional>
 
 #include "common.hh"
+#include "IngestProgress.hh"
 #include "ObjectStore.hh"
 
 MBSTF_NAMESPACE_START
@@ -143,6 +145,129 @@ void testGetStaleObjects(ObjectStore& store) {
     }
 }
 
+static void report(bool passed, const std::string &test_name) {
+    if (passed) {
+        std::cout<<"INFO: "<<test_name<<" passed."<<std::endl;
+        pass++;
+    } else {
+        std::cout<<"ERROR: "<<test_name<<" failed."<<std::endl;
+        fail++;
+    }
+}
+
+static ObjectStore::Metadata testMetadata(const std::string &object_id, const std::string &url) {
+    return ObjectStore::Metadata(object_id, "text/plain", url, url, "acquisition", std::chrono::system_clock::now());
+}
+
+void testEviction(ObjectController &controller) {
+    const ObjectStore::MemoryBudget original_budget(ObjectStore::memoryBudget());
+    ObjectStore::memoryBudget(ObjectStore::MemoryBudget{1000, 0, 90, 1, std::nullopt});
+    {
+        ObjectStore store(controller);
+        auto now = std::chrono::system_clock::now();
+
+        ObjectStore::Metadata oldest(testMetadata("evict_oldest", "evict_url1"));
+        oldest.keepAfterSend(true).receivedTime(now - 3s);
+        ObjectStore::Metadata older(testMetadata("evict_older", "evict_url2"));
+        older.receivedTime(now - 2s);
+        ObjectStore::Metadata old(testMetadata("evict_old", "evict_url3"));
+        old.receivedTime(now - 1s);
+
+        store.addObject("evict_oldest", ObjectStore::ObjectData(300, 0x01), std::move(oldest));
+        store.addObject("evict_older", ObjectStore::ObjectData(300, 0x02), std::move(older));
+        store.addObject("evict_old", ObjectStore::ObjectData(300, 0x03), std::move(old));
+        report(store.findObject("evict_older").has_value() && store.bytesUsed() == 900, "testEviction under budget");
+        report(store.overHighWaterMark(), "testEviction high water mark reached");
+
+        // Over budget: the oldest object not marked keepAfterSend goes first and the new object is never a candidate
+        store.addObject("evict_new", ObjectStore::ObjectData(300, 0x04), testMetadata("evict_new", "evict_url4"));
+        report(store.findObject("evict_oldest").has_value() && !store.findObject("evict_older").has_value() &&
+               store.findObject("evict_old").has_value() && store.findObject("evict_new").has_value() &&
+               store.bytesUsed() == 900, "testEviction order");
+        report(store.currentObjectId("evict_url2") == std::nullopt, "testEviction unindexes URLs");
+
+        store.deleteObject("evict_old");
+        report(store.bytesUsed() == 600 && !store.overHighWaterMark(0) && !store.overHighWaterMark(299) &&
+               store.overHighWaterMark(300), "testEviction high water mark with pending bytes");
+    }
+    ObjectStore::memoryBudget(original_budget);
+}
+
+void testSupersedeByUrl(ObjectController &controller) {
+    ObjectStore store(controller);
+
+    store.addObject("sup_v1", ObjectStore::ObjectData{0x01}, testMetadata("sup_v1", "sup_url"));
+    store.addObject("sup_v2", ObjectStore::ObjectData{0x02, 0x03}, testMetadata("sup_v2", "sup_url"));
+
+    std::optional<ObjectStore::Object> current(store.findObjectByUrl("sup_url"));
+    report(!store.findObject("sup_v1").has_value() && current.has_value() && current->data() == ObjectStore::ObjectData{0x02, 0x03},
+           "testSupersedeByUrl replaces the previous version");
+    report(store.currentObjectId("sup_url") == std::optional<std::string>("sup_v2") && current->metadata().version() == 2 &&
+           current->metadata().previousVersion() == std::optional<std::string>("sup_v1"),
+           "testSupersedeByUrl versions");
+    report(store.bytesUsed() == 2, "testSupersedeByUrl memory accounting");
+}
+
+void testBatchSupersede(ObjectController &controller) {
+    ObjectStore store(controller);
+
+    store.addObject("batch_v1", ObjectStore::ObjectData{0x01}, testMetadata("batch_v1", "batch_url"));
+
+    ObjectStore::Batch batch;
+    batch.addObject("batch_v2", ObjectStore::ObjectData{0x02}, testMetadata("batch_v2", "batch_url"));
+    batch.addObject("batch_v3", ObjectStore::ObjectData{0x03, 0x04}, testMetadata("batch_v3", "batch_url"));
+    batch.addObject("batch_other", ObjectStore::ObjectData{0x05}, testMetadata("batch_other", "batch_other_url"));
+    store.commit(std::move(batch));
+
+    report(!store.findObject("batch_v1").has_value() && !store.findObject("batch_v2").has_value() &&
+           store.findObject("batch_v3").has_value() && store.findObject("batch_other").has_value(),
+           "testBatchSupersede within the batch");
+    report(store.currentObjectId("batch_url") == std::optional<std::string>("batch_v3") && store.bytesUsed() == 3,
+           "testBatchSupersede index and memory accounting");
+}
+
+void testAddObjectIfNew(ObjectController &controller) {
+    ObjectStore store(controller);
+
+    report(store.addObjectIfNew("ifnew_1", std::make_shared<const ObjectBuffer>(ObjectStore::ObjectData{0x01}),
+                                testMetadata("ifnew_1", "ifnew_url")), "testAddObjectIfNew adds a new URL");
+    report(!store.addObjectIfNew("ifnew_2", std::make_shared<const ObjectBuffer>(ObjectStore::ObjectData{0x02}),
+                                 testMetadata("ifnew_2", "ifnew_url")) &&
+           !store.findObject("ifnew_2").has_value() && store.findObject("ifnew_1").has_value() &&
+           store.currentObjectId("ifnew_url") == std::optional<std::string>("ifnew_1"),
+           "testAddObjectIfNew leaves an existing URL alone");
+}
+
+void testGrowingObjects(ObjectController &controller) {
+    ObjectStore store(controller);
+    std::shared_ptr<IngestProgress> progress(std::make_shared<IngestProgress>());
+    int added_calls = 0;
+    int abandoned_calls = 0;
+    int cancelled_calls = 0;
+
+    report(store.addGrowingObject("grow_1", "grow_url1", progress) && !store.addGrowingObject("grow_1", "grow_url1", progress) &&
+           store.findGrowingObject("grow_1") == progress, "testGrowingObjects listing");
+    report(store.notifyWhenAdded("not_growing", [&]() { added_calls++; }) == ObjectStore::c_noGrowingListener,
+           "testGrowingObjects no listener when not growing");
+
+    store.notifyWhenAdded("grow_1", [&]() { added_calls++; });
+    progress->received(2).complete();
+    store.addObject("grow_1", ObjectStore::ObjectData{0x01, 0x02}, testMetadata("grow_1", "grow_url1"));
+    report(added_calls == 1 && !store.findGrowingObject("grow_1") && store.findObject("grow_1").has_value(),
+           "testGrowingObjects notifyWhenAdded on add");
+
+    store.addGrowingObject("grow_2", "grow_url2", std::make_shared<IngestProgress>());
+    store.notifyWhenAdded("grow_2", [&]() { abandoned_calls++; });
+    ObjectStore::GrowingListenerId cancelled_id(store.notifyWhenAdded("grow_2", [&]() { cancelled_calls++; }));
+    store.cancelNotifyWhenAdded("grow_2", cancelled_id);
+    store.abandonGrowingObject("grow_2");
+    report(abandoned_calls == 1 && cancelled_calls == 0 && !store.findGrowingObject("grow_2") &&
+           !store.findObject("grow_2").has_value(), "testGrowingObjects abandonGrowingObject");
+
+    store.abandonGrowingObject("grow_2");
+    report(abandoned_calls == 1 && added_calls == 1, "testGrowingObjects listeners only called once");
+}
+
 MBSTF_NAMESPACE_STOP
 MBSTF_NAMESPACE_USING;
 int main() {
@@ -161,6 +286,11 @@ int main() {
     testAddObject(store);
     std::this_thread::sleep_for(10s);
     testGetStaleObjects(store);
+    testEviction(objectController);
+    testSupersedeByUrl(objectController);
+    testBatchSupersede(objectController);
+    testAddObjectIfNew(objectController);
+    testGrowingObjects(objectController);
     std::cout<<"Test: ObjectStore "<<"Pass: "<<pass<<" Fail: "<<fail<<std::endl;
     std::cout<<"### ObjectStore: Test finish #### "<<std::endl;
     return 0;
@@ -10,12 +10,16 @@
  * https://drive.google.com/file/d/1cinCiA778IErENZ3JN52VFW-1ffHpx7Z/view
  */
 
+#include <atomic>
 #include <chrono>
 #include <condition_variable>
 #include <exception>
 #include <iostream>
+#include <memory>
 #include <optional>
 #include <mutex>
+#include <thread>
+#include <vector>
 
 #include "common.hh"
 #include "SubscriptionService.hh"
@@ -64,6 +68,8 @@ public:
 
     bool sendSynchronous(Event &event) {return sendEventSynchronous(event);};
     void sendAsynchronous(const std::shared_ptr<Event> &event) {sendEventAsynchronous(event);};
+    void sendAsynchronousCoalesced(const std::shared_ptr<Event> &event, const void *source) {sendEventAsynchronousCoalesced(event, source);};
+    void flushCoalesced(const void *source) {flushCoalescedEvents(source);};
 };
 
 class TestSubscriber : public Subscriber
@@ -184,6 +190,57 @@ private:
     std::condition_variable_any m_condVar;
 };
 
+/* Records the Type1 events it receives and can hold up their delivery until release() is called, or unsubscribe
+ * itself from within processEvent()
+ */
+class TestBlockingSubscriber : public Subscriber
+{
+public:
+    TestBlockingSubscriber() :Subscriber(),m_received(),m_blocked(false),m_unsubscribeOnEvent(false),m_mutex(),m_condVar() {};
+
+    virtual ~TestBlockingSubscriber() {};
+
+    virtual void processEvent(Event &event, SubscriptionService &event_service) {
+        if (event.eventName() != "Type1") return;
+        EventType1 &ev1 = dynamic_cast<EventType1&>(event);
+        bool unsubscribe;
+        {
+            std::unique_lock lock(m_mutex);
+            m_received.push_back(ev1.data());
+            m_condVar.notify_all();
+            m_condVar.wait(lock, [this]() { return !m_blocked; });
+            unsubscribe = m_unsubscribeOnEvent;
+        }
+        if (unsubscribe) event_service.unsubscribe(*this);
+        event.preventDefault();
+    };
+
+    void addSubscribeToT1(SubscriptionService &svc) {
+        if (!subscribeTo({"Type1"}, svc)) {
+            throw std::runtime_error("Failed subscription");
+        }
+    };
+
+    void block() { std::lock_guard lock(m_mutex); m_blocked = true; };
+    void release() { std::lock_guard lock(m_mutex); m_blocked = false; m_condVar.notify_all(); };
+    void unsubscribeOnEvent(bool unsubscribe) { std::lock_guard lock(m_mutex); m_unsubscribeOnEvent = unsubscribe; };
+
+    template <class Rep, class Period>
+    bool waitForReceived(std::size_t count, std::chrono::duration<Rep, Period> timeout) {
+        std::unique_lock lock(m_mutex);
+        return m_condVar.wait_for(lock, timeout, [this, count]() { return m_received.size() >= count; });
+    };
+
+    std::vector<int> received() { std::lock_guard lock(m_mutex); return m_received; };
+
+private:
+    std::vector<int> m_received;
+    bool m_blocked;
+    bool m_unsubscribeOnEvent;
+    std::mutex m_mutex;
+    std::condition_variable m_condVar;
+};
+
 enum Result {
     RESULT_OK = 0,
     RESULT_ERROR,
@@ -496,6 +553,181 @@ Result test_asynchronous_unfiltered(TestContext &ctx)
     return RESULT_OK;
 }
 
+Result test_unsubscribe_waits_for_delivery(TestContext &ctx)
+{
+    TestSubscriptionService svc;
+    TestBlockingSubscriber sub;
+    sub.addSubscribeToT1(svc);
+    sub.block();
+
+    std::thread sender([&svc]() {
+        EventType1 t1(7);
+        svc.sendSynchronous(t1);
+    });
+    if (!sub.waitForReceived(1, 15s)) {
+        std::cerr << "Synchronous event not delivered to blocking subscriber" << std::endl;
+        sub.release();
+        sender.join();
+        return RESULT_ERROR;
+    }
+
+    // The delivery is in progress on another thread, so unsubscribe() must not return until it finishes
+    std::atomic_bool unsubscribed(false);
+    std::thread unsubscriber([&svc, &sub, &unsubscribed]() {
+        svc.unsubscribe(sub);
+        unsubscribed = true;
+    });
+    std::this_thread::sleep_for(200ms);
+    bool returned_early = unsubscribed;
+    sub.release();
+    unsubscriber.join();
+    sender.join();
+
+    if (returned_early) {
+        std::cerr << "unsubscribe() returned while a delivery to the subscriber was in progress" << std::endl;
+        return RESULT_ERROR;
+    }
+
+    if (!svc.subscribedEvents(sub).empty()) {
+        std::cerr << "Subscriber still subscribed after unsubscribe()" << std::endl;
+        return RESULT_ERROR;
+    }
+
+    EventType1 t1(8);
+    svc.sendSynchronous(t1);
+    if (sub.received().size() != 1) {
+        std::cerr << "Event delivered after unsubscribe() returned" << std::endl;
+        return RESULT_ERROR;
+    }
+
+    return RESULT_OK;
+}
+
+Result test_unsubscribe_during_delivery(TestContext &ctx)
+{
+    // Left allocated if the delivery never finishes, as the sending thread would still be using them
+    TestSubscriptionService *svc = new TestSubscriptionService;
+    TestBlockingSubscriber *sub = new TestBlockingSubscriber;
+    sub->addSubscribeToT1(*svc);
+    sub->unsubscribeOnEvent(true);
+
+    // Unsubscribing from within processEvent() must not wait for the delivery it is part of
+    std::shared_ptr<std::atomic_bool> delivered(std::make_shared<std::atomic_bool>(false));
+    std::thread sender([svc, delivered]() {
+        EventType1 t1(9);
+        svc->sendSynchronous(t1);
+        *delivered = true;
+    });
+    for (int i = 0; i < 150 && !*delivered; i++) std::this_thread::sleep_for(100ms);
+    if (!*delivered) {
+        std::cerr << "unsubscribe() from within processEvent() did not return" << std::endl;
+        sender.detach();
+        return RESULT_ERROR;
+    }
+    sender.join();
+
+    Result result = RESULT_OK;
+    if (!svc->subscribedEvents(*sub).empty()) {
+        std::cerr << "Subscriber still subscribed after unsubscribing during delivery" << std::endl;
+        result = RESULT_ERROR;
+    }
+
+    delete sub;
+    delete svc;
+    return result;
+}
+
+Result test_coalesced_replaces_queued(TestContext &ctx)
+{
+    std::chrono::milliseconds original_interval(SubscriptionService::coalescingInterval());
+    SubscriptionService::coalescingInterval(0ms);
+
+    TestSubscriptionService svc;
+    TestBlockingSubscriber sub;
+    sub.addSubscribeToT1(svc);
+
+    // Hold up delivery of the first event so that the coalesced ones stay queued behind it
+    sub.block();
+    svc.sendAsynchronous(std::shared_ptr<Event>(new EventType1(0)));
+    if (!sub.waitForReceived(1, 15s)) {
+        std::cerr << "Async Event took longer than 15 seconds to reach subscriber" << std::endl;
+        sub.release();
+        SubscriptionService::coalescingInterval(original_interval);
+        return RESULT_ERROR;
+    }
+    for (int i = 1; i <= 3; i++) {
+        svc.sendAsynchronousCoalesced(std::shared_ptr<Event>(new EventType1(i)), &sub);
+    }
+    sub.release();
+
+    bool delivered = sub.waitForReceived(2, 15s);
+    std::this_thread::sleep_for(100ms);
+    SubscriptionService::coalescingInterval(original_interval);
+
+    if (!delivered || sub.received() != std::vector<int>{0, 3}) {
+        std::cerr << "Coalesced events did not replace the queued event with the latest" << std::endl;
+        return RESULT_ERROR;
+    }
+
+    return RESULT_OK;
+}
+
+Result test_coalesced_hold_back(TestContext &ctx)
+{
+    std::chrono::milliseconds original_interval(SubscriptionService::coalescingInterval());
+    SubscriptionService::coalescingInterval(300ms);
+
+    TestSubscriptionService svc;
+    TestBlockingSubscriber sub;
+    sub.addSubscribeToT1(svc);
+    Result result = RESULT_OK;
+
+    // The first event is queued straight away, the next ones within the interval are held back
+    svc.sendAsynchronousCoalesced(std::shared_ptr<Event>(new EventType1(1)), &sub);
+    if (!sub.waitForReceived(1, 15s)) {
+        std::cerr << "First coalesced event not delivered" << std::endl;
+        result = RESULT_ERROR;
+    }
+    svc.sendAsynchronousCoalesced(std::shared_ptr<Event>(new EventType1(2)), &sub);
+    svc.sendAsynchronousCoalesced(std::shared_ptr<Event>(new EventType1(3)), &sub);
+    std::this_thread::sleep_for(100ms);
+    if (result == RESULT_OK && sub.received() != std::vector<int>{1}) {
+        std::cerr << "Coalesced events within the interval were not held back" << std::endl;
+        result = RESULT_ERROR;
+    }
+
+    // The next event after the interval is queued, replacing those held back
+    std::this_thread::sleep_for(300ms);
+    svc.sendAsynchronousCoalesced(std::shared_ptr<Event>(new EventType1(4)), &sub);
+    if (result == RESULT_OK && (!sub.waitForReceived(2, 15s) || sub.received() != std::vector<int>{1, 4})) {
+        std::cerr << "Coalesced event after the interval was not delivered in place of the held back events" << std::endl;
+        result = RESULT_ERROR;
+    }
+
+    // flushCoalescedEvents() queues the latest held back event without waiting for another
+    svc.sendAsynchronousCoalesced(std::shared_ptr<Event>(new EventType1(5)), &sub);
+    svc.sendAsynchronousCoalesced(std::shared_ptr<Event>(new EventType1(6)), &sub);
+    std::this_thread::sleep_for(100ms);
+    if (result == RESULT_OK && sub.received() != std::vector<int>{1, 4}) {
+        std::cerr << "Coalesced events within the interval were not held back before flushing" << std::endl;
+        result = RESULT_ERROR;
+    }
+    svc.flushCoalesced(&sub);
+    if (result == RESULT_OK && (!sub.waitForReceived(3, 15s) || sub.received() != std::vector<int>{1, 4, 6})) {
+        std::cerr << "flushCoalescedEvents() did not deliver the latest held back event" << std::endl;
+        result = RESULT_ERROR;
+    }
+
+    std::this_thread::sleep_for(100ms);
+    if (result == RESULT_OK && sub.received().size() != 3) {
+        std::cerr << "Superseded coalesced events were delivered" << std::endl;
+        result = RESULT_ERROR;
+    }
+
+    SubscriptionService::coalescingInterval(original_interval);
+    return result;
+}
+
 void test_cleanup(TestContext &ctx)
 {
     for (auto *svc : ctx.services) {
@@ -530,7 +762,11 @@ int main(int argc, char *argv[])
         {"Synchronous events with event filters", test_synchronous_filtered},
         {"Synchronous events without event filters", test_synchronous_unfiltered},
         {"Asynchronous events with event filters", test_asynchronous_filtered},
-        {"Asynchronous events without event filters", test_asynchronous_unfiltered}
+        {"Asynchronous events without event filters", test_asynchronous_unfiltered},
+        {"Unsubscribe waits for deliveries on other threads", test_unsubscribe_waits_for_delivery},
+        {"Unsubscribe from within a delivery", test_unsubscribe_during_delivery},
+        {"Coalesced event replaces the queued event", test_coalesced_replaces_queued},
+        {"Coalesced events held back within the interval", test_coalesced_hold_back}
     };
 
     size_t results[RESULT_MAX] = {};
@@ -0,0 +1,320 @@
+/******************************************************************************
+ * 5G-MAG Reference Tools: MBS Traffic Function: Unit test: TimerWheel
+ ******************************************************************************
+ * Copyright: (C)2025 British Broadcasting Corporation
+ * Author(s): David Waring <david.waring2@bbc.co.uk>
+ * License: 5G-MAG Public License v1
+ *
+ * For full license terms please see the LICENSE file distributed with this
+ * program. If this file is missing then the license can be retrieved from
+ * https://drive.google.com/file/d/1cinCiA778IErENZ3JN52VFW-1ffHpx7Z/view
+ */
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <random>
+#include <vector>
+
+#include "common.hh"
+#include "TimerWheel.hh"
+
+using namespace std::chrono_literals;
+
+MBSTF_NAMESPACE_USING;
+
+/* Timer wheel without a driver thread, whose time is moved on by the test */
+class TestTimerWheel : public TimerWheel
+{
+public:
+    TestTimerWheel() :TimerWheel(clock_type::time_point(1h), false), m_now(clock_type::time_point(1h)) {};
+
+    clock_type::time_point at(std::chrono::milliseconds offset) const { return clock_type::time_point(1h) + offset; };
+    clock_type::time_point now() const { return m_now; };
+
+    void moveTo(std::chrono::milliseconds offset) {
+        m_now = at(offset);
+        expireUntil(m_now);
+    };
+
+private:
+    clock_type::time_point m_now;
+};
+
+enum Result {
+    RESULT_OK = 0,
+    RESULT_ERROR,
+    RESULT_SKIP,
+    RESULT_MAX
+};
+
+struct Fired {
+    unsigned int timer;
+    TimerWheel::clock_type::time_point when;
+};
+
+/* Timers either side of each level boundary and beyond the wheel's horizon fire on their tick, in order */
+static Result test_level_boundaries()
+{
+    static const std::int64_t c_offsets[] = {
+        1, 2, 63, 64, 65, 127, 128, 4095, 4096, 4097, 4159, 262143, 262144, 262145, 266240, 16777215, 16777216,
+        16777217, 20000000, 33554431, 33554433, 100000000
+    };
+
+    TestTimerWheel wheel;
+    std::vector<Fired> fired;
+    std::map<unsigned int, std::int64_t> due;
+    // Schedule in reverse so that the wheel can't rely on scheduling order
+    for (unsigned int i = sizeof(c_offsets)/sizeof(c_offsets[0]); i > 0; i--) {
+        unsigned int timer = i - 1;
+        due[timer] = c_offsets[timer];
+        wheel.schedule(wheel.at(std::chrono::milliseconds(c_offsets[timer])), [&wheel, &fired, timer]() {
+            fired.push_back(Fired{timer, wheel.now()});
+        });
+    }
+
+    for (auto &[timer, offset] : due) {
+        wheel.moveTo(std::chrono::milliseconds(offset - 1));
+        if (fired.size() != timer) {
+            std::cout << "timer due at " << offset << "ms fired early... ";
+            return RESULT_ERROR;
+        }
+        wheel.moveTo(std::chrono::milliseconds(offset));
+        if (fired.size() != timer + 1 || fired.back().timer != timer) {
+            std::cout << "timer due at " << offset << "ms did not fire on time... ";
+            return RESULT_ERROR;
+        }
+    }
+
+    // A time part way through a tick fires on the next tick
+    wheel.schedule(wheel.at(100000010ms) + 500us, [&wheel, &fired]() { fired.push_back(Fired{0, wheel.now()}); });
+    std::size_t num_fired = fired.size();
+    wheel.moveTo(100000010ms);
+    if (fired.size() != num_fired) {
+        std::cout << "timer due part way through a tick fired early... ";
+        return RESULT_ERROR;
+    }
+    wheel.moveTo(100000011ms);
+    if (fired.size() != num_fired + 1) {
+        std::cout << "timer due part way through a tick did not fire... ";
+        return RESULT_ERROR;
+    }
+
+    if (wheel.size() != 0) {
+        std::cout << wheel.size() << " timers left over... ";
+        return RESULT_ERROR;
+    }
+    return RESULT_OK;
+}
+
+/* Rescheduled timers move between levels, cancelled timers never fire */
+static Result test_reschedule_cancel()
+{
+    TestTimerWheel wheel;
+    std::vector<Fired> fired;
+    auto record = [&wheel, &fired](unsigned int timer) {
+        return [&wheel, &fired, timer]() { fired.push_back(Fired{timer, wheel.now()}); };
+    };
+
+    // 0: far beyond the horizon, brought in to level 0
+    TimerWheel::TimerId t0 = wheel.schedule(wheel.at(30h), record(0));
+    // 1: level 0, pushed out beyond the horizon
+    TimerWheel::TimerId t1 = wheel.schedule(wheel.at(10ms), record(1));
+    // 2: level 3, cancelled after it has cascaded down to level 0
+    TimerWheel::TimerId t2 = wheel.schedule(wheel.at(300s), record(2));
+    // 3: level 2, cancelled straight away
+    TimerWheel::TimerId t3 = wheel.schedule(wheel.at(5s), record(3));
+    // 4: level 3, rescheduled to a level 2 time after the wheel has moved on
+    TimerWheel::TimerId t4 = wheel.schedule(wheel.at(2h), record(4));
+
+    if (!wheel.reschedule(t0, wheel.at(50ms)) || !wheel.reschedule(t1, wheel.at(6h)) || !wheel.cancel(t3)) {
+        std::cout << "reschedule or cancel failed... ";
+        return RESULT_ERROR;
+    }
+
+    wheel.moveTo(49ms);
+    if (!fired.empty()) {
+        std::cout << "timer fired early... ";
+        return RESULT_ERROR;
+    }
+    wheel.moveTo(50ms);
+    if (fired.size() != 1 || fired[0].timer != 0) {
+        std::cout << "rescheduled timer 0 did not fire... ";
+        return RESULT_ERROR;
+    }
+    if (wheel.reschedule(t0, wheel.at(60ms)) || wheel.cancel(t0)) {
+        std::cout << "fired timer could still be changed... ";
+        return RESULT_ERROR;
+    }
+
+    wheel.moveTo(299999ms);
+    if (!wheel.cancel(t2)) {
+        std::cout << "cancel of pending timer 2 failed... ";
+        return RESULT_ERROR;
+    }
+    if (!wheel.reschedule(t4, wheel.at(310s))) {
+        std::cout << "reschedule of timer 4 failed... ";
+        return RESULT_ERROR;
+    }
+    wheel.moveTo(309999ms);
+    if (fired.size() != 1) {
+        std::cout << "timer fired early or after being cancelled... ";
+        return RESULT_ERROR;
+    }
+    wheel.moveTo(310s);
+    if (fired.size() != 2 || fired[1].timer != 4) {
+        std::cout << "rescheduled timer 4 did not fire... ";
+        return RESULT_ERROR;
+    }
+
+    wheel.moveTo(6h - 1ms);
+    if (fired.size() != 2) {
+        std::cout << "timer 1 fired early... ";
+        return RESULT_ERROR;
+    }
+    wheel.moveTo(6h);
+    if (fired.size() != 3 || fired[2].timer != 1) {
+        std::cout << "timer 1 did not fire after being pushed beyond the horizon... ";
+        return RESULT_ERROR;
+    }
+    if (wheel.size() != 0) {
+        std::cout << wheel.size() << " timers left over... ";
+        return RESULT_ERROR;
+    }
+    return RESULT_OK;
+}
+
+/* Random schedules, reschedules and cancels with time moving on in uneven steps */
+static Result test_random()
+{
+    static constexpr unsigned int c_numTimers = 5000;
+    static constexpr std::int64_t c_maxOffsetMs = 40 * 3600 * 1000; // beyond the ~4.6 hour horizon
+
+    std::mt19937_64 rng(20250117);
+    std::uniform_int_distribution<std::int64_t> offset_dist(1, c_maxOffsetMs);
+    std::uniform_int_distribution<int> action_dist(0, 9);
+
+    TestTimerWheel wheel;
+    std::vector<std::int64_t> due(c_numTimers);
+    std::vector<TimerWheel::TimerId> ids(c_numTimers);
+    std::vector<bool> cancelled(c_numTimers, false);
+    std::vector<std::int64_t> fired_at(c_numTimers, -1);
+    std::vector<unsigned int> firing_order;
+    std::int64_t now = 0;
+
+    for (unsigned int timer = 0; timer < c_numTimers; timer++) {
+        due[timer] = offset_dist(rng);
+        ids[timer] = wheel.schedule(wheel.at(std::chrono::milliseconds(due[timer])),
+                                    [&fired_at, &firing_order, &now, timer]() {
+            if (fired_at[timer] < 0) fired_at[timer] = now;
+            else fired_at[timer] = -2; // fired twice
+            firing_order.push_back(timer);
+        });
+    }
+
+    while (now < c_maxOffsetMs * 2) {
+        // Steps from 1ms to about 1.5 hours
+        std::int64_t step = std::int64_t(1) << std::uniform_int_distribution<int>(0, 22)(rng);
+        now += std::uniform_int_distribution<std::int64_t>(1, step)(rng);
+
+        // Change some of the pending timers
+        for (unsigned int n = 0; n < 20; n++) {
+            unsigned int timer = std::uniform_int_distribution<unsigned int>(0, c_numTimers - 1)(rng);
+            if (cancelled[timer] || fired_at[timer] != -1) continue;
+            int action = action_dist(rng);
+            if (action == 0) {
+                if (!wheel.cancel(ids[timer])) return RESULT_ERROR;
+                cancelled[timer] = true;
+            } else if (action < 5) {
+                // Sometimes reschedule into the past, which should fire on the next tick
+                due[timer] = now + offset_dist(rng) - c_maxOffsetMs / 4;
+                if (due[timer] <= now) due[timer] = now + 1;
+                if (!wheel.reschedule(ids[timer], wheel.at(std::chrono::milliseconds(due[timer])))) return RESULT_ERROR;
+            }
+        }
+
+        firing_order.clear();
+        wheel.moveTo(std::chrono::milliseconds(now));
+
+        // Those that fired did so in order of due time
+        for (std::size_t i = 1; i < firing_order.size(); i++) {
+            if (due[firing_order[i]] < due[firing_order[i - 1]]) {
+                std::cout << "timer due at " << due[firing_order[i]] << "ms fired after one due at "
+                          << due[firing_order[i - 1]] << "ms... ";
+                return RESULT_ERROR;
+            }
+        }
+
+        // Everything due by now has fired, nothing early, nothing cancelled
+        for (unsigned int timer = 0; timer < c_numTimers; timer++) {
+            if (cancelled[timer]) {
+                if (fired_at[timer] != -1) {
+                    std::cout << "cancelled timer fired... ";
+                    return RESULT_ERROR;
+                }
+                continue;
+            }
+            if (fired_at[timer] == -2) {
+                std::cout << "timer fired twice... ";
+                return RESULT_ERROR;
+            }
+            if (due[timer] <= now && fired_at[timer] == -1) {
+                std::cout << "timer due at " << due[timer] << "ms not fired at " << now << "ms... ";
+                return RESULT_ERROR;
+            }
+            if (fired_at[timer] != -1 && fired_at[timer] < due[timer]) {
+                std::cout << "timer due at " << due[timer] << "ms fired early at " << fired_at[timer] << "ms... ";
+                return RESULT_ERROR;
+            }
+        }
+    }
+
+    if (wheel.size() != 0) {
+        std::cout << wheel.size() << " timers left over... ";
+        return RESULT_ERROR;
+    }
+    return RESULT_OK;
+}
+
+int main(int argc, char *argv[])
+{
+    static const struct TestCase {
+        const char *name;
+        Result (*fn)();
+    } tests[] = {
+        {"Timers either side of level boundaries", test_level_boundaries},
+        {"Rescheduling and cancelling across levels", test_reschedule_cancel},
+        {"Random scheduling, rescheduling and cancelling", test_random}
+    };
+
+    size_t results[RESULT_MAX] = {};
+    for (auto tc : tests) {
+        std::cout << tc.name << "... ";
+        Result result = tc.fn();
+        results[result]++;
+        switch (result) {
+        case RESULT_OK:
+            std::cout << "ok" << std::endl;
+            break;
+        case RESULT_ERROR:
+            std::cout << "ERROR!" << std::endl;
+            break;
+        case RESULT_SKIP:
+            std::cout << "skipped" << std::endl;
+            break;
+        default:
+            std::cout << "runtime error, aborting!" << std::endl;
+            return 1;
+        }
+    }
+
+    if (results[RESULT_OK] == 0 && results[RESULT_ERROR] == 0) return 77; /* tests skipped */
+
+    if (results[RESULT_ERROR] != 0) return 1;
+
+    return 0;
+}
+
+/* vim:ts=8:sts=4:sw=4:expandtab:
+ */